@@ -0,0 +1,344 @@
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "memory.h"
+#include "perfcount.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+/*
+ * Benchmark runner: times every selected benchmark 'repeat' times for a
+ * fixed instruction count on one warmed-up machine, and writes the runs
+ * and their medians as JSON. Repeats go round-robin over the
+ * benchmarks, so a slow patch on the host spreads over all of them
+ * rather than landing on one benchmark's runs.
+ */
+
+#define DEFAULT_INSNS  2000000
+#define DEFAULT_REPEAT 5
+#define CHECK_BUDGET   100000000    // cycles for one checked kernel pass
+#define PERF_PERIOD    997          // emulated cycles between per-class samples (--perf)
+
+#ifdef CPU_THREADED_DISPATCH
+#define ENGINE "threaded"
+#else
+#define ENGINE "switch"
+#endif
+
+#ifdef CPU_JIT
+#define JIT_ENABLED true
+#else
+#define JIT_ENABLED false
+#endif
+
+typedef struct {
+    uint64_t ns;
+    uint64_t cycles;
+} BenchRun;
+
+typedef struct {
+    const Benchmark* bench;
+    CPU*             cpu;
+    BenchRun*        runs;
+    uint64_t         pass_cycles;   // one checked kernel pass, 0 if not checked
+    double           mhz;           // medians over the runs
+    double           mips;
+    double           ns_per_insn;
+    double           cycles_per_second;
+    PerfCounts       perf;              // --perf: host counters over one run
+    PerfCounts       classes[INS_TYPES];
+} BenchResult;
+
+static void usage(void) {
+    printf("usage: bench [--filter TEXT] [--repeat N] [--insns N] [--out FILE] [--list] [--perf]\n"
+           "\n"
+           "Runs each benchmark whose name or group contains TEXT, N times\n"
+           "(default %d) for N instructions (default %d) each, and writes\n"
+           "JSON to FILE (default standard output). With --out a table of\n"
+           "medians goes to standard output.\n"
+           "\n"
+           "--perf adds one more run per benchmark under the host's\n"
+           "performance counters (Linux perf_event_open), sampled by opcode\n"
+           "class, to the JSON and, with --out, its report to the output.\n",
+           DEFAULT_REPEAT, DEFAULT_INSNS);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Idle loops run pass by pass: jmp_abs is a JMP to itself */
+static CPU* machine_create(void) {
+    Memory* mem = memory_create();
+    Bus* bus = bus_create();
+    bus_map_memory(bus, mem);
+    CPU* cpu = cpu_create(bus);
+    cpu_set_idle_skip(cpu, false);
+    return cpu;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double* values, int n) {
+    qsort(values, n, sizeof(double), compare_doubles);
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/* Run the kernel once to its JAM and check what it left; false on a wrong result */
+static bool bench_check(const Benchmark* bench, uint64_t* pass_cycles) {
+    CPU* cpu = machine_create();
+    bench->setup(bench, cpu, true);
+    *pass_cycles = cpu_run(cpu, CHECK_BUDGET);
+    bool ok = cpu_is_halted(cpu) && bench->check(bench, cpu_get_bus(cpu));
+    cpu_destroy(cpu);
+    return ok;
+}
+
+/* A machine with the program loaded, past its warm-up */
+static CPU* bench_prepare(const Benchmark* bench, uint64_t insns) {
+    CPU* cpu = machine_create();
+    bench->setup(bench, cpu, false);
+
+    /* Fill the block cache (and JIT) before timing anything */
+    cpu_run_instructions(cpu, insns / 10 + 1);
+    return cpu;
+}
+
+static void bench_time(BenchResult* res, int run, uint64_t insns) {
+    uint64_t start = now_ns();
+    res->runs[run].cycles = cpu_run_instructions(res->cpu, insns);
+    res->runs[run].ns = now_ns() - start;
+    if (!res->runs[run].ns) res->runs[run].ns = 1;
+}
+
+/* One more run of the timed length under the host counters */
+static void bench_perf(BenchResult* res, PerfCounters* pc) {
+    perf_clear_samples(pc);
+    perf_set_sampling(pc, PERF_PERIOD);
+    perf_run(pc, res->cpu, res->runs[0].cycles, &res->perf);
+    for (int t = 0; t < INS_TYPES; t++)
+        perf_class_counts(pc, (ins_type_t)t, &res->classes[t]);
+}
+
+static void bench_summarize(BenchResult* res, uint64_t insns, int repeat) {
+    double mhz[repeat], mips[repeat], ns_per_insn[repeat], cps[repeat];
+    for (int i = 0; i < repeat; i++) {
+        double ns = (double)res->runs[i].ns;
+        double cycles = (double)res->runs[i].cycles;
+        mhz[i] = cycles * 1e3 / ns;
+        mips[i] = (double)insns * 1e3 / ns;
+        ns_per_insn[i] = ns / (double)insns;
+        cps[i] = cycles * 1e9 / ns;
+    }
+    res->mhz = median(mhz, repeat);
+    res->mips = median(mips, repeat);
+    res->ns_per_insn = median(ns_per_insn, repeat);
+    res->cycles_per_second = median(cps, repeat);
+}
+
+/* ============================== Output ================================== */
+
+static void json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void write_perf_events(FILE* out, const PerfCounters* pc, const PerfCounts* counts) {
+    bool first = true;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (!perf_has(pc, (PerfEvent)e)) continue;
+        fprintf(out, "%s\"%s\": %" PRIu64, first ? "" : ", ",
+                perf_event_name((PerfEvent)e), counts->events[e]);
+        first = false;
+    }
+}
+
+static void write_perf(FILE* out, const PerfCounters* pc, const BenchResult* r) {
+    fprintf(out, ",\n      \"perf\": {\"instructions\": %" PRIu64 ", \"cycles\": %" PRIu64
+            ", \"events\": {", r->perf.steps, r->perf.cycles);
+    write_perf_events(out, pc, &r->perf);
+    fprintf(out, "},\n        \"classes\": {");
+    bool first = true;
+    for (int t = 0; t < INS_TYPES; t++) {
+        const PerfCounts* c = &r->classes[t];
+        if (!c->steps) continue;
+        fprintf(out, "%s\n          \"%s\": {\"samples\": %" PRIu64 ", \"cycles\": %" PRIu64 ", ",
+                first ? "" : ",", opcode_type_name((ins_type_t)t), c->steps, c->cycles);
+        write_perf_events(out, pc, c);
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "}}");
+}
+
+static void write_json(FILE* out, const BenchResult* results, size_t count,
+                       uint64_t insns, int repeat, const PerfCounters* pc) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"format\": \"6502-bench\",\n");
+    fprintf(out, "  \"version\": 1,\n");
+    fprintf(out, "  \"engine\": \"%s\",\n", ENGINE);
+    fprintf(out, "  \"jit\": %s,\n", JIT_ENABLED ? "true" : "false");
+    fprintf(out, "  \"instructions\": %" PRIu64 ",\n", insns);
+    fprintf(out, "  \"repeat\": %d,\n", repeat);
+    fprintf(out, "  \"benchmarks\": [");
+    for (size_t i = 0; i < count; i++) {
+        const BenchResult* r = &results[i];
+        fprintf(out, "%s\n    {\n", i ? "," : "");
+        fprintf(out, "      \"name\": ");
+        json_string(out, r->bench->name);
+        fprintf(out, ",\n      \"group\": ");
+        json_string(out, r->bench->group);
+        fprintf(out, ",\n      \"what\": ");
+        json_string(out, r->bench->what);
+        if (r->bench->mode) {
+            fprintf(out, ",\n      \"mode\": ");
+            json_string(out, r->bench->mode);
+        }
+        if (r->pass_cycles)
+            fprintf(out, ",\n      \"pass_cycles\": %" PRIu64, r->pass_cycles);
+        fprintf(out, ",\n      \"mhz\": %.4f", r->mhz);
+        fprintf(out, ",\n      \"mips\": %.4f", r->mips);
+        fprintf(out, ",\n      \"ns_per_insn\": %.4f", r->ns_per_insn);
+        fprintf(out, ",\n      \"cycles_per_second\": %.0f", r->cycles_per_second);
+        if (pc) write_perf(out, pc, r);
+        fprintf(out, ",\n      \"runs\": [");
+        for (int j = 0; j < repeat; j++)
+            fprintf(out, "%s{\"ns\": %" PRIu64 ", \"cycles\": %" PRIu64 "}",
+                    j ? ", " : "", r->runs[j].ns, r->runs[j].cycles);
+        fprintf(out, "]\n    }");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+static void write_table(FILE* out, const BenchResult* results, size_t count) {
+    fprintf(out, "%-16s %-6s %-12s %10s %10s %12s\n",
+            "benchmark", "group", "class", "MHz", "MIPS", "ns/insn");
+    for (size_t i = 0; i < count; i++) {
+        const BenchResult* r = &results[i];
+        const char* what = r->bench->mode ? r->bench->what : "kernel";
+        fprintf(out, "%-16s %-6s %-12s %10.2f %10.2f %12.3f\n",
+                r->bench->name, r->bench->group, what, r->mhz, r->mips, r->ns_per_insn);
+    }
+}
+
+/* ============================== Main ==================================== */
+
+static bool selected(const Benchmark* bench, const char* filter) {
+    return !filter || strstr(bench->name, filter) || strstr(bench->group, filter);
+}
+
+int main(int argc, char** argv) {
+    const char* filter = NULL;
+    const char* out_path = NULL;
+    uint64_t insns = DEFAULT_INSNS;
+    int repeat = DEFAULT_REPEAT;
+    bool list = false;
+    bool perf = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--insns") && i + 1 < argc) {
+            insns = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (!strcmp(argv[i], "--list")) {
+            list = true;
+        } else if (!strcmp(argv[i], "--perf")) {
+            perf = true;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (repeat < 1 || !insns) {
+        usage();
+        return 1;
+    }
+
+    const Benchmark* all[micro_benchmark_count + macro_benchmark_count];
+    size_t count = 0;
+    for (size_t i = 0; i < micro_benchmark_count; i++)
+        if (selected(&micro_benchmarks[i], filter)) all[count++] = &micro_benchmarks[i];
+    for (size_t i = 0; i < macro_benchmark_count; i++)
+        if (selected(&macro_benchmarks[i], filter)) all[count++] = &macro_benchmarks[i];
+
+    if (list) {
+        for (size_t i = 0; i < count; i++)
+            printf("%-16s %-6s %s%s%s\n", all[i]->name, all[i]->group, all[i]->what,
+                   all[i]->mode ? ", " : "", all[i]->mode ? all[i]->mode : "");
+        return 0;
+    }
+    if (!count) {
+        printf("No benchmark matches '%s'\n", filter);
+        return 1;
+    }
+
+    BenchResult* results = calloc(count, sizeof(BenchResult));
+    BenchRun* runs = calloc(count * (size_t)repeat, sizeof(BenchRun));
+    if (!results || !runs) {
+        printf("Failed to allocate results\n");
+        exit(1);
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < count; i++) {
+        BenchResult* r = &results[i];
+        r->bench = all[i];
+        r->runs = runs + i * (size_t)repeat;
+        if (all[i]->check && !bench_check(all[i], &r->pass_cycles)) {
+            fprintf(stderr, "%s: wrong result\n", all[i]->name);
+            failures++;
+        }
+        r->cpu = bench_prepare(all[i], insns);
+    }
+    for (int run = 0; run < repeat; run++)
+        for (size_t i = 0; i < count; i++) bench_time(&results[i], run, insns);
+
+    PerfCounters* pc = perf ? perf_open() : NULL;
+    if (perf && !pc) fprintf(stderr, "perf_event_open unavailable: --perf ignored\n");
+    for (size_t i = 0; pc && i < count; i++) {
+        bench_perf(&results[i], pc);
+        if (out_path) {
+            printf("== %s\n", results[i].bench->name);
+            perf_report(pc, &results[i].perf, stdout);
+            printf("\n");
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        bench_summarize(&results[i], insns, repeat);
+        cpu_destroy(results[i].cpu);
+    }
+
+    if (out_path) {
+        FILE* out = fopen(out_path, "w");
+        if (!out) {
+            printf("Cannot open %s\n", out_path);
+            exit(1);
+        }
+        write_json(out, results, count, insns, repeat, pc);
+        fclose(out);
+        write_table(stdout, results, count);
+    } else {
+        write_json(stdout, results, count, insns, repeat, pc);
+    }
+
+    perf_close(pc);
+    free(runs);
+    free(results);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+/**
+ * Benchmark suite shared definitions.
+ *
+ * A benchmark loads a program that loops forever into a fresh machine;
+ * the runner times fixed instruction counts of it. Micro benchmarks
+ * repeat one instruction (or a pair that undo each other) per
+ * addressing mode and instruction class. Macro benchmarks call a
+ * realistic kernel from a driver loop at $0200, and can first run it
+ * once to a JAM and check its results.
+ */
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu.h"
+#include "bus.h"
+
+typedef struct Benchmark Benchmark;
+
+struct Benchmark {
+    const char* name;
+    const char* group;          // "micro" or "macro"
+    const char* what;           // instruction class or kernel
+    const char* mode;           // addressing mode; NULL for kernels
+
+    /*
+     * Load program and data and set registers. With 'once' the kernel
+     * runs a single time and stops at a JAM instead of looping.
+     */
+    void (*setup)(const Benchmark* bench, CPU* cpu, bool once);
+
+    /* Results of one pass are right; NULL if there is nothing to check */
+    bool (*check)(const Benchmark* bench, Bus* bus);
+
+    const void* spec;           // group-specific program description
+};
+
+extern const Benchmark micro_benchmarks[];
+extern const size_t    micro_benchmark_count;
+extern const Benchmark macro_benchmarks[];
+extern const size_t    macro_benchmark_count;
+
+#endif
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+/*
+ * Benchmark comparator: reads two result files written by bench (a
+ * baseline and a new run) and compares each benchmark's throughput over
+ * its repeated runs. A bootstrap over the runs gives a confidence
+ * interval for the change of the median; a benchmark regresses when its
+ * median drops by more than the threshold and the whole interval is
+ * below zero, so one noisy run cannot fail a comparison by itself.
+ *
+ * Exit status: 0 no regression, 1 regressions, 2 bad usage or input.
+ */
+
+#define DEFAULT_THRESHOLD  3.0      // percent
+#define DEFAULT_CONFIDENCE 95.0     // percent
+#define BOOTSTRAP_ROUNDS   2000
+
+/* ============================== JSON ==================================== */
+
+/* Just enough JSON for bench's output */
+typedef enum { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT } JsonType;
+
+typedef struct JsonValue JsonValue;
+struct JsonValue {
+    JsonType    type;
+    double      number;     // JSON_NUMBER, JSON_BOOL
+    char*       string;     // JSON_STRING
+    char*       key;        // member name, for object members
+    JsonValue*  items;      // JSON_ARRAY, JSON_OBJECT
+    size_t      count;
+};
+
+typedef struct {
+    const char* p;
+    const char* end;
+    bool        failed;
+} JsonParser;
+
+static void* xrealloc(void* ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        printf("Failed to allocate JSON\n");
+        exit(2);
+    }
+    return ptr;
+}
+
+static void json_skip(JsonParser* j) {
+    while (j->p < j->end && isspace((unsigned char)*j->p)) j->p++;
+}
+
+static bool json_eat(JsonParser* j, char c) {
+    json_skip(j);
+    if (j->p < j->end && *j->p == c) {
+        j->p++;
+        return true;
+    }
+    return false;
+}
+
+static char* json_parse_string(JsonParser* j) {
+    if (!json_eat(j, '"')) {
+        j->failed = true;
+        return NULL;
+    }
+    size_t len = 0, cap = 16;
+    char* s = xrealloc(NULL, cap);
+    while (j->p < j->end && *j->p != '"') {
+        char c = *j->p++;
+        if (c == '\\' && j->p < j->end) {
+            c = *j->p++;
+            if (c == 'n') c = '\n';
+            else if (c == 't') c = '\t';
+            else if (c == 'u') {                    // not produced by bench
+                j->p += j->end - j->p < 4 ? j->end - j->p : 4;
+                c = '?';
+            }
+        }
+        if (len + 1 == cap) s = xrealloc(s, cap *= 2);
+        s[len++] = c;
+    }
+    if (!json_eat(j, '"')) j->failed = true;
+    s[len] = '\0';
+    return s;
+}
+
+static void json_parse_value(JsonParser* j, JsonValue* v);
+
+static void json_parse_list(JsonParser* j, JsonValue* v, char close, bool members) {
+    size_t cap = 0;
+    if (json_eat(j, close)) return;
+    do {
+        if (v->count == cap) {
+            cap = cap ? cap * 2 : 8;
+            v->items = xrealloc(v->items, cap * sizeof(JsonValue));
+        }
+        JsonValue* item = &v->items[v->count++];
+        memset(item, 0, sizeof(*item));
+        if (members) {
+            item->key = json_parse_string(j);
+            if (j->failed || !json_eat(j, ':')) {
+                j->failed = true;
+                return;
+            }
+        }
+        json_parse_value(j, item);
+    } while (!j->failed && json_eat(j, ','));
+    if (!json_eat(j, close)) j->failed = true;
+}
+
+static void json_parse_value(JsonParser* j, JsonValue* v) {
+    json_skip(j);
+    if (j->p >= j->end) {
+        j->failed = true;
+        return;
+    }
+    char c = *j->p;
+    if (c == '{') {
+        j->p++;
+        v->type = JSON_OBJECT;
+        json_parse_list(j, v, '}', true);
+    } else if (c == '[') {
+        j->p++;
+        v->type = JSON_ARRAY;
+        json_parse_list(j, v, ']', false);
+    } else if (c == '"') {
+        v->type = JSON_STRING;
+        v->string = json_parse_string(j);
+    } else if (!strncmp(j->p, "true", 4) || !strncmp(j->p, "false", 5)) {
+        v->type = JSON_BOOL;
+        v->number = c == 't';
+        j->p += c == 't' ? 4 : 5;
+    } else if (!strncmp(j->p, "null", 4)) {
+        v->type = JSON_NULL;
+        j->p += 4;
+    } else {
+        char* end;
+        v->type = JSON_NUMBER;
+        v->number = strtod(j->p, &end);
+        if (end == j->p) j->failed = true;
+        j->p = end;
+    }
+}
+
+static void json_free(JsonValue* v) {
+    for (size_t i = 0; i < v->count; i++) json_free(&v->items[i]);
+    free(v->items);
+    free(v->string);
+    free(v->key);
+}
+
+static const JsonValue* json_get(const JsonValue* obj, const char* key) {
+    if (!obj || obj->type != JSON_OBJECT) return NULL;
+    for (size_t i = 0; i < obj->count; i++)
+        if (!strcmp(obj->items[i].key, key)) return &obj->items[i];
+    return NULL;
+}
+
+static double json_number(const JsonValue* obj, const char* key, double fallback) {
+    const JsonValue* v = json_get(obj, key);
+    return v && (v->type == JSON_NUMBER || v->type == JSON_BOOL) ? v->number : fallback;
+}
+
+static const char* json_string(const JsonValue* obj, const char* key) {
+    const JsonValue* v = json_get(obj, key);
+    return v && v->type == JSON_STRING ? v->string : "";
+}
+
+/* ============================== Results ================================= */
+
+typedef struct {
+    const char* name;
+    double*     values;     // throughput of each run, higher is better
+    int         count;
+} Series;
+
+typedef struct {
+    JsonValue root;
+    Series*   series;
+    size_t    count;
+} ResultFile;
+
+/* Read a bench result file; the metric is "mhz" or "mips" */
+static bool result_load(ResultFile* rf, const char* path, const char* metric) {
+    memset(rf, 0, sizeof(*rf));
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        printf("Cannot open %s\n", path);
+        return false;
+    }
+    size_t len = 0, cap = 1 << 16, n;
+    char* text = xrealloc(NULL, cap);
+    while ((n = fread(text + len, 1, cap - len, f)) > 0) {
+        len += n;
+        if (len == cap) text = xrealloc(text, cap *= 2);
+    }
+    fclose(f);
+
+    JsonParser j = { text, text + len, false };
+    json_parse_value(&j, &rf->root);
+    free(text);
+    const JsonValue* benches = json_get(&rf->root, "benchmarks");
+    if (j.failed || strcmp(json_string(&rf->root, "format"), "6502-bench")
+        || !benches || benches->type != JSON_ARRAY) {
+        printf("%s: not a bench result file\n", path);
+        return false;
+    }
+
+    double insns = json_number(&rf->root, "instructions", 0);
+    bool mips = !strcmp(metric, "mips");
+    rf->series = xrealloc(NULL, (benches->count + 1) * sizeof(Series));
+    for (size_t i = 0; i < benches->count; i++) {
+        const JsonValue* b = &benches->items[i];
+        const JsonValue* runs = json_get(b, "runs");
+        Series* s = &rf->series[rf->count];
+        s->name = json_string(b, "name");
+        s->count = 0;
+        s->values = xrealloc(NULL, ((runs ? runs->count : 0) + 1) * sizeof(double));
+        for (size_t r = 0; runs && r < runs->count; r++) {
+            double ns = json_number(&runs->items[r], "ns", 0);
+            double work = mips ? insns : json_number(&runs->items[r], "cycles", 0);
+            if (ns > 0 && work > 0) s->values[s->count++] = work * 1e3 / ns;
+        }
+        if (*s->name && s->count) rf->count++;
+        else free(s->values);
+    }
+    return true;
+}
+
+static void result_free(ResultFile* rf) {
+    for (size_t i = 0; i < rf->count; i++) free(rf->series[i].values);
+    free(rf->series);
+    json_free(&rf->root);
+}
+
+static const Series* result_find(const ResultFile* rf, const char* name) {
+    for (size_t i = 0; i < rf->count; i++)
+        if (!strcmp(rf->series[i].name, name)) return &rf->series[i];
+    return NULL;
+}
+
+/* ============================== Statistics ============================== */
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Median of n values; sorts them */
+static double median(double* values, int n) {
+    qsort(values, n, sizeof(double), compare_doubles);
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/* Median absolute deviation from the median */
+static double mad(const double* values, int n, double med) {
+    double dev[n];
+    for (int i = 0; i < n; i++) dev[i] = values[i] > med ? values[i] - med : med - values[i];
+    return median(dev, n);
+}
+
+static uint64_t rng_next(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Median of a resample with replacement */
+static double resample_median(const Series* s, double* scratch, uint64_t* rng) {
+    for (int i = 0; i < s->count; i++) scratch[i] = s->values[rng_next(rng) % s->count];
+    return median(scratch, s->count);
+}
+
+/*
+ * Percentile bootstrap interval for the change of the median, in
+ * percent. Seeded the same every time, so a comparison is repeatable.
+ */
+static void bootstrap_interval(const Series* base, const Series* cur, double confidence,
+                               double* low, double* high) {
+    double* deltas = xrealloc(NULL, BOOTSTRAP_ROUNDS * sizeof(double));
+    double* scratch = xrealloc(NULL, (base->count > cur->count ? base->count : cur->count)
+                                     * sizeof(double));
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    for (int i = 0; i < BOOTSTRAP_ROUNDS; i++) {
+        double b = resample_median(base, scratch, &rng);
+        double c = resample_median(cur, scratch, &rng);
+        deltas[i] = (c / b - 1.0) * 100.0;
+    }
+    qsort(deltas, BOOTSTRAP_ROUNDS, sizeof(double), compare_doubles);
+    int tail = (int)((100.0 - confidence) / 200.0 * BOOTSTRAP_ROUNDS);
+    *low = deltas[tail];
+    *high = deltas[BOOTSTRAP_ROUNDS - 1 - tail];
+    free(scratch);
+    free(deltas);
+}
+
+/* ============================== Main ==================================== */
+
+static void usage(void) {
+    printf("usage: compare [--threshold PCT] [--confidence PCT] [--metric mhz|mips]\n"
+           "               BASELINE.json CURRENT.json\n"
+           "\n"
+           "Compares the per-run throughput of every benchmark in both files.\n"
+           "A benchmark regresses when its median is more than PCT (default %.0f)\n"
+           "lower and the whole confidence interval (default %.0f%%) is below\n"
+           "zero. Exits 1 if any benchmark regressed, 2 on bad input.\n",
+           DEFAULT_THRESHOLD, DEFAULT_CONFIDENCE);
+}
+
+int main(int argc, char** argv) {
+    double threshold = DEFAULT_THRESHOLD;
+    double confidence = DEFAULT_CONFIDENCE;
+    const char* metric = "mhz";
+    const char* paths[2];
+    int npaths = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--confidence") && i + 1 < argc) {
+            confidence = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--metric") && i + 1 < argc) {
+            metric = argv[++i];
+        } else if (argv[i][0] != '-' && npaths < 2) {
+            paths[npaths++] = argv[i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (npaths != 2 || threshold < 0 || confidence <= 0 || confidence >= 100
+        || (strcmp(metric, "mhz") && strcmp(metric, "mips"))) {
+        usage();
+        return 2;
+    }
+
+    ResultFile base, cur;
+    if (!result_load(&base, paths[0], metric) || !result_load(&cur, paths[1], metric))
+        return 2;
+
+    const char* keys[] = { "engine", "jit" };
+    for (int i = 0; i < 2; i++) {
+        const JsonValue* a = json_get(&base.root, keys[i]);
+        const JsonValue* b = json_get(&cur.root, keys[i]);
+        bool same = a && b && a->type == b->type
+                 && (a->type == JSON_STRING ? !strcmp(a->string, b->string) : a->number == b->number);
+        if (!same) printf("warning: the files differ in \"%s\"\n", keys[i]);
+    }
+
+    printf("%-16s %12s %7s %12s %7s %8s   %-20s\n", "benchmark",
+           !strcmp(metric, "mips") ? "base MIPS" : "base MHz", "MAD",
+           !strcmp(metric, "mips") ? "new MIPS" : "new MHz", "MAD", "change",
+           "confidence interval");
+
+    int regressions = 0, improvements = 0, compared = 0;
+    for (size_t i = 0; i < cur.count; i++) {
+        const Series* c = &cur.series[i];
+        const Series* b = result_find(&base, c->name);
+        if (!b) {
+            printf("%-16s only in %s\n", c->name, paths[1]);
+            continue;
+        }
+        double bv[b->count], cv[c->count];
+        memcpy(bv, b->values, sizeof(bv));
+        memcpy(cv, c->values, sizeof(cv));
+        double bmed = median(bv, b->count), cmed = median(cv, c->count);
+        double bmad = mad(bv, b->count, bmed), cmad = mad(cv, c->count, cmed);
+        double delta = (cmed / bmed - 1.0) * 100.0;
+        double low, high;
+        bootstrap_interval(b, c, confidence, &low, &high);
+
+        const char* verdict = "";
+        if (delta < -threshold && high < 0) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if (delta > threshold && low > 0) {
+            verdict = "faster";
+            improvements++;
+        }
+        compared++;
+        printf("%-16s %12.2f %6.1f%% %12.2f %6.1f%% %+7.1f%%   [%+6.1f%%, %+6.1f%%]  %s\n",
+               c->name, bmed, bmad / bmed * 100.0, cmed, cmad / cmed * 100.0,
+               delta, low, high, verdict);
+    }
+    for (size_t i = 0; i < base.count; i++)
+        if (!result_find(&cur, base.series[i].name))
+            printf("%-16s only in %s\n", base.series[i].name, paths[0]);
+
+    printf("\n%d compared, %d regressed, %d faster (threshold %.1f%%, %.0f%% confidence)\n",
+           compared, regressions, improvements, threshold, confidence);
+
+    result_free(&base);
+    result_free(&cur);
+    return regressions ? 1 : 0;
+}
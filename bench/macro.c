@@ -0,0 +1,533 @@
+#include "bench.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Macro benchmarks: kernels of the kind 6502 programs spend their time
+ * in, each a subroutine at $0300 called by
+ *
+ *   $0200: JSR $0300
+ *          JMP $0200      (JAM when run once for the check)
+ *
+ * Input data is 4 KB of fixed pseudo-random bytes at $1000; kernels
+ * that produce a block write it at $4000.
+ */
+
+#define DRIVER_ADDR 0x0200
+#define KERNEL_ADDR 0x0300
+#define INPUT_ADDR  0x1000
+#define INPUT_SIZE  0x1000
+#define OUTPUT_ADDR 0x4000
+
+typedef struct {
+    const uint8_t* code;
+    size_t         size;
+} MacroSpec;
+
+#define MACRO(name, what, code, check) \
+    { name, "macro", what, NULL, macro_setup, check, \
+      &(const MacroSpec){ code, sizeof(code) } }
+
+/* The same bytes every run, for the kernels and their checks */
+static void input_bytes(uint8_t* buf) {
+    uint32_t x = 0x6502A11Eu;
+    for (size_t i = 0; i < INPUT_SIZE; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        buf[i] = (uint8_t)(x >> 24);
+    }
+}
+
+static void macro_setup(const Benchmark* bench, CPU* cpu, bool once) {
+    const MacroSpec* spec = bench->spec;
+    Bus* bus = cpu_get_bus(cpu);
+    const uint8_t driver[] = { 0x20, KERNEL_ADDR & 0xFF, KERNEL_ADDR >> 8,
+                               0x4C, DRIVER_ADDR & 0xFF, DRIVER_ADDR >> 8 };
+    const uint8_t jam = 0x02;
+    uint8_t input[INPUT_SIZE];
+
+    input_bytes(input);
+    bus_load(bus, INPUT_ADDR, input, sizeof(input));
+    bus_load(bus, KERNEL_ADDR, spec->code, spec->size);
+    bus_load(bus, DRIVER_ADDR, driver, sizeof(driver));
+    if (once) bus_load(bus, DRIVER_ADDR + 3, &jam, 1);
+
+    cpu_set_sp(cpu, 0xFF);
+    cpu_set_status(cpu, FLAG_I | FLAG_U);
+    cpu_set_pc(cpu, DRIVER_ADDR);
+}
+
+static bool bytes_equal(Bus* bus, uint16_t addr, const uint8_t* want, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        if (bus_read(bus, addr + (uint16_t)i) != want[i]) return false;
+    return true;
+}
+
+static uint32_t read_le(Bus* bus, uint16_t addr, int bytes) {
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | bus_read(bus, addr + i);
+    return v;
+}
+
+/* ============================== Sieve ============================== */
+
+/*
+ * Sieve of Eratosthenes over 0..8191, one flag byte per number at
+ * $2000-$3FFF. Counts the primes into $F4/$F5.
+ */
+static const uint8_t sieve_prog[] = {
+    0xA9, 0x00, /* LDA #$00 */
+    0x85, 0xFA, /* STA $FA */
+    0xA9, 0x20, /* LDA #$20 */
+    0x85, 0xFB, /* STA $FB */
+    0xA2, 0x20, /* LDX #$20 */
+    0xA9, 0x01, /* LDA #$01 */
+    0xA0, 0x00, /* LDY #$00 */
+    0x91, 0xFA, /* fill: STA ($FA),Y */
+    0xC8,       /* INY */
+    0xD0, 0xFB, /* BNE fill */
+    0xE6, 0xFB, /* INC $FB */
+    0xCA,       /* DEX */
+    0xD0, 0xF6, /* BNE fill */
+    0xA9, 0x02, /* LDA #$02 */
+    0x85, 0xF0, /* STA $F0 */
+    0xA9, 0x00, /* LDA #$00 */
+    0x85, 0xF1, /* STA $F1 */
+    0x85, 0xF4, /* STA $F4 */
+    0x85, 0xF5, /* STA $F5 */
+    0xA5, 0xF0, /* outer: LDA $F0 */
+    0x85, 0xFA, /* STA $FA */
+    0xA5, 0xF1, /* LDA $F1 */
+    0x18,       /* CLC */
+    0x69, 0x20, /* ADC #$20 */
+    0x85, 0xFB, /* STA $FB */
+    0xB1, 0xFA, /* LDA ($FA),Y */
+    0xF0, 0x1D, /* BEQ next */
+    0xE6, 0xF4, /* INC $F4 */
+    0xD0, 0x02, /* BNE mark */
+    0xE6, 0xF5, /* INC $F5 */
+    0xA5, 0xFA, /* mark: LDA $FA */
+    0x18,       /* CLC */
+    0x65, 0xF0, /* ADC $F0 */
+    0x85, 0xFA, /* STA $FA */
+    0xA5, 0xFB, /* LDA $FB */
+    0x65, 0xF1, /* ADC $F1 */
+    0x85, 0xFB, /* STA $FB */
+    0xC9, 0x40, /* CMP #$40 */
+    0xB0, 0x06, /* BCS next */
+    0xA9, 0x00, /* LDA #$00 */
+    0x91, 0xFA, /* STA ($FA),Y */
+    0xF0, 0xE9, /* BEQ mark */
+    0xE6, 0xF0, /* next: INC $F0 */
+    0xD0, 0x02, /* BNE test */
+    0xE6, 0xF1, /* INC $F1 */
+    0xA5, 0xF1, /* test: LDA $F1 */
+    0xC9, 0x20, /* CMP #$20 */
+    0x90, 0xC8, /* BCC outer */
+    0x60        /* RTS */
+};
+
+static bool sieve_check(const Benchmark* bench, Bus* bus) {
+    (void)bench;
+    static uint8_t flags[0x2000];
+    int count = 0;
+    memset(flags, 1, sizeof(flags));
+    for (int i = 2; i < 0x2000; i++) {
+        if (!flags[i]) continue;
+        count++;
+        for (int j = 2 * i; j < 0x2000; j += i) flags[j] = 0;
+    }
+    return read_le(bus, 0x00F4, 2) == (uint32_t)count
+        && bytes_equal(bus, 0x2002, flags + 2, sizeof(flags) - 2);
+}
+
+/* ============================== CRC-16 ============================== */
+
+/* CRC-16/CCITT-FALSE (poly $1021, init $FFFF) of 1 KB of input, bit by bit, into $E0/$E1 */
+static const uint8_t crc16_prog[] = {
+    0xA9, 0xFF, /* LDA #$FF */
+    0x85, 0xE0, /* STA $E0 */
+    0x85, 0xE1, /* STA $E1 */
+    0xA9, 0x00, /* LDA #$00 */
+    0x85, 0xFA, /* STA $FA */
+    0xA9, 0x10, /* LDA #$10 */
+    0x85, 0xFB, /* STA $FB */
+    0xA9, 0x04, /* LDA #$04 */
+    0x85, 0xE2, /* STA $E2 */
+    0xA0, 0x00, /* LDY #$00 */
+    0xB1, 0xFA, /* byte: LDA ($FA),Y */
+    0x45, 0xE1, /* EOR $E1 */
+    0x85, 0xE1, /* STA $E1 */
+    0xA2, 0x08, /* LDX #$08 */
+    0x06, 0xE0, /* bit: ASL $E0 */
+    0x26, 0xE1, /* ROL $E1 */
+    0x90, 0x0C, /* BCC next */
+    0xA5, 0xE1, /* LDA $E1 */
+    0x49, 0x10, /* EOR #$10 */
+    0x85, 0xE1, /* STA $E1 */
+    0xA5, 0xE0, /* LDA $E0 */
+    0x49, 0x21, /* EOR #$21 */
+    0x85, 0xE0, /* STA $E0 */
+    0xCA,       /* next: DEX */
+    0xD0, 0xEB, /* BNE bit */
+    0xC8,       /* INY */
+    0xD0, 0xE0, /* BNE byte */
+    0xE6, 0xFB, /* INC $FB */
+    0xC6, 0xE2, /* DEC $E2 */
+    0xD0, 0xDA, /* BNE byte */
+    0x60        /* RTS */
+};
+
+static bool crc16_check(const Benchmark* bench, Bus* bus) {
+    (void)bench;
+    uint8_t input[INPUT_SIZE];
+    input_bytes(input);
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < 0x400; i++) {
+        crc ^= input[i] << 8;
+        for (int b = 0; b < 8; b++)
+            crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return read_le(bus, 0x00E0, 2) == crc;
+}
+
+/* ============================== CRC-32 ============================== */
+
+/* CRC-32 (reflected poly $EDB88320, as zlib) of 1 KB of input, bit by bit, into $E0-$E3 */
+static const uint8_t crc32_prog[] = {
+    0xA9, 0xFF, /* LDA #$FF */
+    0x85, 0xE0, /* STA $E0 */
+    0x85, 0xE1, /* STA $E1 */
+    0x85, 0xE2, /* STA $E2 */
+    0x85, 0xE3, /* STA $E3 */
+    0xA9, 0x00, /* LDA #$00 */
+    0x85, 0xFA, /* STA $FA */
+    0xA9, 0x10, /* LDA #$10 */
+    0x85, 0xFB, /* STA $FB */
+    0xA9, 0x04, /* LDA #$04 */
+    0x85, 0xE4, /* STA $E4 */
+    0xA0, 0x00, /* LDY #$00 */
+    0xB1, 0xFA, /* byte: LDA ($FA),Y */
+    0x45, 0xE0, /* EOR $E0 */
+    0x85, 0xE0, /* STA $E0 */
+    0xA2, 0x08, /* LDX #$08 */
+    0x46, 0xE3, /* bit: LSR $E3 */
+    0x66, 0xE2, /* ROR $E2 */
+    0x66, 0xE1, /* ROR $E1 */
+    0x66, 0xE0, /* ROR $E0 */
+    0x90, 0x18, /* BCC next */
+    0xA5, 0xE3, /* LDA $E3 */
+    0x49, 0xED, /* EOR #$ED */
+    0x85, 0xE3, /* STA $E3 */
+    0xA5, 0xE2, /* LDA $E2 */
+    0x49, 0xB8, /* EOR #$B8 */
+    0x85, 0xE2, /* STA $E2 */
+    0xA5, 0xE1, /* LDA $E1 */
+    0x49, 0x83, /* EOR #$83 */
+    0x85, 0xE1, /* STA $E1 */
+    0xA5, 0xE0, /* LDA $E0 */
+    0x49, 0x20, /* EOR #$20 */
+    0x85, 0xE0, /* STA $E0 */
+    0xCA,       /* next: DEX */
+    0xD0, 0xDB, /* BNE bit */
+    0xC8,       /* INY */
+    0xD0, 0xD0, /* BNE byte */
+    0xE6, 0xFB, /* INC $FB */
+    0xC6, 0xE4, /* DEC $E4 */
+    0xD0, 0xCA, /* BNE byte */
+    0xA2, 0x03, /* LDX #$03 */
+    0xB5, 0xE0, /* final: LDA $E0,X */
+    0x49, 0xFF, /* EOR #$FF */
+    0x95, 0xE0, /* STA $E0,X */
+    0xCA,       /* DEX */
+    0x10, 0xF7, /* BPL final */
+    0x60        /* RTS */
+};
+
+static bool crc32_check(const Benchmark* bench, Bus* bus) {
+    (void)bench;
+    uint8_t input[INPUT_SIZE];
+    input_bytes(input);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < 0x400; i++) {
+        crc ^= input[i];
+        for (int b = 0; b < 8; b++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+    }
+    return read_le(bus, 0x00E0, 4) == ~crc;
+}
+
+/* ============================== Copy ============================== */
+
+/* Copy the 4 KB of input to $4000, a page at a time through (zp),Y */
+static const uint8_t memcpy_prog[] = {
+    0xA9, 0x00, /* LDA #$00 */
+    0x85, 0xFA, /* STA $FA */
+    0x85, 0xFC, /* STA $FC */
+    0xA9, 0x10, /* LDA #$10 */
+    0x85, 0xFB, /* STA $FB */
+    0xA9, 0x40, /* LDA #$40 */
+    0x85, 0xFD, /* STA $FD */
+    0xA2, 0x10, /* LDX #$10 */
+    0xA0, 0x00, /* LDY #$00 */
+    0xB1, 0xFA, /* copy: LDA ($FA),Y */
+    0x91, 0xFC, /* STA ($FC),Y */
+    0xC8,       /* INY */
+    0xD0, 0xF9, /* BNE copy */
+    0xE6, 0xFB, /* INC $FB */
+    0xE6, 0xFD, /* INC $FD */
+    0xCA,       /* DEX */
+    0xD0, 0xF2, /* BNE copy */
+    0x60        /* RTS */
+};
+
+static bool memcpy_check(const Benchmark* bench, Bus* bus) {
+    (void)bench;
+    uint8_t input[INPUT_SIZE];
+    input_bytes(input);
+    return bytes_equal(bus, OUTPUT_ADDR, input, INPUT_SIZE);
+}
+
+/* ============================== Sort ============================== */
+
+/*
+ * Bubble sort a copy of the first 128 input bytes at $4000, unsigned
+ * ascending. Compares with SEC/SBC: this core's CMP sets C from the
+ * sign of the difference, which is not an unsigned compare.
+ */
+static const uint8_t sort_prog[] = {
+    0xA2, 0x7F,       /* LDX #$7F */
+    0xBD, 0x00, 0x10, /* copy: LDA $1000,X */
+    0x9D, 0x00, 0x40, /* STA $4000,X */
+    0xCA,             /* DEX */
+    0x10, 0xF7,       /* BPL copy */
+    0xA9, 0x7F,       /* LDA #$7F */
+    0x85, 0xE0,       /* STA $E0 */
+    0xA2, 0x00,       /* pass: LDX #$00 */
+    0xBD, 0x00, 0x40, /* inner: LDA $4000,X */
+    0x38,             /* SEC */
+    0xFD, 0x01, 0x40, /* SBC $4001,X */
+    0x90, 0x10,       /* BCC keep */
+    0xF0, 0x0E,       /* BEQ keep */
+    0xBD, 0x00, 0x40, /* LDA $4000,X */
+    0xA8,             /* TAY */
+    0xBD, 0x01, 0x40, /* LDA $4001,X */
+    0x9D, 0x00, 0x40, /* STA $4000,X */
+    0x98,             /* TYA */
+    0x9D, 0x01, 0x40, /* STA $4001,X */
+    0xE8,             /* keep: INX */
+    0xE4, 0xE0,       /* CPX $E0 */
+    0xD0, 0xE2,       /* BNE inner */
+    0xC6, 0xE0,       /* DEC $E0 */
+    0xD0, 0xDC,       /* BNE pass */
+    0x60              /* RTS */
+};
+
+static int compare_bytes(const void* a, const void* b) {
+    return *(const uint8_t*)a - *(const uint8_t*)b;
+}
+
+static bool sort_check(const Benchmark* bench, Bus* bus) {
+    (void)bench;
+    uint8_t input[INPUT_SIZE];
+    input_bytes(input);
+    qsort(input, 128, 1, compare_bytes);
+    return bytes_equal(bus, OUTPUT_ADDR, input, 128);
+}
+
+/* ============================== Multiply ============================== */
+
+/*
+ * 16 x 16 -> 32-bit shift-and-add multiply of the 256 pairs of 16-bit
+ * words in the input, products to $4000. Each add starts with CLC and
+ * carries by INC, so no ADC runs with carry in.
+ */
+static const uint8_t mul_prog[] = {
+    0xA9, 0x00,       /* LDA #$00 */
+    0x85, 0xFA,       /* STA $FA */
+    0x85, 0xFC,       /* STA $FC */
+    0x85, 0xE8,       /* STA $E8 */
+    0xA9, 0x10,       /* LDA #$10 */
+    0x85, 0xFB,       /* STA $FB */
+    0xA9, 0x40,       /* LDA #$40 */
+    0x85, 0xFD,       /* STA $FD */
+    0xA0, 0x00,       /* pair: LDY #$00 */
+    0xB1, 0xFA,       /* LDA ($FA),Y */
+    0x85, 0xE0,       /* STA $E0 */
+    0xC8,             /* INY */
+    0xB1, 0xFA,       /* LDA ($FA),Y */
+    0x85, 0xE1,       /* STA $E1 */
+    0xC8,             /* INY */
+    0xB1, 0xFA,       /* LDA ($FA),Y */
+    0x85, 0xE2,       /* STA $E2 */
+    0xC8,             /* INY */
+    0xB1, 0xFA,       /* LDA ($FA),Y */
+    0x85, 0xE3,       /* STA $E3 */
+    0xA9, 0x00,       /* LDA #$00 */
+    0x85, 0xE4,       /* STA $E4 */
+    0x85, 0xE5,       /* STA $E5 */
+    0x85, 0xE6,       /* STA $E6 */
+    0x85, 0xE7,       /* STA $E7 */
+    0xA2, 0x10,       /* LDX #$10 */
+    0x06, 0xE4,       /* bit: ASL $E4 */
+    0x26, 0xE5,       /* ROL $E5 */
+    0x26, 0xE6,       /* ROL $E6 */
+    0x26, 0xE7,       /* ROL $E7 */
+    0x06, 0xE2,       /* ASL $E2 */
+    0x26, 0xE3,       /* ROL $E3 */
+    0x90, 0x22,       /* BCC skip */
+    0x18,             /* CLC */
+    0xA5, 0xE4,       /* LDA $E4 */
+    0x65, 0xE0,       /* ADC $E0 */
+    0x85, 0xE4,       /* STA $E4 */
+    0x90, 0x0A,       /* BCC hi */
+    0xE6, 0xE5,       /* INC $E5 */
+    0xD0, 0x06,       /* BNE hi */
+    0xE6, 0xE6,       /* INC $E6 */
+    0xD0, 0x02,       /* BNE hi */
+    0xE6, 0xE7,       /* INC $E7 */
+    0x18,             /* hi: CLC */
+    0xA5, 0xE5,       /* LDA $E5 */
+    0x65, 0xE1,       /* ADC $E1 */
+    0x85, 0xE5,       /* STA $E5 */
+    0x90, 0x06,       /* BCC skip */
+    0xE6, 0xE6,       /* INC $E6 */
+    0xD0, 0x02,       /* BNE skip */
+    0xE6, 0xE7,       /* INC $E7 */
+    0xCA,             /* skip: DEX */
+    0xD0, 0xCD,       /* BNE bit */
+    0xA0, 0x00,       /* LDY #$00 */
+    0xA5, 0xE4,       /* LDA $E4 */
+    0x91, 0xFC,       /* STA ($FC),Y */
+    0xC8,             /* INY */
+    0xA5, 0xE5,       /* LDA $E5 */
+    0x91, 0xFC,       /* STA ($FC),Y */
+    0xC8,             /* INY */
+    0xA5, 0xE6,       /* LDA $E6 */
+    0x91, 0xFC,       /* STA ($FC),Y */
+    0xC8,             /* INY */
+    0xA5, 0xE7,       /* LDA $E7 */
+    0x91, 0xFC,       /* STA ($FC),Y */
+    0x18,             /* CLC */
+    0xA5, 0xFA,       /* LDA $FA */
+    0x69, 0x04,       /* ADC #$04 */
+    0x85, 0xFA,       /* STA $FA */
+    0x90, 0x02,       /* BCC out */
+    0xE6, 0xFB,       /* INC $FB */
+    0x18,             /* out: CLC */
+    0xA5, 0xFC,       /* LDA $FC */
+    0x69, 0x04,       /* ADC #$04 */
+    0x85, 0xFC,       /* STA $FC */
+    0x90, 0x02,       /* BCC more */
+    0xE6, 0xFD,       /* INC $FD */
+    0xE6, 0xE8,       /* more: INC $E8 */
+    0xF0, 0x03,       /* BEQ done */
+    0x4C, 0x10, 0x03, /* JMP pair */
+    0x60              /* done: RTS */
+};
+
+static bool mul_check(const Benchmark* bench, Bus* bus) {
+    (void)bench;
+    uint8_t input[INPUT_SIZE];
+    input_bytes(input);
+    for (int i = 0; i < 256; i++) {
+        const uint8_t* p = input + 4 * i;
+        uint32_t a = p[0] | p[1] << 8;
+        uint32_t b = p[2] | p[3] << 8;
+        if (read_le(bus, OUTPUT_ADDR + 4 * i, 4) != a * b) return false;
+    }
+    return true;
+}
+
+/* ============================== BCD ============================== */
+
+/*
+ * Fibonacci in 20-digit unpacked BCD, one digit per byte, low digit
+ * first: a at $80, b at $A0, 90 steps of t = a + b, then t = b - a at
+ * $C0. Decimal carries and borrows are done in software, since this
+ * core ignores the D flag (like the NES's 2A03).
+ */
+static const uint8_t bcd_prog[] = {
+    0xA2, 0x13, /* LDX #$13 */
+    0xA9, 0x00, /* LDA #$00 */
+    0x95, 0x80, /* clear: STA $80,X */
+    0x95, 0xA0, /* STA $A0,X */
+    0xCA,       /* DEX */
+    0x10, 0xF9, /* BPL clear */
+    0xA9, 0x01, /* LDA #$01 */
+    0x85, 0xA0, /* STA $A0 */
+    0xA9, 0x5A, /* LDA #90 */
+    0x85, 0xDA, /* STA $DA */
+    0xA2, 0x00, /* fib: LDX #$00 */
+    0x86, 0xD8, /* STX $D8 */
+    0xA0, 0x00, /* add: LDY #$00 */
+    0xB5, 0x80, /* LDA $80,X */
+    0x18,       /* CLC */
+    0x75, 0xA0, /* ADC $A0,X */
+    0x18,       /* CLC */
+    0x65, 0xD8, /* ADC $D8 */
+    0xC9, 0x0A, /* CMP #10 */
+    0x90, 0x04, /* BCC nocarry */
+    0xE9, 0x0A, /* SBC #10 */
+    0xA0, 0x01, /* LDY #$01 */
+    0x84, 0xD8, /* nocarry: STY $D8 */
+    0x95, 0xC0, /* STA $C0,X */
+    0xE8,       /* INX */
+    0xE0, 0x14, /* CPX #20 */
+    0xD0, 0xE5, /* BNE add */
+    0xA2, 0x13, /* LDX #$13 */
+    0xB5, 0xA0, /* move: LDA $A0,X */
+    0x95, 0x80, /* STA $80,X */
+    0xB5, 0xC0, /* LDA $C0,X */
+    0x95, 0xA0, /* STA $A0,X */
+    0xCA,       /* DEX */
+    0x10, 0xF5, /* BPL move */
+    0xC6, 0xDA, /* DEC $DA */
+    0xD0, 0xD0, /* BNE fib */
+    0xA2, 0x00, /* LDX #$00 */
+    0x86, 0xD8, /* STX $D8 */
+    0xA0, 0x00, /* sub: LDY #$00 */
+    0x38,       /* SEC */
+    0xB5, 0xA0, /* LDA $A0,X */
+    0xF5, 0x80, /* SBC $80,X */
+    0x38,       /* SEC */
+    0xE5, 0xD8, /* SBC $D8 */
+    0x10, 0x05, /* BPL noborrow */
+    0x18,       /* CLC */
+    0x69, 0x0A, /* ADC #10 */
+    0xA0, 0x01, /* LDY #$01 */
+    0x84, 0xD8, /* noborrow: STY $D8 */
+    0x95, 0xC0, /* STA $C0,X */
+    0xE8,       /* INX */
+    0xE0, 0x14, /* CPX #20 */
+    0xD0, 0xE6, /* BNE sub */
+    0x60        /* RTS */
+};
+
+static bool bcd_digits_equal(Bus* bus, uint16_t addr, uint64_t v) {
+    for (int i = 0; i < 20; i++, v /= 10)
+        if (bus_read(bus, addr + i) != v % 10) return false;
+    return true;
+}
+
+static bool bcd_check(const Benchmark* bench, Bus* bus) {
+    (void)bench;
+    uint64_t fib[92] = { 0, 1 };
+    for (int i = 2; i < 92; i++) fib[i] = fib[i - 1] + fib[i - 2];
+    return bcd_digits_equal(bus, 0x0080, fib[90])
+        && bcd_digits_equal(bus, 0x00A0, fib[91])
+        && bcd_digits_equal(bus, 0x00C0, fib[89]);
+}
+
+const Benchmark macro_benchmarks[] = {
+    MACRO("sieve",  "Sieve of Eratosthenes, 8192 flags",     sieve_prog,  sieve_check),
+    MACRO("crc16",  "CRC-16/CCITT of 1 KB, bitwise",          crc16_prog,  crc16_check),
+    MACRO("crc32",  "CRC-32 of 1 KB, bitwise",                crc32_prog,  crc32_check),
+    MACRO("memcpy", "4 KB copy through (zp),Y",               memcpy_prog, memcpy_check),
+    MACRO("sort",   "Bubble sort of 128 bytes",               sort_prog,   sort_check),
+    MACRO("mul16",  "256 16x16-bit shift-and-add multiplies", mul_prog,    mul_check),
+    MACRO("bcd",    "Unpacked BCD Fibonacci, 20 digits",      bcd_prog,    bcd_check),
+};
+
+const size_t macro_benchmark_count = sizeof(macro_benchmarks) / sizeof(macro_benchmarks[0]);
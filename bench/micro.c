@@ -0,0 +1,109 @@
+#include "bench.h"
+
+/*
+ * Micro benchmarks: one instruction per addressing mode and instruction
+ * class, unrolled at $0200 and closed with JMP $0200, so almost every
+ * step is the instruction being measured.
+ *
+ * Machine state for every body:
+ *   A = X = Y = 1, Z clear     BNE always taken, BEQ never
+ *   $11/$12 -> $0300           (zp,X) operand $10
+ *   $20/$21 -> $0300           (zp),Y operand $20
+ *   $30/$31 -> $0200           JMP ($0030) restarts the loop
+ *   $0400: RTS                 JSR target
+ */
+
+#define LOOP_ADDR 0x0200
+#define UNROLL    32
+
+typedef struct {
+    uint8_t bytes[4];   // the body: one instruction, or a pair
+    uint8_t length;
+    uint8_t unroll;     // copies before the JMP; 0 for UNROLL
+} MicroSpec;
+
+#define MICRO(name, what, mode, unroll, ...) \
+    { name, "micro", what, mode, micro_setup, NULL, \
+      &(const MicroSpec){ { __VA_ARGS__ }, sizeof((uint8_t[]){ __VA_ARGS__ }), unroll } }
+
+static void micro_setup(const Benchmark* bench, CPU* cpu, bool once) {
+    const MicroSpec* spec = bench->spec;
+    Bus* bus = cpu_get_bus(cpu);
+    (void)once;
+
+    uint16_t addr = LOOP_ADDR;
+    int copies = spec->unroll ? spec->unroll : UNROLL;
+    for (int i = 0; i < copies; i++) {
+        bus_load(bus, addr, spec->bytes, spec->length);
+        addr += spec->length;
+    }
+    const uint8_t jmp[] = { 0x4C, LOOP_ADDR & 0xFF, LOOP_ADDR >> 8 };
+    bus_load(bus, addr, jmp, sizeof(jmp));
+
+    const uint8_t pointers[] = { 0x00, 0x03 };
+    const uint8_t loop[] = { LOOP_ADDR & 0xFF, LOOP_ADDR >> 8 };
+    const uint8_t rts = 0x60;
+    bus_load(bus, 0x0011, pointers, sizeof(pointers));
+    bus_load(bus, 0x0020, pointers, sizeof(pointers));
+    bus_load(bus, 0x0030, loop, sizeof(loop));
+    bus_load(bus, 0x0400, &rts, 1);
+
+    cpu_set_a(cpu, 1);
+    cpu_set_x(cpu, 1);
+    cpu_set_y(cpu, 1);
+    cpu_set_sp(cpu, 0xFF);
+    cpu_set_status(cpu, FLAG_I | FLAG_U);
+    cpu_set_pc(cpu, LOOP_ADDR);
+}
+
+const Benchmark micro_benchmarks[] = {
+    /* ==== LOAD ==== */
+    MICRO("lda_imm",       "load",       "immediate",    0, 0xA9, 0x01),
+    MICRO("lda_zp",        "load",       "zeropage",     0, 0xA5, 0x40),
+    MICRO("lda_zpx",       "load",       "zeropage,x",   0, 0xB5, 0x40),
+    MICRO("lda_abs",       "load",       "absolute",     0, 0xAD, 0x00, 0x03),
+    MICRO("lda_absx",      "load",       "absolute,x",   0, 0xBD, 0x00, 0x03),
+    MICRO("lda_absy",      "load",       "absolute,y",   0, 0xB9, 0x00, 0x03),
+    MICRO("lda_absx_page", "load",       "absolute,x",   0, 0xBD, 0xFF, 0x03),   // crosses a page
+    MICRO("lda_indx",      "load",       "(indirect,x)", 0, 0xA1, 0x10),
+    MICRO("lda_indy",      "load",       "(indirect),y", 0, 0xB1, 0x20),
+
+    /* ==== STORE ==== */
+    MICRO("sta_zp",        "store",      "zeropage",     0, 0x85, 0x40),
+    MICRO("sta_abs",       "store",      "absolute",     0, 0x8D, 0x00, 0x03),
+    MICRO("sta_absx",      "store",      "absolute,x",   0, 0x9D, 0x00, 0x03),
+    MICRO("sta_indy",      "store",      "(indirect),y", 0, 0x91, 0x20),
+
+    /* ==== ARITHMETIC AND LOGIC ==== */
+    MICRO("adc_imm",       "arithmetic", "immediate",    0, 0x69, 0x01),
+    MICRO("sbc_zp",        "arithmetic", "zeropage",     0, 0xE5, 0x40),
+    MICRO("and_abs",       "logic",      "absolute",     0, 0x2D, 0x00, 0x03),
+    MICRO("eor_imm",       "logic",      "immediate",    0, 0x49, 0x01),
+    MICRO("bit_zp",        "logic",      "zeropage",     0, 0x24, 0x40),
+    MICRO("cmp_imm",       "compare",    "immediate",    0, 0xC9, 0x01),
+
+    /* ==== READ-MODIFY-WRITE ==== */
+    MICRO("asl_acc",       "rmw",        "accumulator",  0, 0x0A),
+    MICRO("inc_zp",        "rmw",        "zeropage",     0, 0xE6, 0x40),
+    MICRO("rol_abs",       "rmw",        "absolute",     0, 0x2E, 0x00, 0x03),
+    MICRO("inc_absx",      "rmw",        "absolute,x",   0, 0xFE, 0x00, 0x03),
+
+    /* ==== REGISTERS AND FLAGS ==== */
+    MICRO("inx_dex",       "register",   "implied",      0, 0xE8, 0xCA),
+    MICRO("tax_txa",       "register",   "implied",      0, 0xAA, 0x8A),
+    MICRO("clc_sec",       "flags",      "implied",      0, 0x18, 0x38),
+    MICRO("nop",           "nop",        "implied",      0, 0xEA),
+
+    /* ==== CONTROL FLOW ==== */
+    MICRO("bne_taken",     "branch",     "relative",     0, 0xD0, 0x00),
+    MICRO("beq_not_taken", "branch",     "relative",     0, 0xF0, 0x00),
+    MICRO("jmp_abs",       "jump",       "absolute",     1, 0x4C, 0x00, 0x02),
+    MICRO("jmp_ind",       "jump",       "indirect",     1, 0x6C, 0x30, 0x00),
+    MICRO("jsr_rts",       "jump",       "absolute",     0, 0x20, 0x00, 0x04),
+
+    /* ==== STACK ==== */
+    MICRO("pha_pla",       "stack",      "implied",      0, 0x48, 0x68),
+    MICRO("php_plp",       "stack",      "implied",      0, 0x08, 0x28),
+};
+
+const size_t micro_benchmark_count = sizeof(micro_benchmarks) / sizeof(micro_benchmarks[0]);
@@ -0,0 +1,137 @@
+#include "block_cache.h"
+#include "opcodes.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* calloc rather than a flush: fresh zero pages need not be touched at startup */
+BlockCache* block_cache_create(void) {
+    BlockCache* c = calloc(1, sizeof(BlockCache));
+    if (!c) {
+        printf("Failed to init block cache\n");
+        exit(1);
+    }
+    return c;
+}
+
+void block_cache_destroy(BlockCache* cache) {
+    free(cache);
+    return;
+}
+
+void block_cache_flush(BlockCache* cache) {
+    if (!cache) return;
+    memset(cache->entries, 0, sizeof(cache->entries));
+    return;
+}
+
+/*
+ * Instructions after which the next PC is not simply PC + length, or
+ * after which a held IRQ may become serviceable
+ */
+static inline bool block_ends_after(const opcode_info_t* info) {
+    switch (info->type) {
+        case BRANCH: case JUMP: case IRPT: case ILLEGAL:
+            return true;
+        default:
+            return info->op == CLI || info->op == PLP;
+    }
+}
+
+/*
+ * May be part of an idle loop: writes nothing, reads at most one fixed
+ * address, and gives the same result when repeated (loads, transfers,
+ * compares, AND/ORA, flags), so a polling loop settles after a pass or
+ * two. Counting (INX, ADC, shifts) would make it a delay loop instead.
+ */
+static bool block_idle_insn(const opcode_info_t* info) {
+    if (info->flags & (OPF_STORE | OPF_RMW)) return false;
+    switch (info->mode) {
+        case IMPL: case ACC: case IMM: case ZPG: case ABS: case REL:
+            break;
+        default:
+            return false;
+    }
+    switch (info->type) {
+        case TRANS: case FLAG: case COMP: case BIT_T: case NOP_T: case BRANCH:
+            return true;
+        case LOGIC:
+            return info->op != EOR;
+        case JUMP:
+            return info->op == JMP;
+        default:
+            return false;
+    }
+}
+
+/* The block's last instruction, at 'at', goes back to the block's start */
+static bool block_loops_to_start(const Block* b, uint16_t at) {
+    const BlockInsn* last = &b->insns[b->count - 1];
+    const opcode_info_t* info = &opcode_info[last->opcode];
+    if (info->mode == REL) return (uint16_t)(at + last->length + last->operand) == b->pc;
+    return info->op == JMP && info->mode == ABS && last->operand == b->pc;
+}
+
+bool block_reads_direct(const Block* b, const Bus* bus) {
+    for (int i = 0; i < b->count; i++) {
+        addr_mode_t mode = opcode_info[b->insns[i].opcode].mode;
+        if ((mode == ZPG || mode == ABS) && !bus->pages[b->insns[i].operand >> 8].read)
+            return false;
+    }
+    return true;
+}
+
+const Block* block_cache_build(BlockCache* cache, Bus* bus, uint16_t pc) {
+    Block* b = &cache->entries[(pc ^ (pc >> 10)) & (BLOCK_CACHE_SIZE - 1)];
+    b->count = 0;
+
+    /* MMIO can change under us without a bus write: never cache it */
+    if (!bus->pages[pc >> 8].read) return NULL;
+
+    b->pc = pc;
+    b->page_lo = b->page_hi = pc >> 8;
+    b->lead_cycles = 0;
+
+    uint16_t at = pc;
+    uint16_t last_at = pc;
+    bool idle = true;
+    while (b->count < BLOCK_MAX_INSNS) {
+        if (!bus->pages[at >> 8].read) break;
+
+        uint8_t byte = bus_read_uncounted(bus, at);
+        const opcode_info_t* info = &opcode_info[byte];
+        uint16_t last = at + info->length - 1;
+        if (!bus->pages[last >> 8].read) break;
+
+        BlockInsn* in = &b->insns[b->count++];
+        in->opcode  = byte;
+        in->length  = info->length;
+        in->cycles  = info->cycles;
+        in->operand = 0;
+        if (info->length == 2) {
+            in->operand = bus_read_uncounted(bus, at + 1);
+            if (info->mode == REL) in->operand = (int8_t)in->operand;
+        } else if (info->length == 3) {
+            in->operand = bus_read_uncounted(bus, at + 1)
+                        | (bus_read_uncounted(bus, (uint16_t)(at + 2)) << 8);
+        }
+        b->page_hi = last >> 8;
+        idle = idle && block_idle_insn(info);
+        last_at = at;
+        at += info->length;
+
+        if (block_ends_after(info)) break;
+        /* Base cost plus a possible page-cross cycle */
+        b->lead_cycles += info->cycles + 1;
+    }
+
+    if (!b->count) return NULL;
+    b->idle = idle && block_loops_to_start(b, last_at) && block_reads_direct(b, bus);
+
+    /* Watch before sampling generations: watching does not bump them */
+    bus_watch_page(bus, b->page_lo);
+    bus_watch_page(bus, b->page_hi);
+    b->gen_lo = bus_page_gen(bus, b->page_lo);
+    b->gen_hi = bus_page_gen(bus, b->page_hi);
+    return b;
+}
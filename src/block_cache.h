@@ -0,0 +1,71 @@
+/**
+ * Predecoded basic-block cache for the CPU run loop.
+ *
+ * A block is a straight-line run of instructions starting at a PC, up to
+ * and including the first instruction that can change the flow of control
+ * or unmask IRQs (CLI, PLP).
+ * Only code on direct bus pages is cached; pages holding cached code are
+ * watched on the bus, so any write to them (self-modifying code, bus_load)
+ * bumps the page generation and the block is rebuilt on its next lookup.
+ *
+ * A block is marked idle when it is a polling loop of its own: it ends
+ * in a branch or JMP back to its start, writes nothing, touches no
+ * stack, counts nothing and reads only fixed addresses on direct pages,
+ * e.g. LDA $xx / BEQ loop or JMP *. The run loop may skip such a loop
+ * once it stops making progress (cpu.c).
+ */
+#ifndef BLOCK_CACHE_H_
+#define BLOCK_CACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bus.h"
+
+#define BLOCK_MAX_INSNS   16
+#define BLOCK_CACHE_SIZE  1024     // direct-mapped entries, power of two
+
+typedef struct {
+    uint8_t  opcode;    // opcode byte: index into opcode_info / handlers
+    uint8_t  length;    // instruction length in bytes
+    uint8_t  cycles;    // base cycles from opcode_info
+    uint16_t operand;   // operand bytes as fetched (REL sign-extended)
+} BlockInsn;
+
+typedef struct {
+    uint16_t  pc;               // start address (tag)
+    uint8_t   count;            // 0 = empty entry
+    uint8_t   page_lo;          // first and last page the block's bytes span
+    uint8_t   page_hi;
+    uint8_t   idle;             // loops to its own start, no writes (see above)
+    uint16_t  lead_cycles;      // worst-case cycles of all but the last insn
+    uint32_t  gen_lo;           // bus page generations when decoded
+    uint32_t  gen_hi;
+    BlockInsn insns[BLOCK_MAX_INSNS];
+} Block;
+
+/* Layout public so lookups inline into the run loop */
+typedef struct {
+    Block entries[BLOCK_CACHE_SIZE];
+} BlockCache;
+
+BlockCache*  block_cache_create(void);
+void         block_cache_destroy(BlockCache* cache);
+void         block_cache_flush(BlockCache* cache);
+
+/* Decode a block at pc into its cache entry; NULL if pc is not cacheable */
+const Block* block_cache_build(BlockCache* cache, Bus* bus, uint16_t pc);
+
+/* Every address an idle block reads is on a direct page (no device to ask) */
+bool         block_reads_direct(const Block* block, const Bus* bus);
+
+static inline const Block* block_cache_lookup(BlockCache* cache, Bus* bus,
+                                              uint16_t pc) {
+    const Block* b = &cache->entries[(pc ^ (pc >> 10)) & (BLOCK_CACHE_SIZE - 1)];
+    if (b->count && b->pc == pc
+        && b->gen_lo == bus_page_gen(bus, b->page_lo)
+        && b->gen_hi == bus_page_gen(bus, b->page_hi))
+        return b;
+    return block_cache_build(cache, bus, pc);
+}
+
+#endif
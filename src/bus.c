@@ -2,22 +2,11 @@
 #include "memory.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-#define MAX_REGIONS 16
-
-typedef struct {
-    uint16_t        start;
-    uint16_t        end;
-    bus_read_fn     read;
-    bus_write_fn    write;
-    void*           ctx;
-    bus_destroy_fn  destroy;
-} BusRegion;
-
-struct Bus {
-    BusRegion regions[MAX_REGIONS];
-    int       region_count;
-};
+/* Page table entries that are not a region index */
+#define PAGE_UNMAPPED 0xFF  // Nothing mapped: open bus
+#define PAGE_SPLIT    0xFE  // Shared by several regions: scan per address
 
 Bus* bus_create(void) {
     Bus* b = malloc(sizeof(Bus));
@@ -26,94 +15,322 @@ Bus* bus_create(void) {
         exit(1);
     }
     b->region_count = 0;
+    memset(b->pages, 0, sizeof(b->pages));
+    memset(b->page_region, PAGE_UNMAPPED, sizeof(b->page_region));
+    memset(b->page_gen, 0, sizeof(b->page_gen));
+    memset(b->page_watched, 0, sizeof(b->page_watched));
+    b->slow_accesses = 0;
+#ifdef BUS_HEATMAP
+    b->heat = NULL;
+#endif
     return b;
 }
 
-void bus_destroy(Bus* bus) {
-    if (!bus) return;
+/* Region predicates for bus_devices */
+static bool has_destroy(const BusRegion* r) { return r->destroy != NULL; }
+static bool has_state(const BusRegion* r)   { return r->state_size != NULL; }
+static bool has_reset(const BusRegion* r)   { return r->reset != NULL; }
 
-    /* Destroy owned devices (deduplicate ctx pointers) */
-    void* destroyed[MAX_REGIONS];
-    int destroyed_count = 0;
+/*
+ * Collect one region per device that has a hook: regions sharing a ctx
+ * are the same device, and the first one mapped with the hook wins.
+ */
+static int bus_devices(Bus* bus, bool (*has)(const BusRegion*),
+                       BusRegion* out[BUS_MAX_REGIONS]) {
+    int count = 0;
 
     for (int i = 0; i < bus->region_count; i++) {
-        if (!bus->regions[i].destroy || !bus->regions[i].ctx)
+        if (!has(&bus->regions[i]) || !bus->regions[i].ctx)
             continue;
 
-        /* Check if already destroyed */
+        /* Check if already collected */
         bool already = false;
-        for (int j = 0; j < destroyed_count; j++) {
-            if (destroyed[j] == bus->regions[i].ctx) {
+        for (int j = 0; j < count; j++) {
+            if (out[j]->ctx == bus->regions[i].ctx) {
                 already = true;
                 break;
             }
         }
-        if (!already) {
-            bus->regions[i].destroy(bus->regions[i].ctx);
-            destroyed[destroyed_count++] = bus->regions[i].ctx;
-        }
+        if (!already) out[count++] = &bus->regions[i];
     }
+    return count;
+}
+
+void bus_destroy(Bus* bus) {
+    if (!bus) return;
+
+    /* Destroy owned devices (deduplicate ctx pointers) */
+    BusRegion* devices[BUS_MAX_REGIONS];
+    int count = bus_devices(bus, has_destroy, devices);
+    for (int i = 0; i < count; i++)
+        devices[i]->destroy(devices[i]->ctx);
 
     free(bus);
 }
 
-bool bus_map(Bus* bus, uint16_t start, uint16_t end,
-             bus_read_fn read_fn, bus_write_fn write_fn,
-             void* ctx, bus_destroy_fn destroy_fn) {
-    if (bus->region_count >= MAX_REGIONS) return false;
+/* Page of a tracked region's Memory that backs bus address addr */
+static inline uint8_t page_of_host(const BusRegion* r, uint16_t addr) {
+    return (r->host + (addr - r->start) - memory_get_raw(r->dirty)) >> 8;
+}
+
+/* Rebuild page table entries for pages [first, last] */
+static void bus_compile_pages(Bus* bus, int first, int last) {
+    for (int page = first; page <= last; page++) {
+        uint16_t lo = page << 8;
+        uint16_t hi = lo | 0xFF;
+        uint8_t entry = PAGE_UNMAPPED;
+
+        /* Topmost region touching the page decides; partial cover splits it */
+        for (int i = bus->region_count - 1; i >= 0; i--) {
+            BusRegion* r = &bus->regions[i];
+            if (r->end < lo || r->start > hi) continue;
+            entry = (r->start <= lo && r->end >= hi) ? i : PAGE_SPLIT;
+            break;
+        }
+        bus->page_region[page] = entry;
+
+        /* Whole pages of a direct region bypass the callbacks entirely */
+        BusPage* p = &bus->pages[page];
+        p->read = NULL;
+        p->write = NULL;
+        if (entry < BUS_MAX_REGIONS && bus->regions[entry].host) {
+            BusRegion* r = &bus->regions[entry];
+            p->read = r->host + (lo - r->start);
+            if (!r->read_only) p->write = p->read;
+        }
+
+        /* Contents may differ now: anything cached from the page is stale */
+        bus->page_gen[page]++;
+        bus->page_watched[page] = false;
+
+        /* A clean tracked page needs its next write to come through here */
+        if (p->write && bus->regions[entry].dirty
+            && !memory_page_dirty(bus->regions[entry].dirty, page_of_host(&bus->regions[entry], lo)))
+            bus_watch_page(bus, page);
+    }
+}
+
+void bus_watch_page(Bus* bus, uint8_t page) {
+    bus->page_watched[page] = true;
+    bus->pages[page].write = NULL;
+}
+
+void bus_watch_clean(Bus* bus) {
+    for (int page = 0; page < BUS_PAGES; page++) {
+        const BusPage* p = &bus->pages[page];
+        uint8_t entry = bus->page_region[page];
+        if (!p->write || entry >= BUS_MAX_REGIONS) continue;
+        const BusRegion* r = &bus->regions[entry];
+        if (r->dirty && !memory_page_dirty(r->dirty, page_of_host(r, page << 8)))
+            bus_watch_page(bus, page);
+    }
+}
+
+uint8_t* bus_page_host(Bus* bus, uint8_t page) {
+    uint8_t entry = bus->page_region[page];
+    if (entry >= BUS_MAX_REGIONS) return NULL;
+    const BusRegion* r = &bus->regions[entry];
+    if (!r->host || r->read_only) return NULL;
+    return r->host + ((page << 8) - r->start);
+}
+
+void bus_fill_page(Bus* bus, uint8_t page, const uint8_t* bytes) {
+    uint8_t* host = bus_page_host(bus, page);
+    if (!host) return;
+    memcpy(host, bytes, 256);
+
+    const BusRegion* r = &bus->regions[bus->page_region[page]];
+    if (r->dirty) {
+        uint16_t at = (uint16_t)(host - memory_get_raw(r->dirty));
+        memory_mark_dirty(r->dirty, at, at);
+    }
+    bus->page_gen[page]++;
+}
+
+void bus_invalidate(Bus* bus, uint16_t start, uint16_t end) {
+    for (int page = start >> 8; page <= (end >> 8); page++) {
+        bus->page_gen[page]++;
+    }
+}
+
+static BusRegion* bus_add_region(Bus* bus, uint16_t start, uint16_t end,
+                                 void* ctx, bus_destroy_fn destroy_fn) {
+    if (bus->region_count >= BUS_MAX_REGIONS) return NULL;
 
     BusRegion* r = &bus->regions[bus->region_count++];
+    memset(r, 0, sizeof(*r));
     r->start   = start;
     r->end     = end;
-    r->read    = read_fn;
-    r->write   = write_fn;
     r->ctx     = ctx;
     r->destroy = destroy_fn;
+    return r;
+}
+
+bool bus_map(Bus* bus, uint16_t start, uint16_t end,
+             bus_read_fn read_fn, bus_write_fn write_fn,
+             void* ctx, bus_destroy_fn destroy_fn) {
+    BusDevice dev = { .read = read_fn, .write = write_fn, .destroy = destroy_fn };
+    return bus_map_device(bus, start, end, &dev, ctx);
+}
+
+bool bus_map_device(Bus* bus, uint16_t start, uint16_t end,
+                    const BusDevice* dev, void* ctx) {
+    BusRegion* r = bus_add_region(bus, start, end, ctx, dev->destroy);
+    if (!r) return false;
+    r->read  = dev->read;
+    r->write = dev->write;
+
+    /* State hooks come as a set */
+    if (dev->state_size && dev->save && dev->restore) {
+        r->state_size = dev->state_size;
+        r->save       = dev->save;
+        r->restore    = dev->restore;
+    }
+    r->reset = dev->reset;
+
+    bus_compile_pages(bus, start >> 8, end >> 8);
     return true;
 }
 
-uint8_t bus_read(Bus* bus, uint16_t addr) {
-    /* Reverse scan: last-mapped region wins */
+/**
+ * Map host memory straight onto the bus. 'host' backs address 'start';
+ * pages fully inside the region are read (and, unless read_only, written)
+ * inline by bus_read/bus_write without any callback.
+ */
+bool bus_map_direct(Bus* bus, uint16_t start, uint16_t end,
+                    uint8_t* host, bool read_only,
+                    void* ctx, bus_destroy_fn destroy_fn) {
+    BusRegion* r = bus_add_region(bus, start, end, ctx, destroy_fn);
+    if (!r) return false;
+    r->host      = host;
+    r->read_only = read_only;
+
+    bus_compile_pages(bus, start >> 8, end >> 8);
+    return true;
+}
+
+/* Slow path for split pages: reverse scan, last-mapped region wins */
+static BusRegion* bus_find_region(Bus* bus, uint16_t addr) {
     for (int i = bus->region_count - 1; i >= 0; i--) {
-        if (addr >= bus->regions[i].start && addr <= bus->regions[i].end) {
-            return bus->regions[i].read(bus->regions[i].ctx, addr);
-        }
+        if (addr >= bus->regions[i].start && addr <= bus->regions[i].end)
+            return &bus->regions[i];
     }
-    return 0xFF; /* Open bus */
+    return NULL;
 }
 
-void bus_write(Bus* bus, uint16_t addr, uint8_t val) {
-    /* Reverse scan: last-mapped region wins */
-    for (int i = bus->region_count - 1; i >= 0; i--) {
-        if (addr >= bus->regions[i].start && addr <= bus->regions[i].end) {
-            bus->regions[i].write(bus->regions[i].ctx, addr, val);
-            return;
-        }
+static inline BusRegion* bus_lookup(Bus* bus, uint16_t addr) {
+    uint8_t entry = bus->page_region[addr >> 8];
+    if (entry < BUS_MAX_REGIONS) return &bus->regions[entry];
+    if (entry == PAGE_UNMAPPED)  return NULL;
+    return bus_find_region(bus, addr);
+}
+
+uint8_t bus_read_slow(Bus* bus, uint16_t addr) {
+    bus->slow_accesses++;
+    BusRegion* r = bus_lookup(bus, addr);
+    if (!r) return 0xFF; /* Open bus */
+    if (r->host) return r->host[addr - r->start];
+    if (!r->read) return 0xFF; /* Write-only device: open bus */
+    return r->read(r->ctx, addr);
+}
+
+void bus_write_slow(Bus* bus, uint16_t addr, uint8_t val) {
+    bus->slow_accesses++;
+
+    /* Mark before recompiling, so a tracked page is not re-armed */
+    BusRegion* r = bus_lookup(bus, addr);
+    if (r && r->dirty && !r->read_only) {
+        uint16_t at = (uint16_t)(r->host + (addr - r->start) - memory_get_raw(r->dirty));
+        memory_mark_dirty(r->dirty, at, at);
     }
-    /* Unmapped write: silently ignored */
+
+    /* First write to a watched page: invalidate it and restore its fast path */
+    if (bus->page_watched[addr >> 8])
+        bus_compile_pages(bus, addr >> 8, addr >> 8);
+
+    if (!r) return; /* Unmapped write: silently ignored */
+    if (r->host) {
+        if (!r->read_only) r->host[addr - r->start] = val;
+        return;
+    }
+    if (r->write) r->write(r->ctx, addr, val);   /* Read-only device drops it */
 }
 
-void bus_load(Bus* bus, uint16_t addr, const uint8_t* data, size_t size) {
-    for (size_t i = 0; i < size; i++) {
-        bus_write(bus, addr + (uint16_t)i, data[i]);
+/* ========================= Device state ========================= */
+
+size_t bus_state_size(Bus* bus) {
+    BusRegion* devices[BUS_MAX_REGIONS];
+    int count = bus_devices(bus, has_state, devices);
+    size_t size = 0;
+    for (int i = 0; i < count; i++)
+        size += devices[i]->state_size(devices[i]->ctx);
+    return size;
+}
+
+void bus_save_state(Bus* bus, uint8_t* buf) {
+    BusRegion* devices[BUS_MAX_REGIONS];
+    int count = bus_devices(bus, has_state, devices);
+    for (int i = 0; i < count; i++) {
+        size_t size = devices[i]->state_size(devices[i]->ctx);
+        devices[i]->save(devices[i]->ctx, buf);
+        buf += size;
     }
 }
 
-/* Adapter functions for Memory* */
-static uint8_t mem_adapter_read(void* ctx, uint16_t addr) {
-    return memory_read((Memory*)ctx, addr);
+void bus_restore_state(Bus* bus, const uint8_t* buf) {
+    BusRegion* devices[BUS_MAX_REGIONS];
+    int count = bus_devices(bus, has_state, devices);
+    for (int i = 0; i < count; i++) {
+        size_t size = devices[i]->state_size(devices[i]->ctx);
+        devices[i]->restore(devices[i]->ctx, buf);
+        buf += size;
+    }
+}
+
+void bus_reset_devices(Bus* bus) {
+    BusRegion* devices[BUS_MAX_REGIONS];
+    int count = bus_devices(bus, has_reset, devices);
+    for (int i = 0; i < count; i++)
+        devices[i]->reset(devices[i]->ctx);
 }
 
-static void mem_adapter_write(void* ctx, uint16_t addr, uint8_t val) {
-    memory_write((Memory*)ctx, addr, val);
+bool bus_set_heatmap(Bus* bus, Heatmap* heat) {
+#ifdef BUS_HEATMAP
+    bus->heat = heat;
+    return true;
+#else
+    (void)bus;
+    (void)heat;
+    return false;
+#endif
+}
+
+/* Loading is not a CPU access, so it stays out of the heatmap */
+void bus_load(Bus* bus, uint16_t addr, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        uint16_t a = addr + (uint16_t)i;
+        const BusPage* p = &bus->pages[a >> 8];
+        if (p->write) p->write[a & 0xFF] = data[i];
+        else bus_write_slow(bus, a, data[i]);
+    }
 }
 
+/* Adapter functions for Memory* */
 static void mem_adapter_destroy(void* ctx) {
     memory_destroy((Memory*)ctx);
 }
 
 void bus_map_memory(Bus* bus, Memory* mem) {
-    bus_map(bus, 0x0000, 0xFFFF,
-            mem_adapter_read, mem_adapter_write,
-            mem, mem_adapter_destroy);
+    if (!bus_map_direct(bus, 0x0000, 0xFFFF, memory_get_raw(mem), false,
+                        mem, mem_adapter_destroy))
+        return;
+    bus->regions[bus->region_count - 1].dirty = mem;
+    memory_track_bus(mem, bus);
+    bus_watch_clean(bus);
+}
+
+/* Map [start, end] of a Memory as ROM: reads are direct, writes are dropped */
+void bus_map_rom(Bus* bus, Memory* mem, uint16_t start, uint16_t end) {
+    bus_map_direct(bus, start, end, memory_get_raw(mem) + start, true,
+                   mem, mem_adapter_destroy);
 }
@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#ifdef BUS_HEATMAP
+#include "heatmap.h"
+#endif
 
 typedef struct Bus Bus;
 typedef struct Memory Memory;
@@ -13,6 +16,74 @@ typedef uint8_t (*bus_read_fn)(void* ctx, uint16_t addr);
 typedef void    (*bus_write_fn)(void* ctx, uint16_t addr, uint8_t val);
 typedef void    (*bus_destroy_fn)(void* ctx);
 
+/* Optional device state hooks, for snapshots and save states */
+typedef size_t  (*bus_state_size_fn)(void* ctx);
+typedef void    (*bus_save_fn)(void* ctx, uint8_t* buf);
+typedef void    (*bus_restore_fn)(void* ctx, const uint8_t* buf);
+typedef void    (*bus_reset_fn)(void* ctx);
+
+/*
+ * Everything the bus knows about a device. state_size reports how many
+ * bytes save writes and restore reads back; all three are set or none.
+ * Any hook may be NULL: without read the device reads as open bus
+ * (0xFF), like an unmapped address, and without write its writes are
+ * dropped.
+ */
+typedef struct {
+    bus_read_fn       read;
+    bus_write_fn      write;
+    bus_destroy_fn    destroy;
+    bus_state_size_fn state_size;
+    bus_save_fn       save;
+    bus_restore_fn    restore;
+    bus_reset_fn      reset;
+} BusDevice;
+
+#define BUS_MAX_REGIONS 16
+#define BUS_PAGES       256
+
+typedef struct {
+    uint16_t          start;
+    uint16_t          end;
+    bus_read_fn       read;
+    bus_write_fn      write;
+    void*             ctx;
+    bus_destroy_fn    destroy;
+    bus_state_size_fn state_size;
+    bus_save_fn       save;
+    bus_restore_fn    restore;
+    bus_reset_fn      reset;
+    uint8_t*          host;       // backing store for direct regions, NULL for MMIO
+    bool              read_only;  // direct region drops writes (ROM)
+    Memory*           dirty;      // Memory whose dirty bitmap writes mark, NULL if none
+} BusRegion;
+
+/* Per-page dispatch entry, compiled by bus_map */
+typedef struct {
+    uint8_t*        read;       // host bytes of a direct page, NULL otherwise
+    uint8_t*        write;      // host bytes of a writable direct page, NULL otherwise
+} BusPage;
+
+/*
+ * The layout is only public so bus_read/bus_write can inline the direct
+ * page fast path; everything else should go through the functions below.
+ */
+struct Bus {
+    BusPage   pages[BUS_PAGES];
+    uint8_t   page_region[BUS_PAGES];   // owning region index per page
+    BusRegion regions[BUS_MAX_REGIONS];
+    int       region_count;
+
+    /* Code-modification tracking for the CPU's block cache */
+    uint32_t  page_gen[BUS_PAGES];      // bumped when a page may have changed
+    bool      page_watched[BUS_PAGES];  // writes to the page take the slow path
+    uint32_t  slow_accesses;            // device callbacks and watched writes
+
+#ifdef BUS_HEATMAP
+    Heatmap*  heat;                     // access counts, NULL when not attached
+#endif
+};
+
 /* Lifecycle */
 Bus*    bus_create(void);
 void    bus_destroy(Bus* bus);
@@ -21,13 +92,104 @@ void    bus_destroy(Bus* bus);
 bool    bus_map(Bus* bus, uint16_t start, uint16_t end,
                 bus_read_fn read_fn, bus_write_fn write_fn,
                 void* ctx, bus_destroy_fn destroy_fn);
+bool    bus_map_device(Bus* bus, uint16_t start, uint16_t end,
+                       const BusDevice* dev, void* ctx);
+bool    bus_map_direct(Bus* bus, uint16_t start, uint16_t end,
+                       uint8_t* host, bool read_only,
+                       void* ctx, bus_destroy_fn destroy_fn);
+
+/* Read / Write: slow paths handle MMIO, ROM and split pages */
+uint8_t bus_read_slow(Bus* bus, uint16_t addr);
+void    bus_write_slow(Bus* bus, uint16_t addr, uint8_t val);
+
+/* The read itself; bus_read and bus_fetch add heatmap accounting */
+static inline uint8_t bus_read_uncounted(Bus* bus, uint16_t addr) {
+    const BusPage* p = &bus->pages[addr >> 8];
+    if (p->read) return p->read[addr & 0xFF];
+    return bus_read_slow(bus, addr);
+}
+
+static inline uint8_t bus_read(Bus* bus, uint16_t addr) {
+#ifdef BUS_HEATMAP
+    if (bus->heat) heatmap_count(bus->heat->reads, addr);
+#endif
+    return bus_read_uncounted(bus, addr);
+}
+
+/* An opcode fetch: a read the heatmap counts separately */
+static inline uint8_t bus_fetch(Bus* bus, uint16_t addr) {
+#ifdef BUS_HEATMAP
+    if (bus->heat) heatmap_count(bus->heat->fetches, addr);
+#endif
+    return bus_read_uncounted(bus, addr);
+}
+
+static inline void bus_write(Bus* bus, uint16_t addr, uint8_t val) {
+#ifdef BUS_HEATMAP
+    if (bus->heat) heatmap_count(bus->heat->writes, addr);
+#endif
+    const BusPage* p = &bus->pages[addr >> 8];
+    if (p->write) {
+        p->write[addr & 0xFF] = val;
+        return;
+    }
+    bus_write_slow(bus, addr, val);
+}
+
+/*
+ * Code-modification tracking. Watching a page routes its writes through
+ * the slow path, which bumps the page generation and stops watching it.
+ * bus_invalidate bumps pages changed behind the bus's back.
+ *
+ * slow_accesses counts every slow-path access: anything that can run a
+ * device callback or modify cached code. The CPU checks it to leave a
+ * cached block after such an access.
+ */
+void    bus_watch_page(Bus* bus, uint8_t page);
+void    bus_invalidate(Bus* bus, uint16_t start, uint16_t end);
+
+/*
+ * Dirty-page tracking for bus_map_memory regions: a page whose Memory
+ * dirty bit is clear is watched, so its first write takes the slow path,
+ * which marks it. Later writes to the page stay on the fast path.
+ * memory_clear_dirty calls this to re-arm every clean page.
+ */
+void    bus_watch_clean(Bus* bus);
+
+static inline uint32_t bus_page_gen(const Bus* bus, uint8_t page) {
+    return bus->page_gen[page];
+}
+
+/*
+ * Whole direct pages of writable regions, the memory snapshots and save
+ * states hold. bus_fill_page overwrites one behind the fast path: the
+ * page's generation is bumped and its Memory marked dirty.
+ */
+uint8_t* bus_page_host(Bus* bus, uint8_t page);
+void     bus_fill_page(Bus* bus, uint8_t page, const uint8_t* bytes);
+
+/*
+ * Device state. Regions sharing a ctx are one device, as for destroy:
+ * each hook runs once per device, in mapping order. bus_save_state
+ * writes every device's state back to back into one buffer of
+ * bus_state_size bytes; bus_restore_state reads the same layout, so it
+ * needs a bus with the same devices mapped in the same order.
+ */
+size_t  bus_state_size(Bus* bus);
+void    bus_save_state(Bus* bus, uint8_t* buf);
+void    bus_restore_state(Bus* bus, const uint8_t* buf);
+void    bus_reset_devices(Bus* bus);
 
-/* Read / Write */
-uint8_t bus_read(Bus* bus, uint16_t addr);
-void    bus_write(Bus* bus, uint16_t addr, uint8_t val);
+/*
+ * Count accesses into a heatmap (heatmap.h), NULL to stop. False if the
+ * build has no heatmap support (HEATMAP=1). Not owned.
+ */
+typedef struct Heatmap Heatmap;
+bool    bus_set_heatmap(Bus* bus, Heatmap* heat);
 
 /* Convenience */
 void    bus_load(Bus* bus, uint16_t addr, const uint8_t* data, size_t size);
 void    bus_map_memory(Bus* bus, Memory* mem);
+void    bus_map_rom(Bus* bus, Memory* mem, uint16_t start, uint16_t end);
 
 #endif
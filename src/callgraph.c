@@ -0,0 +1,242 @@
+#include "callgraph.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define PATH_MAX_TEXT   (CALLGRAPH_MAX_DEPTH * 12 + 8)
+
+static void* callgraph_alloc(void* old, size_t size) {
+    void* p = realloc(old, size);
+    if (!p) {
+        printf("Failed to allocate call graph\n");
+        exit(1);
+    }
+    return p;
+}
+
+static inline uint32_t node_hash(uint32_t parent, uint16_t addr, uint8_t kind) {
+    uint32_t h = parent * 0x9E3779B1u ^ ((uint32_t)addr << 3 | kind) * 0x85EBCA77u;
+    return h ^ (h >> 15);
+}
+
+static void table_insert(CallGraph* g, uint32_t node) {
+    const CallNode* n = &g->nodes[node];
+    uint32_t i = node_hash(n->parent, n->addr, n->kind) & g->table_mask;
+    while (g->table[i]) i = (i + 1) & g->table_mask;
+    g->table[i] = node + 1;
+}
+
+static uint32_t add_node(CallGraph* g, uint32_t parent, uint16_t addr, uint8_t kind) {
+    if (g->count == g->cap) {
+        g->cap *= 2;
+        g->nodes = callgraph_alloc(g->nodes, g->cap * sizeof(CallNode));
+    }
+    /* Keep the table at most half full */
+    if ((g->count + 1) * 2 > g->table_mask + 1) {
+        uint32_t size = (g->table_mask + 1) * 2;
+        free(g->table);
+        g->table = calloc(size, sizeof(uint32_t));
+        if (!g->table) {
+            printf("Failed to allocate call graph\n");
+            exit(1);
+        }
+        g->table_mask = size - 1;
+        for (uint32_t i = 0; i < g->count; i++) table_insert(g, i);
+    }
+    g->nodes[g->count] = (CallNode){ parent, addr, kind, 0, 0 };
+    table_insert(g, g->count);
+    return g->count++;
+}
+
+/* The node for calling addr from parent, created on first use */
+static uint32_t child_node(CallGraph* g, uint32_t parent, uint16_t addr, uint8_t kind) {
+    uint32_t i = node_hash(parent, addr, kind) & g->table_mask;
+    for (uint32_t slot; (slot = g->table[i]) != 0; i = (i + 1) & g->table_mask) {
+        const CallNode* n = &g->nodes[slot - 1];
+        if (n->parent == parent && n->addr == addr && n->kind == kind) return slot - 1;
+    }
+    return add_node(g, parent, addr, kind);
+}
+
+CallGraph* callgraph_create(void) {
+    CallGraph* g = calloc(1, sizeof(CallGraph));
+    if (!g) {
+        printf("Failed to allocate call graph\n");
+        exit(1);
+    }
+    g->cap = 64;
+    g->nodes = callgraph_alloc(NULL, g->cap * sizeof(CallNode));
+    g->table_mask = 127;
+    g->table = calloc(g->table_mask + 1, sizeof(uint32_t));
+    if (!g->table) {
+        printf("Failed to allocate call graph\n");
+        exit(1);
+    }
+    callgraph_clear(g);
+    return g;
+}
+
+void callgraph_destroy(CallGraph* g) {
+    if (!g) return;
+    free(g->table);
+    free(g->nodes);
+    free(g);
+}
+
+void callgraph_clear(CallGraph* g) {
+    memset(g->table, 0, (g->table_mask + 1) * sizeof(uint32_t));
+    g->count = 0;
+    add_node(g, CALLGRAPH_ROOT, 0, CALL_ROOT);
+    g->depth = 0;
+    g->current = CALLGRAPH_ROOT;
+}
+
+/*
+ * Drop every frame whose return address is no longer on the 6502 stack,
+ * i.e. whose entry stack pointer is at or below sp.
+ */
+static void unwind(CallGraph* g, uint16_t sp) {
+    while (g->depth && g->stack[g->depth - 1].sp <= sp) g->depth--;
+    g->current = g->depth ? g->stack[g->depth - 1].node : CALLGRAPH_ROOT;
+}
+
+/*
+ * Enter a frame whose pushes started at stack pointer 'entry_sp'. After
+ * unwinding, the frames left have distinct entry pointers above it, so
+ * the shadow stack cannot outgrow CALLGRAPH_MAX_DEPTH.
+ */
+static void push_frame(CallGraph* g, uint16_t addr, uint8_t kind, uint8_t entry_sp) {
+    unwind(g, entry_sp);
+    uint32_t node = child_node(g, g->current, addr, kind);
+    g->nodes[node].calls++;
+    g->stack[g->depth++] = (CallFrame){ node, entry_sp };
+    g->current = node;
+}
+
+void callgraph_transfer(CallGraph* g, opcode_t op, uint16_t pc, uint8_t sp) {
+    switch (op) {
+        case JSR: push_frame(g, pc, CALL_JSR, (uint8_t)(sp + 2)); break;
+        case BRK: push_frame(g, pc, CALL_BRK, (uint8_t)(sp + 3)); break;
+        default:  unwind(g, sp); break;                 // RTS, RTI, TXS
+    }
+}
+
+void callgraph_interrupt(CallGraph* g, bool nmi, uint16_t pc, uint8_t sp, uint8_t cycles) {
+    push_frame(g, pc, nmi ? CALL_NMI : CALL_IRQ, (uint8_t)(sp + 3));
+    g->nodes[g->current].self_cycles += cycles;
+}
+
+void callgraph_add_path(CallGraph* g, const uint16_t* addrs, const uint8_t* kinds,
+                        int length, uint64_t cycles) {
+    uint32_t node = CALLGRAPH_ROOT;
+    for (int i = 0; i < length; i++)
+        node = child_node(g, node, addrs[i], kinds ? kinds[i] : CALL_JSR);
+    g->nodes[node].self_cycles += cycles;
+}
+
+uint32_t callgraph_node_count(const CallGraph* g) {
+    return g->count;
+}
+
+const CallNode* callgraph_node(const CallGraph* g, uint32_t node) {
+    return node < g->count ? &g->nodes[node] : NULL;
+}
+
+int callgraph_depth(const CallGraph* g) {
+    return g->depth;
+}
+
+int64_t callgraph_find(const CallGraph* g, const uint16_t* path, int length) {
+    uint32_t node = CALLGRAPH_ROOT;
+    for (int i = 0; i < length; i++) {
+        uint32_t next = 0;
+        for (uint32_t n = 1; n < g->count && !next; n++)
+            if (g->nodes[n].parent == node && g->nodes[n].addr == path[i]) next = n;
+        if (!next) return -1;
+        node = next;
+    }
+    return node;
+}
+
+/* Children are always created after their parent, so one reverse pass sums subtrees */
+static uint64_t* inclusive_all(const CallGraph* g) {
+    uint64_t* total = malloc(g->count * sizeof(uint64_t));
+    if (!total) {
+        printf("Failed to allocate call graph\n");
+        exit(1);
+    }
+    for (uint32_t n = 0; n < g->count; n++) total[n] = g->nodes[n].self_cycles;
+    for (uint32_t n = g->count - 1; n > 0; n--) total[g->nodes[n].parent] += total[n];
+    return total;
+}
+
+uint64_t callgraph_inclusive(const CallGraph* g, uint32_t node) {
+    if (node >= g->count) return 0;
+    uint64_t* total = inclusive_all(g);
+    uint64_t result = total[node];
+    free(total);
+    return result;
+}
+
+/* Frames of a path from the root, joined by ';' */
+static void path_text(const CallGraph* g, uint32_t node, char* buf, size_t size) {
+    uint32_t chain[CALLGRAPH_MAX_DEPTH + 1];
+    int length = 0;
+    while (node != CALLGRAPH_ROOT && length < CALLGRAPH_MAX_DEPTH) {
+        chain[length++] = node;
+        node = g->nodes[node].parent;
+    }
+
+    size_t used = snprintf(buf, size, "main");
+    for (int i = length - 1; i >= 0 && used < size; i--) {
+        const CallNode* n = &g->nodes[chain[i]];
+        const char* prefix = n->kind == CALL_IRQ ? "irq:" :
+                             n->kind == CALL_NMI ? "nmi:" :
+                             n->kind == CALL_BRK ? "brk:" : "";
+        used += snprintf(buf + used, size - used, ";%s$%04X", prefix, n->addr);
+    }
+}
+
+void callgraph_write_folded(const CallGraph* g, FILE* out) {
+    char path[PATH_MAX_TEXT];
+    for (uint32_t n = 0; n < g->count; n++) {
+        if (!g->nodes[n].self_cycles) continue;
+        path_text(g, n, path, sizeof(path));
+        fprintf(out, "%s %" PRIu64 "\n", path, g->nodes[n].self_cycles);
+    }
+}
+
+void callgraph_report(const CallGraph* g, FILE* out, int top) {
+    if (top <= 0) top = 20;
+    uint64_t* total = inclusive_all(g);
+    uint32_t* rank = malloc(g->count * sizeof(uint32_t));
+    if (!rank) {
+        printf("Failed to allocate call graph\n");
+        exit(1);
+    }
+
+    /* Partial selection: the 'top' nodes by inclusive cycles */
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < g->count; i++) rank[n++] = i;
+    uint32_t shown = n < (uint32_t)top ? n : (uint32_t)top;
+    for (uint32_t i = 0; i < shown; i++) {
+        uint32_t best = i;
+        for (uint32_t j = i + 1; j < n; j++)
+            if (total[rank[j]] > total[rank[best]]) best = j;
+        uint32_t t = rank[i];
+        rank[i] = rank[best];
+        rank[best] = t;
+    }
+
+    char path[PATH_MAX_TEXT];
+    fprintf(out, "Call paths (%" PRIu32 ", by inclusive cycles)\n", g->count);
+    fprintf(out, "       inclusive      exclusive          calls  path\n");
+    for (uint32_t i = 0; i < shown; i++) {
+        const CallNode* node = &g->nodes[rank[i]];
+        path_text(g, rank[i], path, sizeof(path));
+        fprintf(out, "  %14" PRIu64 " %14" PRIu64 " %14" PRIu64 "  %s\n",
+                total[rank[i]], node->self_cycles, node->calls, path);
+    }
+    free(rank);
+    free(total);
+}
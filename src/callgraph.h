@@ -0,0 +1,126 @@
+/**
+ * Call-graph profiler.
+ *
+ * A CPU with a call graph attached (cpu_set_callgraph) keeps a shadow
+ * call stack alongside the 6502 one: JSR, BRK and IRQ/NMI entry push a
+ * frame, RTS and RTI pop it. Every instruction's cycles go to the node
+ * for the current call path, so each node holds the exclusive cycles of
+ * one path; inclusive cycles are the sum over its subtree.
+ *
+ * Frames remember the stack pointer before their return address was
+ * pushed, and a frame ends when the stack pointer climbs back to that
+ * value, not when an RTS happens to run. So a routine that drops its
+ * return address (PLA/PLA before RTS) returns to its caller's caller
+ * together with the caller, an RTS used as a computed jump (return
+ * address pushed by hand) stays in the routine that did it, and a TXS
+ * that abandons the stack discards the frames it abandons.
+ */
+#ifndef CALLGRAPH_H_
+#define CALLGRAPH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "opcodes.h"
+
+#define CALLGRAPH_ROOT  0           // node of code outside any call
+
+/* How a node's frame was entered */
+enum {
+    CALL_ROOT,
+    CALL_JSR,
+    CALL_BRK,
+    CALL_IRQ,
+    CALL_NMI
+};
+
+/* One call path: its last frame and what ran directly in it */
+typedef struct {
+    uint32_t parent;        // the path it was called from; the root is its own parent
+    uint16_t addr;          // routine or handler entry
+    uint8_t  kind;          // CALL_*
+    uint64_t calls;
+    uint64_t self_cycles;   // exclusive
+} CallNode;
+
+/* A live shadow stack frame */
+typedef struct {
+    uint32_t node;
+    uint16_t sp;            // stack pointer before the call pushed anything
+} CallFrame;
+
+/* 6502 frames take at least two stack bytes, so 256 never fills up */
+#define CALLGRAPH_MAX_DEPTH 256
+
+/* Public so the run loop can count an instruction without a call */
+typedef struct CallGraph {
+    CallNode*  nodes;
+    uint32_t   count;
+    uint32_t   cap;
+    uint32_t*  table;       // open-addressed (parent, addr, kind) -> node + 1
+    uint32_t   table_mask;
+    CallFrame  stack[CALLGRAPH_MAX_DEPTH];
+    int        depth;       // frames above the root
+    uint32_t   current;     // node of the innermost frame
+} CallGraph;
+
+CallGraph* callgraph_create(void);
+void       callgraph_destroy(CallGraph* graph);
+
+/* Drop every node and frame */
+void       callgraph_clear(CallGraph* graph);
+
+/* Slow half of callgraph_step: a call, return or stack switch */
+void       callgraph_transfer(CallGraph* graph, opcode_t op, uint16_t pc, uint8_t sp);
+
+/* Interrupt entry; pc is the handler, sp the stack pointer after the pushes */
+void       callgraph_interrupt(CallGraph* graph, bool nmi, uint16_t pc, uint8_t sp,
+                               uint8_t cycles);
+
+/*
+ * Account one executed instruction. pc and sp are the registers after
+ * it ran, so for JSR and BRK pc is the routine or handler entry.
+ */
+static inline void callgraph_step(CallGraph* g, opcode_t op, uint16_t pc,
+                                  uint8_t sp, uint8_t cycles) {
+    g->nodes[g->current].self_cycles += cycles;
+    if (op == JSR || op == RTS || op == RTI || op == BRK || op == TXS)
+        callgraph_transfer(g, op, pc, sp);
+}
+
+/*
+ * Add cycles to a path given outermost frame first, creating its nodes
+ * as needed, without touching the shadow stack. kinds may be NULL for
+ * JSR frames throughout. Used for sampled stacks.
+ */
+void       callgraph_add_path(CallGraph* graph, const uint16_t* addrs, const uint8_t* kinds,
+                              int length, uint64_t cycles);
+
+/* Nodes recorded so far (the root included), and one of them by index */
+uint32_t   callgraph_node_count(const CallGraph* graph);
+const CallNode* callgraph_node(const CallGraph* graph, uint32_t node);
+
+/* Frames on the shadow stack above the root */
+int        callgraph_depth(const CallGraph* graph);
+
+/*
+ * Node for a path of entry addresses from the root, e.g. {0x0220, 0x0230};
+ * kind is ignored, so an interrupt handler matches by its address. -1 if
+ * the path never ran.
+ */
+int64_t    callgraph_find(const CallGraph* graph, const uint16_t* path, int length);
+
+/* Cycles of the node and every path below it */
+uint64_t   callgraph_inclusive(const CallGraph* graph, uint32_t node);
+
+/*
+ * Folded stacks for flamegraph tools: one line per path with exclusive
+ * cycles, frames joined by ';', e.g. "main;$0220;$0230 220". Interrupt
+ * frames read "irq:$0300", "nmi:..." and "brk:...".
+ */
+void       callgraph_write_folded(const CallGraph* graph, FILE* out);
+
+/* The 'top' paths by inclusive cycles, with exclusive cycles and calls */
+void       callgraph_report(const CallGraph* graph, FILE* out, int top);
+
+#endif
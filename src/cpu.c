@@ -2,56 +2,112 @@
 #include "opcodes.h"
 #include "addressing.h"
 #include "util.h"
+#include "block_cache.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "profile.h"
+#include "callgraph.h"
+#include "sampler.h"
+#ifdef CPU_JIT
+#include "jit.h"
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 
+#if defined(CPU_THREADED_DISPATCH) && !defined(__GNUC__)
+#error "CPU_THREADED_DISPATCH needs GCC/Clang computed goto"
+#endif
+
+/* Force inlining so each opcode handler is specialised at compile time */
+#if defined(__GNUC__)
+#define CPU_INLINE static inline __attribute__((always_inline))
+#else
+#define CPU_INLINE static inline
+#endif
+
+/*
+ * Working copy of the programmer-visible registers. The run loop keeps
+ * it in locals and only writes it back to struct CPU when it returns.
+ *
+ * Flags are kept lazily: N and Z as the last result (nz), C and V as
+ * separate 0/1 bytes, and only I, D, B and U in p. The packed status
+ * byte is built only when something observes it (PHP, an interrupt
+ * push, cpu_get_status).
+ */
+typedef struct {
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint16_t pc;
+    uint16_t nz;    // Z = (nz & 0xFF) == 0, N = (nz & 0x180) != 0
+    uint8_t c;      // carry, 0 or 1
+    uint8_t v;      // overflow, 0 or 1
+    uint8_t p;      // I, D, B and U; the other bits are always clear
+} Regs;
+
 /* Forward declarations */
-static void cpu_instruction_exec(CPU* cpu, uint8_t* curr_cycles,
-                                 opcode_t opcode, addr_mode_t a_mode,
-                                 uint16_t operand, uint16_t ea);
+CPU_INLINE void cpu_instruction_exec(CPU* cpu, Bus* bus, Regs* r,
+                                     uint8_t* curr_cycles,
+                                     opcode_t opcode, addr_mode_t a_mode,
+                                     uint16_t operand, uint16_t ea);
 
-static void cpu_resolve_ea(CPU* cpu, addr_mode_t curr_am, int16_t *operand, 
-                           uint16_t *ea, bool *cross_page);
+CPU_INLINE uint16_t cpu_fetch_operand(Bus* bus, Regs* r, addr_mode_t curr_am);
 
-static void cpu_increment_cycles(addr_mode_t curr_am, opcode_t curr_oc,
-                                 ins_type_t curr_it, bool cp, uint8_t *c);
 
-static uint8_t cpu_do_interrupt(CPU* cpu, uint16_t return_addr,
+CPU_INLINE void cpu_resolve_ea(Bus* bus, Regs* r, addr_mode_t curr_am,
+                               uint16_t operand, uint16_t *ea,
+                               bool *cross_page);
+
+static uint8_t cpu_do_interrupt(Bus* bus, Regs* r, uint16_t return_addr,
                                 uint16_t vector, bool is_brk);
 
-/* Update N and Z flags based on a result value */
-static inline void cpu_set_nz(uint8_t *status, uint8_t val) {
-    if (val == 0)   *status |= FLAG_Z;
-    else            *status &= ~FLAG_Z;
-    if (val & 0x80) *status |= FLAG_N;
-    else            *status &= ~FLAG_N;
+/* Materialize the packed status register from the lazy flags */
+static inline uint8_t cpu_pack_status(const Regs* r) {
+    return r->p | r->c | (r->v << 6)
+         | ((r->nz & 0xFF) ? 0 : FLAG_Z) | ((r->nz & 0x180) ? FLAG_N : 0);
+}
+
+/* Split a packed status byte into the lazy flags */
+static inline void cpu_unpack_status(Regs* r, uint8_t status) {
+    r->nz = ((status & FLAG_Z) ? 0 : 1) | ((status & FLAG_N) ? 0x100 : 0);
+    r->c = status & FLAG_C;
+    r->v = (status & FLAG_V) >> 6;
+    r->p = status & ~(FLAG_N | FLAG_Z | FLAG_C | FLAG_V);
 }
 
 struct CPU {
-    uint8_t a;
-    uint8_t x;
-    uint8_t y;
-    uint8_t sp;
-    uint16_t pc;
-    uint8_t status;
+    Regs regs;              // between runs; flags stay lazy here too
 
     Bus* bus;
+    BlockCache* blocks;     // predecoded code on direct pages
+#ifdef CPU_JIT
+    Jit* jit;               // native translations of cached blocks
+#endif
+    PageTracker* pages;     // copy-on-write memory pages; first snapshot creates it
+    Tracer* tracer;         // records every step when set; not owned
+    Profile* profile;       // per-PC counts when set; not owned
+    CallGraph* callgraph;   // cycles per call path when set; not owned
+    Sampler* sampler;       // stops the run every sample period when set; not owned
+    bool observed;          // any of the four above is set
+
+    uint64_t steps_run;     // steps taken by the last engine call
+    bool idle_skip;         // skip idle loops to the end of the budget
+    uint64_t idle_cycles;   // cycles skipped that way since cpu_create
+    bool stuck;             // last run stopped in an idle loop with no budget
 
     uint64_t total_cycles;
-    bool halted;
+    bool halted;            // JAM executed; only cpu_reset recovers
+    bool illegal;           // halted on an unimplemented opcode instead
+    bool stop_requested;    // cpu_stop called; run loop exits after this step
 
     // Interrupt state
     bool nmi_line;       // current NMI input (true = asserted/low)
     bool nmi_line_prev;  // previous NMI state (for edge detection)
     bool nmi_pending;    // edge detected, waiting to service
     bool irq_line;       // current IRQ input (true = asserted/low)
-
-    // Internal registers
-    uint16_t mar;   // Memory Address Register
-    uint8_t mdr;    // Memory Data Register
-    uint8_t cir;    // Current Instruction Register
 };
 
 CPU* cpu_create(Bus* bus) {
@@ -61,27 +117,52 @@ CPU* cpu_create(Bus* bus) {
         exit(1);
     }
     c->bus = bus;
+    c->blocks = block_cache_create();
+#ifdef CPU_JIT
+    c->jit = jit_create(bus, c->blocks);
+#endif
+    c->pages = NULL;
+    c->tracer = NULL;
+    c->profile = NULL;
+    c->callgraph = NULL;
+    c->sampler = NULL;
+    c->observed = false;
+    c->idle_skip = true;
+    c->idle_cycles = 0;
+    c->stuck = false;
+    c->regs.a = c->regs.x = c->regs.y = 0;
+    c->total_cycles = 0;
     cpu_reset(c);
     return c;
 }
 
 void cpu_destroy(CPU* cpu) {
     if (cpu->bus) bus_destroy(cpu->bus);
+#ifdef CPU_JIT
+    jit_destroy(cpu->jit);
+#endif
+    block_cache_destroy(cpu->blocks);
+    page_tracker_destroy(cpu->pages);
     free(cpu);
     return;
 }
 
 void cpu_reset(CPU* cpu) {
     if (!cpu) return;
-    cpu->sp = 0xFF;
-    cpu->status = FLAG_U | FLAG_I;
+    cpu->regs.sp = 0xFF;
+    cpu_unpack_status(&cpu->regs, FLAG_U | FLAG_I);
+
+    /* The reset line reaches the devices too; one may supply the vector */
+    bus_reset_devices(cpu->bus);
 
     /* Read from reset vector */
     uint8_t lo = bus_read(cpu->bus, 0xFFFC);
     uint8_t hi = bus_read(cpu->bus, 0xFFFD);
-    cpu->pc = (hi << 8) | lo;
+    cpu->regs.pc = (hi << 8) | lo;
 
     cpu->halted = false;
+    cpu->illegal = false;
+    cpu->stop_requested = false;
 
     cpu->nmi_line = false;
     cpu->nmi_line_prev = false;
@@ -91,8 +172,22 @@ void cpu_reset(CPU* cpu) {
     return;
 }
 
-uint8_t cpu_step(CPU* cpu) {
-    /* Poll for pending interrupts before fetching next instruction */
+static inline Regs cpu_load_regs(const CPU* cpu) {
+    return cpu->regs;
+}
+
+static inline void cpu_store_regs(CPU* cpu, const Regs* r) {
+    cpu->regs = *r;
+}
+
+/*
+ * Poll interrupt lines at an instruction boundary. Returns the cycles
+ * spent entering a handler, or 0 if nothing was serviced.
+ */
+static inline uint8_t cpu_poll_interrupts(CPU* cpu, Regs* r) {
+    /* Nothing asserted and no NMI edge: the common case */
+    if (!(cpu->irq_line | cpu->nmi_pending | (cpu->nmi_line != cpu->nmi_line_prev)))
+        return 0;
 
     /* NMI edge detection: falling edge (line went from low to high/asserted) */
     if (cpu->nmi_line && !cpu->nmi_line_prev)
@@ -102,180 +197,760 @@ uint8_t cpu_step(CPU* cpu) {
     /* Service NMI (highest priority, non-maskable) */
     if (cpu->nmi_pending) {
         cpu->nmi_pending = false;
-        return cpu_do_interrupt(cpu, cpu->pc, 0xFFFA, false);
+        return cpu_do_interrupt(cpu->bus, r, r->pc, 0xFFFA, false);
     }
 
     /* Service IRQ (level-triggered, maskable via FLAG_I) */
-    if (cpu->irq_line && !(cpu->status & FLAG_I)) {
-        return cpu_do_interrupt(cpu, cpu->pc, 0xFFFE, false);
+    if (cpu->irq_line && !(r->p & FLAG_I)) {
+        return cpu_do_interrupt(cpu->bus, r, r->pc, 0xFFFE, false);
     }
+    return 0;
+}
 
-    uint8_t curr_cycles = 0;
-    bool cross_page = false;
+/*
+ * Number of instructions of a cached block that can run without checking
+ * the budgets: all of them if even the worst case stays inside both,
+ * otherwise one, so the run loop re-checks before every instruction.
+ */
+static inline uint8_t cpu_block_span(const Block* blk,
+                                     uint64_t cycles, uint64_t cycle_budget,
+                                     uint64_t steps, uint64_t step_budget) {
+    if (steps + blk->count <= step_budget
+        && cycles + blk->lead_cycles < cycle_budget)
+        return blk->count;
+    return 1;
+}
 
-    /* 1. Fetch opcode */
-    cpu->mar = cpu->pc;
-    cpu->mdr = bus_read(cpu->bus, cpu->mar);
-    cpu->cir = cpu->mdr;
+/*
+ * Idle loops. Once a pass of an idle block (block_cache.h) comes back to
+ * its start with every register as it found it, the following passes
+ * are all the same: the loop writes nothing, and what it reads is
+ * direct memory that nothing else changes during the run (only device
+ * callbacks and the host between runs could, and the loop calls no
+ * device). The passes are skipped in one go, as many as the real loop
+ * would run within both budgets, with their cycles and steps counted.
+ * An interrupt the CPU would take at the loop head ends the loop
+ * instead; the host raising one means a new run call, which re-checks.
+ * Under the JIT an idle block runs one pass per native call, so the
+ * check comes before native code spins the loop up to the budget.
+ *
+ * With neither budget bounded the loop would never end: the run stops
+ * there instead, marked stuck. Returns false then.
+ */
+static inline bool cpu_skip_idle(CPU* cpu, const Block* blk, const Regs* before,
+                                 const Regs* r, uint64_t pass_cycles,
+                                 uint64_t* cycles, uint64_t cycle_budget,
+                                 uint64_t* steps, uint64_t step_budget) {
+    if (r->pc != blk->pc || !pass_cycles || !cpu->idle_skip
+        || *cycles >= cycle_budget || *steps >= step_budget)
+        return true;
+    if (r->a != before->a || r->x != before->x || r->y != before->y
+        || r->sp != before->sp || r->nz != before->nz || r->c != before->c
+        || r->v != before->v || r->p != before->p)
+        return true;
+    if (cpu->stop_requested || cpu->halted || cpu->nmi_pending
+        || cpu->nmi_line != cpu->nmi_line_prev || (cpu->irq_line && !(r->p & FLAG_I)))
+        return true;
+    if (!block_reads_direct(blk, cpu->bus)) return true;
+
+    if (cycle_budget == UINT64_MAX && step_budget == UINT64_MAX) {
+        cpu->stuck = true;
+        return false;
+    }
 
-    /* 2. Decode */
-    opcode_t curr_opcode = fetch_opcode(cpu->cir);
-    addr_mode_t curr_addr_mode = fetch_addr_mode(cpu->cir);
-    ins_type_t curr_ins_type = cat_opcode(curr_opcode);
-    curr_cycles++;
+    /* Every skipped pass must start and end short of both budgets */
+    uint64_t passes = (cycle_budget - *cycles - 1) / pass_cycles;
+    uint64_t by_steps = (step_budget - *steps) / blk->count;
+    uint64_t by_counter = (UINT64_MAX - cpu->total_cycles - *cycles) / pass_cycles;
+    if (passes > by_steps) passes = by_steps;
+    if (passes > by_counter) passes = by_counter;
+
+    *cycles += passes * pass_cycles;
+    *steps += passes * blk->count;
+    cpu->idle_cycles += passes * pass_cycles;
+    return true;
+}
+
+#ifdef CPU_JIT
+/*
+ * Run a whole cached block as native code. Returns the number of
+ * instructions executed, 0 if the block has no translation.
+ */
+static inline uint32_t cpu_run_native(CPU* cpu, Regs* r, const Block* blk,
+                                      uint64_t* cycles, uint64_t cycle_budget,
+                                      uint64_t steps, uint64_t step_budget) {
+    jit_fn fn = jit_code(cpu->jit, blk);
+    if (!fn) return 0;
+
+    uint64_t cycle_room = cycle_budget - *cycles;
+    uint64_t step_room = step_budget - steps;
+    JitCtx ctx = {
+        .a = r->a, .x = r->x, .y = r->y, .sp = r->sp,
+        .nz = r->nz, .p = r->p | r->c | (r->v << 6),
+        .slow = cpu->bus->slow_accesses,
+        .cycle_room = cycle_room > (1u << 30) ? (1u << 30) : (uint32_t)cycle_room,
+        .step_room = step_room > (1u << 30) ? (1u << 30) : (uint32_t)step_room,
+    };
+    uint32_t c = fn(&ctx);
+
+    r->a = ctx.a;
+    r->x = ctx.x;
+    r->y = ctx.y;
+    r->sp = ctx.sp;
+    r->pc = ctx.pc;
+    r->nz = ctx.nz;
+    r->c = ctx.p & FLAG_C;
+    r->v = (ctx.p & FLAG_V) >> 6;
+    r->p = ctx.p & ~(FLAG_N | FLAG_Z | FLAG_C | FLAG_V);
+    *cycles += c + ctx.extra;
+    return ctx.count;
+}
+#endif
+
+/*
+ * Undocumented opcodes the CPU does not implement (all but JAM). The CPU
+ * halts on one before fetching its operand: PC stays on the opcode, and
+ * the step takes no cycles and touches nothing else on the bus.
+ */
+static inline bool cpu_unimplemented(opcode_t op) {
+    return op >= ALR && op < JAM;
+}
+
+static inline void cpu_halt_illegal(CPU* cpu) {
+    cpu->halted = true;
+    cpu->illegal = true;
+}
+
+/*
+ * Execute one decoded instruction whose operand has been fetched; PC
+ * points at the next instruction. With constant arguments (the threaded
+ * handlers) the addressing and instruction switches fold away.
+ * Returns the cycle count.
+ */
+CPU_INLINE uint8_t cpu_exec_decoded(CPU* cpu, Bus* bus, Regs* r,
+                                    opcode_t op, addr_mode_t mode,
+                                    uint8_t base_cycles, uint8_t flags,
+                                    uint16_t operand) {
+    bool cross_page = false;
+    uint8_t curr_cycles = base_cycles;
 
     /* 3. Execute */
     /* 3. a) resolve the address */
-    uint16_t operand = 0;
     uint16_t e_addr = 0;
-    cpu_resolve_ea(cpu, curr_addr_mode, &operand, &e_addr, &cross_page);
-
-    /* 3. b) calculate cycle counts after address resolution */
-    cpu_increment_cycles(curr_addr_mode, curr_opcode, curr_ins_type, cross_page, &curr_cycles);
+    cpu_resolve_ea(bus, r, mode, operand, &e_addr, &cross_page);
 
-    // Handle per operation additional cycle increment
-    cpu_instruction_exec(cpu, &curr_cycles, curr_opcode, curr_addr_mode, operand, e_addr);
+    /* 3. b) reads pay for a page cross; stores and RMW already include it */
+    if (cross_page && !(flags & (OPF_STORE | OPF_RMW)))
+        curr_cycles++;
 
-    /* 4. Update PC */
-    cpu->pc = cpu->mar + 1;
+    /* Only branches add cycles beyond this point */
+    cpu_instruction_exec(cpu, bus, r, &curr_cycles, op, mode, operand, e_addr);
 
     return curr_cycles;
 }
 
-static void cpu_instruction_exec(CPU* cpu, uint8_t* curr_cycles,
-                                 opcode_t opcode, addr_mode_t a_mode,
-                                 uint16_t operand, uint16_t ea) {
+/*
+ * Fetch, decode and execute one instruction. Returns its cycle count;
+ * the instruction is stored in *op.
+ */
+CPU_INLINE uint8_t cpu_exec_one(CPU* cpu, Bus* bus, Regs* r, opcode_t* op) {
+    /* 1. Fetch opcode */
+    uint8_t cir = bus_fetch(bus, r->pc++);
+
+    /* 2. Decode */
+    const opcode_info_t* info = &opcode_info[cir];
+    *op = info->op;
+    if (cpu_unimplemented(info->op)) {
+        r->pc--;
+        cpu_halt_illegal(cpu);
+        return 0;
+    }
+    uint16_t operand = cpu_fetch_operand(bus, r, info->mode);
+
+    return cpu_exec_decoded(cpu, bus, r, info->op, info->mode,
+                            info->cycles, info->flags, operand);
+}
+
+/*
+ * Run loop shared by cpu_step and cpu_run*. Executes until either budget
+ * is used up, the CPU halts, or cpu_stop is called. Interrupt entry counts
+ * as one step. Registers live in locals for the duration.
+ *
+ * Code on direct pages runs from the block cache: opcode and operand
+ * bytes come from the predecoded block instead of the bus. A block is
+ * left early after any slow bus access, since only those can run a device
+ * callback (cpu_stop, interrupt lines) or modify cached code. Blocks end
+ * after CLI and PLP, so a held IRQ is still seen right after them.
+ *
+ * With a profile or call graph every instruction is counted into them
+ * and cached blocks are interpreted rather than run as native code.
+ * Callers pass constant NULLs otherwise, and the counting compiles away.
+ */
+CPU_INLINE uint64_t cpu_execute_blocks(CPU* cpu, uint64_t cycle_budget,
+                                       uint64_t step_budget, Profile* prof,
+                                       CallGraph* graph) {
+    Bus* bus = cpu->bus;
+    BlockCache* cache = cpu->blocks;
+    Regs r = cpu_load_regs(cpu);
+    uint64_t cycles = 0;
+    uint64_t steps = 0;
+
+    cpu->stop_requested = false;
+    while (!cpu->halted && cycles < cycle_budget && steps < step_budget) {
+        bool nmi = graph && (cpu->nmi_pending || (cpu->nmi_line && !cpu->nmi_line_prev));
+        uint8_t c = cpu_poll_interrupts(cpu, &r);
+        if (c) {
+            if (prof) {
+                prof->interrupts++;
+                prof->interrupt_cycles += c;
+            }
+            if (graph) callgraph_interrupt(graph, nmi, r.pc, r.sp, c);
+            cycles += c;
+            steps++;
+            if (cpu->stop_requested) break;
+            continue;
+        }
+
+        const Block* blk = block_cache_lookup(cache, bus, r.pc);
+        if (!blk) {
+            uint16_t at = r.pc;
+            opcode_t op;
+            c = cpu_exec_one(cpu, bus, &r, &op);
+            if (prof) {
+                prof->insns[at]++;
+                prof->cycles[at] += c;
+            }
+            if (graph) callgraph_step(graph, op, r.pc, r.sp, c);
+            cycles += c;
+            steps++;
+            if (cpu->stop_requested) break;
+            continue;
+        }
+
+        uint8_t span = cpu_block_span(blk, cycles, cycle_budget,
+                                      steps, step_budget);
+        /* Exact profiles count every pass: no idle skipping for them */
+        bool idle = !prof && !graph && blk->idle && span == blk->count && cpu->idle_skip;
+        Regs before = r;
+        uint64_t start = cycles;
+#ifdef CPU_JIT
+        uint32_t ran;
+        if (!prof && !graph && span == blk->count
+            && (ran = cpu_run_native(cpu, &r, blk, &cycles, cycle_budget, steps,
+                                     idle ? steps + blk->count : step_budget))) {
+            steps += ran;
+            if (cpu->stop_requested) break;
+            if (idle && ran == blk->count
+                && !cpu_skip_idle(cpu, blk, &before, &r, cycles - start,
+                                  &cycles, cycle_budget, &steps, step_budget))
+                break;
+            continue;
+        }
+#endif
+
+        uint32_t slow = bus->slow_accesses;
+        const BlockInsn* in = blk->insns;
+        const BlockInsn* end = in + span;
+        do {
+            const opcode_info_t* info = &opcode_info[in->opcode];
+            uint16_t at = r.pc;
+            if (cpu_unimplemented(info->op)) {
+                cpu_halt_illegal(cpu);
+                steps++;
+                break;
+            }
+            r.pc += in->length;
+            c = cpu_exec_decoded(cpu, bus, &r, info->op, info->mode,
+                                 in->cycles, info->flags, in->operand);
+            if (prof) {
+                prof->insns[at]++;
+                prof->cycles[at] += c;
+            }
+            if (graph) callgraph_step(graph, info->op, r.pc, r.sp, c);
+            cycles += c;
+            steps++;
+        } while (++in != end && bus->slow_accesses == slow);
+        if (cpu->stop_requested) break;
+        if (idle && in == end
+            && !cpu_skip_idle(cpu, blk, &before, &r, cycles - start,
+                              &cycles, cycle_budget, &steps, step_budget))
+            break;
+    }
+
+    cpu_store_regs(cpu, &r);
+    cpu->total_cycles += cycles;
+    cpu->steps_run = steps;
+    return cycles;
+}
+
+#ifndef CPU_THREADED_DISPATCH
+
+static uint64_t cpu_execute(CPU* cpu, uint64_t cycle_budget,
+                            uint64_t step_budget) {
+    return cpu_execute_blocks(cpu, cycle_budget, step_budget, NULL, NULL);
+}
+
+#else
+
+/* Whether an instruction accesses the bus beyond its own opcode/operand */
+static inline bool cpu_touches_bus(addr_mode_t mode, ins_type_t type) {
+    return !(mode == IMPL || mode == ACC || mode == IMM || mode == REL)
+        || type == STACK;
+}
+
+/*
+ * Threaded variant of the run loop: one handler per opcode byte with the
+ * decode table row baked in, each ending in its own indirect jump to the
+ * next handler so the branch predictor sees per-opcode history.
+ *
+ * Two handler sets are generated: op_XX fetch their operand from the bus
+ * (code outside direct pages), cop_XX take it from the cached block and
+ * chain straight to the next instruction of the block.
+ */
+static uint64_t cpu_execute(CPU* cpu, uint64_t cycle_budget,
+                            uint64_t step_budget) {
+    static void* const handlers[256] = {
+#define OPCODE(byte, op, mode, type, length, cycles, flags) \
+        [byte] = &&op_##byte,
+#include "opcode_table.def"
+#undef OPCODE
+    };
+    static void* const cached_handlers[256] = {
+#define OPCODE(byte, op, mode, type, length, cycles, flags) \
+        [byte] = &&cop_##byte,
+#include "opcode_table.def"
+#undef OPCODE
+    };
+
+    Bus* bus = cpu->bus;
+    BlockCache* cache = cpu->blocks;
+    Regs r = cpu_load_regs(cpu);
+    uint64_t cycles = 0;
+    uint64_t steps = 0;
+    const Block* blk;
+    const BlockInsn* in = NULL;
+    const BlockInsn* end = NULL;
+    uint32_t slow = 0;
+    uint8_t span;
+#ifdef CPU_JIT
+    uint32_t ran;
+#endif
+    uint8_t c;
+    const Block* idle = NULL;       // idle block that just ran a pass
+    Regs before = r;
+    uint64_t start = 0;
+
+    cpu->stop_requested = false;
+
+next:
+    if (idle) {
+        if (in == end && !cpu->stop_requested
+            && !cpu_skip_idle(cpu, idle, &before, &r, cycles - start,
+                              &cycles, cycle_budget, &steps, step_budget))
+            goto done;
+        idle = NULL;
+    }
+    if (cpu->stop_requested || cpu->halted
+        || cycles >= cycle_budget || steps >= step_budget)
+        goto done;
+    steps++;
+    if ((c = cpu_poll_interrupts(cpu, &r)) != 0) {
+        cycles += c;
+        goto next;
+    }
+    blk = block_cache_lookup(cache, bus, r.pc);
+    if (!blk)
+        goto *handlers[bus_fetch(bus, r.pc++)];
+    span = cpu_block_span(blk, cycles, cycle_budget, steps - 1, step_budget);
+    if (blk->idle && span == blk->count && cpu->idle_skip) {
+        idle = blk;
+        before = r;
+        start = cycles;
+    }
+#ifdef CPU_JIT
+    if (span == blk->count
+        && (ran = cpu_run_native(cpu, &r, blk, &cycles, cycle_budget, steps - 1,
+                                 idle ? steps - 1 + blk->count : step_budget))) {
+        steps += ran - 1;
+        /* A whole pass of an idle block, as in == end tells below */
+        in = end = NULL;
+        if (ran != blk->count) idle = NULL;
+        goto next;
+    }
+#endif
+    in = blk->insns;
+    end = in + span;
+    slow = bus->slow_accesses;
+    goto *cached_handlers[in->opcode];
+
+#define OPCODE(byte, op, mode, type, length, base_cycles, flags)            \
+op_##byte:                                                                  \
+    if (cpu_unimplemented(op)) {                                            \
+        r.pc--;                                                             \
+        cpu_halt_illegal(cpu);                                              \
+        goto next;                                                          \
+    }                                                                       \
+    cycles += cpu_exec_decoded(cpu, bus, &r, op, mode, base_cycles, flags,  \
+                               cpu_fetch_operand(bus, &r, mode));           \
+    goto next;                                                              \
+cop_##byte:                                                                 \
+    if (cpu_unimplemented(op)) {                                            \
+        cpu_halt_illegal(cpu);                                              \
+        goto next;                                                          \
+    }                                                                       \
+    r.pc += length;                                                         \
+    cycles += cpu_exec_decoded(cpu, bus, &r, op, mode, base_cycles, flags,  \
+                               in->operand);                                \
+    if (++in == end                                                         \
+        || (cpu_touches_bus(mode, type) && bus->slow_accesses != slow))     \
+        goto next;                                                          \
+    steps++;                                                                \
+    goto *cached_handlers[in->opcode];
+#include "opcode_table.def"
+#undef OPCODE
+
+done:
+    cpu_store_regs(cpu, &r);
+    cpu->total_cycles += cycles;
+    cpu->steps_run = steps;
+    return cycles;
+}
+
+#endif
+
+/* The switch loop with counting, whichever engine is built */
+static uint64_t cpu_execute_profiled(CPU* cpu, uint64_t cycle_budget,
+                                     uint64_t step_budget) {
+    return cpu_execute_blocks(cpu, cycle_budget, step_budget,
+                              cpu->profile, cpu->callgraph);
+}
+
+/* Whether the addressing mode reads or writes a data byte at the ea */
+static inline bool cpu_accesses_data(addr_mode_t mode) {
+    return !(mode == IMPL || mode == ACC || mode == IMM || mode == REL || mode == IND);
+}
+
+/*
+ * Run loop with a tracer or heatmap attached: one step at a time
+ * straight from the bus (no block cache or JIT), recording the state
+ * before each step. Steps are also counted into the profile and call
+ * graph, if set.
+ */
+static uint64_t cpu_execute_traced(CPU* cpu, uint64_t cycle_budget,
+                                   uint64_t step_budget) {
+    Bus* bus = cpu->bus;
+    Regs r = cpu_load_regs(cpu);
+    uint64_t cycles = 0;
+    uint64_t steps = 0;
+
+    cpu->stop_requested = false;
+    while (!cpu->halted && cycles < cycle_budget && steps < step_budget) {
+        TraceRecord rec = {
+            .cycle = cpu->total_cycles + cycles,
+            .pc = r.pc,
+            .a = r.a, .x = r.x, .y = r.y, .sp = r.sp,
+            .p = cpu_pack_status(&r),
+        };
+        bool nmi = cpu->nmi_pending || (cpu->nmi_line && !cpu->nmi_line_prev);
+
+        uint8_t c = cpu_poll_interrupts(cpu, &r);
+        if (c) {
+            rec.kind = nmi ? TRACE_NMI : TRACE_IRQ;
+            rec.ea = r.pc;
+        } else {
+            rec.opcode = bus_fetch(bus, r.pc++);
+            const opcode_info_t* info = &opcode_info[rec.opcode];
+            if (cpu_unimplemented(info->op)) {
+                r.pc--;
+                cpu_halt_illegal(cpu);
+            } else {
+                bool cross_page = false;
+
+                uint16_t operand = cpu_fetch_operand(bus, &r, info->mode);
+                cpu_resolve_ea(bus, &r, info->mode, operand, &rec.ea, &cross_page);
+                rec.operand = operand;
+                if (info->mode == REL) {
+                    rec.operand = operand & 0xFF;
+                    rec.ea = r.pc + operand;
+                }
+                c = info->cycles;
+                if (cross_page && !(info->flags & (OPF_STORE | OPF_RMW)))
+                    c++;
+                cpu_instruction_exec(cpu, bus, &r, &c, info->op, info->mode,
+                                     operand, rec.ea);
+
+                /* The byte the step loaded or stored, unless it is device I/O */
+                const uint8_t* host = bus->pages[rec.ea >> 8].read;
+                if (host && info->type != JUMP && cpu_accesses_data(info->mode)) {
+                    rec.data = host[rec.ea & 0xFF];
+                    rec.flags = TRACE_F_DATA;
+                }
+            }
+        }
+        if (cpu->tracer) tracer_record(cpu->tracer, &rec);
+
+        Profile* prof = cpu->profile;
+        if (prof) {
+            if (rec.kind == TRACE_INSN) {
+                prof->insns[rec.pc]++;
+                prof->cycles[rec.pc] += c;
+            } else {
+                prof->interrupts++;
+                prof->interrupt_cycles += c;
+            }
+        }
+        CallGraph* graph = cpu->callgraph;
+        if (graph) {
+            if (rec.kind == TRACE_INSN)
+                callgraph_step(graph, opcode_info[rec.opcode].op, r.pc, r.sp, c);
+            else
+                callgraph_interrupt(graph, nmi, r.pc, r.sp, c);
+        }
+
+        cycles += c;
+        steps++;
+        if (cpu->stop_requested) break;
+    }
+
+    cpu_store_regs(cpu, &r);
+    cpu->total_cycles += cycles;
+    cpu->steps_run = steps;
+    return cycles;
+}
+
+/* A heatmap needs every access on the bus, which the block cache and JIT skip */
+static inline bool cpu_bus_heat(const CPU* cpu) {
+#ifdef BUS_HEATMAP
+    return cpu->bus->heat != NULL;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+/* Engine for one run call given what is attached */
+static uint64_t cpu_execute_observed(CPU* cpu, uint64_t cycle_budget,
+                                     uint64_t step_budget) {
+    if (cpu->tracer || cpu_bus_heat(cpu))
+        return cpu_execute_traced(cpu, cycle_budget, step_budget);
+    if (cpu->profile || cpu->callgraph)
+        return cpu_execute_profiled(cpu, cycle_budget, step_budget);
+    return cpu_execute(cpu, cycle_budget, step_budget);
+}
+
+/*
+ * Sampling: run the engine with its cycle budget cut at the next sample,
+ * take the sample between runs, and carry on until the caller's budgets
+ * are used up or the run ends early.
+ */
+static uint64_t cpu_execute_sampled(CPU* cpu, uint64_t cycle_budget,
+                                    uint64_t step_budget) {
+    Sampler* s = cpu->sampler;
+    uint64_t cycles = 0;
+    uint64_t steps = 0;
+
+    while (cycles < cycle_budget && steps < step_budget) {
+        uint64_t chunk = sampler_due(s);
+        if (chunk > cycle_budget - cycles) chunk = cycle_budget - cycles;
+
+        uint64_t c = cpu_execute_observed(cpu, chunk, step_budget - steps);
+        cycles += c;
+        steps += cpu->steps_run;
+        sampler_advance(s, c, cpu->bus, cpu->regs.pc, cpu->regs.sp, cpu->callgraph);
+        if (!c || cpu->halted || cpu->stop_requested) break;
+    }
+    cpu->steps_run = steps;
+    return cycles;
+}
+
+/* The engines never see a tracer or profiler: they cost one branch per call */
+static inline uint64_t cpu_dispatch(CPU* cpu, uint64_t cycle_budget,
+                                    uint64_t step_budget) {
+    cpu->stuck = false;
+    if (cpu->observed || cpu_bus_heat(cpu)) {
+        if (cpu->sampler) return cpu_execute_sampled(cpu, cycle_budget, step_budget);
+        return cpu_execute_observed(cpu, cycle_budget, step_budget);
+    }
+    return cpu_execute(cpu, cycle_budget, step_budget);
+}
+
+static void cpu_update_observed(CPU* cpu) {
+    cpu->observed = cpu->tracer || cpu->profile || cpu->callgraph || cpu->sampler;
+}
+
+uint8_t cpu_step(CPU* cpu) {
+    return (uint8_t)cpu_dispatch(cpu, UINT64_MAX, 1);
+}
+
+uint64_t cpu_run(CPU* cpu, uint64_t cycle_budget) {
+    return cpu_dispatch(cpu, cycle_budget, UINT64_MAX);
+}
+
+uint64_t cpu_run_instructions(CPU* cpu, uint64_t count) {
+    return cpu_dispatch(cpu, UINT64_MAX, count);
+}
+
+void cpu_set_tracer(CPU* cpu, Tracer* tracer) {
+    cpu->tracer = tracer;
+    cpu_update_observed(cpu);
+}
+
+void cpu_set_profile(CPU* cpu, Profile* profile) {
+    cpu->profile = profile;
+    cpu_update_observed(cpu);
+}
+
+void cpu_set_callgraph(CPU* cpu, CallGraph* graph) {
+    cpu->callgraph = graph;
+    cpu_update_observed(cpu);
+}
+
+void cpu_set_sampler(CPU* cpu, Sampler* sampler) {
+    cpu->sampler = sampler;
+    cpu_update_observed(cpu);
+}
+
+void cpu_stop(CPU* cpu) {
+    cpu->stop_requested = true;
+}
+
+void cpu_set_idle_skip(CPU* cpu, bool enabled) {
+    cpu->idle_skip = enabled;
+}
+
+uint64_t cpu_get_idle_cycles(CPU* cpu) {
+    return cpu->idle_cycles;
+}
+
+bool cpu_is_stuck(CPU* cpu) {
+    return cpu->stuck;
+}
+
+uint64_t cpu_get_last_steps(CPU* cpu) {
+    return cpu->steps_run;
+}
+
+CPU_INLINE void cpu_instruction_exec(CPU* cpu, Bus* bus, Regs* r,
+                                     uint8_t* curr_cycles,
+                                     opcode_t opcode, addr_mode_t a_mode,
+                                     uint16_t operand, uint16_t ea) {
     uint8_t *src, *dst, val, pcl, pch;
     switch (opcode) {
         /* ==== TRANSFER ==== */
         case LDA: case LDX: case LDY:
             if (a_mode == IMM)      val = operand;
-            else                    val = bus_read(cpu->bus, ea);
+            else                    val = bus_read(bus, ea);
 
-            if (opcode == LDA)      dst = &cpu->a;  //cpu->a = val;
-            if (opcode == LDX)      dst = &cpu->x;  //cpu->x = val;
-            if (opcode == LDY)      dst = &cpu->y;  //cpu->y = val;
+            if (opcode == LDA)      dst = &r->a;  //r->a = val;
+            if (opcode == LDX)      dst = &r->x;  //r->x = val;
+            if (opcode == LDY)      dst = &r->y;  //r->y = val;
 
             *dst = val;
 
-            cpu_set_nz(&cpu->status, *dst);
-            /* Cycle already counted in addressing mode resolution */
+            r->nz = *dst;
             break;
         case STA: case STX: case STY:
-            src = (opcode == STA) ? &cpu->a : 
-                  (opcode == STX) ? &cpu->x : &cpu->y;
-            bus_write(cpu->bus, ea, *src);
-            /* Cycle already counted in addressing mode resolution */
+            src = (opcode == STA) ? &r->a :
+                  (opcode == STX) ? &r->x : &r->y;
+            bus_write(bus, ea, *src);
             break;
         case TAX: case TAY: case TSX: case TXA: case TXS: case TYA:
             // Only TXS does not set flags
-            if (opcode == TAX || opcode == TSX) dst = &cpu->x;
-            if (opcode == TXA || opcode == TYA) dst = &cpu->a;
-            if (opcode == TAY)                  dst = &cpu->y;
-            if (opcode == TXS)                  dst = &cpu->sp;
+            if (opcode == TAX || opcode == TSX) dst = &r->x;
+            if (opcode == TXA || opcode == TYA) dst = &r->a;
+            if (opcode == TAY)                  dst = &r->y;
+            if (opcode == TXS)                  dst = &r->sp;
 
-            if (opcode == TAX || opcode == TAY) src = &cpu->a;
-            if (opcode == TXA || opcode == TXS) src = &cpu->x;
-            if (opcode == TSX)                  src = &cpu->sp;
-            if (opcode == TYA)                  src = &cpu->y;
+            if (opcode == TAX || opcode == TAY) src = &r->a;
+            if (opcode == TXA || opcode == TXS) src = &r->x;
+            if (opcode == TSX)                  src = &r->sp;
+            if (opcode == TYA)                  src = &r->y;
 
             *dst = *src;
 
             if (opcode != TXS) {
-                cpu_set_nz(&cpu->status, *dst);
+                r->nz = *dst;
             }
-            /* Transfer instructions are implied mode: +1 for internal operation */
-            (*curr_cycles)++;
             break;
 
         /* ==== STACK ==== */
         case PHA: case PHP:
-            src = (opcode == PHA) ? &cpu->a : &cpu->status;
-
-            if (opcode == PHP)  val = *src | (FLAG_B | FLAG_U);
-            else                val = *src;
+            if (opcode == PHP)  val = cpu_pack_status(r) | (FLAG_B | FLAG_U);
+            else                val = r->a;
 
-            bus_write(cpu->bus, (0x0100 | (cpu->sp--)), val);
-            (*curr_cycles)++;
-            (*curr_cycles)++;
+            bus_write(bus, (0x0100 | (r->sp--)), val);
             break;
 
         case PLA: case PLP:
-            dst = (opcode == PLA) ? &cpu->a : &cpu->status;
-            val = bus_read(cpu->bus, (0x0100 | (++cpu->sp)));
+            val = bus_read(bus, (0x0100 | (++r->sp)));
 
-            *dst = val;
             if (opcode == PLA) {
-                cpu_set_nz(&cpu->status, *dst);
+                r->a = val;
+                r->nz = val;
+            } else {
+                cpu_unpack_status(r, val);
             }
             /* Discard FLAG_B */
-            cpu->status &= ~FLAG_B;
-            (*curr_cycles)++;
-            (*curr_cycles)++;
-            (*curr_cycles)++;
+            r->p &= ~FLAG_B;
             break;
 
         /* ==== INC / DEC ==== */
         case DEX: case DEY:
-            dst = (opcode == DEX) ? &cpu->x : &cpu->y;
+            dst = (opcode == DEX) ? &r->x : &r->y;
             (*dst)--;
-            cpu_set_nz(&cpu->status, *dst);
-            (*curr_cycles)++;
+            r->nz = *dst;
             break;
         case INX: case INY:
-            dst = (opcode == INX) ? &cpu->x : &cpu->y;
+            dst = (opcode == INX) ? &r->x : &r->y;
             (*dst)++;
-            cpu_set_nz(&cpu->status, *dst);
-            (*curr_cycles)++;
+            r->nz = *dst;
             break;
         case INC: case DEC:
-            val = (opcode == INC) ? bus_read(cpu->bus, ea) + 1 : bus_read(cpu->bus, ea) - 1;
-            (*curr_cycles)++;
+            val = (opcode == INC) ? bus_read(bus, ea) + 1 : bus_read(bus, ea) - 1;
 
-            bus_write(cpu->bus, ea, val);
-            cpu_set_nz(&cpu->status, val);
-            (*curr_cycles)++;
+            bus_write(bus, ea, val);
+            r->nz = val;
             break;
 
         /* ==== ARITHMETIC ==== */
         case ADC: case SBC: {
-            dst = &cpu->a;
+            dst = &r->a;
             if (a_mode == IMM)      val = operand;
-            else                    val = bus_read(cpu->bus, ea);
+            else                    val = bus_read(bus, ea);
             val = (opcode == ADC) ? val : ~val;
 
-            uint8_t a_old = cpu->a;
+            uint8_t a_old = r->a;
             uint8_t old_sign = ((a_old) & 0x80)>>7;
             uint8_t new_sign = ((a_old + val) & 0x80)>>7;
             bool same_sign = (a_old & 0x80) == (val & 0x80);
 
-            *dst += val + (cpu->status & FLAG_C);
+            *dst += val + r->c;
 
-            if (cpu->a < a_old)                         cpu->status |= FLAG_C;
-            else if (opcode == SBC && cpu->a > a_old)   cpu->status &= ~FLAG_C; // Clear carry flag if negative overflow happens
-            if (same_sign && (old_sign != new_sign))    cpu->status |= FLAG_V;
-            cpu_set_nz(&cpu->status, *dst);
+            if (r->a < a_old)                           r->c = 1;
+            else if (opcode == SBC && r->a > a_old)     r->c = 0; // Clear carry flag if negative overflow happens
+            if (same_sign && (old_sign != new_sign))    r->v = 1;
+            r->nz = *dst;
             break;
         }
 
         /* ==== LOGIC ==== */
         case AND: case EOR: case ORA:
-            dst = &cpu->a;
+            dst = &r->a;
             if (a_mode == IMM)      val = operand;
-            else                    val = bus_read(cpu->bus, ea);
-            *dst = (opcode == AND) ? cpu->a & val :
-                   (opcode == EOR) ? cpu->a ^ val :
-                                     cpu->a | val;
+            else                    val = bus_read(bus, ea);
+            *dst = (opcode == AND) ? r->a & val :
+                   (opcode == EOR) ? r->a ^ val :
+                                     r->a | val;
 
-            cpu_set_nz(&cpu->status, *dst);
+            r->nz = *dst;
             break;
 
         /* ==== SHIFT ==== */
         case ASL: case ROL: case LSR: case ROR: {
-            uint8_t carry_set = cpu->status & FLAG_C;
+            uint8_t carry_set = r->c;
             bool will_set_carry = false;
-            if (a_mode == ACC)  val = cpu->a;
-            else                val = bus_read(cpu->bus, ea);
+            if (a_mode == ACC)  val = r->a;
+            else                val = bus_read(bus, ea);
             uint8_t val_old = val;
 
             if (opcode & 1) {   /* LSR or ROR */
@@ -288,299 +963,208 @@ static void cpu_instruction_exec(CPU* cpu, uint8_t* curr_cycles,
                 if (val_old & 0x80)     will_set_carry = true;
             }
 
-            if (a_mode == ACC)  cpu->a = val;
-            else {
-                bus_write(cpu->bus, ea, val);
-                (*curr_cycles)++;
-            }
+            if (a_mode == ACC)  r->a = val;
+            else                bus_write(bus, ea, val);
 
-            if (carry_set)          cpu->status &= ~FLAG_C;
-            if (will_set_carry)     cpu->status |= FLAG_C;
-            cpu_set_nz(&cpu->status, val);
-            (*curr_cycles)++;
+            r->c = will_set_carry;
+            r->nz = val;
             break;
         }
 
         /* ==== FLAGS ==== */
-        case CLC: case CLD: case CLI: case CLV: 
-            dst = &cpu->status;
-            if (opcode == CLC)  *dst &= ~FLAG_C;
-            if (opcode == CLD)  *dst &= ~FLAG_D;
-            if (opcode == CLI)  *dst &= ~FLAG_I;
-            if (opcode == CLV)  *dst &= ~FLAG_V;
-            (*curr_cycles)++;
+        case CLC: case CLD: case CLI: case CLV:
+            if (opcode == CLC)  r->c = 0;
+            if (opcode == CLD)  r->p &= ~FLAG_D;
+            if (opcode == CLI)  r->p &= ~FLAG_I;
+            if (opcode == CLV)  r->v = 0;
             break;
         case SEC: case SED: case SEI:
-            dst = &cpu->status;
-            if (opcode == SEC)  *dst |= FLAG_C;
-            if (opcode == SED)  *dst |= FLAG_D;
-            if (opcode == SEI)  *dst |= FLAG_I;
-            (*curr_cycles)++;
+            if (opcode == SEC)  r->c = 1;
+            if (opcode == SED)  r->p |= FLAG_D;
+            if (opcode == SEI)  r->p |= FLAG_I;
             break;
 
         /* ==== COMPARISONS ==== */
         case CMP: case CPX: case CPY:
-            src = (opcode == CMP) ? &cpu->a :
-                  (opcode == CPX) ? &cpu->x : &cpu->y;
+            src = (opcode == CMP) ? &r->a :
+                  (opcode == CPX) ? &r->x : &r->y;
             if (a_mode == IMM)      val = operand;
-            else                    val = bus_read(cpu->bus, ea);
-            dst = &cpu->status;
+            else                    val = bus_read(bus, ea);
 
+            /* C is set unless the difference is negative; N is only ever set */
             val = *src - val;
-            if (((int8_t)val) < 0) {
-                *dst &= ~(FLAG_C | FLAG_Z);
-                *dst |= (val & 0x80);
-            } else if (val == 0) {
-                *dst |= FLAG_Z | FLAG_C;
-            } else {
-                *dst &= ~FLAG_Z;
-                *dst |= FLAG_C | (val & 0x80);
-            }
+            r->c = !(val & 0x80);
+            r->nz = val | ((r->nz | (r->nz << 1)) & 0x100);
             break;
 
         /* ==== BIT ==== */
         case BIT:
-            src = &cpu->a;
-            dst = &cpu->status;
-            val = bus_read(cpu->bus, ea);
+            val = bus_read(bus, ea);
 
-            *dst = (*dst & ~(FLAG_N | FLAG_V | FLAG_Z))
-                 | ((!(*src & val))<<1)
-                 | (val & 0xC0);
+            /* Z from A & M, N and V straight from bits 7 and 6 of M */
+            r->nz = (r->a & val) | ((val & 0x80) << 1);
+            r->v = (val >> 6) & 1;
             break;
 
         /* ==== CONDITIONAL BRANCH ==== */
-        case BCC: case BCS: case BEQ: case BMI: case BNE: 
+        case BCC: case BCS: case BEQ: case BMI: case BNE:
         case BPL: case BVC: case BVS: {
             bool take_branch = false;
-            val = (int8_t)operand;
-            if (opcode == BCC)  take_branch = !(cpu->status & FLAG_C);
-            if (opcode == BCS)  take_branch = cpu->status & FLAG_C;
-            if (opcode == BEQ)  take_branch = cpu->status & FLAG_Z;
-            if (opcode == BMI)  take_branch = cpu->status & FLAG_N;
-            if (opcode == BNE)  take_branch = !(cpu->status & FLAG_Z);
-            if (opcode == BPL)  take_branch = !(cpu->status & FLAG_N);
-            if (opcode == BVC)  take_branch = !(cpu->status & FLAG_V);
-            if (opcode == BVS)  take_branch = cpu->status & FLAG_V;
-            bool page_cross = ((cpu->mar + (int8_t)val) & 0xFF00) != (cpu->mar & 0xFF00);
+            int8_t offset = (int8_t)operand;
+            if (opcode == BCC)  take_branch = !r->c;
+            if (opcode == BCS)  take_branch = r->c;
+            if (opcode == BEQ)  take_branch = !(r->nz & 0xFF);
+            if (opcode == BMI)  take_branch = r->nz & 0x180;
+            if (opcode == BNE)  take_branch = r->nz & 0xFF;
+            if (opcode == BPL)  take_branch = !(r->nz & 0x180);
+            if (opcode == BVC)  take_branch = !r->v;
+            if (opcode == BVS)  take_branch = r->v;
 
             if (take_branch) {
+                /* Page cross is measured from the operand byte */
+                uint16_t from = r->pc - 1;
                 (*curr_cycles)++;
-                if (page_cross) (*curr_cycles)++;
-                cpu->mar += (int8_t)val;
-            }    
+                if (((from + offset) & 0xFF00) != (from & 0xFF00)) (*curr_cycles)++;
+                r->pc += offset;
+            }
             break;
         }
 
         /* ==== JUMP / SUBROUTINE ==== */
         case JMP:
-            if (a_mode == ABS)  (*curr_cycles)--;
-            cpu->mar = (ea - 1);
+            r->pc = ea;
             break;
         case JSR:
-            /* Push (cpu->mar) hi */
-            bus_write(cpu->bus, (0x0100 | (cpu->sp--)), (((cpu->pc + 2) & 0xFF00)>>8));
-            /* Push (cpu->mar) lo */
-            bus_write(cpu->bus, (0x0100 | (cpu->sp--)), ((cpu->pc + 2) & 0x00FF));
-            cpu->mar = (ea - 1);
-            *curr_cycles += 2;
+            /* Push address of the last JSR byte, hi then lo */
+            bus_write(bus, (0x0100 | (r->sp--)), (((r->pc - 1) & 0xFF00)>>8));
+            bus_write(bus, (0x0100 | (r->sp--)), ((r->pc - 1) & 0x00FF));
+            r->pc = ea;
             break;
         case RTS:
-            pcl = bus_read(cpu->bus, (0x0100 | (++cpu->sp)));
-            pch = bus_read(cpu->bus, (0x0100 | (++cpu->sp)));
-            cpu->mar = ((uint16_t)pch)<<8 | pcl;
-            *curr_cycles += 5;
+            pcl = bus_read(bus, (0x0100 | (++r->sp)));
+            pch = bus_read(bus, (0x0100 | (++r->sp)));
+            r->pc = (((uint16_t)pch)<<8 | pcl) + 1;
             break;
 
         /* ==== INTERRUPTS ==== */
         case BRK:
-            cpu_do_interrupt(cpu, cpu->pc + 2, 0xFFFE, true);
-            cpu->mar = cpu->pc - 1;
-            *curr_cycles += 6;
+            /* BRK skips a padding byte: return address is BRK + 2 */
+            cpu_do_interrupt(bus, r, r->pc + 1, 0xFFFE, true);
             break;
 
         case RTI:
             /* Pull SR, then pull PC */
-            cpu->status = (bus_read(cpu->bus, (0x0100 | (++cpu->sp))) & ~(FLAG_B | FLAG_U));
-            pcl = bus_read(cpu->bus, (0x0100 | (++cpu->sp)));
-            pch = bus_read(cpu->bus, (0x0100 | (++cpu->sp)));
-            cpu->mar = (((uint16_t)pch)<<8 | pcl) - 1;
-            *curr_cycles += 5;
+            cpu_unpack_status(r, bus_read(bus, (0x0100 | (++r->sp))) & ~(FLAG_B | FLAG_U));
+            pcl = bus_read(bus, (0x0100 | (++r->sp)));
+            pch = bus_read(bus, (0x0100 | (++r->sp)));
+            r->pc = ((uint16_t)pch)<<8 | pcl;
             break;
 
         /* ==== NOP ==== */
         case NOP:
-            (*curr_cycles)++;
+            break;
+
+        /* ==== ILLEGAL ==== */
+        case JAM:
+            /* Locks the CPU up on the JAM byte until reset */
+            r->pc--;
+            cpu->halted = true;
             break;
         default:
-            printf("\n[DEBUG:cpu.c] cpu_instruction_exec(): invalid opcode: 0x%02X\n", opcode);
-            exit(1);        // TODO: clean up function before exit?
+            /* Unimplemented opcodes halt before decoding (cpu_unimplemented) */
             break;
     }
     return;
 }
 
-static void cpu_resolve_ea(CPU* cpu, addr_mode_t curr_am, int16_t *operand_ptr, 
-                           uint16_t *ea_ptr, bool *cross_page_ptr) {
-    bool cross_page = false;
+/* Fetch the operand bytes for an addressing mode, advancing PC past them */
+CPU_INLINE uint16_t cpu_fetch_operand(Bus* bus, Regs* r, addr_mode_t curr_am) {
     uint16_t operand = 0;
-    uint16_t e_addr = 0;
     switch (curr_am) {
-        case IMPL: break;   // Handle per instruction..?
-        case ACC:
-            operand = cpu->a;
-            break;
-        case IMM:
-            operand = bus_read(cpu->bus, ++cpu->mar);
+        case IMPL: case ACC:
             break;
         case REL:
-            operand = (int8_t)bus_read(cpu->bus, ++cpu->mar);
+            operand = (int8_t)bus_read(bus, r->pc++);
+            break;
+        case IMM: case ZPG: case ZPG_X: case ZPG_Y:
+        case IND_IDX: case IDX_IND:
+            operand = bus_read(bus, r->pc++);
             break;
         case ABS: case ABS_X: case ABS_Y: case IND:
-            // Get address; increment MAR +2
-            operand = (bus_read(cpu->bus, ++cpu->mar)) 
-                    | (bus_read(cpu->bus, ++cpu->mar)<<8);
-            switch (curr_am) {
-                case ABS:   e_addr = operand;           break;
-                case ABS_X: e_addr = operand + cpu->x;  break; // TODO: how to handle overflow..?
-                case ABS_Y: e_addr = operand + cpu->y;  break;
-                case IND:
-                    e_addr = (bus_read(cpu->bus, operand))
-                           | (bus_read(cpu->bus, (operand & 0xFF00) | ((operand + 1) & 0x00FF))<<8);
-                    break;
-                default:
-                    printf("[DEBUG] cpu.c -> cpu_step(): invalid absolute addressing\n");
-                    exit(1);
-                    break;
-            } 
-            if (curr_am == ABS_X || curr_am == ABS_Y) {
-                cross_page = (e_addr & 0xFF00) != (operand & 0xFF00);
-            }
+            operand = bus_read(bus, r->pc++);
+            operand |= bus_read(bus, r->pc++) << 8;
             break;
-        case ZPG: case ZPG_X: case ZPG_Y:
-        case IND_IDX: case IDX_IND:
-            operand = bus_read(cpu->bus, ++cpu->mar);
-            switch (curr_am) {
-                case ZPG:   e_addr = operand; break;
-                case ZPG_X: e_addr = (operand + cpu->x) & 0x00FF; break;
-                case ZPG_Y: e_addr = (operand + cpu->y) & 0x00FF; break;
-                case IDX_IND:
-                    e_addr = (bus_read(cpu->bus, (operand + cpu->x) & 0x00FF))
-                           | (bus_read(cpu->bus, (operand + cpu->x + 1) & 0x00FF) << 8);
-                    break;
-                case IND_IDX:
-                    e_addr = ((bus_read(cpu->bus, operand))
-                           |  (bus_read(cpu->bus, (operand + 1) & 0xFF) << 8))
-                           +  cpu->y;
-                    cross_page = ((e_addr & 0xFF00)>>8) != (bus_read(cpu->bus, operand + 1));
-                    break;
-                default:
-                    printf("[DEBUG] cpu.c -> cpu_step(): invalid zero-page addressing\n");
-                    exit(1);
-                    break;
-            } break;
         default:
             printf("[DEBUG] cpu.c -> cpu_step(): invalid addressing type\n");
             exit(1);
             break;
     }
-
-    *operand_ptr = operand;
-    *ea_ptr = e_addr;
-    *cross_page_ptr = cross_page;
-    return;
+    return operand;
 }
 
-static void cpu_increment_cycles(addr_mode_t curr_am, opcode_t curr_oc, 
-                                 ins_type_t curr_it, bool cp, uint8_t *c) {
-    /*
-     * Cycle counting based on 6502 reference:
-     *   IMM:          2 (opcode + operand)
-     *   ZPG:          3 (opcode + ZP addr + read)
-     *   ZPG_X/Y:      4 (opcode + ZP addr + index calc + read)
-     *   ABS:          4 (opcode + addr_lo + addr_hi + read)
-     *   ABS_X/Y:      4 or 5 (opcode + addr_lo + addr_hi + read [+1 if page cross])
-     *   (IND,X):      6 (opcode + ptr + index calc + target_lo + target_hi + read)
-     *   (IND),Y:      5 or 6 (opcode + ptr + base_lo + base_hi + read [+1 if page cross])
-     *   IND (JMP):    5 (opcode + addr_lo + addr_hi + target_lo + target_hi)
-     *   IMPL/ACC:     2 (opcode + internal operation)
-     *
-     * Store operations: same as read, but ABS_X/Y and (IND),Y always take the penalty
-     */
-    opcode_t curr_opcode = curr_oc;
-    ins_type_t curr_ins_type = curr_it;
-    addr_mode_t curr_addr_mode = curr_am;
-    uint8_t curr_cycles = 0;
-
-    bool cross_page = cp;
-    bool is_store = (curr_opcode == STA || curr_opcode == STX || curr_opcode == STY);
-    bool is_rmw = (curr_ins_type == SHIFT || curr_ins_type == INCDEC)
-                  && curr_addr_mode != ACC
-                  && curr_addr_mode != IMPL;
-    bool needs_penalty = is_store || is_rmw || cross_page;
-    switch (curr_addr_mode) {
-        case IDX_IND:   /* (IND,X): 6 cycles */
-            curr_cycles += 5;
-            break;
-        case IND_IDX:   /* (IND),Y: 5 cycles (+1 if penalty) */
-            curr_cycles += 4;
-            if (needs_penalty) curr_cycles++;
-            break;
-        case IND:       /* IND (JMP only): 5 cycles */
-            curr_cycles += 4;
-            break;
-        case ABS_X:
-        case ABS_Y:     /* ABS,X/Y: 4 cycles (+1 if penalty) */
-            curr_cycles += 3;
-            if (needs_penalty) curr_cycles++;
-            break;
-        case ABS:       /* ABS: 4 cycles */
-            curr_cycles += 3;
-            break;
-        case ZPG_X:
-        case ZPG_Y:     /* ZPG,X/Y: 4 cycles */
-            curr_cycles += 3;
-            break;
-        case ZPG:       /* ZPG: 3 cycles */
-            curr_cycles += 2;
-            break;
-        case IMM:       /* IMM: 2 cycles */
-        case REL:
-            curr_cycles += 1;
+CPU_INLINE void cpu_resolve_ea(Bus* bus, Regs* r, addr_mode_t curr_am,
+                               uint16_t operand, uint16_t *ea_ptr,
+                               bool *cross_page_ptr) {
+    bool cross_page = false;
+    uint16_t e_addr = 0;
+    uint16_t base;
+    switch (curr_am) {
+        case IMPL: case ACC: case IMM: case REL:
+            break;
+        case ABS:   e_addr = operand;           break;
+        case ABS_X: e_addr = operand + r->x;    break; // wraps at $FFFF
+        case ABS_Y: e_addr = operand + r->y;    break;
+        case IND:
+            /* NMOS bug: the pointer high byte never crosses a page */
+            e_addr = (bus_read(bus, operand))
+                   | (bus_read(bus, (operand & 0xFF00) | ((operand + 1) & 0x00FF))<<8);
             break;
-        case ACC:
-        case IMPL:      /* Implied/Accumulator: handled in instruction exec */
+        case ZPG:   e_addr = operand; break;
+        case ZPG_X: e_addr = (operand + r->x) & 0x00FF; break;
+        case ZPG_Y: e_addr = (operand + r->y) & 0x00FF; break;
+        case IDX_IND:
+            e_addr = (bus_read(bus, (operand + r->x) & 0x00FF))
+                   | (bus_read(bus, (operand + r->x + 1) & 0x00FF) << 8);
+            break;
+        case IND_IDX:
+            base = (bus_read(bus, operand))
+                 | (bus_read(bus, (operand + 1) & 0xFF) << 8);
+            e_addr = base + r->y;
+            cross_page = (e_addr & 0xFF00) != (base & 0xFF00);
             break;
         default:
             printf("[DEBUG] cpu.c -> cpu_step(): invalid addressing type\n");
             exit(1);
             break;
     }
+    if (curr_am == ABS_X || curr_am == ABS_Y) {
+        cross_page = (e_addr & 0xFF00) != (operand & 0xFF00);
+    }
 
-    (*c) += curr_cycles;
+    *ea_ptr = e_addr;
+    *cross_page_ptr = cross_page;
     return;
 }
 
-
-static uint8_t cpu_do_interrupt(CPU* cpu, uint16_t return_addr,
+static uint8_t cpu_do_interrupt(Bus* bus, Regs* r, uint16_t return_addr,
                                 uint16_t vector, bool is_brk) {
     /* Push return address high then low */
-    bus_write(cpu->bus, (0x0100 | (cpu->sp--)), ((return_addr & 0xFF00) >> 8));
-    bus_write(cpu->bus, (0x0100 | (cpu->sp--)), (return_addr & 0x00FF));
+    bus_write(bus, (0x0100 | (r->sp--)), ((return_addr & 0xFF00) >> 8));
+    bus_write(bus, (0x0100 | (r->sp--)), (return_addr & 0x00FF));
 
     /* Push status: B set for BRK, clear for hardware interrupts; U always set */
-    uint8_t pushed_status = cpu->status | FLAG_U;
+    uint8_t pushed_status = cpu_pack_status(r) | FLAG_U;
     if (is_brk) pushed_status |= FLAG_B;
     else        pushed_status &= ~FLAG_B;
-    bus_write(cpu->bus, (0x0100 | (cpu->sp--)), pushed_status);
+    bus_write(bus, (0x0100 | (r->sp--)), pushed_status);
 
     /* Set interrupt disable */
-    cpu->status |= FLAG_I;
+    r->p |= FLAG_I;
 
     /* Load PC from vector */
-    uint8_t pcl = bus_read(cpu->bus, vector);
-    uint8_t pch = bus_read(cpu->bus, vector + 1);
-    cpu->pc = ((uint16_t)pch << 8) | pcl;
+    uint8_t pcl = bus_read(bus, vector);
+    uint8_t pch = bus_read(bus, vector + 1);
+    r->pc = ((uint16_t)pch << 8) | pcl;
 
     return 7;
 }
@@ -601,18 +1185,136 @@ void cpu_irq_release(CPU* cpu) {
     cpu->irq_line = false;
 }
 
-uint8_t  cpu_get_a(CPU* cpu)      { return cpu->a; }
-uint8_t  cpu_get_x(CPU* cpu)      { return cpu->x; }
-uint8_t  cpu_get_y(CPU* cpu)      { return cpu->y; }
-uint8_t  cpu_get_sp(CPU* cpu)     { return cpu->sp; }
-uint16_t cpu_get_pc(CPU* cpu)     { return cpu->pc; }
-uint8_t  cpu_get_status(CPU* cpu) { return cpu->status; }
+bool cpu_interrupt_requested(CPU* cpu) {
+    return cpu->irq_line || cpu->nmi_pending || cpu->nmi_line != cpu->nmi_line_prev;
+}
 
-void cpu_set_a(CPU* cpu, uint8_t val)       { cpu->a = val; }
-void cpu_set_x(CPU* cpu, uint8_t val)       { cpu->x = val; }
-void cpu_set_y(CPU* cpu, uint8_t val)       { cpu->y = val; }
-void cpu_set_sp(CPU* cpu, uint8_t val)      { cpu->sp = val; }
-void cpu_set_pc(CPU* cpu, uint16_t val)     { cpu->pc = val; }
-void cpu_set_status(CPU* cpu, uint8_t val)  { cpu->status = val; }
+uint8_t  cpu_get_a(CPU* cpu)      { return cpu->regs.a; }
+uint8_t  cpu_get_x(CPU* cpu)      { return cpu->regs.x; }
+uint8_t  cpu_get_y(CPU* cpu)      { return cpu->regs.y; }
+uint8_t  cpu_get_sp(CPU* cpu)     { return cpu->regs.sp; }
+uint16_t cpu_get_pc(CPU* cpu)     { return cpu->regs.pc; }
+uint8_t  cpu_get_status(CPU* cpu) { return cpu_pack_status(&cpu->regs); }
+uint64_t cpu_get_total_cycles(CPU* cpu) { return cpu->total_cycles; }
+bool     cpu_is_halted(CPU* cpu)  { return cpu->halted; }
+bool     cpu_is_illegal(CPU* cpu) { return cpu->illegal; }
+
+void cpu_set_a(CPU* cpu, uint8_t val)       { cpu->regs.a = val; }
+void cpu_set_x(CPU* cpu, uint8_t val)       { cpu->regs.x = val; }
+void cpu_set_y(CPU* cpu, uint8_t val)       { cpu->regs.y = val; }
+void cpu_set_sp(CPU* cpu, uint8_t val)      { cpu->regs.sp = val; }
+void cpu_set_pc(CPU* cpu, uint16_t val)     { cpu->regs.pc = val; }
+void cpu_set_status(CPU* cpu, uint8_t val)  { cpu_unpack_status(&cpu->regs, val); }
+void cpu_set_total_cycles(CPU* cpu, uint64_t val) { cpu->total_cycles = val; }
 
 Bus* cpu_get_bus(CPU* cpu) { return cpu->bus; }
+
+void cpu_get_state(CPU* cpu, CPUState* state) {
+    state->a             = cpu->regs.a;
+    state->x             = cpu->regs.x;
+    state->y             = cpu->regs.y;
+    state->sp            = cpu->regs.sp;
+    state->p             = cpu_pack_status(&cpu->regs);
+    state->pc            = cpu->regs.pc;
+    state->total_cycles  = cpu->total_cycles;
+    state->halted        = cpu->halted;
+    state->illegal       = cpu->illegal;
+    state->nmi_line      = cpu->nmi_line;
+    state->nmi_line_prev = cpu->nmi_line_prev;
+    state->nmi_pending   = cpu->nmi_pending;
+    state->irq_line      = cpu->irq_line;
+}
+
+void cpu_set_state(CPU* cpu, const CPUState* state) {
+    cpu->regs.a         = state->a;
+    cpu->regs.x         = state->x;
+    cpu->regs.y         = state->y;
+    cpu->regs.sp        = state->sp;
+    cpu_unpack_status(&cpu->regs, state->p);
+    cpu->regs.pc        = state->pc;
+    cpu->total_cycles   = state->total_cycles;
+    cpu->halted         = state->halted;
+    cpu->illegal        = state->illegal;
+    cpu->stop_requested = false;
+    cpu->nmi_line       = state->nmi_line;
+    cpu->nmi_line_prev  = state->nmi_line_prev;
+    cpu->nmi_pending    = state->nmi_pending;
+    cpu->irq_line       = state->irq_line;
+}
+
+/* ========================= Snapshots ========================= */
+
+struct Snapshot {
+    Regs     regs;
+    uint64_t total_cycles;
+    bool     halted;
+    bool     illegal;
+    bool     nmi_line;
+    bool     nmi_line_prev;
+    bool     nmi_pending;
+    bool     irq_line;
+    PageSet  mem;
+    uint8_t* devices;       // bus_save_state buffer, NULL if no device has state
+    size_t   devices_size;
+};
+
+Snapshot* cpu_snapshot(CPU* cpu) {
+    Snapshot* snap = malloc(sizeof(Snapshot));
+    if (!snap) {
+        printf("Failed to allocate snapshot\n");
+        exit(1);
+    }
+    if (!cpu->pages) cpu->pages = page_tracker_create();
+
+    snap->regs          = cpu->regs;
+    snap->total_cycles  = cpu->total_cycles;
+    snap->halted        = cpu->halted;
+    snap->illegal       = cpu->illegal;
+    snap->nmi_line      = cpu->nmi_line;
+    snap->nmi_line_prev = cpu->nmi_line_prev;
+    snap->nmi_pending   = cpu->nmi_pending;
+    snap->irq_line      = cpu->irq_line;
+    page_tracker_capture(cpu->pages, cpu->bus, &snap->mem);
+
+    snap->devices_size = bus_state_size(cpu->bus);
+    snap->devices = NULL;
+    if (snap->devices_size) {
+        snap->devices = malloc(snap->devices_size);
+        if (!snap->devices) {
+            printf("Failed to allocate snapshot\n");
+            exit(1);
+        }
+        bus_save_state(cpu->bus, snap->devices);
+    }
+    return snap;
+}
+
+void cpu_restore(CPU* cpu, const Snapshot* snap) {
+    if (!cpu->pages) cpu->pages = page_tracker_create();
+
+    cpu->regs           = snap->regs;
+    cpu->total_cycles   = snap->total_cycles;
+    cpu->halted         = snap->halted;
+    cpu->illegal        = snap->illegal;
+    cpu->stop_requested = false;
+    cpu->nmi_line       = snap->nmi_line;
+    cpu->nmi_line_prev  = snap->nmi_line_prev;
+    cpu->nmi_pending    = snap->nmi_pending;
+    cpu->irq_line       = snap->irq_line;
+    page_tracker_restore(cpu->pages, cpu->bus, &snap->mem);
+
+    /* Devices are only restored onto a bus with the same layout */
+    if (snap->devices && bus_state_size(cpu->bus) == snap->devices_size)
+        bus_restore_state(cpu->bus, snap->devices);
+}
+
+void cpu_snapshot_free(Snapshot* snap) {
+    if (!snap) return;
+    page_set_release(&snap->mem);
+    free(snap->devices);
+    free(snap);
+}
+
+uint64_t cpu_snapshot_page_copies(CPU* cpu) {
+    return cpu->pages ? page_tracker_copies(cpu->pages) : 0;
+}
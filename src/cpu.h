@@ -16,15 +16,78 @@ typedef struct CPU CPU;
 
 CPU*    cpu_create(Bus* bus);
 void    cpu_destroy(CPU* cpu);
-void    cpu_reset(CPU* cpu);
+void    cpu_reset(CPU* cpu);     // also resets devices (bus_reset_devices)
 
-uint8_t cpu_step(CPU* cpu);
+uint8_t  cpu_step(CPU* cpu);
+
+/*
+ * Batch execution: run until the budget is used up, the CPU halts (JAM)
+ * or cpu_stop is called (e.g. from a device callback). The last
+ * instruction may overshoot a cycle budget. Returns cycles consumed.
+ */
+uint64_t cpu_run(CPU* cpu, uint64_t cycle_budget);
+uint64_t cpu_run_instructions(CPU* cpu, uint64_t count);
+void     cpu_stop(CPU* cpu);
+
+/* Steps (instructions or interrupt entries) taken by the last step or run call */
+uint64_t cpu_get_last_steps(CPU* cpu);
+
+/*
+ * Idle loops (LDA $xx / BEQ loop, JMP *) that read only direct memory
+ * and write nothing are skipped to the end of the run budget once a
+ * pass changes no register, with cycles and steps counted exactly as
+ * if they had run. On by default; cpu_get_idle_cycles is the total
+ * skipped since cpu_create. A run with no budget at all (both
+ * UINT64_MAX) stops at such a loop instead, which cpu_is_stuck reports
+ * until the next run.
+ */
+void     cpu_set_idle_skip(CPU* cpu, bool enabled);
+uint64_t cpu_get_idle_cycles(CPU* cpu);
+bool     cpu_is_stuck(CPU* cpu);
+
+/*
+ * Record every step into a tracer (trace.h), NULL to stop. While one is
+ * set the CPU runs one instruction at a time without the block cache or
+ * JIT; without one, tracing costs a single branch per run call. The
+ * tracer is not owned and must outlive its use.
+ */
+typedef struct Tracer Tracer;
+void     cpu_set_tracer(CPU* cpu, Tracer* tracer);
+
+/*
+ * Count every instruction into a profile (profile.h), NULL to stop.
+ * While one is set the CPU runs the block cache interpreter whatever the
+ * build's engine, without JIT; with a tracer too, the traced loop counts.
+ * The profile is not owned and must outlive its use.
+ */
+typedef struct Profile Profile;
+void     cpu_set_profile(CPU* cpu, Profile* profile);
+
+/*
+ * Attribute cycles to call paths in a call graph (callgraph.h), NULL to
+ * stop. Runs the same instrumented loop as a profile; the two can be
+ * attached together. Not owned; must outlive its use.
+ */
+typedef struct CallGraph CallGraph;
+void     cpu_set_callgraph(CPU* cpu, CallGraph* graph);
+
+/*
+ * Sample PC and call stack every sample period (sampler.h), NULL
+ * to stop. Runs split at sample points but otherwise use the normal
+ * engine, JIT included, or whatever the other hooks above select. Not
+ * owned; must outlive its use.
+ */
+typedef struct Sampler Sampler;
+void     cpu_set_sampler(CPU* cpu, Sampler* sampler);
 
 void    cpu_nmi(CPU* cpu);
 void    cpu_nmi_release(CPU* cpu);
 void    cpu_irq(CPU* cpu);
 void    cpu_irq_release(CPU* cpu);
 
+/* An NMI edge or the IRQ line is pending: the next step may enter a handler */
+bool    cpu_interrupt_requested(CPU* cpu);
+
 /* Accessors for testing */
 uint8_t  cpu_get_a(CPU* cpu);
 uint8_t  cpu_get_x(CPU* cpu);
@@ -32,6 +95,9 @@ uint8_t  cpu_get_y(CPU* cpu);
 uint8_t  cpu_get_sp(CPU* cpu);
 uint16_t cpu_get_pc(CPU* cpu);
 uint8_t  cpu_get_status(CPU* cpu);
+uint64_t cpu_get_total_cycles(CPU* cpu);
+bool     cpu_is_halted(CPU* cpu);
+bool     cpu_is_illegal(CPU* cpu);   // halted on an unimplemented opcode, PC on it
 
 void     cpu_set_a(CPU* cpu, uint8_t val);
 void     cpu_set_x(CPU* cpu, uint8_t val);
@@ -39,7 +105,42 @@ void     cpu_set_y(CPU* cpu, uint8_t val);
 void     cpu_set_sp(CPU* cpu, uint8_t val);
 void     cpu_set_pc(CPU* cpu, uint16_t val);
 void     cpu_set_status(CPU* cpu, uint8_t val);
+void     cpu_set_total_cycles(CPU* cpu, uint64_t val);
 
 Bus*     cpu_get_bus(CPU* cpu);
 
+/* Everything but memory and devices, for save states and migration */
+typedef struct {
+    uint8_t  a, x, y, sp, p;
+    uint16_t pc;
+    uint64_t total_cycles;
+    bool     halted;
+    bool     illegal;
+    bool     nmi_line;
+    bool     nmi_line_prev;
+    bool     nmi_pending;
+    bool     irq_line;
+} CPUState;
+
+void     cpu_get_state(CPU* cpu, CPUState* state);
+void     cpu_set_state(CPU* cpu, const CPUState* state);
+
+/*
+ * Snapshots: registers, interrupt lines, cycle counter, every whole
+ * direct page of writable memory and the state of devices mapped with
+ * state hooks (bus_map_device). Pages are shared copy-on-write between
+ * snapshots, so taking or restoring one copies only pages written since
+ * the last snapshot or restore on this CPU. A snapshot may be restored
+ * any number of times, onto any CPU whose bus has the same layout.
+ * Not callable from device callbacks during cpu_run.
+ */
+typedef struct Snapshot Snapshot;
+
+Snapshot* cpu_snapshot(CPU* cpu);
+void      cpu_restore(CPU* cpu, const Snapshot* snap);
+void      cpu_snapshot_free(Snapshot* snap);
+
+/* Pages copied by this CPU's snapshots and restores so far */
+uint64_t  cpu_snapshot_page_copies(CPU* cpu);
+
 #endif
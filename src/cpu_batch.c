@@ -0,0 +1,578 @@
+#include "cpu_batch.h"
+#include "opcodes.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Lanes per group. GCC/Clang vector extensions lower these types to SSE
+ * registers by default and to AVX2 when it is enabled.
+ */
+#if defined(__AVX2__)
+#define LANES 32
+#else
+#define LANES 16
+#endif
+
+typedef uint8_t  lane8   __attribute__((vector_size(LANES)));
+typedef int8_t   lane8s  __attribute__((vector_size(LANES)));
+typedef uint16_t lane16  __attribute__((vector_size(LANES * 2)));
+typedef int16_t  lane16s __attribute__((vector_size(LANES * 2)));
+typedef uint64_t lane64  __attribute__((vector_size(LANES * 8)));
+
+/* Most cycles one step can take: 7 base + page cross, or an interrupt entry */
+#define MAX_STEP_CYCLES 8
+
+/* Masks are all-ones in selected lanes, zero elsewhere */
+#define BLEND(dst, src, m)  ((dst) = ((dst) & ~(m)) | ((src) & (m)))
+
+/* Macros rather than functions: wide vectors cannot cross a call ABI-neutrally */
+#define SPLAT8(k)       ((lane8){0} + (uint8_t)(k))
+#define SPLAT16(k)      ((lane16){0} + (uint16_t)(k))
+#define SPLAT64(k)      ((lane64){0} + (uint64_t)(k))
+#define WIDEN(v)        __builtin_convertvector((v), lane16)
+#define WIDEN_MASK(m)   ((lane16)__builtin_convertvector((lane8s)(m), lane16s))
+#define NARROW_MASK(m)  ((lane8)__builtin_convertvector((lane16s)(m), lane8s))
+
+/* Bit i set for each selected lane i */
+static inline uint32_t lane_bits(lane8 m) {
+#if defined(__AVX2__)
+    return (uint32_t)_mm256_movemask_epi8((__m256i)m);
+#elif defined(__SSE2__)
+    return (uint32_t)_mm_movemask_epi8((__m128i)m);
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < LANES; i++)
+        if (m[i]) bits |= 1u << i;
+    return bits;
+#endif
+}
+
+/*
+ * Registers of one group of lanes. Flags use the core's lazy layout:
+ * N and Z as the last result in nz, C and V as 0/1, the rest in p.
+ */
+typedef struct {
+    lane8    a, x, y, sp;
+    lane8    c, v, p;
+    lane16   pc, nz;
+    lane64   cycles;            // consumed in the current run
+    lane8    live;              // lane exists, not halted, budget left
+    lane8    scalar;            // interrupt requested: step through the CPU
+    CPU*     cpu[LANES];
+    Bus*     bus[LANES];
+} LaneGroup;
+
+struct CPUBatch {
+    LaneGroup* groups;
+    size_t     group_count;
+    size_t     lanes;
+    uint64_t   scalar_steps;
+};
+
+CPUBatch* cpu_batch_create(CPU** cpus, size_t count) {
+    CPUBatch* b = malloc(sizeof(CPUBatch));
+    if (!b) {
+        printf("Failed to init cpu batch\n");
+        exit(1);
+    }
+    b->lanes = count;
+    b->group_count = (count + LANES - 1) / LANES;
+    b->scalar_steps = 0;
+    b->groups = aligned_alloc(_Alignof(LaneGroup),
+                              (b->group_count ? b->group_count : 1) * sizeof(LaneGroup));
+    if (!b->groups) {
+        printf("Failed to init cpu batch\n");
+        exit(1);
+    }
+    memset(b->groups, 0, b->group_count * sizeof(LaneGroup));
+    for (size_t i = 0; i < count; i++) {
+        LaneGroup* g = &b->groups[i / LANES];
+        g->cpu[i % LANES] = cpus[i];
+        g->bus[i % LANES] = cpu_get_bus(cpus[i]);
+    }
+    return b;
+}
+
+void cpu_batch_destroy(CPUBatch* batch) {
+    if (!batch) return;
+    free(batch->groups);
+    free(batch);
+    return;
+}
+
+/* ========================= Lane <-> CPU ========================= */
+
+static uint8_t lane_status(const LaneGroup* g, int i) {
+    return g->p[i] | g->c[i] | (g->v[i] << 6)
+         | ((g->nz[i] & 0xFF) ? 0 : FLAG_Z) | ((g->nz[i] & 0x180) ? FLAG_N : 0);
+}
+
+static void lane_set_status(LaneGroup* g, int i, uint8_t status) {
+    g->nz[i] = ((status & FLAG_Z) ? 0 : 1) | ((status & FLAG_N) ? 0x100 : 0);
+    g->c[i] = status & FLAG_C;
+    g->v[i] = (status & FLAG_V) >> 6;
+    g->p[i] = status & ~(FLAG_N | FLAG_Z | FLAG_C | FLAG_V);
+}
+
+static void lane_load(LaneGroup* g, int i) {
+    CPU* cpu = g->cpu[i];
+    g->a[i] = cpu_get_a(cpu);
+    g->x[i] = cpu_get_x(cpu);
+    g->y[i] = cpu_get_y(cpu);
+    g->sp[i] = cpu_get_sp(cpu);
+    g->pc[i] = cpu_get_pc(cpu);
+    lane_set_status(g, i, cpu_get_status(cpu));
+}
+
+static void lane_store(const LaneGroup* g, int i) {
+    CPU* cpu = g->cpu[i];
+    cpu_set_a(cpu, g->a[i]);
+    cpu_set_x(cpu, g->x[i]);
+    cpu_set_y(cpu, g->y[i]);
+    cpu_set_sp(cpu, g->sp[i]);
+    cpu_set_pc(cpu, g->pc[i]);
+    cpu_set_status(cpu, lane_status(g, i));
+}
+
+/* Run one instruction (or interrupt entry) of a lane on its own CPU */
+static void lane_scalar_step(CPUBatch* b, LaneGroup* g, int i) {
+    CPU* cpu = g->cpu[i];
+    lane_store(g, i);
+    g->cycles[i] += cpu_step(cpu);
+    lane_load(g, i);
+    g->scalar[i] = cpu_interrupt_requested(cpu) ? 0xFF : 0;
+    if (cpu_is_halted(cpu)) g->live[i] = 0;
+    b->scalar_steps++;
+}
+
+/* ========================= Execute ========================= */
+
+static inline void lanes_store(LaneGroup* g, const lane16* ea, uint32_t lanes, lane8 val) {
+    for (; lanes; lanes &= lanes - 1) {
+        int i = __builtin_ctz(lanes);
+        bus_write(g->bus[i], (*ea)[i], val[i]);
+    }
+}
+
+static inline void lane_push(LaneGroup* g, int i, uint8_t val) {
+    uint8_t sp = g->sp[i];
+    bus_write(g->bus[i], 0x0100 | sp, val);
+    g->sp[i] = sp - 1;
+}
+
+static inline uint8_t lane_pull(LaneGroup* g, int i) {
+    uint8_t sp = g->sp[i] + 1;
+    g->sp[i] = sp;
+    return bus_read(g->bus[i], 0x0100 | sp);
+}
+
+/*
+ * Per-lane part of address resolution: pointer reads for the indirect
+ * modes, then the direct-page check and operand read at ea. Lanes that
+ * would touch a page without a direct mapping are returned; nothing is
+ * read from such a page.
+ */
+static uint32_t lanes_resolve(LaneGroup* g, const opcode_info_t* info, uint16_t operand,
+                              uint32_t lanes, lane16* ea, lane8* val, lane8* cross) {
+    uint32_t drop = 0;
+    bool uses_ea = !(info->mode == IMPL || info->mode == ACC
+                     || info->mode == IMM || info->mode == REL)
+                && info->type != JUMP && info->type != NOP_T;
+    bool reads = uses_ea && !(info->flags & OPF_STORE);
+    bool stack = info->type == STACK || info->op == JSR || info->op == RTS;
+    bool indirect = info->mode == IND || info->mode == IDX_IND || info->mode == IND_IDX;
+
+    if (!uses_ea && !stack && !indirect) return drop;
+
+    for (; lanes; lanes &= lanes - 1) {
+        int i = __builtin_ctz(lanes);
+        Bus* bus = g->bus[i];
+        uint16_t base;
+
+        /* Same pointer arithmetic as cpu_resolve_ea */
+        switch (info->mode) {
+            case IND:
+                /* Both pointer bytes sit on the operand's page (NMOS bug) */
+                if (!bus->pages[operand >> 8].read) { drop |= 1u << i; continue; }
+                (*ea)[i] = bus_read(bus, operand)
+                         | (bus_read(bus, (operand & 0xFF00) | ((operand + 1) & 0x00FF)) << 8);
+                break;
+            case IDX_IND:
+                if (!bus->pages[0].read) { drop |= 1u << i; continue; }
+                (*ea)[i] = bus_read(bus, (operand + g->x[i]) & 0x00FF)
+                         | (bus_read(bus, (operand + g->x[i] + 1) & 0x00FF) << 8);
+                break;
+            case IND_IDX:
+                if (!bus->pages[0].read) { drop |= 1u << i; continue; }
+                base = bus_read(bus, operand)
+                     | (bus_read(bus, (operand + 1) & 0x00FF) << 8);
+                (*ea)[i] = base + g->y[i];
+                (*cross)[i] = ((*ea)[i] & 0xFF00) != (base & 0xFF00);
+                break;
+            default:
+                break;
+        }
+
+        if (stack && !bus->pages[0x01].read) { drop |= 1u << i; continue; }
+        if (uses_ea) {
+            const uint8_t* page = bus->pages[(*ea)[i] >> 8].read;
+            if (!page) { drop |= 1u << i; continue; }
+            if (reads) (*val)[i] = page[(*ea)[i] & 0xFF];
+        }
+    }
+    return drop;
+}
+
+/*
+ * Execute one instruction on the lanes in m, which all sit at the same
+ * PC with the same code bytes. Register and flag updates are vector
+ * operations; memory goes lane by lane through each bus. Mirrors
+ * cpu_instruction_exec, quirks included.
+ */
+static void group_exec(CPUBatch* b, LaneGroup* g, const uint8_t* bytes, lane8 m) {
+    const opcode_info_t* info = &opcode_info[bytes[0]];
+    opcode_t op = info->op;
+    uint16_t operand = 0;
+    if (info->length == 2)
+        operand = (info->mode == REL) ? (uint16_t)(int8_t)bytes[1] : bytes[1];
+    else if (info->length == 3)
+        operand = bytes[1] | (bytes[2] << 8);
+
+    /* Uniform part of the address; indexing and pointers per lane */
+    lane16 ea = SPLAT16(operand);
+    lane8 val = SPLAT8(operand);
+    lane8 cross = {0};
+    switch (info->mode) {
+        case ZPG_X: ea = (ea + WIDEN(g->x)) & 0x00FF; break;
+        case ZPG_Y: ea = (ea + WIDEN(g->y)) & 0x00FF; break;
+        case ABS_X: case ABS_Y:
+            ea += WIDEN(info->mode == ABS_X ? g->x : g->y);
+            cross = NARROW_MASK((lane16)(((ea ^ SPLAT16(operand)) & 0xFF00) != 0)) & 1;
+            break;
+        default:
+            break;
+    }
+    uint32_t lanes = lane_bits(m);
+    uint32_t drop = lanes_resolve(g, info, operand, lanes, &ea, &val, &cross);
+    if (drop) {
+        lanes &= ~drop;
+        for (uint32_t d = drop; d; d &= d - 1) m[__builtin_ctz(d)] = 0;
+    }
+
+    lane16 m16 = WIDEN_MASK(m);
+    lane8 res;
+    lane8 cycles = SPLAT8(info->cycles);
+    lane16 next = g->pc + SPLAT16(info->length);
+
+    if (!(info->flags & (OPF_STORE | OPF_RMW)))
+        cycles += cross;
+
+    switch (op) {
+        /* ==== TRANSFER ==== */
+        case LDA: BLEND(g->a, val, m); BLEND(g->nz, WIDEN(val), m16); break;
+        case LDX: BLEND(g->x, val, m); BLEND(g->nz, WIDEN(val), m16); break;
+        case LDY: BLEND(g->y, val, m); BLEND(g->nz, WIDEN(val), m16); break;
+        case STA: lanes_store(g, &ea, lanes, g->a); break;
+        case STX: lanes_store(g, &ea, lanes, g->x); break;
+        case STY: lanes_store(g, &ea, lanes, g->y); break;
+        case TAX: BLEND(g->x, g->a, m);  BLEND(g->nz, WIDEN(g->a), m16);  break;
+        case TAY: BLEND(g->y, g->a, m);  BLEND(g->nz, WIDEN(g->a), m16);  break;
+        case TSX: BLEND(g->x, g->sp, m); BLEND(g->nz, WIDEN(g->sp), m16); break;
+        case TXA: BLEND(g->a, g->x, m);  BLEND(g->nz, WIDEN(g->x), m16);  break;
+        case TYA: BLEND(g->a, g->y, m);  BLEND(g->nz, WIDEN(g->y), m16);  break;
+        case TXS: BLEND(g->sp, g->x, m); break;
+
+        /* ==== STACK ==== */
+        case PHA:
+            for (uint32_t l = lanes; l; l &= l - 1)
+                lane_push(g, __builtin_ctz(l), g->a[__builtin_ctz(l)]);
+            break;
+        case PHP:
+            for (uint32_t l = lanes; l; l &= l - 1)
+                lane_push(g, __builtin_ctz(l), lane_status(g, __builtin_ctz(l)) | FLAG_B | FLAG_U);
+            break;
+        case PLA:
+            for (uint32_t l = lanes; l; l &= l - 1) {
+                int i = __builtin_ctz(l);
+                g->a[i] = lane_pull(g, i);
+                g->nz[i] = g->a[i];
+                g->p[i] &= ~FLAG_B;
+            }
+            break;
+        case PLP:
+            for (uint32_t l = lanes; l; l &= l - 1) {
+                int i = __builtin_ctz(l);
+                lane_set_status(g, i, lane_pull(g, i));
+                g->p[i] &= ~FLAG_B;
+            }
+            break;
+
+        /* ==== INC / DEC ==== */
+        case DEX: res = g->x - 1; BLEND(g->x, res, m); BLEND(g->nz, WIDEN(res), m16); break;
+        case DEY: res = g->y - 1; BLEND(g->y, res, m); BLEND(g->nz, WIDEN(res), m16); break;
+        case INX: res = g->x + 1; BLEND(g->x, res, m); BLEND(g->nz, WIDEN(res), m16); break;
+        case INY: res = g->y + 1; BLEND(g->y, res, m); BLEND(g->nz, WIDEN(res), m16); break;
+        case INC: case DEC:
+            res = (op == INC) ? val + 1 : val - 1;
+            lanes_store(g, &ea, lanes, res);
+            BLEND(g->nz, WIDEN(res), m16);
+            break;
+
+        /* ==== ARITHMETIC ==== */
+        case ADC: case SBC: {
+            lane8 in = (op == ADC) ? val : ~val;
+            lane8 a_old = g->a;
+            lane8 sum = a_old + in;
+            res = sum + g->c;
+
+            /* Carry set on wrap; SBC also clears it when the result grew */
+            lane8 wrapped = (lane8)(res < a_old);
+            lane8 keep = ~wrapped;
+            if (op == SBC) keep &= ~(lane8)(res > a_old);
+            lane8 c = (wrapped & 1) | (g->c & keep);
+
+            /* V is only ever set, from a + operand without the carry */
+            lane8 ovf = (lane8)(((a_old ^ in) & 0x80) == 0)
+                      & (lane8)(((a_old ^ sum) & 0x80) != 0);
+
+            BLEND(g->a, res, m);
+            BLEND(g->c, c, m);
+            BLEND(g->v, g->v | (ovf & 1), m);
+            BLEND(g->nz, WIDEN(res), m16);
+            break;
+        }
+
+        /* ==== LOGIC ==== */
+        case AND: case EOR: case ORA:
+            res = (op == AND) ? g->a & val :
+                  (op == EOR) ? g->a ^ val :
+                                g->a | val;
+            BLEND(g->a, res, m);
+            BLEND(g->nz, WIDEN(res), m16);
+            break;
+
+        /* ==== SHIFT ==== */
+        case ASL: case ROL: case LSR: case ROR: {
+            lane8 src = (info->mode == ACC) ? g->a : val;
+            lane8 c;
+            if (op == ASL || op == ROL) {
+                res = src << 1;
+                if (op == ROL) res |= g->c;
+                c = src >> 7;
+            } else {
+                res = src >> 1;
+                if (op == ROR) res |= g->c << 7;
+                c = src & 1;
+            }
+            if (info->mode == ACC)  BLEND(g->a, res, m);
+            else                    lanes_store(g, &ea, lanes, res);
+            BLEND(g->c, c, m);
+            BLEND(g->nz, WIDEN(res), m16);
+            break;
+        }
+
+        /* ==== FLAGS ==== */
+        case CLC: g->c &= ~m;                      break;
+        case SEC: BLEND(g->c, SPLAT8(1), m);       break;
+        case CLV: g->v &= ~m;                      break;
+        case CLD: g->p &= ~(m & FLAG_D);           break;
+        case SED: g->p |= m & FLAG_D;              break;
+        case CLI: g->p &= ~(m & FLAG_I);           break;
+        case SEI: g->p |= m & FLAG_I;              break;
+
+        /* ==== COMPARISONS ==== */
+        case CMP: case CPX: case CPY: {
+            lane8 reg = (op == CMP) ? g->a : (op == CPX) ? g->x : g->y;
+            res = reg - val;
+            /* C is set unless the difference is negative; N is only ever set */
+            BLEND(g->c, (res >> 7) ^ 1, m);
+            BLEND(g->nz, WIDEN(res) | ((g->nz | (g->nz << 1)) & 0x100), m16);
+            break;
+        }
+
+        /* ==== BIT ==== */
+        case BIT:
+            BLEND(g->nz, WIDEN(g->a & val) | (WIDEN(val & 0x80) << 1), m16);
+            BLEND(g->v, (val >> 6) & 1, m);
+            break;
+
+        /* ==== CONDITIONAL BRANCH ==== */
+        case BCC: case BCS: case BEQ: case BMI: case BNE:
+        case BPL: case BVC: case BVS: {
+            lane8 zero = NARROW_MASK((lane16)((g->nz & 0xFF) == 0));
+            lane8 neg = NARROW_MASK((lane16)((g->nz & 0x180) != 0));
+            lane8 take;
+            switch (op) {
+                case BCC: take = (lane8)(g->c == 0); break;
+                case BCS: take = (lane8)(g->c != 0); break;
+                case BEQ: take = zero;               break;
+                case BNE: take = ~zero;              break;
+                case BMI: take = neg;                break;
+                case BPL: take = ~neg;               break;
+                case BVC: take = (lane8)(g->v == 0); break;
+                default:  take = (lane8)(g->v != 0); break;
+            }
+            take &= m;
+
+            /* Page cross is measured from the operand byte */
+            lane16 from = next - 1;
+            lane16 offset = SPLAT16(operand);
+            lane8 crossed = NARROW_MASK((lane16)((((from + offset) ^ from) & 0xFF00) != 0));
+            cycles += (take & 1) + (take & crossed & 1);
+            BLEND(next, next + offset, WIDEN_MASK(take));
+            break;
+        }
+
+        /* ==== JUMP / SUBROUTINE ==== */
+        case JMP:
+            next = ea;
+            break;
+        case JSR:
+            for (uint32_t l = lanes; l; l &= l - 1) {
+                int i = __builtin_ctz(l);
+                uint16_t ret = next[i] - 1;
+                lane_push(g, i, ret >> 8);
+                lane_push(g, i, ret & 0xFF);
+            }
+            next = ea;
+            break;
+        case RTS:
+            for (uint32_t l = lanes; l; l &= l - 1) {
+                int i = __builtin_ctz(l);
+                uint8_t pcl = lane_pull(g, i);
+                uint8_t pch = lane_pull(g, i);
+                next[i] = ((pch << 8) | pcl) + 1;
+            }
+            break;
+
+        /* NOP; interrupts and illegal opcodes never reach the vector path */
+        default:
+            break;
+    }
+
+    BLEND(g->pc, next, m16);
+    g->cycles += __builtin_convertvector(cycles & m, lane64);
+
+    for (; drop; drop &= drop - 1)
+        lane_scalar_step(b, g, __builtin_ctz(drop));
+}
+
+/*
+ * Code bytes at pc for one lane, straight from the page when the
+ * instruction fits on it, copied into buf when it straddles two pages.
+ * NULL when any of the bytes sits on a page without a direct mapping.
+ */
+static inline const uint8_t* lane_code(Bus* bus, uint16_t pc, uint8_t length, uint8_t* buf) {
+    const uint8_t* page = bus->pages[pc >> 8].read;
+    if (!page) return NULL;
+    if ((pc & 0xFF) + length <= 0x100) return page + (pc & 0xFF);
+    for (uint8_t k = 0; k < length; k++) {
+        uint16_t addr = pc + k;
+        page = bus->pages[addr >> 8].read;
+        if (!page) return NULL;
+        buf[k] = page[addr & 0xFF];
+    }
+    return buf;
+}
+
+static inline bool same_code(const uint8_t* a, const uint8_t* b, uint8_t length) {
+    return a[0] == b[0] && (length < 2 || a[1] == b[1]) && (length < 3 || a[2] == b[2]);
+}
+
+/*
+ * Advance every live lane of a group by one instruction. The first
+ * pending lane leads: every lane at the same PC with the same code bytes
+ * executes with it in one masked pass, lanes that diverged lead further
+ * passes. Interrupt opcodes, illegal opcodes and code off direct pages
+ * step through the lane's CPU.
+ */
+static void group_step(CPUBatch* b, LaneGroup* g) {
+    uint32_t pending = lane_bits(g->live);
+
+    for (uint32_t l = pending & lane_bits(g->scalar); l; l &= l - 1) {
+        lane_scalar_step(b, g, __builtin_ctz(l));
+        pending &= ~(1u << __builtin_ctz(l));
+    }
+
+    while (pending) {
+        int lead = __builtin_ctz(pending);
+        uint16_t pc = g->pc[lead];
+        const uint8_t* code = g->bus[lead]->pages[pc >> 8].read;
+        const opcode_info_t* info = code ? &opcode_info[code[pc & 0xFF]] : NULL;
+        uint8_t buf[3], other_buf[3];
+        const uint8_t* bytes = info ? lane_code(g->bus[lead], pc, info->length, buf) : NULL;
+        if (!bytes || info->type == IRPT || info->type == ILLEGAL) {
+            lane_scalar_step(b, g, lead);
+            pending &= ~(1u << lead);
+            continue;
+        }
+
+        lane8 m = NARROW_MASK((lane16)(g->pc == SPLAT16(pc)));
+        uint32_t same = pending & lane_bits(m);
+        for (uint32_t l = same & (same - 1); l; l &= l - 1) {
+            int i = __builtin_ctz(l);
+            const uint8_t* other = lane_code(g->bus[i], pc, info->length, other_buf);
+            if (!other || !same_code(other, bytes, info->length))
+                same &= ~(1u << i);
+        }
+        pending &= ~same;
+        if (same != lane_bits(m)) {
+            for (uint32_t l = lane_bits(m) & ~same; l; l &= l - 1)
+                m[__builtin_ctz(l)] = 0;
+        }
+        group_exec(b, g, bytes, m);
+    }
+}
+
+uint64_t cpu_batch_run(CPUBatch* batch, uint64_t cycle_budget) {
+    uint64_t total = 0;
+
+    for (size_t gi = 0; gi < batch->group_count; gi++) {
+        LaneGroup* g = &batch->groups[gi];
+        uint64_t start[LANES] = {0};
+
+        g->cycles = SPLAT64(0);
+        g->live = SPLAT8(0);
+        for (int i = 0; i < LANES; i++) {
+            CPU* cpu = g->cpu[i];
+            if (!cpu) continue;
+            lane_load(g, i);
+            start[i] = cpu_get_total_cycles(cpu);
+            g->scalar[i] = cpu_interrupt_requested(cpu) ? 0xFF : 0;
+            if (!cpu_is_halted(cpu) && cycle_budget > 0) g->live[i] = 0xFF;
+        }
+
+        while (lane_bits(g->live)) {
+            /* Steps every live lane can take before any might reach the budget */
+            uint64_t most = 0;
+            for (int i = 0; i < LANES; i++)
+                if (g->live[i] && g->cycles[i] > most) most = g->cycles[i];
+            uint64_t steps = (cycle_budget - most - 1) / MAX_STEP_CYCLES + 1;
+
+            while (steps-- && lane_bits(g->live))
+                group_step(batch, g);
+            g->live &= (lane8)__builtin_convertvector(g->cycles < SPLAT64(cycle_budget), lane8s);
+        }
+
+        for (int i = 0; i < LANES; i++) {
+            if (!g->cpu[i]) continue;
+            lane_store(g, i);
+            cpu_set_total_cycles(g->cpu[i], start[i] + g->cycles[i]);
+            total += g->cycles[i];
+        }
+    }
+    return total;
+}
+
+uint64_t cpu_batch_lane_cycles(const CPUBatch* batch, size_t lane) {
+    if (lane >= batch->lanes) return 0;
+    return batch->groups[lane / LANES].cycles[lane % LANES];
+}
+
+uint64_t cpu_batch_scalar_steps(const CPUBatch* batch) {
+    return batch->scalar_steps;
+}
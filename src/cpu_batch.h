@@ -0,0 +1,43 @@
+/**
+ * Lockstep engine for many independent CPUs running at once.
+ *
+ * Lane registers are kept structure-of-arrays in SIMD vectors (16 lanes
+ * per group with SSE, 32 when built with -mavx2). Each step every lane
+ * fetches its next instruction; lanes at the same PC with the same code
+ * bytes execute together, masked, and lanes that diverge take further
+ * passes of the same step. Operands and stores are gathered and scattered per lane
+ * through each lane's own bus.
+ *
+ * A lane falls back to cpu_step on its own CPU for anything the vector
+ * path does not do: interrupts (pending or entered via BRK/RTI), illegal
+ * opcodes, and any instruction that would touch a page without a direct
+ * mapping, so devices always see the exact scalar access sequence.
+ * cpu_stop is not observed by the batch.
+ */
+#ifndef CPU_BATCH_H_
+#define CPU_BATCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu.h"
+
+typedef struct CPUBatch CPUBatch;
+
+/* The batch borrows the CPUs; each must have its own bus */
+CPUBatch* cpu_batch_create(CPU** cpus, size_t count);
+void      cpu_batch_destroy(CPUBatch* batch);
+
+/*
+ * Run every lane until it has used the cycle budget or halted, as
+ * cpu_run would. Registers and total cycles are written back to the
+ * CPUs. Returns cycles consumed summed over all lanes.
+ */
+uint64_t  cpu_batch_run(CPUBatch* batch, uint64_t cycle_budget);
+
+/* Cycles a lane consumed in the last run */
+uint64_t  cpu_batch_lane_cycles(const CPUBatch* batch, size_t lane);
+
+/* Instructions (or interrupt entries) that went through cpu_step, all runs */
+uint64_t  cpu_batch_scalar_steps(const CPUBatch* batch);
+
+#endif
@@ -0,0 +1,336 @@
+#define _DEFAULT_SOURCE
+#include "fleet.h"
+#include "cpu.h"
+#include "bus.h"
+#include "memory.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define DEQUE_EMPTY  UINT32_MAX
+#define DEQUE_ABORT  (UINT32_MAX - 1)
+
+/*
+ * Chase-Lev work-stealing deque of job indices. Only the owner pushes
+ * and pops at the bottom; thieves take from the top. The buffer is sized
+ * for the whole run up front and never grows, so a slot is never reused
+ * while a thief might still read it.
+ */
+typedef struct {
+    _Atomic int64_t   top;
+    _Atomic int64_t   bottom;
+    _Atomic uint32_t* slots;
+    size_t            capacity;
+} Deque;
+
+static void deque_reset(Deque* d, size_t capacity) {
+    if (capacity > d->capacity) {
+        free((void*)d->slots);
+        d->slots = malloc(capacity * sizeof(*d->slots));
+        if (!d->slots) {
+            printf("Failed to allocate fleet deque\n");
+            exit(1);
+        }
+        d->capacity = capacity;
+    }
+    atomic_store_explicit(&d->top, 0, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, 0, memory_order_relaxed);
+}
+
+static void deque_push(Deque* d, uint32_t job) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    atomic_store_explicit(&d->slots[b], job, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+static uint32_t deque_pop(Deque* d) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return DEQUE_EMPTY;
+    }
+    uint32_t job = atomic_load_explicit(&d->slots[b], memory_order_relaxed);
+    if (t == b) {
+        /* Last job: race the thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed))
+            job = DEQUE_EMPTY;
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+static uint32_t deque_steal(Deque* d) {
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (t >= b) return DEQUE_EMPTY;
+    uint32_t job = atomic_load_explicit(&d->slots[t], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+        return DEQUE_ABORT;
+    return job;
+}
+
+/* One worker thread and the machine it reuses for every job */
+typedef struct {
+    _Alignas(64) Deque deque;
+    Fleet*    fleet;
+    uint32_t  index;
+    pthread_t thread;
+    CPU*      cpu;
+    Memory*   mem;
+    uint64_t  rng;
+    uint64_t  steals;
+} Worker;
+
+struct Fleet {
+    Worker*         workers;
+    size_t          worker_count;
+
+    /* Run handoff; only taken at the start and end of fleet_run */
+    pthread_mutex_t lock;
+    pthread_cond_t  start;
+    pthread_cond_t  done;
+    uint64_t        generation;
+    size_t          active;
+    bool            shutdown;
+
+    /* Current run, published under lock before the workers wake */
+    const FleetJob* jobs;
+    FleetResult*    results;
+};
+
+uint64_t fleet_digest(const uint8_t* mem, size_t size) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        h ^= mem[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+/* Put the worker's machine into the state a fresh one would have */
+static void machine_prepare(Worker* w, const FleetJob* job) {
+    uint8_t* raw = memory_get_raw(w->mem);
+    Bus* bus = cpu_get_bus(w->cpu);
+
+    memory_reset(w->mem);
+    if (job->image) {
+        size_t room = 0x10000 - job->load_addr;
+        memory_load(w->mem, job->load_addr, job->image,
+                    job->image_size < room ? job->image_size : room);
+    }
+    raw[0xFFFC] = job->reset_vector & 0xFF;
+    raw[0xFFFD] = job->reset_vector >> 8;
+
+    /* Memory changed behind the bus: drop cached blocks */
+    bus_invalidate(bus, 0x0000, 0xFFFF);
+
+    cpu_set_a(w->cpu, 0);
+    cpu_set_x(w->cpu, 0);
+    cpu_set_y(w->cpu, 0);
+    cpu_reset(w->cpu);
+    cpu_set_total_cycles(w->cpu, 0);
+}
+
+static void run_job(Worker* w, uint32_t index) {
+    const FleetJob* job = &w->fleet->jobs[index];
+    FleetResult* r = &w->fleet->results[index];
+    CPU* cpu = w->cpu;
+    uint64_t cycles = 0;
+    FleetStop stop = FLEET_STOP_BUDGET;
+
+    machine_prepare(w, job);
+
+    if (job->stop_on_pc) {
+        while (cycles < job->cycle_budget && !cpu_is_halted(cpu)) {
+            if (cpu_get_pc(cpu) == job->stop_pc) {
+                stop = FLEET_STOP_PC;
+                break;
+            }
+            cycles += cpu_step(cpu);
+        }
+    } else {
+        cycles = cpu_run(cpu, job->cycle_budget);
+    }
+    if (cpu_is_halted(cpu))
+        stop = cpu_is_illegal(cpu) ? FLEET_STOP_ILLEGAL : FLEET_STOP_HALTED;
+
+    r->a = cpu_get_a(cpu);
+    r->x = cpu_get_x(cpu);
+    r->y = cpu_get_y(cpu);
+    r->sp = cpu_get_sp(cpu);
+    r->status = cpu_get_status(cpu);
+    r->pc = cpu_get_pc(cpu);
+    r->cycles = cycles;
+    r->stop = stop;
+    r->digest = fleet_digest(memory_get_raw(w->mem), 0x10000);
+    r->worker = w->index;
+}
+
+/* Next job from our own deque, else stolen; DEQUE_EMPTY once all are dry */
+static uint32_t next_job(Worker* w) {
+    uint32_t job = deque_pop(&w->deque);
+    if (job != DEQUE_EMPTY) return job;
+
+    Fleet* f = w->fleet;
+    for (;;) {
+        bool contended = false;
+        size_t first = random_byte_r(&w->rng) % f->worker_count;
+        for (size_t k = 0; k < f->worker_count; k++) {
+            Worker* victim = &f->workers[(first + k) % f->worker_count];
+            if (victim == w) continue;
+            job = deque_steal(&victim->deque);
+            if (job == DEQUE_ABORT) {
+                contended = true;
+            } else if (job != DEQUE_EMPTY) {
+                w->steals++;
+                return job;
+            }
+        }
+        /* No jobs are added during a run, so empty everywhere means done */
+        if (!contended) return DEQUE_EMPTY;
+    }
+}
+
+static void* worker_main(void* arg) {
+    Worker* w = arg;
+    Fleet* f = w->fleet;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&f->lock);
+        while (f->generation == seen && !f->shutdown)
+            pthread_cond_wait(&f->start, &f->lock);
+        if (f->shutdown) {
+            pthread_mutex_unlock(&f->lock);
+            return NULL;
+        }
+        seen = f->generation;
+        pthread_mutex_unlock(&f->lock);
+
+        for (uint32_t job; (job = next_job(w)) != DEQUE_EMPTY; )
+            run_job(w, job);
+
+        pthread_mutex_lock(&f->lock);
+        if (--f->active == 0) pthread_cond_signal(&f->done);
+        pthread_mutex_unlock(&f->lock);
+    }
+}
+
+Fleet* fleet_create(size_t workers) {
+    if (workers == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (size_t)online : 1;
+    }
+
+    Fleet* f = calloc(1, sizeof(Fleet));
+    if (!f) {
+        printf("Failed to allocate fleet\n");
+        exit(1);
+    }
+    f->workers = aligned_alloc(_Alignof(Worker), workers * sizeof(Worker));
+    if (!f->workers) {
+        printf("Failed to allocate fleet workers\n");
+        exit(1);
+    }
+    memset(f->workers, 0, workers * sizeof(Worker));
+    f->worker_count = workers;
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->start, NULL);
+    pthread_cond_init(&f->done, NULL);
+
+    for (size_t i = 0; i < workers; i++) {
+        Worker* w = &f->workers[i];
+        Bus* bus = bus_create();
+        w->fleet = f;
+        w->index = (uint32_t)i;
+        w->mem = memory_create();
+        w->rng = 0x9E3779B97F4A7C15ull * (i + 1);
+        bus_map_memory(bus, w->mem);
+        w->cpu = cpu_create(bus);
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            printf("Failed to start fleet worker\n");
+            exit(1);
+        }
+    }
+    return f;
+}
+
+void fleet_destroy(Fleet* fleet) {
+    if (!fleet) return;
+
+    pthread_mutex_lock(&fleet->lock);
+    fleet->shutdown = true;
+    pthread_cond_broadcast(&fleet->start);
+    pthread_mutex_unlock(&fleet->lock);
+
+    for (size_t i = 0; i < fleet->worker_count; i++) {
+        Worker* w = &fleet->workers[i];
+        pthread_join(w->thread, NULL);
+        cpu_destroy(w->cpu);      // also destroys the bus and the memory
+        free((void*)w->deque.slots);
+    }
+    pthread_cond_destroy(&fleet->done);
+    pthread_cond_destroy(&fleet->start);
+    pthread_mutex_destroy(&fleet->lock);
+    free(fleet->workers);
+    free(fleet);
+}
+
+size_t fleet_workers(const Fleet* fleet) {
+    return fleet->worker_count;
+}
+
+void fleet_run(Fleet* fleet, const FleetJob* jobs, size_t count, FleetResult* results) {
+    if (!fleet || count == 0) return;
+    if (count >= DEQUE_ABORT) {
+        printf("Too many fleet jobs\n");
+        exit(1);
+    }
+
+    /*
+     * Deal contiguous slices, pushed in reverse so each owner pops its
+     * slice in job order while thieves take from the far end. The workers
+     * are all parked, so this thread may act as every deque's owner.
+     */
+    size_t n = fleet->worker_count;
+    for (size_t i = 0; i < n; i++) {
+        size_t lo = count * i / n;
+        size_t hi = count * (i + 1) / n;
+        Deque* d = &fleet->workers[i].deque;
+        deque_reset(d, hi - lo > 0 ? hi - lo : 1);
+        for (size_t j = hi; j > lo; j--)
+            deque_push(d, (uint32_t)(j - 1));
+    }
+
+    pthread_mutex_lock(&fleet->lock);
+    fleet->jobs = jobs;
+    fleet->results = results;
+    fleet->active = n;
+    fleet->generation++;
+    pthread_cond_broadcast(&fleet->start);
+    while (fleet->active > 0)
+        pthread_cond_wait(&fleet->done, &fleet->lock);
+    pthread_mutex_unlock(&fleet->lock);
+}
+
+uint64_t fleet_steals(const Fleet* fleet) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < fleet->worker_count; i++)
+        total += fleet->workers[i].steals;
+    return total;
+}
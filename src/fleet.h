@@ -0,0 +1,65 @@
+/**
+ * Run many independent jobs across a pool of worker threads.
+ *
+ * Each worker owns one preallocated CPU/Bus/Memory and reuses it for
+ * every job it runs: memory is cleared, the image and reset vector are
+ * loaded and the CPU is reset, so a job never sees state left by the one
+ * before it. Jobs are dealt out in contiguous slices to per-worker
+ * work-stealing deques; a worker whose deque runs dry steals from the
+ * others. Each result slot is written by exactly one worker, so nothing
+ * on the job path takes a lock.
+ */
+#ifndef FLEET_H_
+#define FLEET_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Fleet Fleet;
+
+typedef struct {
+    const uint8_t* image;         // loaded at load_addr, clipped at $FFFF
+    size_t         image_size;
+    uint16_t       load_addr;
+    uint16_t       reset_vector;  // written to $FFFC/$FFFD after the image
+    uint64_t       cycle_budget;
+    bool           stop_on_pc;    // also stop when PC reaches stop_pc
+    uint16_t       stop_pc;
+} FleetJob;
+
+typedef enum {
+    FLEET_STOP_BUDGET,            // cycle budget used up
+    FLEET_STOP_HALTED,            // JAM
+    FLEET_STOP_PC,                // reached stop_pc
+    FLEET_STOP_ILLEGAL            // unimplemented opcode; pc is its address
+} FleetStop;
+
+typedef struct {
+    uint8_t   a, x, y, sp, status;
+    uint16_t  pc;
+    uint64_t  cycles;
+    FleetStop stop;
+    uint64_t  digest;             // FNV-1a over all 64K of memory
+    uint32_t  worker;             // index of the worker that ran the job
+} FleetResult;
+
+/* workers == 0 uses one per online CPU */
+Fleet*   fleet_create(size_t workers);
+void     fleet_destroy(Fleet* fleet);
+size_t   fleet_workers(const Fleet* fleet);
+
+/*
+ * Run every job and fill results[i] for jobs[i]. Blocks until all are
+ * done. Jobs with stop_on_pc single-step so the PC is checked at every
+ * instruction boundary; the others go through cpu_run.
+ */
+void     fleet_run(Fleet* fleet, const FleetJob* jobs, size_t count, FleetResult* results);
+
+/* Jobs taken from another worker's deque, summed over all runs */
+uint64_t fleet_steals(const Fleet* fleet);
+
+/* The digest fleet_run reports, for checking results against a reference */
+uint64_t fleet_digest(const uint8_t* mem, size_t size);
+
+#endif
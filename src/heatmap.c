@@ -0,0 +1,213 @@
+#include "heatmap.h"
+#include "bus.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define HEADER_SIZE 16
+
+static const char magic[8] = "6502HEA";
+
+static inline void put32(uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static inline uint32_t get32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+Heatmap* heatmap_create(void) {
+    Heatmap* h = calloc(1, sizeof(Heatmap));
+    if (!h) {
+        printf("Failed to allocate heatmap\n");
+        exit(1);
+    }
+    return h;
+}
+
+void heatmap_destroy(Heatmap* h) {
+    free(h);
+}
+
+void heatmap_clear(Heatmap* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+/* ============================== Dumps =================================== */
+
+static bool write_counters(FILE* f, const uint32_t* counters) {
+    uint8_t buf[4 * 1024];
+    for (uint32_t i = 0; i < 0x10000; i += 1024) {
+        for (uint32_t j = 0; j < 1024; j++) put32(buf + 4 * j, counters[i + j]);
+        if (fwrite(buf, 1, sizeof(buf), f) != sizeof(buf)) return false;
+    }
+    return true;
+}
+
+static bool read_counters(FILE* f, uint32_t* counters) {
+    uint8_t buf[4 * 1024];
+    for (uint32_t i = 0; i < 0x10000; i += 1024) {
+        if (fread(buf, 1, sizeof(buf), f) != sizeof(buf)) return false;
+        for (uint32_t j = 0; j < 1024; j++) counters[i + j] = get32(buf + 4 * j);
+    }
+    return true;
+}
+
+bool heatmap_write_dump(const Heatmap* h, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+
+    uint8_t header[HEADER_SIZE];
+    memcpy(header, magic, sizeof(magic));
+    put32(header + 8, HEATMAP_VERSION);
+    put32(header + 12, 0x10000);
+    bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header)
+           && write_counters(f, h->reads)
+           && write_counters(f, h->writes)
+           && write_counters(f, h->fetches);
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+Heatmap* heatmap_read_dump(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    uint8_t header[HEADER_SIZE];
+    Heatmap* h = NULL;
+    if (fread(header, 1, sizeof(header), f) == sizeof(header)
+        && memcmp(header, magic, sizeof(magic)) == 0
+        && get32(header + 8) == HEATMAP_VERSION
+        && get32(header + 12) == 0x10000) {
+        h = heatmap_create();
+        if (!read_counters(f, h->reads) || !read_counters(f, h->writes)
+            || !read_counters(f, h->fetches)) {
+            heatmap_destroy(h);
+            h = NULL;
+        }
+    }
+    fclose(f);
+    return h;
+}
+
+/* ============================== Images ================================== */
+
+static uint64_t heat_value(const Heatmap* h, HeatKind kind, uint32_t addr) {
+    switch (kind) {
+        case HEAT_READS:   return h->reads[addr];
+        case HEAT_WRITES:  return h->writes[addr];
+        case HEAT_FETCHES: return h->fetches[addr];
+        case HEAT_ALL:     break;
+    }
+    return (uint64_t)h->reads[addr] + h->writes[addr] + h->fetches[addr];
+}
+
+/* log2(v) in 1/256ths, for v > 0 */
+static uint32_t log2_fixed(uint64_t v) {
+    uint32_t msb = 0;
+    while (v >> (msb + 1)) msb++;
+    uint32_t frac = msb >= 8 ? (v >> (msb - 8)) & 0xFF : (v << (8 - msb)) & 0xFF;
+    return msb * 256 + frac;
+}
+
+bool heatmap_write_pgm(const Heatmap* h, HeatKind kind, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+
+    uint64_t max = 0;
+    for (uint32_t a = 0; a < 0x10000; a++) {
+        uint64_t v = heat_value(h, kind, a);
+        if (v > max) max = v;
+    }
+
+    uint8_t* pixels = malloc(0x10000);
+    if (!pixels) {
+        printf("Failed to allocate heatmap image\n");
+        exit(1);
+    }
+
+    /*
+     * Log scale, so one hot loop does not leave everything else black:
+     * untouched is 0, touched at least 1, the busiest address 255.
+     */
+    uint32_t top = max > 1 ? log2_fixed(max) : 1;
+    for (uint32_t a = 0; a < 0x10000; a++) {
+        uint64_t v = heat_value(h, kind, a);
+        pixels[a] = v ? (uint8_t)(1 + 254 * (uint64_t)log2_fixed(v) / top) : 0;
+    }
+
+    bool ok = fprintf(f, "P5\n256 256\n255\n") > 0
+           && fwrite(pixels, 1, 0x10000, f) == 0x10000;
+    free(pixels);
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+/* ============================== Report ================================== */
+
+/* What the bus maps at a page, without touching any device */
+static const char* page_kind(Bus* bus, uint8_t page) {
+    if (!bus) return "";
+    const BusPage* p = &bus->pages[page];
+    if (p->read && p->write) return "ram";
+    if (p->read)             return "rom";
+    return "device";
+}
+
+/* The 'top' indices of the largest nonzero values, largest first */
+static size_t hottest(const uint64_t* values, size_t n, uint32_t* out, size_t top) {
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!values[i]) continue;
+        if (found == top && values[i] <= values[out[found - 1]]) continue;
+        size_t j = found < top ? found++ : found - 1;
+        while (j > 0 && values[out[j - 1]] < values[i]) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = (uint32_t)i;
+    }
+    return found;
+}
+
+void heatmap_report(const Heatmap* h, Bus* bus, FILE* out, int top) {
+    if (top <= 0) top = 20;
+    uint64_t* totals = malloc(0x10000 * sizeof(uint64_t));
+    uint64_t pages[256][3] = {{0}};
+    uint64_t page_totals[256] = {0};
+    uint32_t* rank = malloc((size_t)top * sizeof(uint32_t));
+    if (!totals || !rank) {
+        printf("Failed to allocate heatmap report\n");
+        exit(1);
+    }
+
+    uint64_t reads = 0, writes = 0, fetches = 0;
+    for (uint32_t a = 0; a < 0x10000; a++) {
+        totals[a] = heat_value(h, HEAT_ALL, a);
+        pages[a >> 8][0] += h->reads[a];
+        pages[a >> 8][1] += h->writes[a];
+        pages[a >> 8][2] += h->fetches[a];
+        page_totals[a >> 8] += totals[a];
+        reads += h->reads[a];
+        writes += h->writes[a];
+        fetches += h->fetches[a];
+    }
+    fprintf(out, "Heatmap: %" PRIu64 " reads, %" PRIu64 " writes, %" PRIu64 " opcode fetches\n",
+            reads, writes, fetches);
+
+    size_t n = hottest(page_totals, 256, rank, (size_t)top);
+    fprintf(out, "\nBusiest pages\n");
+    fprintf(out, "  page  mapped           reads         writes        fetches\n");
+    for (size_t i = 0; i < n; i++) {
+        uint8_t p = rank[i];
+        fprintf(out, "  $%02Xxx %-7s %14" PRIu64 " %14" PRIu64 " %14" PRIu64 "\n",
+                p, page_kind(bus, p), pages[p][0], pages[p][1], pages[p][2]);
+    }
+
+    n = hottest(totals, 0x10000, rank, (size_t)top);
+    fprintf(out, "\nBusiest addresses\n");
+    fprintf(out, "  addr  mapped           reads         writes        fetches\n");
+    for (size_t i = 0; i < n; i++) {
+        uint16_t a = rank[i];
+        fprintf(out, "  $%04X %-7s %14" PRIu32 " %14" PRIu32 " %14" PRIu32 "\n",
+                a, page_kind(bus, a >> 8), h->reads[a], h->writes[a], h->fetches[a]);
+    }
+
+    free(rank);
+    free(totals);
+}
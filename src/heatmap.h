@@ -0,0 +1,73 @@
+/**
+ * Memory access heatmap.
+ *
+ * Built with HEATMAP=1 (-DBUS_HEATMAP), a bus with a heatmap attached
+ * (bus_set_heatmap) counts every bus_read, bus_write and opcode fetch
+ * per address, whichever device serves it. Counters are 32-bit and
+ * saturate. Without the build flag the bus has no hook at all and
+ * bus_set_heatmap refuses; the rest of this module still works, e.g. to
+ * inspect a dump.
+ *
+ * While a heatmap is attached the CPU runs one instruction at a time
+ * from the bus, since the block cache and JIT read code and direct
+ * memory without it. Operand bytes count as reads; only the opcode byte
+ * of an instruction counts as a fetch.
+ *
+ * Dump file layout (little endian):
+ *   0   char[8]  magic "6502HEA\0"
+ *   8   u32      version (1)
+ *   12  u32      addresses (65536)
+ *   16  u32      reads[65536], then writes[65536], then fetches[65536]
+ */
+#ifndef HEATMAP_H_
+#define HEATMAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define HEATMAP_VERSION 1
+
+typedef struct Bus Bus;
+
+/* Public so bus_read/bus_write can count inline */
+typedef struct Heatmap {
+    uint32_t reads[0x10000];
+    uint32_t writes[0x10000];
+    uint32_t fetches[0x10000];
+} Heatmap;
+
+/* Which counters an image shows */
+typedef enum {
+    HEAT_READS,
+    HEAT_WRITES,
+    HEAT_FETCHES,
+    HEAT_ALL
+} HeatKind;
+
+static inline void heatmap_count(uint32_t* counters, uint16_t addr) {
+    counters[addr] += counters[addr] != UINT32_MAX;
+}
+
+Heatmap* heatmap_create(void);
+void     heatmap_destroy(Heatmap* heat);
+void     heatmap_clear(Heatmap* heat);
+
+/* Binary dump; false on an I/O error. read_dump returns NULL if not a dump */
+bool     heatmap_write_dump(const Heatmap* heat, const char* path);
+Heatmap* heatmap_read_dump(const char* path);
+
+/*
+ * 256x256 binary PGM: one row per page, one column per byte in it,
+ * brightness on a log scale up to the busiest address. False on an I/O
+ * error.
+ */
+bool     heatmap_write_pgm(const Heatmap* heat, HeatKind kind, const char* path);
+
+/*
+ * Totals, the 'top' busiest pages (with what the bus maps there, if bus
+ * is not NULL) and the 'top' busiest addresses.
+ */
+void     heatmap_report(const Heatmap* heat, Bus* bus, FILE* out, int top);
+
+#endif
@@ -0,0 +1,901 @@
+#ifdef CPU_JIT
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "CPU_JIT requires Linux on x86-64"
+#endif
+
+#define _DEFAULT_SOURCE
+#include "jit.h"
+#include "opcodes.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define JIT_ARENA_SIZE   (4u << 20)
+#define JIT_BLOCK_MAX    (16u << 10)     // worst-case bytes for one block
+
+/* Host registers */
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+       R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/* Guest state pinned to callee-saved registers for the whole block */
+#define REG_A    RBX
+#define REG_X    RBP
+#define REG_Y    R13
+#define REG_NZ   R14     // lazy N/Z source, see JitCtx.nz
+#define REG_P    R15
+#define REG_CTX  R12
+
+/* Condition codes for jcc / setcc */
+#define CC_Z   0x4
+#define CC_NZ  0x5
+#define CC_AE  0x3
+#define CC_A   0x7
+
+#define CTX(field) ((int32_t)offsetof(JitCtx, field))
+
+_Static_assert(sizeof(BusPage) == 16, "page table stride assumed by the JIT");
+
+/* Translation of one cache slot, valid while the block is unchanged */
+typedef struct {
+    uint16_t pc;
+    uint32_t gen_lo;
+    uint32_t gen_hi;
+    bool     tried;
+    jit_fn   code;      // NULL if the block's first instruction is untranslatable
+} JitEntry;
+
+struct Jit {
+    Bus*        bus;
+    BlockCache* cache;
+    uint8_t*    arena;
+    size_t      used;
+    JitEntry    entries[BLOCK_CACHE_SIZE];
+};
+
+/* ============================ Emitter ============================ */
+
+typedef struct {
+    uint8_t* p;
+} Emit;
+
+/* Exit point of a block, emitted after the body */
+typedef struct {
+    uint8_t* patch;     // rel32 to point at the stub
+    uint16_t pc;
+    bool     dynamic;   // pc in EAX instead of 'pc'
+    uint8_t  count;
+    uint16_t cycles;
+} Exit;
+
+static inline void emit8(Emit* e, uint8_t b)  { *e->p++ = b; }
+static inline void emit32(Emit* e, uint32_t v) { memcpy(e->p, &v, 4); e->p += 4; }
+static inline void emit64(Emit* e, uint64_t v) { memcpy(e->p, &v, 8); e->p += 8; }
+
+enum { M_REG, M_DISP, M_IDX };
+
+/*
+ * Generic encoder: [pfx] [REX] opcode(1-2 bytes) ModRM [SIB] [disp32].
+ * M_REG: rm is a register. M_DISP: [rm + disp32]. M_IDX: [rm + index].
+ * 'byte_reg' forces a REX prefix so SPL/BPL/SIL/DIL are addressable.
+ */
+static void enc(Emit* e, uint8_t pfx, int w, bool byte_reg, uint32_t opc,
+                int reg, int mode, int rm, int index, int32_t disp) {
+    if (pfx) emit8(e, pfx);
+    uint8_t rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | ((rm >> 3) & 1);
+    if (mode == M_IDX) rex |= ((index >> 3) & 1) << 1;
+    if (rex != 0x40 || byte_reg) emit8(e, rex);
+    if (opc > 0xFF) emit8(e, opc >> 8);
+    emit8(e, opc & 0xFF);
+    switch (mode) {
+        case M_REG:
+            emit8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+            break;
+        case M_DISP:
+            emit8(e, 0x80 | ((reg & 7) << 3) | (rm & 7));
+            if ((rm & 7) == RSP) emit8(e, 0x24);
+            emit32(e, (uint32_t)disp);
+            break;
+        case M_IDX:     /* base must not be RBP/R13 */
+            emit8(e, 0x04 | ((reg & 7) << 3));
+            emit8(e, ((index & 7) << 3) | (rm & 7));
+            break;
+    }
+}
+
+static inline bool is_byte_hi(int r) { return r >= RSP && r <= RDI; }
+
+/* 32-bit register-register ALU op: opc is the "op r/m32, r32" form */
+#define ALU_ADD  0x01
+#define ALU_OR   0x09
+#define ALU_AND  0x21
+#define ALU_SUB  0x29
+#define ALU_XOR  0x31
+#define ALU_CMP  0x39
+#define ALU_MOV  0x89
+
+static void op_rr(Emit* e, uint8_t opc, int dst, int src) {
+    enc(e, 0, 0, false, opc, src, M_REG, dst, 0, 0);
+}
+
+/* 32-bit ALU op with immediate: ext is the /digit of opcode 0x81 */
+#define EXT_ADD 0
+#define EXT_OR  1
+#define EXT_AND 4
+#define EXT_SUB 5
+#define EXT_XOR 6
+
+static void op_ri(Emit* e, int ext, int dst, int32_t imm) {
+    enc(e, 0, 0, false, 0x81, ext, M_REG, dst, 0, 0);
+    emit32(e, (uint32_t)imm);
+}
+
+static void test_ri(Emit* e, int r, uint32_t imm) {
+    enc(e, 0, 0, false, 0xF7, 0, M_REG, r, 0, 0);
+    emit32(e, imm);
+}
+
+static void mov_ri(Emit* e, int r, uint32_t imm) {
+    if (r >= R8) emit8(e, 0x41);
+    emit8(e, 0xB8 | (r & 7));
+    emit32(e, imm);
+}
+
+static void mov_ri64(Emit* e, int r, const void* ptr) {
+    emit8(e, 0x48 | ((r >> 3) & 1));
+    emit8(e, 0xB8 | (r & 7));
+    emit64(e, (uint64_t)(uintptr_t)ptr);
+}
+
+/* shl/shr r32, imm8 */
+static void shl_ri(Emit* e, int r, uint8_t n) {
+    enc(e, 0, 0, false, 0xC1, 4, M_REG, r, 0, 0);
+    emit8(e, n);
+}
+
+static void shr_ri(Emit* e, int r, uint8_t n) {
+    enc(e, 0, 0, false, 0xC1, 5, M_REG, r, 0, 0);
+    emit8(e, n);
+}
+
+static void not_r(Emit* e, int r) {
+    enc(e, 0, 0, false, 0xF7, 2, M_REG, r, 0, 0);
+}
+
+/* movzx r32, r8 */
+static void movzx_rr8(Emit* e, int dst, int src) {
+    enc(e, 0, 0, is_byte_hi(src), 0x0FB6, dst, M_REG, src, 0, 0);
+}
+
+/* setcc r8 (zero-extend separately) */
+static void setcc(Emit* e, int cc, int r) {
+    enc(e, 0, 0, is_byte_hi(r), 0x0F90 | cc, 0, M_REG, r, 0, 0);
+}
+
+/* inc/dec r8 */
+static void incdec_r8(Emit* e, bool dec, int r) {
+    enc(e, 0, 0, is_byte_hi(r), 0xFE, dec ? 1 : 0, M_REG, r, 0, 0);
+}
+
+/* Context field accesses: [REG_CTX + off] */
+static void load_ctx(Emit* e, int r, int32_t off) {
+    enc(e, 0, 0, false, 0x8B, r, M_DISP, REG_CTX, 0, off);
+}
+
+static void store_ctx(Emit* e, int32_t off, int r) {
+    enc(e, 0, 0, false, 0x89, r, M_DISP, REG_CTX, 0, off);
+}
+
+static void movzx_ctx8(Emit* e, int r, int32_t off) {
+    enc(e, 0, 0, false, 0x0FB6, r, M_DISP, REG_CTX, 0, off);
+}
+
+static void or_ctx(Emit* e, int r, int32_t off) {
+    enc(e, 0, 0, false, 0x0B, r, M_DISP, REG_CTX, 0, off);
+}
+
+static void add_ctx_r(Emit* e, int32_t off, int r) {
+    enc(e, 0, 0, false, 0x01, r, M_DISP, REG_CTX, 0, off);
+}
+
+static void incdec_ctx8(Emit* e, bool dec, int32_t off) {
+    enc(e, 0, 0, false, 0xFE, dec ? 1 : 0, M_DISP, REG_CTX, 0, off);
+}
+
+static void add_ctx_imm(Emit* e, int32_t off, uint32_t imm) {
+    enc(e, 0, 0, false, 0x81, EXT_ADD, M_DISP, REG_CTX, 0, off);
+    emit32(e, imm);
+}
+
+static void store_ctx_imm(Emit* e, int32_t off, uint32_t imm) {
+    enc(e, 0, 0, false, 0xC7, 0, M_DISP, REG_CTX, 0, off);
+    emit32(e, imm);
+}
+
+/* Jumps: return the rel32 field for patching */
+static uint8_t* jcc(Emit* e, int cc) {
+    emit8(e, 0x0F);
+    emit8(e, 0x80 | cc);
+    uint8_t* at = e->p;
+    emit32(e, 0);
+    return at;
+}
+
+static uint8_t* jmp(Emit* e) {
+    emit8(e, 0xE9);
+    uint8_t* at = e->p;
+    emit32(e, 0);
+    return at;
+}
+
+static void patch(uint8_t* at, const uint8_t* target) {
+    int32_t rel = (int32_t)(target - (at + 4));
+    memcpy(at, &rel, 4);
+}
+
+static void call(Emit* e, const void* fn) {
+    mov_ri64(e, RAX, fn);
+    emit8(e, 0xFF);
+    emit8(e, 0xD0);     // call rax
+}
+
+/* ========================= Bus accesses ========================= */
+
+/*
+ * Reads return the byte in EAX. 'addr' >= 0 is a static address;
+ * otherwise the address is in ESI. Both clobber the caller-saved
+ * registers (the slow path is a C call).
+ */
+static void emit_read(Jit* jit, Emit* e, int32_t addr) {
+    Bus* bus = jit->bus;
+    if (addr >= 0) {
+        mov_ri64(e, RAX, &bus->pages[addr >> 8].read);
+        enc(e, 0, 1, false, 0x8B, RAX, M_DISP, RAX, 0, 0);
+    } else {
+        op_rr(e, ALU_MOV, RAX, RSI);
+        shr_ri(e, RAX, 8);
+        shl_ri(e, RAX, 4);
+        mov_ri64(e, RCX, &bus->pages[0].read);
+        enc(e, 0, 1, false, 0x8B, RAX, M_IDX, RCX, RAX, 0);
+    }
+    enc(e, 0, 1, false, 0x85, RAX, M_REG, RAX, 0, 0);      // test rax, rax
+    uint8_t* slow = jcc(e, CC_Z);
+    if (addr >= 0) {
+        enc(e, 0, 0, false, 0x0FB6, RAX, M_DISP, RAX, 0, addr & 0xFF);
+    } else {
+        movzx_rr8(e, RCX, RSI);
+        enc(e, 0, 0, false, 0x0FB6, RAX, M_IDX, RAX, RCX, 0);
+    }
+    uint8_t* done = jmp(e);
+    patch(slow, e->p);
+    if (addr >= 0) mov_ri(e, RSI, addr);
+    mov_ri64(e, RDI, bus);
+    call(e, (const void*)bus_read_slow);
+    movzx_rr8(e, RAX, RAX);
+    patch(done, e->p);
+}
+
+/* Writes the byte in EDX; address as for emit_read */
+static void emit_write(Jit* jit, Emit* e, int32_t addr) {
+    Bus* bus = jit->bus;
+    if (addr >= 0) {
+        mov_ri64(e, RAX, &bus->pages[addr >> 8].write);
+        enc(e, 0, 1, false, 0x8B, RAX, M_DISP, RAX, 0, 0);
+    } else {
+        op_rr(e, ALU_MOV, RAX, RSI);
+        shr_ri(e, RAX, 8);
+        shl_ri(e, RAX, 4);
+        mov_ri64(e, RCX, &bus->pages[0].write);
+        enc(e, 0, 1, false, 0x8B, RAX, M_IDX, RCX, RAX, 0);
+    }
+    enc(e, 0, 1, false, 0x85, RAX, M_REG, RAX, 0, 0);
+    uint8_t* slow = jcc(e, CC_Z);
+    if (addr >= 0) {
+        enc(e, 0, 0, false, 0x88, RDX, M_DISP, RAX, 0, addr & 0xFF);
+    } else {
+        movzx_rr8(e, RCX, RSI);
+        enc(e, 0, 0, false, 0x88, RDX, M_IDX, RAX, RCX, 0);
+    }
+    uint8_t* done = jmp(e);
+    patch(slow, e->p);
+    if (addr >= 0) mov_ri(e, RSI, addr);
+    mov_ri64(e, RDI, bus);
+    call(e, (const void*)bus_write_slow);
+    patch(done, e->p);
+}
+
+/* Push EDX / pull into EAX through the stack page */
+static void emit_push(Jit* jit, Emit* e) {
+    movzx_ctx8(e, RSI, CTX(sp));
+    op_ri(e, EXT_OR, RSI, 0x0100);
+    emit_write(jit, e, -1);
+    incdec_ctx8(e, true, CTX(sp));
+}
+
+static void emit_pull(Jit* jit, Emit* e) {
+    incdec_ctx8(e, false, CTX(sp));
+    movzx_ctx8(e, RSI, CTX(sp));
+    op_ri(e, EXT_OR, RSI, 0x0100);
+    emit_read(jit, e, -1);
+}
+
+/* ======================= Flags and addressing ======================= */
+
+/* EAX = 8-bit result: becomes the N/Z source */
+static void set_nz(Emit* e, int r) {
+    op_rr(e, ALU_MOV, REG_NZ, r);
+}
+
+/* EDX = status byte with N and Z materialized */
+static void emit_status(Emit* e) {
+    op_rr(e, ALU_MOV, RDX, REG_P);
+    op_ri(e, EXT_AND, RDX, ~(FLAG_N | FLAG_Z) & 0xFF);
+    op_rr(e, ALU_XOR, RAX, RAX);
+    test_ri(e, REG_NZ, 0xFF);
+    setcc(e, CC_Z, RAX);
+    shl_ri(e, RAX, 1);
+    op_rr(e, ALU_OR, RDX, RAX);
+    op_rr(e, ALU_XOR, RAX, RAX);
+    test_ri(e, REG_NZ, 0x180);
+    setcc(e, CC_NZ, RAX);
+    shl_ri(e, RAX, 7);
+    op_rr(e, ALU_OR, RDX, RAX);
+}
+
+/* Carry flag := bit 0 of EDX */
+static void set_carry(Emit* e) {
+    op_ri(e, EXT_AND, REG_P, ~FLAG_C);
+    op_rr(e, ALU_OR, REG_P, RDX);
+}
+
+/* EAX = low byte of 'index' + 'base' > 0xFF; added to the extra cycles */
+static void emit_cross(Emit* e, int index, uint8_t base_lo) {
+    op_rr(e, ALU_MOV, RAX, index);
+    op_ri(e, EXT_ADD, RAX, base_lo);
+    shr_ri(e, RAX, 8);
+    add_ctx_r(e, CTX(extra), RAX);
+}
+
+/*
+ * Effective address for memory modes, matching cpu_resolve_ea. Returns a
+ * static address, or -1 with the address in ESI. Pointer reads for the
+ * indirect modes go through the bus like the interpreter's.
+ */
+static int32_t emit_ea(Jit* jit, Emit* e, addr_mode_t mode, uint16_t operand,
+                       bool pays_cross) {
+    switch (mode) {
+        case ZPG: case ABS:
+            return operand;
+        case ZPG_X: case ZPG_Y:
+            op_rr(e, ALU_MOV, RSI, mode == ZPG_X ? REG_X : REG_Y);
+            op_ri(e, EXT_ADD, RSI, operand);
+            op_ri(e, EXT_AND, RSI, 0xFF);
+            return -1;
+        case ABS_X: case ABS_Y: {
+            int index = mode == ABS_X ? REG_X : REG_Y;
+            if (pays_cross) emit_cross(e, index, operand & 0xFF);
+            op_rr(e, ALU_MOV, RSI, index);
+            op_ri(e, EXT_ADD, RSI, operand);
+            op_ri(e, EXT_AND, RSI, 0xFFFF);
+            return -1;
+        }
+        case IND:
+            emit_read(jit, e, operand);
+            store_ctx(e, CTX(tmp[0]), RAX);
+            emit_read(jit, e, (operand & 0xFF00) | ((operand + 1) & 0x00FF));
+            shl_ri(e, RAX, 8);
+            or_ctx(e, RAX, CTX(tmp[0]));
+            op_rr(e, ALU_MOV, RSI, RAX);
+            return -1;
+        case IDX_IND:
+            op_rr(e, ALU_MOV, RSI, REG_X);
+            op_ri(e, EXT_ADD, RSI, operand);
+            op_ri(e, EXT_AND, RSI, 0xFF);
+            emit_read(jit, e, -1);
+            store_ctx(e, CTX(tmp[0]), RAX);
+            op_rr(e, ALU_MOV, RSI, REG_X);
+            op_ri(e, EXT_ADD, RSI, operand + 1);
+            op_ri(e, EXT_AND, RSI, 0xFF);
+            emit_read(jit, e, -1);
+            shl_ri(e, RAX, 8);
+            or_ctx(e, RAX, CTX(tmp[0]));
+            op_rr(e, ALU_MOV, RSI, RAX);
+            return -1;
+        case IND_IDX:
+            emit_read(jit, e, operand);
+            store_ctx(e, CTX(tmp[0]), RAX);
+            emit_read(jit, e, (operand + 1) & 0xFF);
+            shl_ri(e, RAX, 8);
+            or_ctx(e, RAX, CTX(tmp[0]));
+            op_rr(e, ALU_MOV, RSI, RAX);        // base
+            if (pays_cross) {
+                movzx_rr8(e, RAX, RSI);
+                op_rr(e, ALU_ADD, RAX, REG_Y);
+                shr_ri(e, RAX, 8);
+                add_ctx_r(e, CTX(extra), RAX);
+            }
+            op_rr(e, ALU_ADD, RSI, REG_Y);
+            op_ri(e, EXT_AND, RSI, 0xFFFF);
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+/* EAX = operand value for IMM or a memory read */
+static void emit_load_operand(Jit* jit, Emit* e, addr_mode_t mode,
+                              int32_t addr, uint16_t operand) {
+    if (mode == IMM) mov_ri(e, RAX, operand & 0xFF);
+    else             emit_read(jit, e, addr);
+}
+
+/* ADC / SBC with the interpreter's flag behaviour; operand in ECX */
+static void emit_adc(Emit* e, bool sbc) {
+    if (sbc) {
+        not_r(e, RCX);
+        movzx_rr8(e, RCX, RCX);
+    }
+    op_rr(e, ALU_MOV, RAX, REG_A);
+    op_rr(e, ALU_ADD, RAX, RCX);            // a + val (no carry)
+    op_rr(e, ALU_MOV, RDX, REG_A);
+    op_rr(e, ALU_XOR, RDX, RCX);
+    not_r(e, RDX);                          // bit 7: same sign
+    op_rr(e, ALU_MOV, RSI, REG_A);
+    op_rr(e, ALU_XOR, RSI, RAX);            // bit 7: sign changed
+    op_rr(e, ALU_AND, RDX, RSI);
+    op_ri(e, EXT_AND, RDX, 0x80);
+    shr_ri(e, RDX, 1);
+    op_rr(e, ALU_OR, REG_P, RDX);           // V is set, never cleared
+    op_rr(e, ALU_MOV, RDX, REG_P);
+    op_ri(e, EXT_AND, RDX, FLAG_C);
+    op_rr(e, ALU_ADD, RAX, RDX);
+    movzx_rr8(e, RAX, RAX);                 // result
+    op_rr(e, ALU_CMP, RAX, REG_A);
+    uint8_t* not_less = jcc(e, CC_AE);
+    op_ri(e, EXT_OR, REG_P, FLAG_C);
+    uint8_t* done = jmp(e);
+    patch(not_less, e->p);
+    if (sbc) {
+        uint8_t* same = jcc(e, CC_Z);
+        op_ri(e, EXT_AND, REG_P, ~FLAG_C);
+        patch(same, e->p);
+    }
+    patch(done, e->p);
+    op_rr(e, ALU_MOV, REG_A, RAX);
+    set_nz(e, RAX);
+}
+
+/* CMP / CPX / CPY with the interpreter's flag behaviour; operand in ECX */
+static void emit_cmp(Emit* e, int reg) {
+    op_rr(e, ALU_MOV, RAX, reg);
+    op_rr(e, ALU_SUB, RAX, RCX);
+    movzx_rr8(e, RAX, RAX);
+    /* Z from the result; N is set from bit 7 but never cleared */
+    op_rr(e, ALU_XOR, RDX, RDX);
+    test_ri(e, REG_NZ, 0x180);
+    setcc(e, CC_NZ, RDX);
+    shl_ri(e, RDX, 8);
+    op_rr(e, ALU_OR, RDX, RAX);
+    op_rr(e, ALU_MOV, REG_NZ, RDX);
+    /* C = result is not negative */
+    op_rr(e, ALU_XOR, RDX, RDX);
+    test_ri(e, RAX, 0x80);
+    setcc(e, CC_Z, RDX);
+    set_carry(e);
+}
+
+/* Shift / rotate EAX in place, updating C and N/Z */
+static void emit_shift(Emit* e, opcode_t op) {
+    if (op == ROL || op == ROR) {
+        op_rr(e, ALU_MOV, RCX, REG_P);
+        op_ri(e, EXT_AND, RCX, FLAG_C);
+        if (op == ROR) shl_ri(e, RCX, 7);
+    }
+    op_rr(e, ALU_MOV, RDX, RAX);
+    if (op == ASL || op == ROL) {
+        shr_ri(e, RDX, 7);
+        shl_ri(e, RAX, 1);
+    } else {
+        op_ri(e, EXT_AND, RDX, 1);
+        shr_ri(e, RAX, 1);
+    }
+    set_carry(e);
+    if (op == ROL || op == ROR) op_rr(e, ALU_OR, RAX, RCX);
+    movzx_rr8(e, RAX, RAX);
+    set_nz(e, RAX);
+}
+
+/* ========================= Translation ========================= */
+
+/* Instructions the translator handles */
+static bool jit_supported(opcode_t op) {
+    switch (op) {
+        case BRK: case RTI:
+            return false;
+        default:
+            return op <= NOP;
+    }
+}
+
+/* Whether an instruction accesses the bus beyond its own opcode/operand */
+static bool touches_bus(const opcode_info_t* info) {
+    return !(info->mode == IMPL || info->mode == ACC
+             || info->mode == IMM || info->mode == REL)
+        || info->type == STACK;
+}
+
+/*
+ * Translate the block into 'e'. Returns false if its first instruction
+ * cannot be translated.
+ */
+static bool jit_translate(Jit* jit, Emit* e, const Block* blk) {
+    Exit exits[BLOCK_MAX_INSNS + 2];
+    int nexits = 0;
+    uint16_t pc = blk->pc;
+    uint32_t cycles = 0;
+    int n = 0;
+
+    if (!jit_supported(opcode_info[blk->insns[0].opcode].op)) return false;
+
+    /* Prologue: 6 pushes + 8 keeps the stack 16-byte aligned for calls */
+    static const uint8_t prologue[] = {
+        0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,
+        0x48, 0x83, 0xEC, 0x08,             // sub rsp, 8
+        0x49, 0x89, 0xFC                    // mov r12, rdi
+    };
+    memcpy(e->p, prologue, sizeof(prologue));
+    e->p += sizeof(prologue);
+    load_ctx(e, REG_A,  CTX(a));
+    load_ctx(e, REG_X,  CTX(x));
+    load_ctx(e, REG_Y,  CTX(y));
+    load_ctx(e, REG_NZ, CTX(nz));
+    load_ctx(e, REG_P,  CTX(p));
+    store_ctx_imm(e, CTX(extra), 0);
+    store_ctx_imm(e, CTX(count), 0);
+    uint8_t* body = e->p;
+
+    bool ended = false;         // block-ending instruction translated
+    bool falls_through = true;  // body can run off its end
+    for (n = 0; n < blk->count && !ended; n++) {
+        const BlockInsn* in = &blk->insns[n];
+        const opcode_info_t* info = &opcode_info[in->opcode];
+        opcode_t op = info->op;
+        addr_mode_t mode = info->mode;
+        uint16_t next = pc + in->length;
+        bool pays_cross = !(info->flags & (OPF_STORE | OPF_RMW));
+
+        if (!jit_supported(op)) break;
+        cycles += in->cycles;
+
+        int32_t addr = -1;
+        if (mode != IMPL && mode != ACC && mode != IMM && mode != REL
+            && op != JMP && op != JSR)
+            addr = emit_ea(jit, e, mode, in->operand, pays_cross);
+        /* RMW ops need the address again after the read */
+        if (addr < 0 && (info->flags & OPF_RMW))
+            store_ctx(e, CTX(tmp[1]), RSI);
+
+        switch (op) {
+            case LDA: case LDX: case LDY: {
+                int dst = op == LDA ? REG_A : op == LDX ? REG_X : REG_Y;
+                emit_load_operand(jit, e, mode, addr, in->operand);
+                op_rr(e, ALU_MOV, dst, RAX);
+                set_nz(e, RAX);
+                break;
+            }
+            case STA: case STX: case STY:
+                op_rr(e, ALU_MOV, RDX, op == STA ? REG_A : op == STX ? REG_X : REG_Y);
+                emit_write(jit, e, addr);
+                break;
+            case TAX: case TAY: case TXA: case TYA: {
+                int src = (op == TAX || op == TAY) ? REG_A : op == TXA ? REG_X : REG_Y;
+                int dst = op == TAX ? REG_X : op == TAY ? REG_Y : REG_A;
+                op_rr(e, ALU_MOV, dst, src);
+                set_nz(e, dst);
+                break;
+            }
+            case TSX:
+                movzx_ctx8(e, REG_X, CTX(sp));
+                set_nz(e, REG_X);
+                break;
+            case TXS:
+                enc(e, 0, 0, true, 0x88, REG_X, M_DISP, REG_CTX, 0, CTX(sp));
+                break;
+
+            case PHA:
+                op_rr(e, ALU_MOV, RDX, REG_A);
+                emit_push(jit, e);
+                break;
+            case PHP:
+                emit_status(e);
+                op_ri(e, EXT_OR, RDX, FLAG_B | FLAG_U);
+                emit_push(jit, e);
+                break;
+            case PLA:
+                emit_pull(jit, e);
+                op_rr(e, ALU_MOV, REG_A, RAX);
+                set_nz(e, RAX);
+                op_ri(e, EXT_AND, REG_P, ~FLAG_B);
+                break;
+            case PLP:
+                emit_pull(jit, e);
+                op_rr(e, ALU_MOV, REG_P, RAX);
+                op_ri(e, EXT_AND, REG_P, ~FLAG_B);
+                /* nz = (Z ? 0 : 1) | (N ? 0x100 : 0) */
+                op_rr(e, ALU_MOV, RCX, RAX);
+                op_ri(e, EXT_AND, RCX, FLAG_N);
+                shl_ri(e, RCX, 1);
+                op_rr(e, ALU_MOV, RDX, RAX);
+                op_ri(e, EXT_AND, RDX, FLAG_Z);
+                op_ri(e, EXT_XOR, RDX, FLAG_Z);
+                shr_ri(e, RDX, 1);
+                op_rr(e, ALU_OR, RCX, RDX);
+                op_rr(e, ALU_MOV, REG_NZ, RCX);
+                break;
+
+            case INX: case DEX: case INY: case DEY: {
+                int r = (op == INX || op == DEX) ? REG_X : REG_Y;
+                incdec_r8(e, op == DEX || op == DEY, r);
+                set_nz(e, r);
+                break;
+            }
+            case INC: case DEC:
+                emit_read(jit, e, addr);
+                op_ri(e, op == INC ? EXT_ADD : EXT_SUB, RAX, 1);
+                movzx_rr8(e, RDX, RAX);
+                set_nz(e, RDX);
+                if (addr < 0) load_ctx(e, RSI, CTX(tmp[1]));
+                emit_write(jit, e, addr);
+                break;
+
+            case ADC: case SBC:
+                emit_load_operand(jit, e, mode, addr, in->operand);
+                op_rr(e, ALU_MOV, RCX, RAX);
+                emit_adc(e, op == SBC);
+                break;
+            case AND: case EOR: case ORA:
+                emit_load_operand(jit, e, mode, addr, in->operand);
+                op_rr(e, op == AND ? ALU_AND : op == EOR ? ALU_XOR : ALU_OR,
+                      REG_A, RAX);
+                set_nz(e, REG_A);
+                break;
+
+            case ASL: case LSR: case ROL: case ROR:
+                if (mode == ACC) {
+                    op_rr(e, ALU_MOV, RAX, REG_A);
+                    emit_shift(e, op);
+                    op_rr(e, ALU_MOV, REG_A, RAX);
+                } else {
+                    emit_read(jit, e, addr);
+                    emit_shift(e, op);
+                    op_rr(e, ALU_MOV, RDX, RAX);
+                    if (addr < 0) load_ctx(e, RSI, CTX(tmp[1]));
+                    emit_write(jit, e, addr);
+                }
+                break;
+
+            case CLC: op_ri(e, EXT_AND, REG_P, ~FLAG_C); break;
+            case CLD: op_ri(e, EXT_AND, REG_P, ~FLAG_D); break;
+            case CLI: op_ri(e, EXT_AND, REG_P, ~FLAG_I); break;
+            case CLV: op_ri(e, EXT_AND, REG_P, ~FLAG_V); break;
+            case SEC: op_ri(e, EXT_OR,  REG_P, FLAG_C);  break;
+            case SED: op_ri(e, EXT_OR,  REG_P, FLAG_D);  break;
+            case SEI: op_ri(e, EXT_OR,  REG_P, FLAG_I);  break;
+
+            case CMP: case CPX: case CPY:
+                emit_load_operand(jit, e, mode, addr, in->operand);
+                op_rr(e, ALU_MOV, RCX, RAX);
+                emit_cmp(e, op == CMP ? REG_A : op == CPX ? REG_X : REG_Y);
+                break;
+
+            case BIT:
+                emit_read(jit, e, addr);
+                op_ri(e, EXT_AND, REG_P, ~FLAG_V);
+                op_rr(e, ALU_MOV, RDX, RAX);
+                op_ri(e, EXT_AND, RDX, FLAG_V);
+                op_rr(e, ALU_OR, REG_P, RDX);
+                op_rr(e, ALU_MOV, RDX, RAX);
+                op_ri(e, EXT_AND, RDX, FLAG_N);
+                shl_ri(e, RDX, 1);
+                op_rr(e, ALU_AND, RAX, REG_A);
+                op_rr(e, ALU_OR, RAX, RDX);
+                set_nz(e, RAX);
+                break;
+
+            case BCC: case BCS: case BEQ: case BMI:
+            case BNE: case BPL: case BVC: case BVS: {
+                int reg = REG_P;
+                uint32_t mask = FLAG_C;
+                int cc = CC_NZ;     // taken when the tested bits are set
+                switch (op) {
+                    case BCC: cc = CC_Z; break;
+                    case BEQ: reg = REG_NZ; mask = 0xFF;  cc = CC_Z;  break;
+                    case BNE: reg = REG_NZ; mask = 0xFF;  break;
+                    case BMI: reg = REG_NZ; mask = 0x180; break;
+                    case BPL: reg = REG_NZ; mask = 0x180; cc = CC_Z;  break;
+                    case BVC: mask = FLAG_V; cc = CC_Z; break;
+                    case BVS: mask = FLAG_V; break;
+                    default: break;
+                }
+                test_ri(e, reg, mask);
+                uint16_t from = next - 1;
+                uint16_t target = next + (int16_t)in->operand;
+                uint32_t taken = cycles + 1
+                               + (((from + (int8_t)in->operand) & 0xFF00) != (from & 0xFF00));
+                if (target != blk->pc) {
+                    exits[nexits++] = (Exit){ jcc(e, cc), target, false, n + 1, taken };
+                } else {
+                    /*
+                     * Loop back to the start of the block while another
+                     * iteration fits the budgets, as cpu_block_span would
+                     * decide on re-entry.
+                     */
+                    uint8_t* not_taken = jcc(e, cc ^ 1);
+                    add_ctx_imm(e, CTX(extra), taken);
+                    add_ctx_imm(e, CTX(count), n + 1);
+                    load_ctx(e, RAX, CTX(extra));
+                    op_ri(e, EXT_ADD, RAX, blk->lead_cycles);
+                    enc(e, 0, 0, false, 0x3B, RAX, M_DISP, REG_CTX, 0, CTX(cycle_room));
+                    exits[nexits++] = (Exit){ jcc(e, CC_AE), target, false, 0, 0 };
+                    load_ctx(e, RAX, CTX(count));
+                    op_ri(e, EXT_ADD, RAX, blk->count);
+                    enc(e, 0, 0, false, 0x3B, RAX, M_DISP, REG_CTX, 0, CTX(step_room));
+                    exits[nexits++] = (Exit){ jcc(e, CC_A), target, false, 0, 0 };
+                    patch(jmp(e), body);
+                    patch(not_taken, e->p);
+                }
+                ended = true;   // not taken: falls through to 'next'
+                break;
+            }
+
+            case JMP:
+                if (mode == IND) {
+                    emit_ea(jit, e, IND, in->operand, false);
+                    op_rr(e, ALU_MOV, RAX, RSI);
+                    exits[nexits++] = (Exit){ jmp(e), 0, true, n + 1, cycles };
+                } else {
+                    exits[nexits++] = (Exit){ jmp(e), in->operand, false, n + 1, cycles };
+                }
+                ended = true;
+                falls_through = false;
+                break;
+            case JSR:
+                mov_ri(e, RDX, ((uint16_t)(next - 1)) >> 8);
+                emit_push(jit, e);
+                mov_ri(e, RDX, ((uint16_t)(next - 1)) & 0xFF);
+                emit_push(jit, e);
+                exits[nexits++] = (Exit){ jmp(e), in->operand, false, n + 1, cycles };
+                ended = true;
+                falls_through = false;
+                break;
+            case RTS:
+                emit_pull(jit, e);
+                store_ctx(e, CTX(tmp[0]), RAX);
+                emit_pull(jit, e);
+                shl_ri(e, RAX, 8);
+                or_ctx(e, RAX, CTX(tmp[0]));
+                op_ri(e, EXT_ADD, RAX, 1);
+                exits[nexits++] = (Exit){ jmp(e), 0, true, n + 1, cycles };
+                ended = true;
+                falls_through = false;
+                break;
+
+            case NOP:
+                break;
+
+            default:
+                break;
+        }
+
+        /* A slow access may have run a device or hit cached code: stop here */
+        if (!ended && touches_bus(info)) {
+            mov_ri64(e, RAX, &jit->bus->slow_accesses);
+            enc(e, 0, 0, false, 0x8B, RAX, M_DISP, RAX, 0, 0);
+            enc(e, 0, 0, false, 0x3B, RAX, M_DISP, REG_CTX, 0, CTX(slow));
+            exits[nexits++] = (Exit){ jcc(e, CC_NZ), next, false, n + 1, cycles };
+        }
+        pc = next;
+    }
+
+    /*
+     * Exit stubs, each ending in a jump to the shared epilogue. The body
+     * falls into the first one when it runs off its end (straight-line
+     * block, branch not taken, or an untranslated instruction next).
+     */
+    if (falls_through)
+        exits[nexits++] = (Exit){ NULL, pc, false, (uint8_t)n, (uint16_t)cycles };
+    uint8_t* to_epilogue[BLOCK_MAX_INSNS + 2];
+    for (int k = 0; k < nexits; k++) {
+        /* Fall-through stub first */
+        Exit* x = &exits[falls_through ? (k + nexits - 1) % nexits : k];
+        if (x->patch) patch(x->patch, e->p);
+        if (x->dynamic) {
+            op_ri(e, EXT_AND, RAX, 0xFFFF);
+            store_ctx(e, CTX(pc), RAX);
+        } else {
+            store_ctx_imm(e, CTX(pc), x->pc);
+        }
+        add_ctx_imm(e, CTX(count), x->count);
+        mov_ri(e, RAX, x->cycles);
+        to_epilogue[k] = (k == nexits - 1) ? NULL : jmp(e);
+    }
+    for (int k = 0; k < nexits - 1; k++)
+        patch(to_epilogue[k], e->p);
+
+    store_ctx(e, CTX(a),  REG_A);
+    store_ctx(e, CTX(x),  REG_X);
+    store_ctx(e, CTX(y),  REG_Y);
+    store_ctx(e, CTX(nz), REG_NZ);
+    store_ctx(e, CTX(p),  REG_P);
+    static const uint8_t epilogue[] = {
+        0x48, 0x83, 0xC4, 0x08,             // add rsp, 8
+        0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B,
+        0xC3
+    };
+    memcpy(e->p, epilogue, sizeof(epilogue));
+    e->p += sizeof(epilogue);
+    return true;
+}
+
+/* ============================ Cache ============================ */
+
+Jit* jit_create(Bus* bus, BlockCache* cache) {
+    Jit* j = malloc(sizeof(Jit));
+    if (!j) {
+        printf("Failed to init JIT\n");
+        exit(1);
+    }
+    j->arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (j->arena == MAP_FAILED) {
+        printf("Failed to map JIT arena\n");
+        exit(1);
+    }
+    j->bus = bus;
+    j->cache = cache;
+    j->used = 0;
+    memset(j->entries, 0, sizeof(j->entries));
+    return j;
+}
+
+void jit_destroy(Jit* jit) {
+    if (!jit) return;
+    munmap(jit->arena, JIT_ARENA_SIZE);
+    free(jit);
+    return;
+}
+
+jit_fn jit_code(Jit* jit, const Block* blk) {
+    JitEntry* ent = &jit->entries[blk - jit->cache->entries];
+    if (ent->tried && ent->pc == blk->pc
+        && ent->gen_lo == blk->gen_lo && ent->gen_hi == blk->gen_hi)
+        return ent->code;
+
+    /* Arena full: drop every translation and start over */
+    if (jit->used + JIT_BLOCK_MAX > JIT_ARENA_SIZE) {
+        memset(jit->entries, 0, sizeof(jit->entries));
+        jit->used = 0;
+    }
+
+    /* W^X: writable while emitting, executable otherwise */
+    mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE);
+    Emit e = { jit->arena + jit->used };
+    bool ok = jit_translate(jit, &e, blk);
+    mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC);
+
+    ent->pc = blk->pc;
+    ent->gen_lo = blk->gen_lo;
+    ent->gen_hi = blk->gen_hi;
+    ent->tried = true;
+    ent->code = NULL;
+    if (ok) {
+        ent->code = (jit_fn)(void*)(jit->arena + jit->used);
+        jit->used += (size_t)(e.p - (jit->arena + jit->used));
+        jit->used = (jit->used + 15) & ~(size_t)15;
+    }
+    return ent->code;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * x86-64 dynamic recompiler for cached blocks (build with `make JIT=1`).
+ *
+ * Blocks from the block cache are translated into native code in an
+ * mmap'd arena. A, X, Y and the flags stay in host registers for the
+ * whole block; N and Z are kept lazily as the last result. Memory goes
+ * through the bus page table inline and only calls the bus for pages
+ * without a direct pointer. Instructions the translator does not handle
+ * (BRK, RTI, illegal opcodes) end the translated prefix; the run loop
+ * interprets from there.
+ */
+#ifndef JIT_H_
+#define JIT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+#include "bus.h"
+#include "block_cache.h"
+
+typedef struct Jit Jit;
+
+/*
+ * Guest state handed to translated code. a/x/y/nz/p/sp are in and out,
+ * pc/count/extra are out. nz holds N and Z in the core's lazy encoding;
+ * p is the status register with N and Z clear.
+ * A block that branches back to its own start loops natively while the
+ * next iteration still fits in cycle_room / step_room.
+ */
+typedef struct {
+    uint32_t a, x, y;
+    uint32_t nz;        // Z = (nz & 0xFF) == 0, N = (nz & 0x180) != 0
+    uint32_t p;         // status register; N and Z bits are ignored
+    uint32_t sp;
+    uint32_t pc;        // next PC on exit
+    uint32_t count;     // instructions executed
+    uint32_t extra;     // cycles of completed loop iterations and page crosses
+    uint32_t slow;      // bus->slow_accesses on entry
+    uint32_t cycle_room;    // cycles left in the run's budget
+    uint32_t step_room;     // instructions left in the run's budget
+    uint32_t tmp[2];    // scratch for translated code
+} JitCtx;
+
+/* Returns the block's static cycles up to the exit taken */
+typedef uint32_t (*jit_fn)(JitCtx* ctx);
+
+Jit*    jit_create(Bus* bus, BlockCache* cache);
+void    jit_destroy(Jit* jit);
+
+/* Native code for a cached block, translating it on first use; NULL if none */
+jit_fn  jit_code(Jit* jit, const Block* blk);
+
+#endif
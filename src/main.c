@@ -1,5 +1,483 @@
+#define _DEFAULT_SOURCE
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "cpu.h"
+#include "bus.h"
+#include "memory.h"
+#include "fleet.h"
+#include "trace_reader.h"
 
-int main() {
+#define MAX_IMAGES    16
+#define MAX_DUMPS     32
+#define MAX_STOP_PCS  16
+
+static void usage(void) {
+    printf("usage: emu6502 [--load FILE@ADDR | --prg FILE]... [options]\n"
+           "       emu6502 --fleet JOBFILE [--threads N]\n"
+           "       emu6502 --trace-print TRACE [--from N | --from-cycle C] [--count N]\n"
+           "\n"
+           "Run mode loads raw images at ADDR, or PRG files at the address in\n"
+           "their first two bytes, then resets and runs:\n"
+           "  --reset ADDR, --nmi ADDR, --irq ADDR   set a vector\n"
+           "  --pc ADDR                             start here instead of the reset vector\n"
+           "  --cycles N | --insns N                budget (default: until a stop)\n"
+           "  --stop-pc ADDR                        stop when PC reaches ADDR\n"
+           "  --stop-brk                            stop at a BRK, before it runs\n"
+           "  --stop-write ADDR                     stop on a write to ADDR; exit\n"
+           "                                        status is the byte written\n"
+           "  --stop-loop                           stop at a jump or branch to itself\n"
+           "  --dump START:END                      print memory after the run\n"
+           "  --no-idle-skip                        run idle loops instead of skipping them\n"
+           "JAM and unimplemented opcodes always stop. Registers, cycles, instructions and host time\n"
+           "are printed as KEY=VALUE.\n"
+           "\n"
+           "JOBFILE has one job per line ('#' starts a comment):\n"
+           "  IMAGE LOAD_ADDR RESET_VECTOR CYCLES [STOP_PC]\n"
+           "addresses in hex, CYCLES in decimal\n"
+           "\n"
+           "--trace-print prints COUNT records (default all) of a trace file,\n"
+           "starting at record N or at the first record at or after cycle C\n");
+}
+
+static uint8_t* read_image(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        printf("Cannot open %s\n", path);
+        exit(1);
+    }
+    uint8_t* data = malloc(0x10000);
+    if (!data) {
+        printf("Failed to allocate image\n");
+        exit(1);
+    }
+    *size = fread(data, 1, 0x10000, f);
+    fclose(f);
+    return data;
+}
+
+/* Parse the job file; returns the job count, images owned by the jobs */
+static size_t read_jobs(const char* path, FleetJob** out) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        printf("Cannot open %s\n", path);
+        exit(1);
+    }
+
+    size_t count = 0, cap = 16;
+    FleetJob* jobs = malloc(cap * sizeof(FleetJob));
+    char line[512];
+    int lineno = 0;
+    while (jobs && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char image[256];
+        unsigned load, reset, stop;
+        unsigned long long cycles;
+        int n = sscanf(line, "%255s %x %x %llu %x", image, &load, &reset, &cycles, &stop);
+        if (n <= 0) continue;
+        if (n < 4 || load > 0xFFFF || reset > 0xFFFF || (n == 5 && stop > 0xFFFF)) {
+            printf("%s:%d: bad job line\n", path, lineno);
+            exit(1);
+        }
+
+        if (count == cap) {
+            cap *= 2;
+            jobs = realloc(jobs, cap * sizeof(FleetJob));
+            if (!jobs) break;
+        }
+        FleetJob* job = &jobs[count++];
+        memset(job, 0, sizeof(*job));
+        job->image = read_image(image, &job->image_size);
+        job->load_addr = (uint16_t)load;
+        job->reset_vector = (uint16_t)reset;
+        job->cycle_budget = cycles;
+        job->stop_on_pc = (n == 5);
+        job->stop_pc = (uint16_t)stop;
+    }
+    fclose(f);
+    if (!jobs) {
+        printf("Failed to allocate jobs\n");
+        exit(1);
+    }
+    *out = jobs;
+    return count;
+}
+
+static int run_fleet(const char* job_path, size_t threads) {
+    static const char* stop_names[] = { "budget", "halted", "pc", "illegal" };
+    FleetJob* jobs;
+    size_t count = read_jobs(job_path, &jobs);
+    FleetResult* results = calloc(count ? count : 1, sizeof(FleetResult));
+    if (!results) {
+        printf("Failed to allocate results\n");
+        exit(1);
+    }
+
+    Fleet* fleet = fleet_create(threads);
+    fleet_run(fleet, jobs, count, results);
+
+    for (size_t i = 0; i < count; i++) {
+        const FleetResult* r = &results[i];
+        printf("job %zu: A=%02X X=%02X Y=%02X SP=%02X P=%02X PC=%04X "
+               "cycles=%" PRIu64 " stop=%s digest=%016" PRIx64 "\n",
+               i, r->a, r->x, r->y, r->sp, r->status, r->pc,
+               r->cycles, stop_names[r->stop], r->digest);
+    }
+    fleet_destroy(fleet);
+
+    for (size_t i = 0; i < count; i++) free((void*)jobs[i].image);
+    free(jobs);
+    free(results);
+    return 0;
+}
+
+/* ============================== Run mode ================================ */
+
+typedef struct {
+    const char* path;
+    bool        prg;            // load address from the first two bytes
+    uint16_t    addr;
+} RunImage;
+
+typedef struct {
+    uint16_t start, end;
+} RunDump;
+
+typedef struct {
+    RunImage  images[MAX_IMAGES];
+    int       image_count;
+    RunDump   dumps[MAX_DUMPS];
+    int       dump_count;
+    uint16_t  stop_pcs[MAX_STOP_PCS];
+    int       stop_pc_count;
+
+    int32_t   reset, nmi, irq;  // vectors to write, -1 to leave memory as loaded
+    int32_t   start_pc;         // -1: from the reset vector
+    uint64_t  cycle_budget;
+    uint64_t  insn_budget;
+    bool      stop_brk;
+    bool      stop_loop;
+    bool      no_idle_skip;
+    int32_t   stop_write;       // -1: none
+} RunOptions;
+
+typedef enum {
+    RUN_STOP_BUDGET, RUN_STOP_JAM, RUN_STOP_PC, RUN_STOP_BRK, RUN_STOP_WRITE, RUN_STOP_LOOP,
+    RUN_STOP_ILLEGAL
+} RunStop;
+
+/* One byte at --stop-write: keeps what was written and stops the CPU */
+typedef struct {
+    CPU*    cpu;
+    uint8_t value;
+    bool    written;
+} StopDevice;
+
+static uint8_t stop_dev_read(void* ctx, uint16_t addr) {
+    (void)addr;
+    return ((StopDevice*)ctx)->value;
+}
+
+static void stop_dev_write(void* ctx, uint16_t addr, uint8_t val) {
+    (void)addr;
+    StopDevice* dev = ctx;
+    dev->value = val;
+    dev->written = true;
+    cpu_stop(dev->cpu);
+}
+
+/* Hex address, with or without a '$' or '0x' prefix */
+static bool parse_addr(const char* s, uint16_t* out) {
+    char* end;
+    if (*s == '$') s++;
+    unsigned long v = strtoul(s, &end, 16);
+    if (end == s || *end || v > 0xFFFF) return false;
+    *out = (uint16_t)v;
+    return true;
+}
+
+/* Decimal count: digits only, no sign, no suffix, in range */
+static bool parse_count(const char* s, uint64_t* out) {
+    char* end;
+    if (!isdigit((unsigned char)*s)) return false;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*end || errno == ERANGE) return false;
+    *out = v;
+    return true;
+}
+
+static void load_image(Bus* bus, const RunImage* img) {
+    size_t size;
+    uint8_t* data = read_image(img->path, &size);
+    const uint8_t* bytes = data;
+    uint16_t addr = img->addr;
+    if (img->prg) {
+        if (size < 2) {
+            printf("%s: not a PRG file\n", img->path);
+            exit(1);
+        }
+        addr = (uint16_t)(data[0] | data[1] << 8);
+        bytes += 2;
+        size -= 2;
+    }
+    /* Clipped at $FFFF */
+    if (size > 0x10000u - addr) size = 0x10000u - addr;
+    bus_load(bus, addr, bytes, size);
+    free(data);
+}
+
+static void set_vector(Bus* bus, uint16_t at, int32_t target) {
+    if (target < 0) return;
+    const uint8_t vec[] = { target & 0xFF, target >> 8 };
+    bus_load(bus, at, vec, sizeof(vec));
+}
+
+static bool stop_pc_hit(const RunOptions* o, uint16_t pc) {
+    for (int i = 0; i < o->stop_pc_count; i++)
+        if (o->stop_pcs[i] == pc) return true;
+    return false;
+}
+
+/* Opcode at pc if it is in direct memory; peeking a device could set it off */
+static bool peek_opcode(CPU* cpu, uint16_t pc, uint8_t* op) {
+    const BusPage* page = &cpu_get_bus(cpu)->pages[pc >> 8];
+    if (!page->read) return false;
+    *op = page->read[pc & 0xFF];
+    return true;
+}
+
+/* PC conditions need every instruction boundary: one step at a time */
+static RunStop run_checked(CPU* cpu, const RunOptions* o, const StopDevice* dev,
+                           uint64_t* cycles, uint64_t* insns) {
+    while (*cycles < o->cycle_budget && *insns < o->insn_budget) {
+        uint16_t pc = cpu_get_pc(cpu);
+        uint8_t op;
+        if (stop_pc_hit(o, pc)) return RUN_STOP_PC;
+        if (o->stop_brk && peek_opcode(cpu, pc, &op) && op == 0x00) return RUN_STOP_BRK;
+
+        *cycles += cpu_step(cpu);
+        *insns += cpu_get_last_steps(cpu);
+        if (cpu_is_illegal(cpu)) return RUN_STOP_ILLEGAL;
+        if (cpu_is_halted(cpu)) return RUN_STOP_JAM;
+        if (dev->written) return RUN_STOP_WRITE;
+        if (o->stop_loop && cpu_get_pc(cpu) == pc) return RUN_STOP_LOOP;
+    }
+    return RUN_STOP_BUDGET;
+}
+
+static RunStop run_free(CPU* cpu, const RunOptions* o, const StopDevice* dev,
+                        uint64_t* cycles, uint64_t* insns) {
+    *cycles = o->insn_budget != UINT64_MAX ? cpu_run_instructions(cpu, o->insn_budget)
+                                           : cpu_run(cpu, o->cycle_budget);
+    *insns = cpu_get_last_steps(cpu);
+    if (cpu_is_illegal(cpu)) return RUN_STOP_ILLEGAL;
+    if (cpu_is_halted(cpu)) return RUN_STOP_JAM;
+    if (dev->written) return RUN_STOP_WRITE;
+    /* No budget given and an idle loop nothing will end */
+    if (cpu_is_stuck(cpu)) return RUN_STOP_LOOP;
+    return RUN_STOP_BUDGET;
+}
+
+static void dump_memory(Bus* bus, const RunDump* d) {
+    for (uint32_t line = d->start & ~0xFu; line <= d->end; line += 16) {
+        printf("%04X:", line);
+        for (uint32_t a = line; a < line + 16 && a <= d->end; a++) {
+            if (a < d->start) printf("   ");
+            else printf(" %02X", bus_read_uncounted(bus, (uint16_t)a));
+        }
+        printf("\n");
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int run_images(const RunOptions* o) {
+    static const char* stop_names[] = {
+        "budget", "jam", "pc", "brk", "write", "loop", "illegal"
+    };
+    uint64_t start = now_ns();
+
+    Memory* mem = memory_create();
+    Bus* bus = bus_create();
+    bus_map_memory(bus, mem);
+    for (int i = 0; i < o->image_count; i++) load_image(bus, &o->images[i]);
+    set_vector(bus, 0xFFFA, o->nmi);
+    set_vector(bus, 0xFFFC, o->reset);
+    set_vector(bus, 0xFFFE, o->irq);
+
+    /* Mapped after loading, so images are not taken for the stop write */
+    StopDevice dev = {0};
+    if (o->stop_write >= 0) {
+        uint16_t a = (uint16_t)o->stop_write;
+        dev.value = bus_read_uncounted(bus, a);
+        bus_map(bus, a, a, stop_dev_read, stop_dev_write, &dev, NULL);
+    }
+
+    /* Created once everything is mapped: its reset is the only one */
+    CPU* cpu = cpu_create(bus);
+    dev.cpu = cpu;
+    cpu_set_idle_skip(cpu, !o->no_idle_skip);
+    if (o->start_pc >= 0) cpu_set_pc(cpu, (uint16_t)o->start_pc);
+
+    uint64_t run_start = now_ns();
+    uint64_t cycles = 0, insns = 0;
+    bool checked = o->stop_pc_count || o->stop_brk || o->stop_loop;
+    RunStop stop = checked ? run_checked(cpu, o, &dev, &cycles, &insns)
+                           : run_free(cpu, o, &dev, &cycles, &insns);
+    uint64_t end = now_ns();
+
+    double run_ns = (double)(end - run_start);
+    if (run_ns < 1) run_ns = 1;
+    printf("A=%02X X=%02X Y=%02X SP=%02X P=%02X PC=%04X cycles=%" PRIu64
+           " insns=%" PRIu64 " stop=%s",
+           cpu_get_a(cpu), cpu_get_x(cpu), cpu_get_y(cpu), cpu_get_sp(cpu),
+           cpu_get_status(cpu), cpu_get_pc(cpu), cycles, insns, stop_names[stop]);
+    if (stop == RUN_STOP_WRITE) printf(" value=%02X", dev.value);
+    if (stop == RUN_STOP_ILLEGAL)
+        printf(" opcode=%02X", bus_read_uncounted(bus, cpu_get_pc(cpu)));
+    printf("\nsetup_us=%.1f run_ms=%.3f mhz=%.2f mips=%.2f idle_cycles=%" PRIu64 "\n",
+           (double)(run_start - start) / 1e3, run_ns / 1e6,
+           (double)cycles * 1e3 / run_ns, (double)insns * 1e3 / run_ns,
+           cpu_get_idle_cycles(cpu));
+    for (int i = 0; i < o->dump_count; i++) dump_memory(bus, &o->dumps[i]);
+
+    cpu_destroy(cpu);
+    if (stop == RUN_STOP_ILLEGAL) return 1;
+    return stop == RUN_STOP_WRITE ? dev.value : 0;
+}
+
+/* Run-mode option at argv[*i]; false if it is not one or is malformed */
+static bool parse_run_option(RunOptions* o, int argc, char** argv, int* i) {
+    const char* opt = argv[*i];
+    char* arg = *i + 1 < argc ? argv[*i + 1] : NULL;
+    uint16_t addr;
+
+    if (!strcmp(opt, "--stop-brk")) {
+        o->stop_brk = true;
+        return true;
+    }
+    if (!strcmp(opt, "--stop-loop")) {
+        o->stop_loop = true;
+        return true;
+    }
+    if (!strcmp(opt, "--no-idle-skip")) {
+        o->no_idle_skip = true;
+        return true;
+    }
+    if (!arg) return false;
+    (*i)++;
+
+    if (!strcmp(opt, "--load")) {
+        char* at = strrchr(arg, '@');
+        if (!at || o->image_count == MAX_IMAGES || !parse_addr(at + 1, &addr)) return false;
+        *at = '\0';
+        o->images[o->image_count++] = (RunImage){ .path = arg, .addr = addr };
+        return true;
+    }
+    if (!strcmp(opt, "--prg")) {
+        if (o->image_count == MAX_IMAGES) return false;
+        o->images[o->image_count++] = (RunImage){ .path = arg, .prg = true };
+        return true;
+    }
+    if (!strcmp(opt, "--dump")) {
+        char start[8], end[8];
+        RunDump d;
+        if (o->dump_count == MAX_DUMPS || sscanf(arg, "%7[^:]:%7s", start, end) != 2) return false;
+        if (!parse_addr(start, &d.start) || !parse_addr(end, &d.end) || d.end < d.start) return false;
+        o->dumps[o->dump_count++] = d;
+        return true;
+    }
+    if (!strcmp(opt, "--cycles") || !strcmp(opt, "--insns")) {
+        if (parse_count(arg, opt[2] == 'c' ? &o->cycle_budget : &o->insn_budget)) return true;
+        printf("%s: expected a decimal count, got '%s'\n", opt, arg);
+        return false;
+    }
+
+    if (!parse_addr(arg, &addr)) return false;
+    if (!strcmp(opt, "--reset"))           o->reset = addr;
+    else if (!strcmp(opt, "--nmi"))        o->nmi = addr;
+    else if (!strcmp(opt, "--irq"))        o->irq = addr;
+    else if (!strcmp(opt, "--pc"))         o->start_pc = addr;
+    else if (!strcmp(opt, "--stop-write")) o->stop_write = addr;
+    else if (!strcmp(opt, "--stop-pc") && o->stop_pc_count < MAX_STOP_PCS)
+        o->stop_pcs[o->stop_pc_count++] = addr;
+    else return false;
+    return true;
+}
+
+static int print_trace(const char* path, bool by_cycle, uint64_t from, uint64_t count) {
+    TraceReader* reader = trace_reader_open(path);
+    if (!reader) {
+        printf("Cannot read trace %s\n", path);
+        return 1;
+    }
+    if (!trace_reader_indexed(reader))
+        fprintf(stderr, "%s: no index (unfinished trace?), rebuilt from blocks\n", path);
+
+    bool found = by_cycle ? trace_reader_seek_cycle(reader, from)
+                          : trace_reader_seek(reader, from);
+    TraceRecord rec;
+    char line[160];
+    while (found && count-- > 0) {
+        uint64_t index = trace_reader_tell(reader);
+        if (!trace_reader_next(reader, &rec)) break;
+        trace_format(&rec, index, line, sizeof(line));
+        puts(line);
+    }
+    trace_reader_close(reader);
     return 0;
 }
+
+int main(int argc, char** argv) {
+    const char* fleet_jobs = NULL;
+    const char* trace_path = NULL;
+    size_t threads = 0;
+    uint64_t trace_from = 0;
+    uint64_t trace_count = UINT64_MAX;
+    bool trace_by_cycle = false;
+    RunOptions run = {
+        .reset = -1, .nmi = -1, .irq = -1, .start_pc = -1, .stop_write = -1,
+        .cycle_budget = UINT64_MAX, .insn_budget = UINT64_MAX,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--fleet") && i + 1 < argc) {
+            fleet_jobs = argv[++i];
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--trace-print") && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--from") && i + 1 < argc) {
+            trace_from = strtoull(argv[++i], NULL, 10);
+            trace_by_cycle = false;
+        } else if (!strcmp(argv[i], "--from-cycle") && i + 1 < argc) {
+            trace_from = strtoull(argv[++i], NULL, 10);
+            trace_by_cycle = true;
+        } else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+            trace_count = strtoull(argv[++i], NULL, 10);
+        } else if (!parse_run_option(&run, argc, argv, &i)) {
+            usage();
+            return 1;
+        }
+    }
+
+    if (fleet_jobs) return run_fleet(fleet_jobs, threads);
+    if (trace_path) return print_trace(trace_path, trace_by_cycle, trace_from, trace_count);
+    if (!run.image_count || (run.cycle_budget != UINT64_MAX && run.insn_budget != UINT64_MAX)) {
+        usage();
+        return 1;
+    }
+    return run_images(&run);
+}
@@ -1,29 +1,68 @@
+#define _DEFAULT_SOURCE
 #include "memory.h"
+#include "bus.h"
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+
+#define MEMORY_SIZE 0x10000
 
 struct Memory {
-    uint8_t cells[65536];
+    uint8_t* cells;         // MEMORY_SIZE bytes, heap or a private file mapping
+    bool     mapped;
+    uint64_t dirty[4];      // pages written since the last memory_clear_dirty
+    Bus*     bus;           // bus to re-arm on clear, NULL if none
 };
 
 Memory* memory_create(void) {
+    Memory* m = malloc(sizeof(Memory));
+    uint8_t* cells = calloc(1, MEMORY_SIZE);    // zeroed without touching fresh pages
+    if (!m || !cells) {
+        printf("Failed to init memory\n");
+        exit(1);
+    }
+    m->cells = cells;
+    m->mapped = false;
+    m->bus = NULL;
+    memset(m->dirty, 0xFF, sizeof(m->dirty));
+    return m;
+}
+
+/*
+ * Map MEMORY_SIZE bytes of an open file copy-on-write: pages are read in
+ * on first touch and writes never reach the file. 'offset' must be a
+ * multiple of the system page size. Returns NULL if the mapping fails.
+ * The contents count as dirty.
+ */
+Memory* memory_map_file(int fd, long offset) {
+    void* cells = mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+    if (cells == MAP_FAILED) return NULL;
+
     Memory* m = malloc(sizeof(Memory));
     if (!m) {
         printf("Failed to init memory\n");
         exit(1);
     }
-    memory_reset(m);
+    m->cells = cells;
+    m->mapped = true;
+    m->bus = NULL;
+    memset(m->dirty, 0xFF, sizeof(m->dirty));
     return m;
 }
 
 void memory_destroy(Memory* mem) {
+    if (!mem) return;
+    if (mem->mapped) munmap(mem->cells, MEMORY_SIZE);
+    else             free(mem->cells);
     free(mem);
     return;
 }
 
 void memory_reset(Memory* mem) {
     if (!mem) return;
-    memset(mem->cells, 0x00, sizeof(mem->cells));
+    memset(mem->cells, 0x00, MEMORY_SIZE);
+    memset(mem->dirty, 0xFF, sizeof(mem->dirty));
+    if (mem->bus) bus_invalidate(mem->bus, 0x0000, 0xFFFF);
     return;
 }
 
@@ -34,6 +73,8 @@ uint8_t memory_read(Memory* mem, uint16_t addr) {
 
 void memory_write(Memory* mem, uint16_t addr, uint8_t value) {
     mem->cells[addr] = value;
+    mem->dirty[addr >> 14] |= 1ull << ((addr >> 8) & 63);
+    if (mem->bus) bus_invalidate(mem->bus, addr, addr);
     return;
 }
 
@@ -59,6 +100,12 @@ void memory_load(Memory* mem, uint16_t start_addr,
                  const uint8_t* data, size_t size) {
     /* TODO: Handle loading data beyond 0xFFFF */
     memcpy(&mem->cells[start_addr], data, size);
+    if (size > 0) {
+        size_t last = start_addr + size - 1;
+        if (last > 0xFFFF) last = 0xFFFF;
+        memory_mark_dirty(mem, start_addr, (uint16_t)last);
+        if (mem->bus) bus_invalidate(mem->bus, start_addr, (uint16_t)last);
+    }
     return;
 }
 
@@ -70,3 +117,39 @@ void memory_dump(Memory* mem, uint16_t start, uint16_t end) {
     (void)mem; (void)start; (void)end;
     return;
 }
+
+bool memory_page_dirty(const Memory* mem, uint8_t page) {
+    return (mem->dirty[page >> 6] >> (page & 63)) & 1;
+}
+
+int memory_next_dirty(const Memory* mem, int page) {
+    for (int w = page >> 6; page < 256 && w < 4; w++, page = w << 6) {
+        uint64_t bits = mem->dirty[w] & (~0ull << (page & 63));
+        if (bits) return (w << 6) | __builtin_ctzll(bits);
+    }
+    return -1;
+}
+
+int memory_dirty_count(const Memory* mem) {
+    int n = 0;
+    for (int w = 0; w < 4; w++) n += __builtin_popcountll(mem->dirty[w]);
+    return n;
+}
+
+void memory_get_dirty(const Memory* mem, uint64_t bits[4]) {
+    memcpy(bits, mem->dirty, sizeof(mem->dirty));
+}
+
+void memory_mark_dirty(Memory* mem, uint16_t start, uint16_t end) {
+    for (int page = start >> 8; page <= (end >> 8); page++)
+        mem->dirty[page >> 6] |= 1ull << (page & 63);
+}
+
+void memory_clear_dirty(Memory* mem) {
+    memset(mem->dirty, 0, sizeof(mem->dirty));
+    if (mem->bus) bus_watch_clean(mem->bus);
+}
+
+void memory_track_bus(Memory* mem, Bus* bus) {
+    mem->bus = bus;
+}
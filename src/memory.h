@@ -6,9 +6,18 @@
 #include <stdio.h>
 
 typedef struct Memory Memory;
+typedef struct Bus Bus;
+
+/*
+ * memory_reset, memory_write and memory_load on a Memory mapped with
+ * bus_map_memory bump the bus generation of the pages they change, so
+ * code cached from those pages is rebuilt before it runs again. Writes
+ * through memory_get_raw are not seen; follow them with bus_invalidate.
+ */
 
 /* Lifecycle */
 Memory*     memory_create(void);
+Memory*     memory_map_file(int fd, long offset);
 void        memory_destroy(Memory* mem);
 void        memory_reset(Memory* mem);
 
@@ -21,4 +30,21 @@ void        memory_load(Memory* mem, uint16_t start_addr,
 uint8_t*    memory_get_raw(Memory* mem);
 void        memory_dump(Memory* mem, uint16_t start, uint16_t end);
 
+/*
+ * Dirty pages: one bit per 256-byte page, set by memory_write,
+ * memory_load, memory_reset and by writes through a bus that maps the
+ * memory with bus_map_memory. After a clear, that bus watches every
+ * clean page, so only the first write to a page takes its slow path.
+ * Writes through memory_get_raw are not seen; mark them by hand.
+ */
+bool        memory_page_dirty(const Memory* mem, uint8_t page);
+int         memory_next_dirty(const Memory* mem, int page);  // first dirty page >= page, -1 if none
+int         memory_dirty_count(const Memory* mem);
+void        memory_get_dirty(const Memory* mem, uint64_t bits[4]);
+void        memory_mark_dirty(Memory* mem, uint16_t start, uint16_t end);
+void        memory_clear_dirty(Memory* mem);
+
+/* Called by bus_map_memory: the bus whose direct writes feed the bitmap */
+void        memory_track_bus(Memory* mem, Bus* bus);
+
 #endif
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "addressing.h"
 enum opcode {
     /* Transfer */
     LDA,LDX,LDY,STA,STX,STY,TAX,TAY,TSX,TXA,TXS,TYA,
@@ -54,9 +55,27 @@ enum ins_type {
     ILLEGAL     /* Catch all illegal */
 };
 
+#define INS_TYPES (ILLEGAL + 1)
+
 typedef enum opcode opcode_t;
 typedef enum ins_type ins_type_t;
 
+/* Decode flags */
+#define OPF_STORE (1 << 0)  // Store: indexed modes always pay the page-cross cycle
+#define OPF_RMW   (1 << 1)  // Read-modify-write on memory: same as store
+
+/* Everything the CPU needs to know about an opcode byte */
+typedef struct {
+    opcode_t    op;
+    addr_mode_t mode;
+    ins_type_t  type;
+    uint8_t     length;     // instruction length in bytes, opcode included
+    uint8_t     cycles;     // base cycles, without page-cross / branch penalties
+    uint8_t     flags;      // OPF_*
+} opcode_info_t;
+
+extern const opcode_info_t opcode_info[256];
+
 /**
  * 3-3-2 structure:
  * ex) $A9 - LDA #oper
@@ -70,4 +89,17 @@ typedef enum ins_type ins_type_t;
 opcode_t fetch_opcode(uint8_t b);
 ins_type_t cat_opcode(opcode_t op);
 
+/* Short name of an instruction class, e.g. "branch" */
+const char* opcode_type_name(ins_type_t type);
+
+/* Assembler name of an opcode byte, e.g. "LDA" */
+const char* opcode_mnemonic(uint8_t b);
+
+/*
+ * Assembler text of one instruction, e.g. "LDA $0300,X". operand holds
+ * the raw operand bytes; branch targets are worked out from pc, the
+ * address of the opcode byte. Returns the length, as snprintf does.
+ */
+int opcode_disassemble(uint8_t b, uint16_t operand, uint16_t pc, char* buf, size_t size);
+
 #endif
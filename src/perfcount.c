@@ -0,0 +1,342 @@
+#define _DEFAULT_SOURCE
+#include "perfcount.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define CALIBRATION_ROUNDS 31       // empty begin/end pairs; the median is the overhead
+
+struct PerfCounters {
+    int        fd[PERF_EVENTS];         // -1 if the host does not have the event
+    uint64_t   start[PERF_EVENTS];      // reading at perf_begin
+    uint64_t   overhead[PERF_EVENTS];   // counts of one empty begin/end pair
+    uint64_t   period;                  // emulated cycles between samples; 0 = off
+    uint64_t   due;                     // cycles until the next sample
+    uint64_t   samples;
+    PerfCounts classes[INS_TYPES];      // raw sampled counts per opcode class
+};
+
+static const char* const event_names[PERF_EVENTS] = {
+    [PERF_TASK_CLOCK]        = "task-clock",
+    [PERF_HOST_CYCLES]       = "cycles",
+    [PERF_HOST_INSTRUCTIONS] = "instructions",
+    [PERF_BRANCHES]          = "branches",
+    [PERF_BRANCH_MISSES]     = "branch-misses",
+    [PERF_L1D_MISSES]        = "L1-dcache-load-misses",
+    [PERF_LLC_MISSES]        = "cache-misses",
+};
+
+/* ============================== Host side =============================== */
+
+#ifdef __linux__
+
+static int event_open(PerfEvent event) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (event) {
+        case PERF_TASK_CLOCK:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_TASK_CLOCK;
+            break;
+        case PERF_HOST_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_HOST_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_BRANCHES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
+            break;
+        case PERF_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_L1D_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D
+                        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        default:
+            return -1;
+    }
+    /* This thread, any CPU, counting from now on */
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Current count, scaled up if the kernel had to multiplex the counter */
+static uint64_t event_read(int fd) {
+    uint64_t v[3];      // value, time enabled, time running
+    if (read(fd, v, sizeof(v)) != (ssize_t)sizeof(v)) return 0;
+    if (v[2] && v[2] < v[1]) return (uint64_t)((double)v[0] * v[1] / v[2]);
+    return v[0];
+}
+
+static void event_close(int fd) {
+    close(fd);
+}
+
+#else
+
+static int event_open(PerfEvent event) {
+    (void)event;
+    return -1;
+}
+
+static uint64_t event_read(int fd) {
+    (void)fd;
+    return 0;
+}
+
+static void event_close(int fd) {
+    (void)fd;
+}
+
+#endif
+
+/* ============================== Counting ================================ */
+
+static void perf_read(const PerfCounters* pc, uint64_t now[PERF_EVENTS]) {
+    for (int e = 0; e < PERF_EVENTS; e++)
+        now[e] = pc->fd[e] >= 0 ? event_read(pc->fd[e]) : 0;
+}
+
+void perf_begin(PerfCounters* pc) {
+    perf_read(pc, pc->start);
+}
+
+/* Counts since perf_begin */
+static void perf_delta(const PerfCounters* pc, uint64_t delta[PERF_EVENTS]) {
+    uint64_t now[PERF_EVENTS];
+    perf_read(pc, now);
+    for (int e = 0; e < PERF_EVENTS; e++)
+        delta[e] = now[e] > pc->start[e] ? now[e] - pc->start[e] : 0;
+}
+
+void perf_end(PerfCounters* pc, PerfCounts* acc) {
+    uint64_t delta[PERF_EVENTS];
+    perf_delta(pc, delta);
+    for (int e = 0; e < PERF_EVENTS; e++) acc->events[e] += delta[e];
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* What a begin/end pair around nothing counts, per event */
+static void perf_calibrate(PerfCounters* pc) {
+    uint64_t rounds[PERF_EVENTS][CALIBRATION_ROUNDS];
+    for (int i = 0; i < CALIBRATION_ROUNDS; i++) {
+        uint64_t delta[PERF_EVENTS];
+        perf_begin(pc);
+        perf_delta(pc, delta);
+        for (int e = 0; e < PERF_EVENTS; e++) rounds[e][i] = delta[e];
+    }
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        qsort(rounds[e], CALIBRATION_ROUNDS, sizeof(uint64_t), compare_u64);
+        pc->overhead[e] = rounds[e][CALIBRATION_ROUNDS / 2];
+    }
+}
+
+PerfCounters* perf_open(void) {
+    PerfCounters* pc = calloc(1, sizeof(PerfCounters));
+    if (!pc) {
+        printf("Failed to allocate perf counters\n");
+        exit(1);
+    }
+    int opened = 0;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        pc->fd[e] = event_open((PerfEvent)e);
+        if (pc->fd[e] >= 0) opened++;
+    }
+    if (!opened) {
+        free(pc);
+        return NULL;
+    }
+    perf_calibrate(pc);
+    return pc;
+}
+
+void perf_close(PerfCounters* pc) {
+    if (!pc) return;
+    for (int e = 0; e < PERF_EVENTS; e++)
+        if (pc->fd[e] >= 0) event_close(pc->fd[e]);
+    free(pc);
+}
+
+bool perf_has(const PerfCounters* pc, PerfEvent event) {
+    return (unsigned)event < PERF_EVENTS && pc->fd[event] >= 0;
+}
+
+const char* perf_event_name(PerfEvent event) {
+    return (unsigned)event < PERF_EVENTS ? event_names[event] : "?";
+}
+
+/* ============================== Wrappers ================================ */
+
+/*
+ * Opcode class of the instruction at PC, or -1 if the step may not run
+ * it: an interrupt is waiting, or the code is on a device page, where
+ * peeking could set off the device.
+ */
+static int next_class(CPU* cpu) {
+    if (cpu_interrupt_requested(cpu)) return -1;
+    uint16_t pc = cpu_get_pc(cpu);
+    const BusPage* page = &cpu_get_bus(cpu)->pages[pc >> 8];
+    if (!page->read) return -1;
+    return opcode_info[page->read[pc & 0xFF]].type;
+}
+
+uint8_t perf_step(PerfCounters* pc, CPU* cpu, PerfCounts* acc) {
+    int type = next_class(cpu);
+    uint64_t delta[PERF_EVENTS];
+
+    perf_begin(pc);
+    uint8_t cycles = cpu_step(cpu);
+    perf_delta(pc, delta);
+
+    uint64_t steps = cpu_get_last_steps(cpu);
+    for (int e = 0; e < PERF_EVENTS; e++) acc->events[e] += delta[e];
+    acc->steps += steps;
+    acc->cycles += cycles;
+
+    if (pc->period && steps) {
+        pc->samples++;
+        if (type >= 0) {
+            PerfCounts* c = &pc->classes[type];
+            for (int e = 0; e < PERF_EVENTS; e++) c->events[e] += delta[e];
+            c->steps++;
+            c->cycles += cycles;
+        }
+    }
+    return cycles;
+}
+
+uint64_t perf_run(PerfCounters* pc, CPU* cpu, uint64_t cycle_budget, PerfCounts* acc) {
+    uint64_t cycles = 0;
+
+    while (cycles < cycle_budget) {
+        uint64_t chunk = cycle_budget - cycles;
+        if (pc->period && pc->due < chunk) chunk = pc->due;
+
+        if (chunk) {
+            perf_begin(pc);
+            uint64_t c = cpu_run(cpu, chunk);
+            perf_end(pc, acc);
+            acc->steps += cpu_get_last_steps(cpu);
+            acc->cycles += c;
+            cycles += c;
+            if (pc->period) pc->due -= c < pc->due ? c : pc->due;
+            /* Short of the chunk: halted or stopped */
+            if (c < chunk || cpu_is_halted(cpu)) break;
+        }
+        if (pc->period && !pc->due && cycles < cycle_budget) {
+            uint8_t c = perf_step(pc, cpu, acc);
+            cycles += c;
+            pc->due = pc->period;
+            if (!c || cpu_is_halted(cpu)) break;
+        }
+    }
+    return cycles;
+}
+
+/* ============================== Sampling ================================ */
+
+void perf_set_sampling(PerfCounters* pc, uint64_t period) {
+    pc->period = period;
+    pc->due = period;
+}
+
+void perf_clear_samples(PerfCounters* pc) {
+    memset(pc->classes, 0, sizeof(pc->classes));
+    pc->samples = 0;
+}
+
+uint64_t perf_samples(const PerfCounters* pc) {
+    return pc->samples;
+}
+
+void perf_class_counts(const PerfCounters* pc, ins_type_t type, PerfCounts* out) {
+    memset(out, 0, sizeof(*out));
+    if ((unsigned)type >= INS_TYPES) return;
+
+    const PerfCounts* c = &pc->classes[type];
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        uint64_t cost = pc->overhead[e] * c->steps;
+        out->events[e] = c->events[e] > cost ? c->events[e] - cost : 0;
+    }
+    out->steps = c->steps;
+    out->cycles = c->cycles;
+}
+
+/* ============================== Report ================================== */
+
+static double ratio(uint64_t a, uint64_t b) {
+    return b ? (double)a / (double)b : 0.0;
+}
+
+void perf_report(const PerfCounters* pc, const PerfCounts* counts, FILE* out) {
+    const uint64_t* ev = counts->events;
+
+    fprintf(out, "Host counters over %" PRIu64 " emulated instructions, %" PRIu64 " cycles\n",
+            counts->steps, counts->cycles);
+    fprintf(out, "  %-22s %16s %14s\n", "event", "count", "per insn");
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (!perf_has(pc, (PerfEvent)e)) {
+            fprintf(out, "  %-22s %16s\n", event_names[e], "unavailable");
+            continue;
+        }
+        fprintf(out, "  %-22s %16" PRIu64 " %14.3f\n",
+                event_names[e], ev[e], ratio(ev[e], counts->steps));
+    }
+
+    if (perf_has(pc, PERF_HOST_CYCLES) && perf_has(pc, PERF_HOST_INSTRUCTIONS))
+        fprintf(out, "  host IPC %.2f\n", ratio(ev[PERF_HOST_INSTRUCTIONS], ev[PERF_HOST_CYCLES]));
+    if (perf_has(pc, PERF_BRANCHES) && perf_has(pc, PERF_BRANCH_MISSES))
+        fprintf(out, "  branch miss rate %.2f%%\n",
+                100.0 * ratio(ev[PERF_BRANCH_MISSES], ev[PERF_BRANCHES]));
+    if (perf_has(pc, PERF_L1D_MISSES))
+        fprintf(out, "  L1D read misses per 1000 insns %.3f\n",
+                1000.0 * ratio(ev[PERF_L1D_MISSES], counts->steps));
+    if (perf_has(pc, PERF_LLC_MISSES))
+        fprintf(out, "  LLC misses per 1000 insns %.3f\n",
+                1000.0 * ratio(ev[PERF_LLC_MISSES], counts->steps));
+
+    if (!pc->samples) return;
+
+    fprintf(out, "\nBy opcode class (%" PRIu64 " samples, read overhead subtracted; per insn)\n",
+            pc->samples);
+    fprintf(out, "  %-10s %8s", "class", "samples");
+    for (int e = 0; e < PERF_EVENTS; e++)
+        if (perf_has(pc, (PerfEvent)e)) fprintf(out, " %14.14s", event_names[e]);
+    fprintf(out, "\n");
+    for (int t = 0; t < INS_TYPES; t++) {
+        PerfCounts c;
+        perf_class_counts(pc, (ins_type_t)t, &c);
+        if (!c.steps) continue;
+        fprintf(out, "  %-10s %8" PRIu64, opcode_type_name((ins_type_t)t), c.steps);
+        for (int e = 0; e < PERF_EVENTS; e++)
+            if (perf_has(pc, (PerfEvent)e))
+                fprintf(out, " %14.2f", ratio(c.events[e], c.steps));
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,87 @@
+/**
+ * Host performance counters around emulator runs.
+ *
+ * Counts what the host CPU does while the emulator runs: cycles,
+ * instructions, branches and branch misses, L1D read misses, last-level
+ * cache misses and task clock. Linux only, through perf_event_open(2)
+ * on the calling thread, user space only. Each event is opened on its
+ * own and left running; an event the host does not have (VMs often have
+ * no hardware PMU) is left out and reported as unavailable. perf_open
+ * returns NULL when none opens, and always on other systems.
+ *
+ * perf_run and perf_step wrap cpu_run and cpu_step: counters are read
+ * before and after, and the host counts are added to a PerfCounts with
+ * the emulated instructions and cycles they were spent on.
+ *
+ * With sampling on (perf_set_sampling), perf_run stops every 'period'
+ * emulated cycles and runs one instruction alone between two counter
+ * reads, charging its counts to the instruction's opcode class. The
+ * reads have a cost of their own; it is measured when the counters are
+ * opened and taken off the per-class figures.
+ */
+#ifndef PERFCOUNT_H_
+#define PERFCOUNT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "cpu.h"
+#include "opcodes.h"
+
+typedef enum {
+    PERF_TASK_CLOCK,            // ns on a host CPU
+    PERF_HOST_CYCLES,
+    PERF_HOST_INSTRUCTIONS,
+    PERF_BRANCHES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,            // L1 data cache read misses
+    PERF_LLC_MISSES,            // last-level cache misses
+    PERF_EVENTS
+} PerfEvent;
+
+typedef struct {
+    uint64_t events[PERF_EVENTS];   // host counts; 0 for unavailable events
+    uint64_t steps;                 // emulated instructions they were spent on
+    uint64_t cycles;                // emulated cycles
+} PerfCounts;
+
+typedef struct PerfCounters PerfCounters;
+
+PerfCounters* perf_open(void);
+void          perf_close(PerfCounters* pc);
+
+bool          perf_has(const PerfCounters* pc, PerfEvent event);
+const char*   perf_event_name(PerfEvent event);   // perf(1) style, e.g. "branch-misses"
+
+/* Count a region of host code: host counts between the two calls are added to acc */
+void          perf_begin(PerfCounters* pc);
+void          perf_end(PerfCounters* pc, PerfCounts* acc);
+
+/* cpu_run / cpu_step, counted into acc. Return the emulated cycles run. */
+uint64_t      perf_run(PerfCounters* pc, CPU* cpu, uint64_t cycle_budget, PerfCounts* acc);
+uint8_t       perf_step(PerfCounters* pc, CPU* cpu, PerfCounts* acc);
+
+/*
+ * Sample one instruction every period emulated cycles in perf_run, 0 to
+ * stop. Samples accumulate until perf_clear_samples.
+ */
+void          perf_set_sampling(PerfCounters* pc, uint64_t period);
+void          perf_clear_samples(PerfCounters* pc);
+uint64_t      perf_samples(const PerfCounters* pc);
+
+/*
+ * Sampled counts of one opcode class, read overhead taken off: steps is
+ * the number of samples. Interrupt entries and code on device pages are
+ * sampled but belong to no class.
+ */
+void          perf_class_counts(const PerfCounters* pc, ins_type_t type, PerfCounts* out);
+
+/*
+ * Totals and per-emulated-instruction figures of counts: host cycles
+ * and instructions per emulated instruction, IPC, branch miss rate,
+ * cache misses per 1000 instructions. Then the per-class breakdown, if
+ * anything was sampled.
+ */
+void          perf_report(const PerfCounters* pc, const PerfCounts* counts, FILE* out);
+
+#endif
@@ -0,0 +1,229 @@
+#include "profile.h"
+#include "opcodes.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/* Operand notation per addressing mode, for the opcode table */
+static const char* const mode_names[] = {
+    [IMM] = "#imm",      [ABS] = "abs",       [ZPG] = "zpg",
+    [ABS_X] = "abs,X",   [ABS_Y] = "abs,Y",   [ZPG_X] = "zpg,X",
+    [ZPG_Y] = "zpg,Y",   [IMPL] = "",         [IND] = "(ind)",
+    [IDX_IND] = "(zpg,X)", [IND_IDX] = "(zpg),Y", [ACC] = "A",
+    [REL] = "rel",
+};
+
+Profile* profile_create(void) {
+    Profile* p = calloc(1, sizeof(Profile));
+    if (!p) {
+        printf("Failed to allocate profile\n");
+        exit(1);
+    }
+    return p;
+}
+
+void profile_destroy(Profile* p) {
+    free(p);
+}
+
+void profile_clear(Profile* p) {
+    memset(p, 0, sizeof(*p));
+}
+
+uint64_t profile_total_insns(const Profile* p) {
+    uint64_t total = 0;
+    for (uint32_t pc = 0; pc < 0x10000; pc++) total += p->insns[pc];
+    return total;
+}
+
+uint64_t profile_total_cycles(const Profile* p) {
+    uint64_t total = 0;
+    for (uint32_t pc = 0; pc < 0x10000; pc++) total += p->cycles[pc];
+    return total;
+}
+
+/*
+ * Read a byte of the program without a bus access: only direct pages,
+ * so a report never runs a device callback.
+ */
+static bool profile_peek(Bus* bus, uint16_t addr, uint8_t* val) {
+    const uint8_t* host = bus->pages[addr >> 8].read;
+    if (!host) return false;
+    *val = host[addr & 0xFF];
+    return true;
+}
+
+/* Opcode and operand bytes at pc; false if it is not in direct memory */
+static bool profile_decode(Bus* bus, uint16_t pc, uint8_t* opcode, uint16_t* operand) {
+    uint8_t lo = 0, hi = 0;
+    if (!profile_peek(bus, pc, opcode)) return false;
+    uint8_t length = opcode_info[*opcode].length;
+    if (length > 1 && !profile_peek(bus, pc + 1, &lo)) return false;
+    if (length > 2 && !profile_peek(bus, pc + 2, &hi)) return false;
+    *operand = lo | (hi << 8);
+    return true;
+}
+
+static int by_cycles(const void* a, const void* b) {
+    const ProfileRoutine* x = a;
+    const ProfileRoutine* y = b;
+    if (x->cycles != y->cycles) return x->cycles < y->cycles ? 1 : -1;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+size_t profile_routines(const Profile* p, Bus* bus, ProfileRoutine* out, size_t max) {
+    uint64_t* calls = calloc(0x10000, sizeof(uint64_t));
+    bool* starts = calloc(0x10000, sizeof(bool));
+    if (!calls || !starts) {
+        printf("Failed to allocate profile report\n");
+        exit(1);
+    }
+
+    /* Every executed JSR marks its target as a routine start */
+    for (uint32_t pc = 0; pc < 0x10000; pc++) {
+        uint8_t opcode;
+        uint16_t target;
+        if (!p->insns[pc] || !profile_decode(bus, pc, &opcode, &target)) continue;
+        if (opcode_info[opcode].op != JSR) continue;
+        starts[target] = true;
+        calls[target] += p->insns[pc];
+    }
+    starts[0] = true;   // the main program, if anything runs below the first target
+
+    size_t count = 0, cap = 64;
+    ProfileRoutine* all = malloc(cap * sizeof(ProfileRoutine));
+    if (!all) {
+        printf("Failed to allocate profile report\n");
+        exit(1);
+    }
+    for (uint32_t pc = 0; pc < 0x10000; pc++) {
+        if (starts[pc]) {
+            /* Drop an empty main program before the next start */
+            if (count && all[count - 1].start == 0 && !all[count - 1].insns
+                && !all[count - 1].calls)
+                count--;
+            if (count == cap) {
+                cap *= 2;
+                all = realloc(all, cap * sizeof(ProfileRoutine));
+                if (!all) {
+                    printf("Failed to allocate profile report\n");
+                    exit(1);
+                }
+            }
+            all[count++] = (ProfileRoutine){ (uint16_t)pc, calls[pc], 0, 0 };
+        }
+        all[count - 1].insns += p->insns[pc];
+        all[count - 1].cycles += p->cycles[pc];
+    }
+    if (all[count - 1].start == 0 && !all[count - 1].insns && !all[count - 1].calls)
+        count--;
+
+    qsort(all, count, sizeof(ProfileRoutine), by_cycles);
+    if (out) memcpy(out, all, (count < max ? count : max) * sizeof(ProfileRoutine));
+
+    free(all);
+    free(starts);
+    free(calls);
+    return count;
+}
+
+/* Share of the total, in percent */
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+/* The 'top' indices of values with the largest nonzero entries, largest first */
+static size_t hottest(const uint64_t* values, size_t n, uint32_t* out, size_t top) {
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!values[i]) continue;
+        if (found == top && values[i] <= values[out[found - 1]]) continue;
+
+        /* Insertion into the sorted list, dropping its last entry if full */
+        size_t j = found < top ? found++ : found - 1;
+        while (j > 0 && values[out[j - 1]] < values[i]) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = (uint32_t)i;
+    }
+    return found;
+}
+
+void profile_report(const Profile* p, Bus* bus, FILE* out, int top) {
+    if (top <= 0) top = 20;
+    uint64_t insns = profile_total_insns(p);
+    uint64_t cycles = profile_total_cycles(p);
+    uint64_t all_cycles = cycles + p->interrupt_cycles;
+
+    uint32_t* rank = malloc(0x10000 * sizeof(uint32_t));
+    ProfileRoutine* routines = malloc((size_t)top * sizeof(ProfileRoutine));
+    uint64_t* op_insns = calloc(256, sizeof(uint64_t));
+    uint64_t* op_cycles = calloc(256, sizeof(uint64_t));
+    if (!rank || !routines || !op_insns || !op_cycles) {
+        printf("Failed to allocate profile report\n");
+        exit(1);
+    }
+
+    fprintf(out, "Profile: %" PRIu64 " instructions, %" PRIu64 " cycles",
+            insns, all_cycles);
+    if (p->interrupts)
+        fprintf(out, " (%" PRIu64 " interrupts, %" PRIu64 " cycles entering them)",
+                p->interrupts, p->interrupt_cycles);
+    fprintf(out, "\n");
+
+    /* Hottest addresses */
+    size_t n = hottest(p->cycles, 0x10000, rank, (size_t)top);
+    fprintf(out, "\nHottest addresses\n");
+    fprintf(out, "  addr  instruction              count         cycles  cycles%%\n");
+    for (size_t i = 0; i < n; i++) {
+        uint16_t pc = rank[i];
+        uint8_t opcode;
+        uint16_t operand;
+        char text[32] = "(device)";
+        if (profile_decode(bus, pc, &opcode, &operand))
+            opcode_disassemble(opcode, operand, pc, text, sizeof(text));
+        fprintf(out, "  %04X  %-16s %14" PRIu64 " %14" PRIu64 "  %6.2f\n",
+                pc, text, p->insns[pc], p->cycles[pc], percent(p->cycles[pc], all_cycles));
+    }
+
+    /* Hottest routines */
+    size_t total = profile_routines(p, bus, routines, (size_t)top);
+    n = total < (size_t)top ? total : (size_t)top;
+    fprintf(out, "\nHottest routines (%zu, grouped by JSR target)\n", total);
+    fprintf(out, "  start           calls          count         cycles  cycles%%\n");
+    for (size_t i = 0; i < n; i++) {
+        const ProfileRoutine* r = &routines[i];
+        char start[16];
+        if (r->start == 0 && !r->calls) snprintf(start, sizeof(start), "(main)");
+        else                            snprintf(start, sizeof(start), "$%04X", r->start);
+        fprintf(out, "  %-8s %14" PRIu64 " %14" PRIu64 " %14" PRIu64 "  %6.2f\n",
+                start, r->calls, r->insns, r->cycles, percent(r->cycles, all_cycles));
+    }
+
+    /* Per-opcode totals */
+    for (uint32_t pc = 0; pc < 0x10000; pc++) {
+        uint8_t opcode;
+        if (!p->insns[pc] || !profile_peek(bus, pc, &opcode)) continue;
+        op_insns[opcode] += p->insns[pc];
+        op_cycles[opcode] += p->cycles[pc];
+    }
+    n = hottest(op_cycles, 256, rank, (size_t)top);
+    fprintf(out, "\nOpcodes\n");
+    fprintf(out, "  op  instruction              count         cycles  cycles%%\n");
+    for (size_t i = 0; i < n; i++) {
+        uint8_t opcode = rank[i];
+        char text[16];
+        snprintf(text, sizeof(text), "%s %s", opcode_mnemonic(opcode),
+                 mode_names[opcode_info[opcode].mode]);
+        fprintf(out, "  %02X  %-16s %14" PRIu64 " %14" PRIu64 "  %6.2f\n",
+                opcode, text, op_insns[opcode], op_cycles[opcode],
+                percent(op_cycles[opcode], all_cycles));
+    }
+
+    free(op_cycles);
+    free(op_insns);
+    free(routines);
+    free(rank);
+}
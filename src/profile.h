@@ -0,0 +1,60 @@
+/**
+ * Per-PC execution profiler.
+ *
+ * A CPU with a profile attached (cpu_set_profile) adds each instruction
+ * it executes to two flat arrays indexed by the instruction's address:
+ * how many times it ran and the cycles it took, page-cross and branch
+ * penalties included. Interrupt entry is counted separately. Nothing is
+ * decoded or looked up while running; profile_report works out routines
+ * and opcodes afterwards from the counts and the program in memory.
+ */
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "bus.h"
+
+/* Public so the run loop can count without a call */
+typedef struct Profile {
+    uint64_t insns[0x10000];        // executions per instruction address
+    uint64_t cycles[0x10000];       // cycles per instruction address
+    uint64_t interrupts;            // IRQ/NMI entries
+    uint64_t interrupt_cycles;
+} Profile;
+
+Profile* profile_create(void);
+void     profile_destroy(Profile* profile);
+void     profile_clear(Profile* profile);
+
+/* Totals over every address, interrupt entry excluded */
+uint64_t profile_total_insns(const Profile* profile);
+uint64_t profile_total_cycles(const Profile* profile);
+
+/* One routine: the JSR target it starts at and what ran inside it */
+typedef struct {
+    uint16_t start;
+    uint64_t calls;                 // JSR executions that targeted it
+    uint64_t insns;
+    uint64_t cycles;
+} ProfileRoutine;
+
+/*
+ * Group the counts into routines. Every executed JSR names a routine
+ * start; an address belongs to the closest start at or below it, and
+ * code below the first start (the main program) forms a routine at
+ * $0000 with no calls. Opcodes are read from the bus now, so code
+ * that was overwritten after it ran is attributed by what is there
+ * today. Fills at most max entries, hottest by cycles first, and
+ * returns how many routines there are in all.
+ */
+size_t   profile_routines(const Profile* profile, Bus* bus,
+                          ProfileRoutine* out, size_t max);
+
+/*
+ * Text report: totals, the 'top' hottest addresses with their
+ * disassembly, the hottest routines and per-opcode totals.
+ */
+void     profile_report(const Profile* profile, Bus* bus, FILE* out, int top);
+
+#endif
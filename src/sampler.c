@@ -0,0 +1,141 @@
+#include "sampler.h"
+#include "opcodes.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+struct Sampler {
+    uint64_t   period;
+    uint64_t   jitter;
+    uint64_t   rng;             // xorshift64 state for the jitter
+    uint64_t   due;             // cycles until the next sample
+    uint64_t   since;           // cycles since the last sample
+    uint64_t   samples;
+    Profile*   profile;
+    CallGraph* stacks;
+};
+
+static uint64_t sampler_interval(Sampler* s) {
+    if (!s->jitter) return s->period;
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 7;
+    s->rng ^= s->rng << 17;
+    return s->period - s->jitter + s->rng % (2 * s->jitter + 1);
+}
+
+Sampler* sampler_create(uint64_t period, uint64_t jitter) {
+    Sampler* s = malloc(sizeof(Sampler));
+    if (!s) {
+        printf("Failed to allocate sampler\n");
+        exit(1);
+    }
+    if (!period) period = 1;
+    s->period = period;
+    s->jitter = jitter < period ? jitter : period - 1;
+    s->rng = 0x9E3779B97F4A7C15ull;
+    s->since = 0;
+    s->samples = 0;
+    s->profile = profile_create();
+    s->stacks = callgraph_create();
+    s->due = sampler_interval(s);
+    return s;
+}
+
+void sampler_destroy(Sampler* s) {
+    if (!s) return;
+    profile_destroy(s->profile);
+    callgraph_destroy(s->stacks);
+    free(s);
+}
+
+void sampler_clear(Sampler* s) {
+    profile_clear(s->profile);
+    callgraph_clear(s->stacks);
+    s->samples = 0;
+}
+
+uint64_t sampler_samples(const Sampler* s) {
+    return s->samples;
+}
+
+Profile* sampler_profile(Sampler* s) {
+    return s->profile;
+}
+
+CallGraph* sampler_stacks(Sampler* s) {
+    return s->stacks;
+}
+
+uint64_t sampler_due(const Sampler* s) {
+    return s->due;
+}
+
+/* A byte of direct memory, without running a device callback */
+static bool sampler_peek(Bus* bus, uint16_t addr, uint8_t* val) {
+    const uint8_t* host = bus->pages[addr >> 8].read;
+    if (!host) return false;
+    *val = host[addr & 0xFF];
+    return true;
+}
+
+/*
+ * Walk the stack page from the top of stack towards $01FF for return
+ * addresses of JSRs. Fills targets innermost first; returns the count.
+ */
+static int scan_stack(Bus* bus, uint8_t sp, uint16_t* targets) {
+    int depth = 0;
+    for (uint16_t i = sp + 1; i < 0xFF && depth < SAMPLER_MAX_DEPTH; i++) {
+        uint8_t lo, hi, op, tlo, thi;
+        if (!sampler_peek(bus, 0x0100 + i, &lo) || !sampler_peek(bus, 0x0100 + i + 1, &hi))
+            break;
+
+        /* JSR pushes the address of its own last byte */
+        uint16_t jsr = ((hi << 8) | lo) - 2;
+        if (!sampler_peek(bus, jsr, &op) || opcode_info[op].op != JSR) continue;
+        if (!sampler_peek(bus, jsr + 1, &tlo) || !sampler_peek(bus, jsr + 2, &thi)) continue;
+        targets[depth++] = (thi << 8) | tlo;
+        i++;
+    }
+    return depth;
+}
+
+static void sampler_take(Sampler* s, Bus* bus, uint16_t pc, uint8_t sp,
+                         const CallGraph* live) {
+    uint64_t weight = s->since;
+    s->profile->insns[pc]++;
+    s->profile->cycles[pc] += weight;
+
+    uint16_t addrs[SAMPLER_MAX_DEPTH];
+    uint8_t kinds[SAMPLER_MAX_DEPTH];
+    int depth = 0;
+    if (live) {
+        /* The shadow stack: outermost frames first, innermost dropped past the cap */
+        for (int i = 0; i < live->depth && depth < SAMPLER_MAX_DEPTH; i++) {
+            const CallNode* n = &live->nodes[live->stack[i].node];
+            addrs[depth] = n->addr;
+            kinds[depth++] = n->kind;
+        }
+        callgraph_add_path(s->stacks, addrs, kinds, depth, weight);
+    } else {
+        uint16_t inner[SAMPLER_MAX_DEPTH];
+        int found = scan_stack(bus, sp, inner);
+        for (int i = 0; i < found; i++) addrs[depth++] = inner[found - 1 - i];
+        callgraph_add_path(s->stacks, addrs, NULL, depth, weight);
+    }
+    s->samples++;
+    s->since = 0;
+}
+
+void sampler_advance(Sampler* s, uint64_t cycles, Bus* bus,
+                     uint16_t pc, uint8_t sp, const CallGraph* live) {
+    s->since += cycles;
+    if (cycles < s->due) {
+        s->due -= cycles;
+        return;
+    }
+
+    /* The budget ends after the instruction that crosses it; keep the schedule */
+    uint64_t overshoot = cycles - s->due;
+    sampler_take(s, bus, pc, sp, live);
+    uint64_t next = sampler_interval(s);
+    s->due = next > overshoot ? next - overshoot : 1;
+}
@@ -0,0 +1,64 @@
+/**
+ * Sampling profiler.
+ *
+ * A CPU with a sampler attached (cpu_set_sampler) stops every 'period'
+ * emulated cycles, give or take a random jitter so samples do not lock
+ * onto a loop of the same length, and records where it is: the PC into
+ * a Profile and the call stack into a CallGraph, each weighted by the
+ * cycles since the previous sample. The usual profile_report and
+ * callgraph_write_folded/report then read them like exact counts.
+ *
+ * Sampling rides on the run budgets: the CPU runs its normal engine
+ * (block cache, threaded dispatch, JIT) with the budget cut at the next
+ * sample, so between samples nothing is added to the run loop at all.
+ *
+ * The call stack comes from the CPU's call graph if one is attached.
+ * Otherwise it is recovered from the 6502 stack page: every byte pair
+ * that reads as the return address of a JSR (the byte before it is a
+ * JSR opcode) counts as a frame calling that JSR's target. Data on the
+ * stack can occasionally pass that test.
+ */
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <stdint.h>
+#include "bus.h"
+#include "profile.h"
+#include "callgraph.h"
+
+#define SAMPLER_MAX_DEPTH 32        // frames kept per sample
+
+typedef struct Sampler Sampler;
+
+/*
+ * Sample every period cycles, each interval drawn uniformly from
+ * [period - jitter, period + jitter]. jitter is clamped below period.
+ */
+Sampler*   sampler_create(uint64_t period, uint64_t jitter);
+void       sampler_destroy(Sampler* sampler);
+
+/* Drop all samples; the schedule carries on */
+void       sampler_clear(Sampler* sampler);
+
+uint64_t   sampler_samples(const Sampler* sampler);
+
+/*
+ * Where samples accumulate. In the profile, insns counts samples and
+ * cycles the cycles they stand for; in the call graph, self_cycles is
+ * the same weight per path and calls stays 0.
+ */
+Profile*   sampler_profile(Sampler* sampler);
+CallGraph* sampler_stacks(Sampler* sampler);
+
+/* Run loop side: cycles left until the next sample is due */
+uint64_t   sampler_due(const Sampler* sampler);
+
+/*
+ * Account cycles that just ran, with the CPU at pc/sp afterwards; takes
+ * a sample if one has come due. live is the CPU's call graph, or NULL
+ * to read the stack page.
+ */
+void       sampler_advance(Sampler* sampler, uint64_t cycles, Bus* bus,
+                           uint16_t pc, uint8_t sp, const CallGraph* live);
+
+#endif
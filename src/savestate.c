@@ -0,0 +1,351 @@
+#define _DEFAULT_SOURCE
+#include "savestate.h"
+#include "bus.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HEADER_SIZE     32
+#define SECTION_SIZE    16
+#define MEM_HEADER_SIZE 40
+#define MEM_ALIGN       4096
+#define IMAGE_SIZE      0x10000
+#define DEV_MAX_SIZE    (16u << 20)   // sanity limit on the DEV payload
+
+#define TAG(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define TAG_CPU TAG('C', 'P', 'U', ' ')
+#define TAG_MEM TAG('M', 'E', 'M', ' ')
+#define TAG_DEV TAG('D', 'E', 'V', ' ')
+#define TAG_END TAG('E', 'N', 'D', ' ')
+
+#define CPU_HALTED        0x01
+#define CPU_NMI_LINE      0x02
+#define CPU_NMI_LINE_PREV 0x04
+#define CPU_NMI_PENDING   0x08
+#define CPU_IRQ_LINE      0x10
+#define CPU_ILLEGAL       0x20
+
+static const char magic[8] = "6502SAV";
+
+/* ========================= Little-endian fields ========================= */
+
+static inline void put16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static inline void put32(uint8_t* p, uint32_t v) { put16(p, v); put16(p + 2, v >> 16); }
+static inline void put64(uint8_t* p, uint64_t v) { put32(p, v); put32(p + 4, v >> 32); }
+
+static inline uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static inline uint32_t get32(const uint8_t* p) { return get16(p) | ((uint32_t)get16(p + 2) << 16); }
+static inline uint64_t get64(const uint8_t* p) { return get32(p) | ((uint64_t)get32(p + 4) << 32); }
+
+/* ============================== Writing ================================= */
+
+typedef struct {
+    FILE*    f;
+    uint64_t off;       // bytes written so far
+    bool     ok;
+} Writer;
+
+static void emit(Writer* w, const void* data, size_t size) {
+    if (w->ok && fwrite(data, 1, size, w->f) != size) w->ok = false;
+    w->off += size;
+}
+
+static void emit_zeros(Writer* w, uint64_t size) {
+    static const uint8_t zeros[256];
+    while (size > 0) {
+        size_t n = size < sizeof(zeros) ? size : sizeof(zeros);
+        emit(w, zeros, n);
+        size -= n;
+    }
+}
+
+static void emit_section(Writer* w, uint32_t tag, uint16_t version, uint64_t length) {
+    uint8_t h[SECTION_SIZE] = {0};
+    put32(h, tag);
+    put16(h + 4, version);
+    put64(h + 8, length);
+    emit(w, h, sizeof(h));
+}
+
+static void write_cpu(Writer* w, CPU* cpu) {
+    CPUState s;
+    uint8_t p[24] = {0};
+    cpu_get_state(cpu, &s);
+
+    p[0] = s.a;
+    p[1] = s.x;
+    p[2] = s.y;
+    p[3] = s.sp;
+    p[4] = s.p;
+    p[5] = (s.halted        ? CPU_HALTED        : 0)
+         | (s.nmi_line      ? CPU_NMI_LINE      : 0)
+         | (s.nmi_line_prev ? CPU_NMI_LINE_PREV : 0)
+         | (s.nmi_pending   ? CPU_NMI_PENDING   : 0)
+         | (s.irq_line      ? CPU_IRQ_LINE      : 0)
+         | (s.illegal       ? CPU_ILLEGAL       : 0);
+    put16(p + 6, s.pc);
+    put64(p + 8, s.total_cycles);
+
+    emit_section(w, TAG_CPU, 1, sizeof(p));
+    emit(w, p, sizeof(p));
+}
+
+/* Page-aligned image, streamed a page at a time */
+static void write_mem(Writer* w, Bus* bus) {
+    uint64_t payload = w->off + SECTION_SIZE;
+    uint64_t data = (payload + MEM_HEADER_SIZE + MEM_ALIGN - 1) / MEM_ALIGN * MEM_ALIGN;
+    uint32_t data_offset = (uint32_t)(data - payload);
+    uint8_t h[MEM_HEADER_SIZE] = {0};
+
+    put32(h, data_offset);
+    for (int page = 0; page < BUS_PAGES; page++)
+        if (bus_page_host(bus, page)) h[8 + (page >> 3)] |= 1 << (page & 7);
+
+    emit_section(w, TAG_MEM, 1, data_offset + (uint64_t)IMAGE_SIZE);
+    emit(w, h, sizeof(h));
+    emit_zeros(w, data_offset - MEM_HEADER_SIZE);
+    for (int page = 0; page < BUS_PAGES; page++) {
+        const uint8_t* host = bus_page_host(bus, page);
+        if (host) emit(w, host, 256);
+        else      emit_zeros(w, 256);
+    }
+}
+
+/* Every device's state, in one bus_save_state buffer */
+static void write_dev(Writer* w, Bus* bus) {
+    size_t size = bus_state_size(bus);
+    if (!size) return;
+
+    uint8_t* buf = malloc(size);
+    if (!buf) {
+        printf("Failed to allocate device state\n");
+        exit(1);
+    }
+    bus_save_state(bus, buf);
+    emit_section(w, TAG_DEV, 1, size);
+    emit(w, buf, size);
+    emit_zeros(w, ((size + 7) & ~(size_t)7) - size);
+    free(buf);
+}
+
+bool savestate_write(CPU* cpu, FILE* out) {
+    Writer w = { out, 0, true };
+    uint8_t h[HEADER_SIZE] = {0};
+
+    memcpy(h, magic, sizeof(magic));
+    put16(h + 8, SAVESTATE_MAJOR);
+    put16(h + 10, SAVESTATE_MINOR);
+    put32(h + 12, HEADER_SIZE);
+    emit(&w, h, sizeof(h));
+
+    write_cpu(&w, cpu);
+    write_mem(&w, cpu_get_bus(cpu));
+    write_dev(&w, cpu_get_bus(cpu));
+    emit_section(&w, TAG_END, 1, 0);
+    return w.ok && fflush(out) == 0;
+}
+
+bool savestate_save(CPU* cpu, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = savestate_write(cpu, f);
+    return fclose(f) == 0 && ok;
+}
+
+/* ============================== Reading ================================= */
+
+typedef struct {
+    FILE*    f;
+    uint64_t off;       // bytes consumed so far
+} Reader;
+
+static bool take(Reader* r, void* data, size_t size) {
+    if (fread(data, 1, size, r->f) != size) return false;
+    r->off += size;
+    return true;
+}
+
+/* Seek past seekable input, read through pipes */
+static bool skip(Reader* r, uint64_t size) {
+    if (size <= (uint64_t)0x7FFFFFFF && fseek(r->f, (long)size, SEEK_CUR) == 0) {
+        r->off += size;
+        return true;
+    }
+    uint8_t buf[256];
+    while (size > 0) {
+        size_t n = size < sizeof(buf) ? size : sizeof(buf);
+        if (!take(r, buf, n)) return false;
+        size -= n;
+    }
+    return true;
+}
+
+typedef struct {
+    bool     has_cpu;
+    bool     has_mem;
+    CPUState cpu;
+    uint8_t  pages[32];     // MEM page bitmap
+    uint64_t mem_offset;    // file offset of the image
+    uint8_t* image;         // image read from the stream, if asked for
+    uint8_t* devices;       // DEV payload, NULL if none
+    uint64_t devices_size;
+} Parsed;
+
+static bool parse_cpu(Reader* r, Parsed* st, uint64_t length) {
+    uint8_t p[24];
+    if (length < sizeof(p) || !take(r, p, sizeof(p))) return false;
+
+    st->cpu.a             = p[0];
+    st->cpu.x             = p[1];
+    st->cpu.y             = p[2];
+    st->cpu.sp            = p[3];
+    st->cpu.p             = p[4];
+    st->cpu.halted        = p[5] & CPU_HALTED;
+    st->cpu.nmi_line      = p[5] & CPU_NMI_LINE;
+    st->cpu.nmi_line_prev = p[5] & CPU_NMI_LINE_PREV;
+    st->cpu.nmi_pending   = p[5] & CPU_NMI_PENDING;
+    st->cpu.irq_line      = p[5] & CPU_IRQ_LINE;
+    st->cpu.illegal       = p[5] & CPU_ILLEGAL;
+    st->cpu.pc            = get16(p + 6);
+    st->cpu.total_cycles  = get64(p + 8);
+    st->has_cpu = true;
+    return skip(r, length - sizeof(p));
+}
+
+static bool parse_mem(Reader* r, Parsed* st, uint64_t length, bool read_image) {
+    uint8_t h[MEM_HEADER_SIZE];
+    if (length < MEM_HEADER_SIZE || !take(r, h, sizeof(h))) return false;
+
+    uint32_t data_offset = get32(h);
+    if (data_offset < MEM_HEADER_SIZE || length < data_offset + (uint64_t)IMAGE_SIZE)
+        return false;
+    memcpy(st->pages, h + 8, sizeof(st->pages));
+    if (!skip(r, data_offset - MEM_HEADER_SIZE)) return false;
+
+    st->mem_offset = r->off;
+    if (read_image) {
+        if (!st->image) st->image = malloc(IMAGE_SIZE);
+        if (!st->image) {
+            printf("Failed to allocate save state image\n");
+            exit(1);
+        }
+        if (!take(r, st->image, IMAGE_SIZE)) return false;
+    } else if (!skip(r, IMAGE_SIZE)) {
+        return false;
+    }
+    st->has_mem = true;
+    return skip(r, length - data_offset - IMAGE_SIZE);
+}
+
+static bool parse_dev(Reader* r, Parsed* st, uint64_t length) {
+    if (length > DEV_MAX_SIZE || st->devices) return false;
+    st->devices = malloc(length ? length : 1);
+    if (!st->devices) {
+        printf("Failed to allocate device state\n");
+        exit(1);
+    }
+    st->devices_size = length;
+    return take(r, st->devices, length);
+}
+
+/* Read a whole state; nothing is applied until it has all been read */
+static bool parse(FILE* in, Parsed* st, bool read_image) {
+    Reader r = { in, 0 };
+    uint8_t h[HEADER_SIZE];
+
+    memset(st, 0, sizeof(*st));
+    if (!take(&r, h, sizeof(h)) || memcmp(h, magic, sizeof(magic)) != 0) return false;
+    if (get16(h + 8) != SAVESTATE_MAJOR) return false;
+    uint32_t header_size = get32(h + 12);
+    if (header_size < HEADER_SIZE || !skip(&r, header_size - HEADER_SIZE)) return false;
+
+    for (;;) {
+        uint8_t s[SECTION_SIZE];
+        if (!take(&r, s, sizeof(s))) return false;
+        uint32_t tag = get32(s);
+        uint16_t version = get16(s + 4);
+        uint64_t length = get64(s + 8);
+        uint64_t padded = (length + 7) & ~7ull;
+        bool ok;
+
+        if (tag == TAG_END) break;
+        if (tag == TAG_CPU && version == 1)      ok = parse_cpu(&r, st, length);
+        else if (tag == TAG_MEM && version == 1) ok = parse_mem(&r, st, length, read_image);
+        else if (tag == TAG_DEV && version == 1) ok = parse_dev(&r, st, length);
+        else                                     ok = skip(&r, length);
+        if (!ok || !skip(&r, padded - length)) return false;
+    }
+    return st->has_cpu;
+}
+
+static void apply_mem(Bus* bus, const Parsed* st) {
+    for (int page = 0; page < BUS_PAGES; page++)
+        if (st->pages[page >> 3] & (1 << (page & 7)))
+            bus_fill_page(bus, page, st->image + (page << 8));
+}
+
+static void parsed_free(Parsed* st) {
+    free(st->image);
+    free(st->devices);
+}
+
+bool savestate_read(CPU* cpu, FILE* in) {
+    Parsed st;
+    Bus* bus = cpu_get_bus(cpu);
+    bool ok = parse(in, &st, true);
+
+    /* Device state only fits a bus with the same devices */
+    if (ok && st.devices && st.devices_size != bus_state_size(bus)) ok = false;
+    if (ok) {
+        cpu_set_state(cpu, &st.cpu);
+        if (st.has_mem) apply_mem(bus, &st);
+        if (st.devices) bus_restore_state(bus, st.devices);
+    }
+    parsed_free(&st);
+    return ok;
+}
+
+bool savestate_load(CPU* cpu, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    bool ok = savestate_read(cpu, f);
+    fclose(f);
+    return ok;
+}
+
+CPU* savestate_open(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    Parsed st;
+    if (!parse(f, &st, false)) {
+        parsed_free(&st);
+        fclose(f);
+        return NULL;
+    }
+    parsed_free(&st);       // the new machine has no devices to restore
+
+    Memory* mem = NULL;
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (st.has_mem && page_size > 0 && st.mem_offset % page_size == 0)
+        mem = memory_map_file(fileno(f), (long)st.mem_offset);
+
+    /* Unaligned data or no mmap: read the image instead */
+    if (!mem) {
+        mem = memory_create();
+        if (st.has_mem && (fseek(f, (long)st.mem_offset, SEEK_SET) != 0
+                           || fread(memory_get_raw(mem), 1, IMAGE_SIZE, f) != IMAGE_SIZE)) {
+            memory_destroy(mem);
+            fclose(f);
+            return NULL;
+        }
+    }
+    fclose(f);      // the mapping stays valid after close
+
+    Bus* bus = bus_create();
+    bus_map_memory(bus, mem);
+    CPU* cpu = cpu_create(bus);
+    cpu_set_state(cpu, &st.cpu);
+    return cpu;
+}
@@ -0,0 +1,81 @@
+/**
+ * Versioned binary save states.
+ *
+ * A file is a header followed by tagged sections, written front to back
+ * so it can be streamed to a pipe or socket. All integers are little
+ * endian.
+ *
+ *   Header (32 bytes)
+ *     0   char[8]  magic "6502SAV\0"
+ *     8   u16      major version: readers reject any other major
+ *     10  u16      minor version: additions older readers can skip
+ *     12  u32      header size (32); readers skip what they don't know
+ *     16  u8[16]   reserved, zero
+ *
+ *   Section (16-byte header, payload padded to a multiple of 8)
+ *     0   u32      tag, four ASCII characters ('CPU ', 'MEM ', 'DEV ', 'END ')
+ *     4   u16      section version
+ *     6   u16      reserved, zero
+ *     8   u64      payload length, excluding the padding
+ *
+ *   'CPU ' v1 payload (24 bytes)
+ *     0   u8 A, X, Y, SP, P      packed status byte
+ *     5   u8       flags: 1 halted, 2 NMI line, 4 previous NMI line,
+ *                  8 NMI pending, 16 IRQ line, 32 halted on an
+ *                  unimplemented opcode
+ *     6   u16      PC
+ *     8   u64      total cycles
+ *     16  u8[8]    reserved, zero
+ *
+ *   'MEM ' v1 payload
+ *     0   u32      data offset from the start of the payload; the data
+ *                  is 4096-byte aligned in the file so it can be mmap'd
+ *     4   u32      reserved, zero
+ *     8   u8[32]   bitmap of pages that hold memory (bit n = page n)
+ *     40  zero padding up to the data offset
+ *     ... u8[65536] address space image; pages without a bit are zero
+ *
+ *   'DEV ' v1 payload, present when a device has state hooks
+ *     0   bus_save_state buffer: each device's state back to back, in
+ *         mapping order, as its save hook wrote it
+ *
+ *   'END ' marks the end of the state; it has no payload.
+ *
+ * Readers skip sections whose tag they don't know, so new sections can
+ * be added without a major version bump. The memory section holds the
+ * whole direct pages of writable regions, as snapshots do.
+ */
+#ifndef SAVESTATE_H_
+#define SAVESTATE_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+#define SAVESTATE_MAJOR 1
+#define SAVESTATE_MINOR 0
+
+/* Stream a save state of the machine; false on a write error */
+bool savestate_write(CPU* cpu, FILE* out);
+bool savestate_save(CPU* cpu, const char* path);
+
+/*
+ * Stream a save state into an existing machine with the same bus layout.
+ * Memory is copied into the bus's writable direct pages and device state
+ * restored through the device hooks. False (and the machine unchanged)
+ * if the stream is not a readable state or its device state is not the
+ * size this bus's devices expect.
+ */
+bool savestate_read(CPU* cpu, FILE* in);
+bool savestate_load(CPU* cpu, const char* path);
+
+/*
+ * Create a new machine (one Memory over the whole bus) from a state file.
+ * The memory is mapped copy-on-write from the file rather than read, so
+ * only pages the program touches are ever loaded; writes stay private.
+ * The new bus has no devices, so a DEV section is ignored.
+ * Falls back to reading if the data can't be mapped. NULL on error.
+ */
+CPU* savestate_open(const char* path);
+
+#endif
@@ -0,0 +1,106 @@
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* Shared by every snapshot (and tracker) holding these bytes */
+struct SnapPage {
+    _Atomic uint32_t refs;
+    uint8_t          bytes[256];
+};
+
+struct PageTracker {
+    SnapPage* base[BUS_PAGES];       // stored page the host bytes matched
+    uint32_t  base_gen[BUS_PAGES];   // bus page generation at that point
+    uint64_t  copies;
+};
+
+static inline SnapPage* page_retain(SnapPage* page) {
+    if (page) atomic_fetch_add_explicit(&page->refs, 1, memory_order_relaxed);
+    return page;
+}
+
+static inline void page_release(SnapPage* page) {
+    if (page && atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1)
+        free(page);
+}
+
+/* Point the tracker at 'page' as the current contents of bus page p */
+static void tracker_set_base(PageTracker* t, Bus* bus, int p, SnapPage* page) {
+    if (t->base[p] != page) {
+        page_release(t->base[p]);
+        t->base[p] = page_retain(page);
+    }
+    t->base_gen[p] = bus_page_gen(bus, p);
+    bus_watch_page(bus, p);
+}
+
+PageTracker* page_tracker_create(void) {
+    PageTracker* t = calloc(1, sizeof(PageTracker));
+    if (!t) {
+        printf("Failed to allocate page tracker\n");
+        exit(1);
+    }
+    return t;
+}
+
+void page_tracker_destroy(PageTracker* tracker) {
+    if (!tracker) return;
+    for (int p = 0; p < BUS_PAGES; p++) page_release(tracker->base[p]);
+    free(tracker);
+}
+
+void page_tracker_capture(PageTracker* tracker, Bus* bus, PageSet* set) {
+    for (int p = 0; p < BUS_PAGES; p++) {
+        uint8_t* host = bus_page_host(bus, p);
+        if (!host) {
+            set->pages[p] = NULL;
+            continue;
+        }
+
+        SnapPage* page = tracker->base[p];
+        if (!page || bus_page_gen(bus, p) != tracker->base_gen[p]) {
+            page = malloc(sizeof(SnapPage));
+            if (!page) {
+                printf("Failed to allocate snapshot page\n");
+                exit(1);
+            }
+            atomic_init(&page->refs, 0);
+            memcpy(page->bytes, host, sizeof(page->bytes));
+            tracker->copies++;
+            tracker_set_base(tracker, bus, p, page);
+        }
+        set->pages[p] = page_retain(page);
+    }
+}
+
+void page_tracker_restore(PageTracker* tracker, Bus* bus, const PageSet* set) {
+    for (int p = 0; p < BUS_PAGES; p++) {
+        SnapPage* page = set->pages[p];
+        if (!page || !bus_page_host(bus, p)) continue;
+        if (tracker->base[p] == page && bus_page_gen(bus, p) == tracker->base_gen[p])
+            continue;
+
+        /* Written behind the fast path: cached code from the page is stale */
+        bus_fill_page(bus, p, page->bytes);
+        tracker->copies++;
+        tracker_set_base(tracker, bus, p, page);
+    }
+}
+
+uint64_t page_tracker_copies(const PageTracker* tracker) {
+    return tracker->copies;
+}
+
+void page_set_release(PageSet* set) {
+    for (int p = 0; p < BUS_PAGES; p++) {
+        page_release(set->pages[p]);
+        set->pages[p] = NULL;
+    }
+}
+
+const uint8_t* page_set_bytes(const PageSet* set, uint8_t page) {
+    return set->pages[page] ? set->pages[page]->bytes : NULL;
+}
@@ -0,0 +1,50 @@
+/**
+ * Copy-on-write page store behind cpu_snapshot / cpu_restore.
+ *
+ * Memory is captured as 256-byte pages, refcounted and shared between
+ * every snapshot that holds the same contents. A tracker remembers, per
+ * bus page, the stored page the host bytes last matched and the bus page
+ * generation at that moment. Pages are watched on the bus, so the first
+ * write after a capture or restore bumps the generation: a page whose
+ * generation is unchanged still matches its stored copy and is shared
+ * (capture) or skipped (restore) without touching its bytes.
+ *
+ * Only whole direct pages of writable regions are stored; ROM is never
+ * written and device state goes through the bus's device hooks. Writes
+ * through raw pointers go around the bus and must be followed by
+ * bus_invalidate.
+ */
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bus.h"
+
+typedef struct SnapPage SnapPage;
+typedef struct PageTracker PageTracker;
+
+/* One stored page per bus page, NULL where nothing was stored */
+typedef struct {
+    SnapPage* pages[BUS_PAGES];
+} PageSet;
+
+PageTracker* page_tracker_create(void);
+void         page_tracker_destroy(PageTracker* tracker);
+
+/* Fill set with the bus's current memory; copies only changed pages */
+void         page_tracker_capture(PageTracker* tracker, Bus* bus, PageSet* set);
+
+/* Write set back to the bus; copies only pages that differ from it */
+void         page_tracker_restore(PageTracker* tracker, Bus* bus, const PageSet* set);
+
+/* Pages copied by capture and restore over the tracker's lifetime */
+uint64_t     page_tracker_copies(const PageTracker* tracker);
+
+/* Drop every page of a set */
+void         page_set_release(PageSet* set);
+
+/* Stored bytes of a page, NULL if the set holds none */
+const uint8_t* page_set_bytes(const PageSet* set, uint8_t page);
+
+#endif
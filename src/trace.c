@@ -0,0 +1,375 @@
+#define _DEFAULT_SOURCE
+#include "trace.h"
+#include "opcodes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define DEFAULT_RING   (1u << 16)
+#define WRITER_NAP_MS  10           // idle writer flushes at least this often
+#define HEADER_SIZE    16
+#define BLOCK_HEADER   24
+#define DELTA_MAX      26           // largest encoded delta record
+
+static const char magic[8] = "6502TRC";
+static const char index_magic[8] = "6502IDX";
+
+/* One index entry per block */
+typedef struct {
+    uint64_t first;
+    uint64_t cycle;
+    uint64_t offset;
+} IndexEntry;
+
+/*
+ * Writer-side encoder: the block being built, the record each delta is
+ * relative to, and the index of blocks written so far.
+ */
+typedef struct {
+    uint8_t*    buf;            // block header + payload
+    size_t      len;
+    uint32_t    count;          // records in the block
+    TraceRecord prev;
+    uint64_t    records;        // records encoded over the whole trace
+    uint64_t    offset;         // file offset of the next block
+    IndexEntry* index;
+    size_t      blocks;
+    size_t      index_cap;
+} Encoder;
+
+/*
+ * head is only written by the producer and tail only by the writer; each
+ * keeps a cached copy of the other's index so the common case touches
+ * no shared cache line. The producer wakes the writer every half ring,
+ * so records go out in large batches.
+ */
+struct Tracer {
+    TraceRecord*     ring;
+    size_t           mask;
+
+    /* Producer */
+    _Alignas(64) _Atomic uint64_t head;
+    uint64_t         tail_seen;
+    uint64_t         records;
+    uint64_t         stalls;
+
+    /* Writer */
+    _Alignas(64) _Atomic uint64_t tail;
+    FILE*            out;
+    bool             write_error;
+    Encoder          enc;
+
+    pthread_t        thread;
+    pthread_mutex_t  lock;
+    pthread_cond_t   wake;
+    bool             stop;          // under lock
+};
+
+static void tracer_kick(Tracer* t) {
+    pthread_mutex_lock(&t->lock);
+    pthread_cond_signal(&t->wake);
+    pthread_mutex_unlock(&t->lock);
+}
+
+/* ============================== Encoding ================================ */
+
+static inline uint8_t* put16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; return p + 2; }
+static inline uint8_t* put32(uint8_t* p, uint32_t v) { put16(p, v); put16(p + 2, v >> 16); return p + 4; }
+static inline uint8_t* put64(uint8_t* p, uint64_t v) { put32(p, v); put32(p + 4, v >> 32); return p + 8; }
+
+static void tracer_write(Tracer* t, const void* data, size_t size) {
+    if (!t->write_error && fwrite(data, 1, size, t->out) != size)
+        t->write_error = true;
+    t->enc.offset += size;
+}
+
+static void encode_full(uint8_t* p, const TraceRecord* r) {
+    p = put64(p, r->cycle);
+    p = put16(p, r->pc);
+    p = put16(p, r->operand);
+    p = put16(p, r->ea);
+    *p++ = r->opcode;
+    *p++ = r->kind;
+    *p++ = r->a;
+    *p++ = r->x;
+    *p++ = r->y;
+    *p++ = r->sp;
+    *p++ = r->p;
+    *p++ = r->data;
+    *p++ = r->flags;
+    *p   = 0;
+}
+
+uint16_t trace_next_pc(const TraceRecord* prev) {
+    if (prev->kind != TRACE_INSN) return prev->ea;
+    return prev->pc + opcode_info[prev->opcode].length;
+}
+
+uint16_t trace_predict_ea(const TraceRecord* r) {
+    if (r->kind != TRACE_INSN) return 0;
+    uint16_t v = r->operand;
+    switch (opcode_info[r->opcode].mode) {
+        case ABS: case ZPG: return v;
+        case ABS_X:         return v + r->x;
+        case ABS_Y:         return v + r->y;
+        case ZPG_X:         return (v + r->x) & 0xFF;
+        case ZPG_Y:         return (v + r->y) & 0xFF;
+        case REL:           return r->pc + 2 + (int8_t)v;
+        default:            return 0;
+    }
+}
+
+static size_t encode_delta(uint8_t* out, const TraceRecord* r, const TraceRecord* prev) {
+    uint16_t mask = 0;
+    uint8_t* p = out + 2;
+
+    if (r->kind != prev->kind) {
+        mask |= TRACE_D_KIND;
+        *p++ = r->kind;
+    }
+    if (r->kind == TRACE_INSN) {
+        uint8_t length = opcode_info[r->opcode].length;
+        *p++ = r->opcode;
+        if (length > 1) *p++ = r->operand;
+        if (length > 2) *p++ = r->operand >> 8;
+    }
+    if (r->pc != trace_next_pc(prev)) {
+        mask |= TRACE_D_PC;
+        p = put16(p, r->pc);
+    }
+    if (r->a != prev->a)   { mask |= TRACE_D_A;  *p++ = r->a; }
+    if (r->x != prev->x)   { mask |= TRACE_D_X;  *p++ = r->x; }
+    if (r->y != prev->y)   { mask |= TRACE_D_Y;  *p++ = r->y; }
+    if (r->sp != prev->sp) { mask |= TRACE_D_SP; *p++ = r->sp; }
+    if (r->p != prev->p)   { mask |= TRACE_D_P;  *p++ = r->p; }
+    if (r->ea != trace_predict_ea(r)) {
+        mask |= TRACE_D_EA;
+        p = put16(p, r->ea);
+    }
+    if (r->flags & TRACE_F_DATA) {
+        mask |= TRACE_D_DATA;
+        *p++ = r->data;
+    }
+    if (r->cycle >= prev->cycle && r->cycle - prev->cycle <= 0xFF) {
+        *p++ = r->cycle - prev->cycle;
+    } else {
+        mask |= TRACE_D_CYCLE;
+        p = put64(p, r->cycle);
+    }
+    put16(out, mask);
+    return p - out;
+}
+
+/* Write the block out and add it to the index */
+static void encoder_flush(Tracer* t) {
+    Encoder* e = &t->enc;
+    if (!e->count) return;
+
+    if (e->blocks == e->index_cap) {
+        e->index_cap = e->index_cap ? e->index_cap * 2 : 256;
+        e->index = realloc(e->index, e->index_cap * sizeof(IndexEntry));
+        if (!e->index) {
+            printf("Failed to allocate trace index\n");
+            exit(1);
+        }
+    }
+    uint64_t first = e->records - e->count;
+    uint64_t cycle = 0;
+    for (int i = 7; i >= 0; i--) cycle = (cycle << 8) | e->buf[BLOCK_HEADER + i];
+    e->index[e->blocks++] = (IndexEntry){ first, cycle, e->offset };
+
+    put32(e->buf, (uint32_t)(e->len - BLOCK_HEADER));
+    put32(e->buf + 4, e->count);
+    put64(e->buf + 8, first);
+    put64(e->buf + 16, cycle);
+    tracer_write(t, e->buf, e->len);
+    e->len = BLOCK_HEADER;
+    e->count = 0;
+}
+
+static void encoder_add(Tracer* t, const TraceRecord* r) {
+    Encoder* e = &t->enc;
+    if (e->count == 0) {
+        encode_full(e->buf + e->len, r);
+        e->len += sizeof(TraceRecord);
+    } else {
+        e->len += encode_delta(e->buf + e->len, r, &e->prev);
+    }
+    e->prev = *r;
+    e->records++;
+    if (++e->count == TRACE_KEYFRAME) encoder_flush(t);
+}
+
+/* Last block, the index and the footer */
+static void encoder_finish(Tracer* t) {
+    Encoder* e = &t->enc;
+    encoder_flush(t);
+
+    uint64_t index_offset = e->offset;
+    for (size_t i = 0; i < e->blocks; i++) {
+        uint8_t entry[24];
+        put64(entry, e->index[i].first);
+        put64(entry + 8, e->index[i].cycle);
+        put64(entry + 16, e->index[i].offset);
+        tracer_write(t, entry, sizeof(entry));
+    }
+
+    uint8_t footer[32];
+    put64(footer, index_offset);
+    put64(footer + 8, e->blocks);
+    put64(footer + 16, e->records);
+    memcpy(footer + 24, index_magic, sizeof(index_magic));
+    tracer_write(t, footer, sizeof(footer));
+}
+
+/* ============================== Writer thread =========================== */
+
+/* Encode the records in [tail, head) */
+static uint64_t tracer_drain(Tracer* t, uint64_t tail, uint64_t head) {
+    while (tail != head) {
+        encoder_add(t, &t->ring[tail & t->mask]);
+        tail++;
+
+        /* Hand slots back in batches, not one shared write per record */
+        if ((tail & 255) == 0)
+            atomic_store_explicit(&t->tail, tail, memory_order_release);
+    }
+    atomic_store_explicit(&t->tail, tail, memory_order_release);
+    return tail;
+}
+
+static void* tracer_writer(void* arg) {
+    Tracer* t = arg;
+    uint64_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+        if (head != tail) {
+            tail = tracer_drain(t, tail, head);
+            continue;
+        }
+
+        /* Empty: sleep until kicked, stopped, or it is time to flush */
+        pthread_mutex_lock(&t->lock);
+        bool stop = t->stop;
+        if (!stop && atomic_load_explicit(&t->head, memory_order_acquire) == tail) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += WRITER_NAP_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&t->wake, &t->lock, &until);
+        }
+        pthread_mutex_unlock(&t->lock);
+
+        /* Stop only once everything published before it is written */
+        if (stop && atomic_load_explicit(&t->head, memory_order_acquire) == tail)
+            break;
+    }
+    encoder_finish(t);
+    return NULL;
+}
+
+Tracer* tracer_open(const char* path, size_t ring_records) {
+    size_t capacity = 1;
+    if (!ring_records) ring_records = DEFAULT_RING;
+    while (capacity < ring_records) capacity <<= 1;
+    if (capacity < 2) capacity = 2;
+
+    FILE* out = fopen(path, "wb");
+    if (!out) return NULL;
+
+    uint8_t header[HEADER_SIZE] = {0};
+    memcpy(header, magic, sizeof(magic));
+    put16(header + 8, TRACE_VERSION);
+    put16(header + 10, sizeof(TraceRecord));
+    put32(header + 12, TRACE_KEYFRAME);
+    if (fwrite(header, 1, sizeof(header), out) != sizeof(header)) {
+        fclose(out);
+        return NULL;
+    }
+
+    Tracer* t = aligned_alloc(64, (sizeof(Tracer) + 63) & ~(size_t)63);
+    TraceRecord* ring = malloc(capacity * sizeof(TraceRecord));
+    uint8_t* block = malloc(BLOCK_HEADER + sizeof(TraceRecord) + TRACE_KEYFRAME * DELTA_MAX);
+    if (!t || !ring || !block) {
+        printf("Failed to allocate tracer\n");
+        exit(1);
+    }
+    memset(t, 0, sizeof(*t));
+    t->ring = ring;
+    t->mask = capacity - 1;
+    atomic_init(&t->head, 0);
+    atomic_init(&t->tail, 0);
+    t->out = out;
+    t->enc.buf = block;
+    t->enc.len = BLOCK_HEADER;
+    t->enc.offset = HEADER_SIZE;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->wake, NULL);
+
+    if (pthread_create(&t->thread, NULL, tracer_writer, t) != 0) {
+        printf("Failed to start trace writer\n");
+        exit(1);
+    }
+    return t;
+}
+
+bool tracer_close(Tracer* t) {
+    if (!t) return true;
+
+    pthread_mutex_lock(&t->lock);
+    t->stop = true;
+    pthread_cond_signal(&t->wake);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+
+    bool ok = !t->write_error;
+    if (fclose(t->out) != 0) ok = false;
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->wake);
+    free(t->enc.buf);
+    free(t->enc.index);
+    free(t->ring);
+    free(t);
+    return ok;
+}
+
+/* Ring full: hand the CPU to the writer until a slot frees up */
+static void tracer_wait_space(Tracer* t, uint64_t head) {
+    t->stalls++;
+    do {
+        tracer_kick(t);
+        sched_yield();
+        t->tail_seen = atomic_load_explicit(&t->tail, memory_order_acquire);
+    } while (head - t->tail_seen > t->mask);
+}
+
+void tracer_record(Tracer* t, const TraceRecord* rec) {
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    if (head - t->tail_seen > t->mask) {
+        t->tail_seen = atomic_load_explicit(&t->tail, memory_order_acquire);
+        if (head - t->tail_seen > t->mask) tracer_wait_space(t, head);
+    }
+
+    t->ring[head & t->mask] = *rec;
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+    t->records++;
+
+    /* Half a ring is ready: wake the writer for a batch */
+    if (((head + 1) & (t->mask >> 1)) == 0) tracer_kick(t);
+}
+
+uint64_t tracer_records(const Tracer* t) {
+    return t->records;
+}
+
+uint64_t tracer_stalls(const Tracer* t) {
+    return t->stalls;
+}
@@ -0,0 +1,124 @@
+/**
+ * Binary execution trace recorder.
+ *
+ * A CPU with a tracer attached (cpu_set_tracer) emits one fixed-size
+ * record per step into a single-producer/single-consumer ring. A
+ * background thread drains the ring, delta-encodes the records and
+ * writes them out in blocks, so the emulation thread never formats text
+ * or touches stdio. When the ring is full the producer waits for the
+ * writer: records are never dropped. trace_reader.h reads the files.
+ *
+ * File layout (all integers little endian):
+ *
+ *   Header (16 bytes)
+ *     0   char[8]  magic "6502TRC\0"
+ *     8   u16      version (2)
+ *     10  u16      decoded record size (24)
+ *     12  u32      keyframe interval: records per block
+ *
+ *   Block (24-byte header, then the encoded records)
+ *     0   u32      payload bytes
+ *     4   u32      record count
+ *     8   u64      index of the first record in the whole trace
+ *     16  u64      cycle of the first record
+ *     24  keyframe: the first record in full (TraceRecord field order)
+ *         delta records for the rest, each relative to the one before:
+ *           u16    mask of TRACE_D_* bits, then in this order:
+ *           u8     kind                      if TRACE_D_KIND
+ *           u8     opcode, operand bytes     instructions only; operand
+ *                                            length from the opcode table
+ *           u16    PC                        if TRACE_D_PC, else the
+ *                  previous PC + its length (or its ea after an interrupt)
+ *           u8     A, X, Y, SP, P            each if its bit is set
+ *           u16    ea                        if TRACE_D_EA, else
+ *                  trace_predict_ea of the decoded fields
+ *           u8     data                      if TRACE_D_DATA
+ *           u64    cycle                     if TRACE_D_CYCLE, else
+ *           u8     cycles since the previous record
+ *
+ *   Index, written by tracer_close (one entry per block)
+ *     0   u64      first record, u64 first cycle, u64 block file offset
+ *   Footer (32 bytes, last in the file)
+ *     0   u64      index file offset
+ *     8   u64      block count
+ *     16  u64      record count
+ *     24  char[8]  magic "6502IDX\0"
+ *
+ * A trace whose writer never closed has no footer; readers rebuild the
+ * index by walking the block headers. One tracer serves one CPU at a time.
+ */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TRACE_VERSION   2
+#define TRACE_KEYFRAME  4096        // records per block
+
+/* What a record describes */
+enum {
+    TRACE_INSN,     // an instruction
+    TRACE_IRQ,      // IRQ entry: ea is the handler address
+    TRACE_NMI       // NMI entry: ea is the handler address
+};
+
+/* Record flags */
+#define TRACE_F_DATA    0x01        // data holds the memory byte at ea
+
+/* Delta record mask bits (file format) */
+#define TRACE_D_KIND    0x0001
+#define TRACE_D_PC      0x0002
+#define TRACE_D_A       0x0004
+#define TRACE_D_X       0x0008
+#define TRACE_D_Y       0x0010
+#define TRACE_D_SP      0x0020
+#define TRACE_D_P       0x0040
+#define TRACE_D_EA      0x0080      // ea stored instead of predicted
+#define TRACE_D_DATA    0x0100      // data stored; implies TRACE_F_DATA
+#define TRACE_D_CYCLE   0x0200      // absolute cycle instead of a u8 delta
+
+/* State before the step, plus what it decoded to */
+typedef struct {
+    uint64_t cycle;         // total cycles before the step
+    uint16_t pc;
+    uint16_t operand;       // raw operand bytes, 0 if none
+    uint16_t ea;            // effective address (branch target for REL)
+    uint8_t  opcode;
+    uint8_t  kind;          // TRACE_INSN, TRACE_IRQ or TRACE_NMI
+    uint8_t  a, x, y, sp, p;
+    uint8_t  data;          // memory byte at ea after the step, if TRACE_F_DATA
+    uint8_t  flags;         // TRACE_F_*
+    uint8_t  reserved;
+} TraceRecord;
+
+_Static_assert(sizeof(TraceRecord) == 24, "trace records are 24 bytes");
+
+typedef struct Tracer Tracer;
+
+/*
+ * Create the trace file and start its writer thread. ring_records is
+ * rounded up to a power of two; 0 picks a default. NULL if the file
+ * cannot be created.
+ */
+Tracer*  tracer_open(const char* path, size_t ring_records);
+
+/* Drain the ring, stop the writer and close the file; false on a write error */
+bool     tracer_close(Tracer* tracer);
+
+/* Producer side: append one record, waiting if the ring is full */
+void     tracer_record(Tracer* tracer, const TraceRecord* rec);
+
+uint64_t tracer_records(const Tracer* tracer);   // records appended so far
+uint64_t tracer_stalls(const Tracer* tracer);    // times the producer found the ring full
+
+/*
+ * Predictions the delta encoding leaves out when they hold: the PC after
+ * 'prev' if it did not jump, and the ea the addressing mode gives from
+ * the operand and X/Y (0 for modes that need memory to resolve).
+ */
+uint16_t trace_next_pc(const TraceRecord* prev);
+uint16_t trace_predict_ea(const TraceRecord* rec);
+
+#endif
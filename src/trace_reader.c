@@ -0,0 +1,350 @@
+#include "trace_reader.h"
+#include "opcodes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define HEADER_SIZE    16
+#define BLOCK_HEADER   24
+#define FOOTER_SIZE    32
+#define DELTA_MAX      26
+#define MAX_KEYFRAME   (1u << 20)   // sanity limit on the header's interval
+
+static const char magic[8] = "6502TRC";
+static const char index_magic[8] = "6502IDX";
+
+typedef struct {
+    uint64_t first;
+    uint64_t cycle;
+    uint64_t offset;
+} IndexEntry;
+
+struct TraceReader {
+    FILE*        f;
+    uint32_t     keyframe;      // records per block
+    IndexEntry*  index;
+    size_t       blocks;
+    uint64_t     count;
+    bool         indexed;       // index came from the footer
+
+    /* Decoded block */
+    TraceRecord* recs;
+    uint8_t*     payload;
+    size_t       block;         // index of the decoded block, blocks if none
+    uint32_t     block_count;   // records in it
+    uint32_t     pos;           // next record in it
+};
+
+static inline uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static inline uint32_t get32(const uint8_t* p) { return get16(p) | ((uint32_t)get16(p + 2) << 16); }
+static inline uint64_t get64(const uint8_t* p) { return get32(p) | ((uint64_t)get32(p + 4) << 32); }
+
+/* ============================== Decoding ================================ */
+
+static void decode_full(const uint8_t* p, TraceRecord* r) {
+    r->cycle    = get64(p);
+    r->pc       = get16(p + 8);
+    r->operand  = get16(p + 10);
+    r->ea       = get16(p + 12);
+    r->opcode   = p[14];
+    r->kind     = p[15];
+    r->a        = p[16];
+    r->x        = p[17];
+    r->y        = p[18];
+    r->sp       = p[19];
+    r->p        = p[20];
+    r->data     = p[21];
+    r->flags    = p[22];
+    r->reserved = 0;
+}
+
+/*
+ * Decode one delta record at p; returns the bytes used, 0 if it runs past
+ * end. The payload buffer has DELTA_MAX bytes of slack after end, so a
+ * damaged record is only caught after it has been read.
+ */
+static size_t decode_delta(const uint8_t* p, const uint8_t* end,
+                           const TraceRecord* prev, TraceRecord* r) {
+    const uint8_t* start = p;
+    if (p >= end) return 0;
+    uint16_t mask = get16(p);
+    p += 2;
+
+    *r = *prev;
+    r->kind = (mask & TRACE_D_KIND) ? *p++ : prev->kind;
+    r->opcode = 0;
+    r->operand = 0;
+    if (r->kind == TRACE_INSN) {
+        uint8_t length = opcode_info[*p].length;
+        r->opcode = *p++;
+        if (length > 1) r->operand = *p++;
+        if (length > 2) r->operand |= *p++ << 8;
+    }
+    if (mask & TRACE_D_PC) {
+        r->pc = get16(p);
+        p += 2;
+    } else {
+        r->pc = trace_next_pc(prev);
+    }
+    if (mask & TRACE_D_A)  r->a  = *p++;
+    if (mask & TRACE_D_X)  r->x  = *p++;
+    if (mask & TRACE_D_Y)  r->y  = *p++;
+    if (mask & TRACE_D_SP) r->sp = *p++;
+    if (mask & TRACE_D_P)  r->p  = *p++;
+    if (mask & TRACE_D_EA) {
+        r->ea = get16(p);
+        p += 2;
+    } else {
+        r->ea = trace_predict_ea(r);
+    }
+    r->flags = 0;
+    r->data = 0;
+    if (mask & TRACE_D_DATA) {
+        r->flags = TRACE_F_DATA;
+        r->data = *p++;
+    }
+    if (mask & TRACE_D_CYCLE) {
+        r->cycle = get64(p);
+        p += 8;
+    } else {
+        r->cycle = prev->cycle + *p++;
+    }
+    return p > end ? 0 : (size_t)(p - start);
+}
+
+/* Read and decode block b */
+static bool load_block(TraceReader* tr, size_t b) {
+    uint8_t h[BLOCK_HEADER];
+    tr->block = tr->blocks;
+    if (b >= tr->blocks || fseek(tr->f, (long)tr->index[b].offset, SEEK_SET) != 0
+        || fread(h, 1, sizeof(h), tr->f) != sizeof(h))
+        return false;
+
+    uint32_t length = get32(h);
+    uint32_t count = get32(h + 4);
+    if (count == 0 || count > tr->keyframe || length < sizeof(TraceRecord)
+        || length > sizeof(TraceRecord) + (size_t)tr->keyframe * DELTA_MAX
+        || fread(tr->payload, 1, length, tr->f) != length)
+        return false;
+
+    const uint8_t* p = tr->payload;
+    const uint8_t* end = p + length;
+    decode_full(p, &tr->recs[0]);
+    p += sizeof(TraceRecord);
+    for (uint32_t i = 1; i < count; i++) {
+        size_t used = decode_delta(p, end, &tr->recs[i - 1], &tr->recs[i]);
+        if (!used) return false;
+        p += used;
+    }
+
+    tr->block = b;
+    tr->block_count = count;
+    tr->pos = 0;
+    return true;
+}
+
+/* ============================== Index =================================== */
+
+static void index_add(TraceReader* tr, size_t* cap, const IndexEntry* e) {
+    if (tr->blocks == *cap) {
+        *cap = *cap ? *cap * 2 : 256;
+        tr->index = realloc(tr->index, *cap * sizeof(IndexEntry));
+        if (!tr->index) {
+            printf("Failed to allocate trace index\n");
+            exit(1);
+        }
+    }
+    tr->index[tr->blocks++] = *e;
+}
+
+/* Index from the footer; false if there is none */
+static bool read_index(TraceReader* tr, long file_size) {
+    uint8_t footer[FOOTER_SIZE];
+    if (file_size < HEADER_SIZE + FOOTER_SIZE
+        || fseek(tr->f, file_size - FOOTER_SIZE, SEEK_SET) != 0
+        || fread(footer, 1, sizeof(footer), tr->f) != sizeof(footer)
+        || memcmp(footer + 24, index_magic, sizeof(index_magic)) != 0)
+        return false;
+
+    uint64_t offset = get64(footer);
+    uint64_t blocks = get64(footer + 8);
+    if (offset < HEADER_SIZE || blocks > (uint64_t)file_size / 24
+        || offset + blocks * 24 + FOOTER_SIZE != (uint64_t)file_size
+        || fseek(tr->f, (long)offset, SEEK_SET) != 0)
+        return false;
+
+    size_t cap = 0;
+    for (uint64_t i = 0; i < blocks; i++) {
+        uint8_t entry[24];
+        if (fread(entry, 1, sizeof(entry), tr->f) != sizeof(entry)) return false;
+        IndexEntry e = { get64(entry), get64(entry + 8), get64(entry + 16) };
+        index_add(tr, &cap, &e);
+    }
+    tr->count = get64(footer + 16);
+    return true;
+}
+
+/* No footer: walk the block headers up to the first incomplete block */
+static void rebuild_index(TraceReader* tr, long file_size) {
+    uint64_t offset = HEADER_SIZE;
+    size_t cap = 0;
+    tr->blocks = 0;
+    tr->count = 0;
+
+    while (offset + BLOCK_HEADER <= (uint64_t)file_size) {
+        uint8_t h[BLOCK_HEADER];
+        if (fseek(tr->f, (long)offset, SEEK_SET) != 0
+            || fread(h, 1, sizeof(h), tr->f) != sizeof(h))
+            break;
+        uint32_t length = get32(h);
+        uint32_t count = get32(h + 4);
+        if (count == 0 || count > tr->keyframe || get64(h + 8) != tr->count
+            || offset + BLOCK_HEADER + length > (uint64_t)file_size)
+            break;
+
+        IndexEntry e = { tr->count, get64(h + 16), offset };
+        index_add(tr, &cap, &e);
+        tr->count += count;
+        offset += BLOCK_HEADER + length;
+    }
+}
+
+/* ============================== Public API ============================== */
+
+TraceReader* trace_reader_open(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    uint8_t h[HEADER_SIZE];
+    uint32_t keyframe = 0;
+    if (fread(h, 1, sizeof(h), f) == sizeof(h) && memcmp(h, magic, sizeof(magic)) == 0
+        && get16(h + 8) == TRACE_VERSION && get16(h + 10) == sizeof(TraceRecord))
+        keyframe = get32(h + 12);
+    if (keyframe == 0 || keyframe > MAX_KEYFRAME || fseek(f, 0, SEEK_END) != 0) {
+        fclose(f);
+        return NULL;
+    }
+    long file_size = ftell(f);
+
+    TraceReader* tr = calloc(1, sizeof(TraceReader));
+    if (!tr) {
+        printf("Failed to allocate trace reader\n");
+        exit(1);
+    }
+    tr->f = f;
+    tr->keyframe = keyframe;
+    tr->recs = malloc(keyframe * sizeof(TraceRecord));
+    tr->payload = calloc(1, sizeof(TraceRecord) + (size_t)(keyframe + 1) * DELTA_MAX);
+    if (!tr->recs || !tr->payload) {
+        printf("Failed to allocate trace reader\n");
+        exit(1);
+    }
+
+    tr->indexed = read_index(tr, file_size);
+    if (!tr->indexed) rebuild_index(tr, file_size);
+    tr->block = tr->blocks;     // nothing decoded yet
+    trace_reader_seek(tr, 0);
+    return tr;
+}
+
+void trace_reader_close(TraceReader* tr) {
+    if (!tr) return;
+    fclose(tr->f);
+    free(tr->index);
+    free(tr->recs);
+    free(tr->payload);
+    free(tr);
+}
+
+uint64_t trace_reader_count(const TraceReader* tr) {
+    return tr->count;
+}
+
+bool trace_reader_indexed(const TraceReader* tr) {
+    return tr->indexed;
+}
+
+/* Last block whose key (first record or cycle) is <= value */
+static size_t find_block(const TraceReader* tr, uint64_t value, bool by_cycle) {
+    size_t lo = 0, hi = tr->blocks;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        uint64_t key = by_cycle ? tr->index[mid].cycle : tr->index[mid].first;
+        if (key <= value) lo = mid;
+        else              hi = mid;
+    }
+    return lo;
+}
+
+bool trace_reader_seek(TraceReader* tr, uint64_t index) {
+    if (index >= tr->count) {
+        tr->block = tr->blocks;
+        return false;
+    }
+    size_t b = find_block(tr, index, false);
+    if (tr->block != b && !load_block(tr, b)) return false;
+    uint64_t at = index - tr->index[b].first;
+    if (at >= tr->block_count) return false;
+    tr->pos = (uint32_t)at;
+    return true;
+}
+
+bool trace_reader_seek_cycle(TraceReader* tr, uint64_t cycle) {
+    if (!tr->blocks) return false;
+    size_t b = find_block(tr, cycle, true);
+    if (tr->block != b && !load_block(tr, b)) return false;
+    tr->pos = 0;
+
+    /* Skip ahead to the first record at or after the cycle */
+    for (;;) {
+        while (tr->pos < tr->block_count) {
+            if (tr->recs[tr->pos].cycle >= cycle) return true;
+            tr->pos++;
+        }
+        if (tr->block + 1 >= tr->blocks || !load_block(tr, tr->block + 1))
+            return false;
+    }
+}
+
+bool trace_reader_next(TraceReader* tr, TraceRecord* rec) {
+    if (tr->block >= tr->blocks) return false;
+    if (tr->pos == tr->block_count) {
+        if (tr->block + 1 >= tr->blocks) return false;
+        if (!load_block(tr, tr->block + 1)) return false;
+    }
+    *rec = tr->recs[tr->pos++];
+    return true;
+}
+
+uint64_t trace_reader_tell(const TraceReader* tr) {
+    if (tr->block >= tr->blocks) return tr->count;
+    return tr->index[tr->block].first + tr->pos;
+}
+
+/* ============================== Formatting ============================== */
+
+int trace_format(const TraceRecord* rec, uint64_t index, char* buf, size_t size) {
+    char bytes[12] = "";
+    char text[32];
+
+    if (rec->kind == TRACE_INSN) {
+        uint8_t length = opcode_info[rec->opcode].length;
+        if (length == 1)      snprintf(bytes, sizeof(bytes), "%02X", rec->opcode);
+        else if (length == 2) snprintf(bytes, sizeof(bytes), "%02X %02X", rec->opcode, rec->operand & 0xFF);
+        else                  snprintf(bytes, sizeof(bytes), "%02X %02X %02X", rec->opcode,
+                                       rec->operand & 0xFF, rec->operand >> 8);
+        opcode_disassemble(rec->opcode, rec->operand, rec->pc, text, sizeof(text));
+    } else {
+        snprintf(text, sizeof(text), "%s -> $%04X", rec->kind == TRACE_NMI ? "NMI" : "IRQ", rec->ea);
+    }
+
+    char access[16] = "";
+    if (rec->flags & TRACE_F_DATA)
+        snprintf(access, sizeof(access), "@%04X=%02X", rec->ea, rec->data);
+
+    return snprintf(buf, size,
+                    "%10" PRIu64 "  %04X  %-8s  %-14s %-8s  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%" PRIu64,
+                    index, rec->pc, bytes, text, access,
+                    rec->a, rec->x, rec->y, rec->p, rec->sp, rec->cycle);
+}
@@ -0,0 +1,48 @@
+/**
+ * Reader for trace files written by the tracer (trace.h).
+ *
+ * Records are decoded a block at a time. The block index (read from the
+ * footer, or rebuilt by walking the blocks if the writer never closed
+ * the file) lets a reader seek to any record number or cycle by
+ * decoding at most one block.
+ */
+#ifndef TRACE_READER_H_
+#define TRACE_READER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "trace.h"
+
+typedef struct TraceReader TraceReader;
+
+/* NULL if the file is missing or not a trace this reader understands */
+TraceReader* trace_reader_open(const char* path);
+void         trace_reader_close(TraceReader* reader);
+
+/* Records in the trace; false from indexed if the index was rebuilt */
+uint64_t     trace_reader_count(const TraceReader* reader);
+bool         trace_reader_indexed(const TraceReader* reader);
+
+/*
+ * Position the reader so the next record read is record 'index', or the
+ * first record whose cycle is at least 'cycle' (cycles are assumed to
+ * grow through the trace). False if there is no such record.
+ */
+bool         trace_reader_seek(TraceReader* reader, uint64_t index);
+bool         trace_reader_seek_cycle(TraceReader* reader, uint64_t cycle);
+
+/* Read the next record; false at the end or on a damaged block */
+bool         trace_reader_next(TraceReader* reader, TraceRecord* rec);
+
+/* Number of the record the next read returns */
+uint64_t     trace_reader_tell(const TraceReader* reader);
+
+/*
+ * One line of text for a record: number, PC, instruction bytes,
+ * disassembly, data access and registers. Returns the length, as
+ * snprintf does.
+ */
+int          trace_format(const TraceRecord* rec, uint64_t index, char* buf, size_t size);
+
+#endif
@@ -36,12 +36,26 @@ static const uint8_t opcode_to_byte[ADDR_CNT][OP_CNT] = {
     [REL]     = { [BPL] = 0x10, [BMI] = 0x30, [BVC] = 0x50, [BVS] = 0x70, [BCC] = 0x90, [BCS] = 0xB0, [BNE] = 0xD0, [BEQ] = 0xF0, }
 };
 
+/*
+ * xorshift64*: small, fast and good enough for test data. The state must
+ * be non-zero; a zero state is reseeded so callers can start from {0}.
+ */
+uint8_t random_byte_r(uint64_t* state) {
+    uint64_t x = *state ? *state : 0x9E3779B97F4A7C15ull;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (uint8_t)((x * 0x2545F4914F6CDD1Dull) >> 56);
+}
+
+/* One generator per thread, so concurrent callers never share state */
 uint8_t random_byte() {
-    return (uint8_t)(rand() % 256);
+    static _Thread_local uint64_t state;
+    return random_byte_r(&state);
 }
 
-char* byte_to_bits(uint8_t b) {
-    static char buf[10];  // "bbbb bbbb\0"
+char* byte_to_bits_r(uint8_t b, char buf[10]) {
     for (int i = 0; i < 4; i++) {
         buf[i] = (b & (0x80 >> i)) ? '1' : '0';
     }
@@ -53,6 +67,12 @@ char* byte_to_bits(uint8_t b) {
     return buf;
 }
 
+/* Result is valid until the calling thread's next call */
+char* byte_to_bits(uint8_t b) {
+    static _Thread_local char buf[10];  // "bbbb bbbb\0"
+    return byte_to_bits_r(b, buf);
+}
+
 decoded_t decode_byte(uint8_t b) {
     decoded_t rtn;
     rtn.aaa = (b & 0xE0)>>5;
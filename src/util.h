@@ -16,8 +16,14 @@ struct Decoded {
 
 typedef struct Decoded decoded_t;
 
+/* Per-thread generator and buffer; safe to call from any thread */
 uint8_t random_byte();
 char* byte_to_bits(uint8_t b);
+
+/* Reentrant forms: the caller owns the generator state and the buffer */
+uint8_t random_byte_r(uint64_t* state);
+char* byte_to_bits_r(uint8_t b, char buf[10]);
+
 decoded_t decode_byte(uint8_t b);
 uint8_t encode_op(opcode_t op, addr_mode_t am);
 
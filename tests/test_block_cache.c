@@ -0,0 +1,218 @@
+#include "test_common.h"
+#include "bus.h"
+#include "memory.h"
+#include <stdlib.h>
+
+/*
+ * Block cache tests: cached code must see every change to the bytes it
+ * was decoded from.
+ */
+
+/* MMIO "code" device: reads come from a buffer the test edits directly */
+typedef struct {
+    uint8_t bytes[256];
+} CodeDevice;
+
+static uint8_t code_dev_read(void* ctx, uint16_t addr) {
+    return ((CodeDevice*)ctx)->bytes[addr & 0xFF];
+}
+
+static void code_dev_write(void* ctx, uint16_t addr, uint8_t val) {
+    ((CodeDevice*)ctx)->bytes[addr & 0xFF] = val;
+}
+
+/* ===================== Self-modifying code ===================== */
+
+TEST(test_smc_loop) {
+    CPU* cpu = setup_cpu();
+    uint8_t prog[] = {
+        0xA9, 0x01,         /* LDA #$01 */
+        0xEE, 0x01, 0x02,   /* INC $0201 (LDA operand) */
+        0x4C, 0x00, 0x02    /* JMP $0200 */
+    };
+    bus_load(cpu_get_bus(cpu), 0x0200, prog, sizeof(prog));
+
+    cpu_run_instructions(cpu, 3);
+    CHECK_EQ(cpu_get_a(cpu), 0x01);
+    cpu_run_instructions(cpu, 1);
+    CHECK_EQ(cpu_get_a(cpu), 0x02);
+    cpu_run_instructions(cpu, 3 * 10);
+    CHECK_EQ(cpu_get_a(cpu), 0x0C);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_smc_same_block) {
+    CPU* cpu = setup_cpu();
+    uint8_t prog[] = {
+        0xA9, 0xEA,         /* LDA #$EA */
+        0x8D, 0x06, 0x02,   /* STA $0206 (operand of the LDX below) */
+        0xA2, 0x05,         /* LDX #$05 -> LDX #$EA */
+        0x02                /* JAM */
+    };
+    bus_load(cpu_get_bus(cpu), 0x0200, prog, sizeof(prog));
+
+    cpu_run(cpu, 1000);
+    CHECK(cpu_is_halted(cpu), "should reach JAM");
+    CHECK_EQ(cpu_get_x(cpu), 0xEA);
+
+    cpu_destroy(cpu);
+}
+
+/* ===================== Changes from outside the CPU ===================== */
+
+TEST(test_bus_load_replaces_code) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    uint8_t first[]  = { 0xA9, 0x11, 0x02 };   /* LDA #$11; JAM */
+    uint8_t second[] = { 0xA9, 0x22, 0x02 };   /* LDA #$22; JAM */
+
+    bus_load(bus, 0x0200, first, sizeof(first));
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x11);
+
+    bus_load(bus, 0x0200, second, sizeof(second));
+    cpu_reset(cpu);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x22);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_invalidate_behind_bus) {
+    Memory* mem = memory_create();
+    Bus* bus = bus_create();
+    bus_map_memory(bus, mem);
+    bus_write(bus, 0xFFFC, 0x00);
+    bus_write(bus, 0xFFFD, 0x02);
+    CPU* cpu = cpu_create(bus);
+
+    uint8_t prog[] = { 0xA9, 0x11, 0x02 };     /* LDA #$11; JAM */
+    bus_load(bus, 0x0200, prog, sizeof(prog));
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x11);
+
+    /* A raw write to the backing store must be announced */
+    memory_get_raw(mem)[0x0201] = 0x33;
+    bus_invalidate(bus, 0x0201, 0x0201);
+    cpu_reset(cpu);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x33);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_memory_calls_replace_code) {
+    Memory* mem = memory_create();
+    Bus* bus = bus_create();
+    bus_map_memory(bus, mem);
+    CPU* cpu = cpu_create(bus);
+
+    uint8_t prog[] = { 0xA9, 0x01, 0x02 };     /* LDA #$01; JAM */
+    memory_load(mem, 0x0200, prog, sizeof(prog));
+    cpu_set_pc(cpu, 0x0200);
+    cpu_step(cpu);
+    CHECK_EQ(cpu_get_a(cpu), 0x01);
+
+    /* memory_write on the bus's Memory is seen without bus_invalidate */
+    memory_write(mem, 0x0201, 0x42);
+    cpu_set_pc(cpu, 0x0200);
+    cpu_step(cpu);
+    CHECK_EQ(cpu_get_a(cpu), 0x42);
+
+    uint8_t patch[] = { 0xA9, 0x77 };          /* LDA #$77 */
+    memory_load(mem, 0x0200, patch, sizeof(patch));
+    cpu_set_pc(cpu, 0x0200);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x77);
+    CHECK(cpu_is_halted(cpu));
+
+    /* After a reset the page holds BRKs, not the cached LDA */
+    memory_reset(mem);
+    cpu_reset(cpu);
+    cpu_set_pc(cpu, 0x0200);
+    cpu_step(cpu);
+    check_pc(cpu, 0x0000);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_mmio_code_not_cached) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    CodeDevice* dev = calloc(1, sizeof(CodeDevice));
+    bus_map(bus, 0x0200, 0x02FF, code_dev_read, code_dev_write, dev, free);
+
+    dev->bytes[0] = 0xA9; dev->bytes[1] = 0x11; dev->bytes[2] = 0x02;
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x11);
+
+    /* Device contents change without any bus write */
+    dev->bytes[1] = 0x44;
+    cpu_reset(cpu);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x44);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_remap_replaces_code) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    uint8_t prog[] = { 0xA9, 0x11, 0x02 };     /* LDA #$11; JAM */
+    bus_load(bus, 0x0200, prog, sizeof(prog));
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x11);
+
+    /* Overlay a different direct page on the code */
+    static uint8_t overlay[256] = { 0xA9, 0x55, 0x02 };
+    bus_map_direct(bus, 0x0200, 0x02FF, overlay, true, NULL, NULL);
+    cpu_reset(cpu);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x55);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_block_spanning_pages) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_write(bus, 0xFFFC, 0xFD);
+    bus_write(bus, 0xFFFD, 0x02);
+    uint8_t prog[] = {
+        0xA2, 0x01,         /* $02FD: LDX #$01 */
+        0xA0, 0x02,         /* $02FF: LDY #$02 (operand on next page) */
+        0x02                /* $0301: JAM */
+    };
+    bus_load(bus, 0x02FD, prog, sizeof(prog));
+    cpu_reset(cpu);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_y(cpu), 0x02);
+
+    /* Write to the second page must invalidate the block */
+    bus_write(bus, 0x0300, 0x77);
+    cpu_reset(cpu);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_y(cpu), 0x77);
+
+    cpu_destroy(cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Block Cache Tests ===\n\n");
+
+    RUN_TEST(test_smc_loop);
+    RUN_TEST(test_smc_same_block);
+    RUN_TEST(test_bus_load_replaces_code);
+    RUN_TEST(test_invalidate_behind_bus);
+    RUN_TEST(test_memory_calls_replace_code);
+    RUN_TEST(test_mmio_code_not_cached);
+    RUN_TEST(test_remap_replaces_code);
+    RUN_TEST(test_block_spanning_pages);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
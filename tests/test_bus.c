@@ -1,10 +1,12 @@
 #include "test_common.h"
 #include "bus.h"
 #include "memory.h"
+#include <string.h>
 
 /* Simple test device: 256-byte RAM */
 typedef struct {
     uint8_t data[256];
+    int     resets;
 } TestDevice;
 
 static uint8_t test_dev_read(void* ctx, uint16_t addr) {
@@ -21,6 +23,36 @@ static void test_dev_destroy(void* ctx) {
     free(ctx);
 }
 
+/* State hooks: the RAM is the device's whole state */
+static size_t test_dev_state_size(void* ctx) {
+    (void)ctx;
+    return 256;
+}
+
+static void test_dev_save(void* ctx, uint8_t* buf) {
+    memcpy(buf, ((TestDevice*)ctx)->data, 256);
+}
+
+static void test_dev_restore(void* ctx, const uint8_t* buf) {
+    memcpy(((TestDevice*)ctx)->data, buf, 256);
+}
+
+static void test_dev_reset(void* ctx) {
+    TestDevice* dev = (TestDevice*)ctx;
+    memset(dev->data, 0, sizeof(dev->data));
+    dev->resets++;
+}
+
+static const BusDevice test_device = {
+    .read       = test_dev_read,
+    .write      = test_dev_write,
+    .destroy    = test_dev_destroy,
+    .state_size = test_dev_state_size,
+    .save       = test_dev_save,
+    .restore    = test_dev_restore,
+    .reset      = test_dev_reset,
+};
+
 /* ============================ Bus Tests ==================================== */
 
 TEST(test_bus_create_destroy) {
@@ -132,6 +164,246 @@ TEST(test_bus_partial_overlap) {
     bus_destroy(bus);
 }
 
+TEST(test_bus_split_page_open_bus) {
+    Bus* bus = bus_create();
+    TestDevice* dev = calloc(1, sizeof(TestDevice));
+
+    /* Device covers only part of page $20 */
+    bus_map(bus, 0x2010, 0x201F, test_dev_read, test_dev_write,
+            dev, test_dev_destroy);
+
+    bus_write(bus, 0x2010, 0x11);
+    bus_write(bus, 0x201F, 0x22);
+    bus_write(bus, 0x2020, 0x33);  /* unmapped: ignored */
+
+    CHECK(bus_read(bus, 0x2010) == 0x11, "start of partial region");
+    CHECK(bus_read(bus, 0x201F) == 0x22, "end of partial region");
+    CHECK(bus_read(bus, 0x200F) == 0xFF, "same page below region is open bus");
+    CHECK(bus_read(bus, 0x2020) == 0xFF, "same page above region is open bus");
+    CHECK(dev->data[0x20] == 0x00, "unmapped write should not reach device");
+
+    bus_destroy(bus);
+}
+
+TEST(test_bus_overlay_across_pages) {
+    Bus* bus = bus_create();
+    Memory* mem = memory_create();
+    TestDevice* io1 = calloc(1, sizeof(TestDevice));
+    TestDevice* io2 = calloc(1, sizeof(TestDevice));
+
+    bus_map_memory(bus, mem);
+    /* io1 owns a whole page, io2 straddles the end of it */
+    bus_map(bus, 0x1000, 0x10FF, test_dev_read, test_dev_write,
+            io1, test_dev_destroy);
+    bus_map(bus, 0x1080, 0x117F, test_dev_read, test_dev_write,
+            io2, test_dev_destroy);
+
+    bus_write(bus, 0x0FFF, 0x01);
+    bus_write(bus, 0x1000, 0x02);
+    bus_write(bus, 0x1080, 0x03);
+    bus_write(bus, 0x1100, 0x04);
+    bus_write(bus, 0x1180, 0x05);
+
+    CHECK(memory_read(mem, 0x0FFF) == 0x01, "below overlay goes to memory");
+    CHECK(io1->data[0x00] == 0x02, "$1000 goes to io1");
+    CHECK(io2->data[0x80] == 0x03, "$1080 goes to io2 (mapped last)");
+    CHECK(io1->data[0x80] == 0x00, "io1 shadowed by io2 at $1080");
+    CHECK(io2->data[0x00] == 0x04, "$1100 goes to io2");
+    CHECK(memory_read(mem, 0x1180) == 0x05, "past io2 goes back to memory");
+
+    CHECK(bus_read(bus, 0x107F) == 0x00, "io1 below io2");
+    CHECK(bus_read(bus, 0x1080) == 0x03, "io2 read at overlap");
+
+    bus_destroy(bus);
+}
+
+TEST(test_bus_direct_memory_shared) {
+    Bus* bus = bus_create();
+    Memory* mem = memory_create();
+    bus_map_memory(bus, mem);
+
+    /* Direct pages alias the Memory's own storage both ways */
+    memory_write(mem, 0x1234, 0x5A);
+    CHECK(bus_read(bus, 0x1234) == 0x5A, "bus sees memory_write");
+    bus_write(bus, 0xFFFF, 0xA5);
+    CHECK(memory_read(mem, 0xFFFF) == 0xA5, "memory sees bus_write");
+
+    bus_destroy(bus);
+}
+
+TEST(test_bus_rom_drops_writes) {
+    Bus* bus = bus_create();
+    Memory* ram = memory_create();
+    Memory* rom = memory_create();
+
+    uint8_t image[] = {0xDE, 0xAD, 0xBE, 0xEF};
+    memory_load(rom, 0xF000, image, sizeof(image));
+    memory_load(rom, 0xF080, image, sizeof(image));
+
+    bus_map_memory(bus, ram);
+    bus_map_rom(bus, rom, 0xF000, 0xFFFF);   /* whole pages */
+    bus_map_rom(bus, rom, 0xE080, 0xE0FF);   /* split page */
+
+    CHECK(bus_read(bus, 0xF000) == 0xDE, "ROM readable");
+    bus_write(bus, 0xF000, 0x00);
+    CHECK(bus_read(bus, 0xF000) == 0xDE, "ROM write dropped");
+    CHECK(memory_read(ram, 0xF000) == 0x00, "ROM write does not fall through to RAM");
+
+    memory_write(rom, 0xE080, 0x77);
+    bus_write(bus, 0xE080, 0x00);
+    CHECK(bus_read(bus, 0xE080) == 0x77, "split-page ROM write dropped");
+    bus_write(bus, 0xE07F, 0x66);
+    CHECK(memory_read(ram, 0xE07F) == 0x66, "RAM below split ROM still writable");
+
+    bus_destroy(bus);
+}
+
+TEST(test_bus_mmio_over_direct) {
+    Bus* bus = bus_create();
+    Memory* mem = memory_create();
+    TestDevice* io = calloc(1, sizeof(TestDevice));
+
+    bus_map_memory(bus, mem);
+    bus_map(bus, 0xD000, 0xD0FF, test_dev_read, test_dev_write,
+            io, test_dev_destroy);
+
+    bus_write(bus, 0xD010, 0x42);
+    CHECK(io->data[0x10] == 0x42, "MMIO page goes through callbacks");
+    CHECK(memory_read(mem, 0xD010) == 0x00, "RAM under MMIO untouched");
+    bus_write(bus, 0xD100, 0x43);
+    CHECK(memory_read(mem, 0xD100) == 0x43, "next page is direct RAM again");
+
+    bus_destroy(bus);
+}
+
+TEST(test_bus_watch_page_generation) {
+    Bus* bus = bus_create();
+    Memory* mem = memory_create();
+    bus_map_memory(bus, mem);
+
+    uint32_t gen = bus_page_gen(bus, 0x02);
+    bus_write(bus, 0x0200, 0x11);
+    CHECK(bus_page_gen(bus, 0x02) == gen, "unwatched write keeps generation");
+
+    bus_watch_page(bus, 0x02);
+    bus_write(bus, 0x0201, 0x22);
+    CHECK(bus_page_gen(bus, 0x02) != gen, "watched write bumps generation");
+    CHECK(memory_read(mem, 0x0201) == 0x22, "watched write still lands");
+
+    gen = bus_page_gen(bus, 0x02);
+    bus_write(bus, 0x0202, 0x33);
+    CHECK(bus_page_gen(bus, 0x02) == gen, "page no longer watched after first write");
+
+    uint32_t gen3 = bus_page_gen(bus, 0x03);
+    bus_invalidate(bus, 0x02FF, 0x0300);
+    CHECK(bus_page_gen(bus, 0x02) != gen, "invalidate bumps first page");
+    CHECK(bus_page_gen(bus, 0x03) != gen3, "invalidate bumps last page");
+
+    bus_destroy(bus);
+}
+
+TEST(test_bus_fast_writes_mark_dirty) {
+    Bus* bus = bus_create();
+    Memory* mem = memory_create();
+    bus_map_memory(bus, mem);
+    memory_clear_dirty(mem);
+
+    /* Only the first write to a clean page leaves the fast path */
+    uint32_t slow = bus->slow_accesses;
+    bus_write(bus, 0x0200, 0x11);
+    CHECK(memory_page_dirty(mem, 0x02), "first write marks page");
+    CHECK_EQ(bus->slow_accesses, slow + 1);
+    bus_write(bus, 0x0201, 0x22);
+    bus_write(bus, 0x02FF, 0x33);
+    CHECK_EQ(bus->slow_accesses, slow + 1);
+    CHECK_EQ(memory_read(mem, 0x02FF), 0x33);
+
+    bus_write(bus, 0x8000, 0x44);
+    CHECK_EQ(memory_dirty_count(mem), 2);
+    CHECK(bus_read(bus, 0x9000) == 0x00, "reads never mark");
+    CHECK_EQ(memory_dirty_count(mem), 2);
+
+    /* Clearing re-arms pages that were already written */
+    memory_clear_dirty(mem);
+    bus_write(bus, 0x0202, 0x55);
+    CHECK_EQ(memory_next_dirty(mem, 0), 0x02);
+    CHECK_EQ(memory_dirty_count(mem), 1);
+
+    bus_destroy(bus);
+}
+
+/* Device pages over tracked memory are not marked */
+TEST(test_bus_mmio_writes_not_dirty) {
+    Bus* bus = bus_create();
+    Memory* mem = memory_create();
+    TestDevice* dev = calloc(1, sizeof(TestDevice));
+    bus_map_memory(bus, mem);
+    bus_map(bus, 0xD000, 0xD0FF, test_dev_read, test_dev_write, dev, test_dev_destroy);
+    memory_clear_dirty(mem);
+
+    bus_write(bus, 0xD010, 0x99);
+    CHECK_EQ(dev->data[0x10], 0x99);
+    CHECK_EQ(memory_dirty_count(mem), 0);
+
+    /* Remapping part of a page keeps tracking the memory underneath */
+    bus_map(bus, 0xE000, 0xE00F, test_dev_read, test_dev_write, calloc(1, sizeof(TestDevice)), test_dev_destroy);
+    bus_write(bus, 0xE080, 0x12);
+    CHECK(memory_page_dirty(mem, 0xE0), "split page write marks memory");
+
+    bus_destroy(bus);
+}
+
+/* Two devices, one of them mapped twice: each saved and reset once */
+TEST(test_bus_device_state) {
+    Bus* bus = bus_create();
+    TestDevice* a = calloc(1, sizeof(TestDevice));
+    TestDevice* b = calloc(1, sizeof(TestDevice));
+    bus_map_device(bus, 0xD000, 0xD0FF, &test_device, a);
+    bus_map_device(bus, 0xD100, 0xD1FF, &test_device, b);
+    bus_map_device(bus, 0xD200, 0xD2FF, &test_device, a);
+    bus_map(bus, 0xD300, 0xD3FF, test_dev_read, test_dev_write,
+            calloc(1, sizeof(TestDevice)), test_dev_destroy);
+    CHECK_EQ(bus_state_size(bus), 512);
+
+    bus_write(bus, 0xD000, 0x11);
+    bus_write(bus, 0xD1FF, 0x22);
+    uint8_t buf[512];
+    bus_save_state(bus, buf);
+    CHECK(buf[0] == 0x11 && buf[511] == 0x22, "devices saved in mapping order");
+
+    bus_write(bus, 0xD200, 0x33);
+    bus_write(bus, 0xD1FF, 0x44);
+    bus_restore_state(bus, buf);
+    CHECK_EQ(bus_read(bus, 0xD000), 0x11);
+    CHECK_EQ(bus_read(bus, 0xD1FF), 0x22);
+
+    bus_reset_devices(bus);
+    CHECK(a->resets == 1 && b->resets == 1, "each device reset once");
+    CHECK_EQ(bus_read(bus, 0xD000), 0x00);
+
+    bus_destroy(bus);   // frees a once
+}
+
+/* A device without a read hook reads as open bus; without a write hook writes are dropped */
+TEST(test_bus_device_missing_hooks) {
+    Bus* bus = bus_create();
+    TestDevice* dev = calloc(1, sizeof(TestDevice));
+    const BusDevice write_only = { .write = test_dev_write, .destroy = test_dev_destroy };
+    const BusDevice read_only = { .read = test_dev_read };
+    bus_map_device(bus, 0xD000, 0xD0FF, &write_only, dev);
+    bus_map_device(bus, 0xD100, 0xD1FF, &read_only, dev);
+
+    bus_write(bus, 0xD010, 0x5A);
+    CHECK_EQ(dev->data[0x10], 0x5A);
+    CHECK_EQ(bus_read(bus, 0xD010), 0xFF);
+
+    CHECK_EQ(bus_read(bus, 0xD110), 0x5A);
+    bus_write(bus, 0xD110, 0x11);
+    CHECK_EQ(dev->data[0x10], 0x5A);
+
+    bus_destroy(bus);
+}
+
 /* ============================== Test Runner ================================ */
 
 int main(void) {
@@ -145,6 +417,16 @@ int main(void) {
     RUN_TEST(test_bus_map_memory);
     RUN_TEST(test_bus_load);
     RUN_TEST(test_bus_partial_overlap);
+    RUN_TEST(test_bus_split_page_open_bus);
+    RUN_TEST(test_bus_overlay_across_pages);
+    RUN_TEST(test_bus_direct_memory_shared);
+    RUN_TEST(test_bus_rom_drops_writes);
+    RUN_TEST(test_bus_mmio_over_direct);
+    RUN_TEST(test_bus_watch_page_generation);
+    RUN_TEST(test_bus_fast_writes_mark_dirty);
+    RUN_TEST(test_bus_mmio_writes_not_dirty);
+    RUN_TEST(test_bus_device_state);
+    RUN_TEST(test_bus_device_missing_hooks);
 
     print_test_summary();
     return failed_test_count > 0 ? 1 : 0;
@@ -0,0 +1,294 @@
+#include "test_common.h"
+#include "callgraph.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Call-graph tests: cycles must land on the call path the code really
+ * ran under, including when programs play tricks with the stack.
+ */
+
+static CPU* load_cpu(uint16_t addr, const uint8_t* prog, size_t size) {
+    CPU* cpu = setup_cpu();
+    bus_load(cpu_get_bus(cpu), addr, prog, size);
+    cpu_reset(cpu);
+    return cpu;
+}
+
+static void load(CPU* cpu, uint16_t addr, const uint8_t* prog, size_t size) {
+    bus_load(cpu_get_bus(cpu), addr, prog, size);
+}
+
+/* Folded output as one string */
+static char* folded(const CallGraph* g) {
+    FILE* f = tmpfile();
+    if (!f) return calloc(1, 1);
+    callgraph_write_folded(g, f);
+    long size = ftell(f);
+    char* text = calloc(1, size + 1);
+    rewind(f);
+    if (fread(text, 1, size, f) != (size_t)size) text[0] = '\0';
+    fclose(f);
+    return text;
+}
+
+static uint64_t self_cycles(const CallGraph* g, const uint16_t* path, int length) {
+    int64_t node = callgraph_find(g, path, length);
+    return node < 0 ? 0 : callgraph_node(g, node)->self_cycles;
+}
+
+/*
+ * $0200: LDX #$00
+ * loop:  JSR $0220
+ *        INX
+ *        CPX #$0A
+ *        BNE loop
+ *        JAM
+ * $0220: JSR $0230
+ *        RTS
+ * $0230: LDY #$03
+ * inner: DEY
+ *        BNE inner
+ *        RTS
+ */
+static const uint8_t nested_main[] = { 0xA2, 0x00, 0x20, 0x20, 0x02, 0xE8, 0xE0, 0x0A, 0xD0, 0xF8, 0x02 };
+static const uint8_t nested_outer[] = { 0x20, 0x30, 0x02, 0x60 };
+static const uint8_t nested_inner[] = { 0xA0, 0x03, 0x88, 0xD0, 0xFD, 0x60 };
+
+static CPU* nested_cpu(void) {
+    CPU* cpu = load_cpu(0x0200, nested_main, sizeof(nested_main));
+    load(cpu, 0x0220, nested_outer, sizeof(nested_outer));
+    load(cpu, 0x0230, nested_inner, sizeof(nested_inner));
+    return cpu;
+}
+
+TEST(test_callgraph_nested) {
+    CPU* cpu = nested_cpu();
+    CallGraph* g = callgraph_create();
+    cpu_set_callgraph(cpu, g);
+    uint64_t cycles = cpu_run(cpu, 100000);
+
+    const uint16_t outer[] = { 0x0220 };
+    const uint16_t inner[] = { 0x0220, 0x0230 };
+    CHECK(callgraph_node_count(g) == 3, "root and two paths");
+    CHECK(self_cycles(g, inner, 2) == 20 + 60 + 80 + 60, "inner loop cycles");
+    CHECK(self_cycles(g, outer, 1) == 60 + 60, "JSR and RTS of the wrapper");
+    CHECK(callgraph_node(g, callgraph_find(g, inner, 2))->calls == 10);
+    CHECK(callgraph_inclusive(g, callgraph_find(g, outer, 1)) == 120 + 220);
+    CHECK(callgraph_inclusive(g, CALLGRAPH_ROOT) == cycles, "root covers the whole run");
+    CHECK(callgraph_depth(g) == 0, "back at the top level");
+
+    char* text = folded(g);
+    CHECK(strstr(text, "main;$0220;$0230 220\n") != NULL, "folded inner path");
+    CHECK(strstr(text, "main;$0220 120\n") != NULL, "folded wrapper path");
+    CHECK(strncmp(text, "main ", 5) == 0, "top-level code is 'main'");
+    free(text);
+
+    callgraph_destroy(g);
+    cpu_destroy(cpu);
+}
+
+TEST(test_callgraph_step_and_trace_agree) {
+    CPU* cpu = nested_cpu();
+    CallGraph* run = callgraph_create();
+    cpu_set_callgraph(cpu, run);
+    cpu_run(cpu, 100000);
+    char* expected = folded(run);
+    cpu_destroy(cpu);
+
+    cpu = nested_cpu();
+    CallGraph* stepped = callgraph_create();
+    cpu_set_callgraph(cpu, stepped);
+    while (!cpu_is_halted(cpu)) cpu_step(cpu);
+    char* text = folded(stepped);
+    CHECK(strcmp(text, expected) == 0, "stepping gives the same paths");
+    free(text);
+    cpu_destroy(cpu);
+
+    cpu = nested_cpu();
+    CallGraph* traced = callgraph_create();
+    Tracer* t = tracer_open("/dev/null", 0);
+    cpu_set_tracer(cpu, t);
+    cpu_set_callgraph(cpu, traced);
+    cpu_run(cpu, 100000);
+    CHECK(tracer_close(t));
+    text = folded(traced);
+    CHECK(strcmp(text, expected) == 0, "the traced loop gives the same paths");
+    free(text);
+    cpu_destroy(cpu);
+
+    free(expected);
+    callgraph_destroy(run);
+    callgraph_destroy(stepped);
+    callgraph_destroy(traced);
+}
+
+/*
+ * $0200: JSR $0210
+ *        JAM
+ * $0210: JSR $0220
+ *        NOP             never reached
+ *        RTS
+ * $0220: PLA             drop the return address to $0210...
+ *        PLA
+ *        RTS             ...and return straight to main
+ */
+TEST(test_callgraph_dropped_return) {
+    const uint8_t main_prog[] = { 0x20, 0x10, 0x02, 0x02 };
+    const uint8_t mid[] = { 0x20, 0x20, 0x02, 0xEA, 0x60 };
+    const uint8_t drop[] = { 0x68, 0x68, 0x60 };
+    CPU* cpu = load_cpu(0x0200, main_prog, sizeof(main_prog));
+    load(cpu, 0x0210, mid, sizeof(mid));
+    load(cpu, 0x0220, drop, sizeof(drop));
+
+    CallGraph* g = callgraph_create();
+    cpu_set_callgraph(cpu, g);
+    cpu_run(cpu, 1000);
+
+    const uint16_t mid_path[] = { 0x0210 };
+    const uint16_t drop_path[] = { 0x0210, 0x0220 };
+    CHECK(cpu_is_halted(cpu) && cpu_get_pc(cpu) == 0x0203, "returned to main");
+    CHECK(callgraph_depth(g) == 0, "both frames unwound by one RTS");
+    CHECK(self_cycles(g, drop_path, 2) == 4 + 4 + 6, "PLA, PLA, RTS in the callee");
+    CHECK(self_cycles(g, mid_path, 1) == 6, "only the caller's JSR");
+    CHECK(callgraph_node(g, CALLGRAPH_ROOT)->self_cycles == 6 + 1, "JAM back in main");
+
+    callgraph_destroy(g);
+    cpu_destroy(cpu);
+}
+
+/*
+ * $0200: JSR $0210
+ *        JAM
+ * $0210: LDA #$02        push $021F and "return" to $0220
+ *        PHA
+ *        LDA #$1F
+ *        PHA
+ *        RTS
+ * $0220: NOP
+ *        RTS             the real return to main
+ */
+TEST(test_callgraph_rts_as_jump) {
+    const uint8_t main_prog[] = { 0x20, 0x10, 0x02, 0x02 };
+    const uint8_t jumper[] = { 0xA9, 0x02, 0x48, 0xA9, 0x1F, 0x48, 0x60 };
+    const uint8_t target[] = { 0xEA, 0x60 };
+    CPU* cpu = load_cpu(0x0200, main_prog, sizeof(main_prog));
+    load(cpu, 0x0210, jumper, sizeof(jumper));
+    load(cpu, 0x0220, target, sizeof(target));
+
+    CallGraph* g = callgraph_create();
+    cpu_set_callgraph(cpu, g);
+    cpu_run(cpu, 1000);
+
+    const uint16_t path[] = { 0x0210 };
+    const uint16_t wrong[] = { 0x0220 };
+    CHECK(cpu_is_halted(cpu) && cpu_get_pc(cpu) == 0x0203);
+    CHECK(callgraph_depth(g) == 0);
+    CHECK(callgraph_find(g, wrong, 1) < 0, "the jump target is not a call");
+    CHECK(self_cycles(g, path, 1) == 2 + 3 + 2 + 3 + 6 + 2 + 6,
+          "everything up to the real return stays in the routine");
+
+    callgraph_destroy(g);
+    cpu_destroy(cpu);
+}
+
+/*
+ * $0200: JSR $0210
+ * $0210: LDX #$FF        reset the stack, abandoning the call
+ *        TXS
+ *        JSR $0220
+ *        JAM
+ * $0220: RTS
+ */
+TEST(test_callgraph_stack_reset) {
+    const uint8_t main_prog[] = { 0x20, 0x10, 0x02 };
+    const uint8_t reset[] = { 0xA2, 0xFF, 0x9A, 0x20, 0x20, 0x02, 0x02 };
+    CPU* cpu = load_cpu(0x0200, main_prog, sizeof(main_prog));
+    load(cpu, 0x0210, reset, sizeof(reset));
+    bus_write(cpu_get_bus(cpu), 0x0220, 0x60);
+
+    CallGraph* g = callgraph_create();
+    cpu_set_callgraph(cpu, g);
+    cpu_run(cpu, 1000);
+
+    const uint16_t top[] = { 0x0220 };
+    const uint16_t nested[] = { 0x0210, 0x0220 };
+    CHECK(callgraph_depth(g) == 0);
+    CHECK(callgraph_find(g, top, 1) >= 0, "call after TXS made from the top level");
+    CHECK(callgraph_find(g, nested, 2) < 0, "abandoned frame is gone");
+
+    callgraph_destroy(g);
+    cpu_destroy(cpu);
+}
+
+TEST(test_callgraph_runaway_recursion) {
+    /* $0200: JSR $0200 forever; the 6502 stack wraps every 128 calls */
+    const uint8_t prog[] = { 0x20, 0x00, 0x02 };
+    CPU* cpu = load_cpu(0x0200, prog, sizeof(prog));
+    CallGraph* g = callgraph_create();
+    cpu_set_callgraph(cpu, g);
+
+    cpu_run_instructions(cpu, 1000);
+    CHECK(callgraph_depth(g) <= 128, "shadow stack bounded by the real one");
+    CHECK(callgraph_inclusive(g, CALLGRAPH_ROOT) == 6000);
+
+    callgraph_destroy(g);
+    cpu_destroy(cpu);
+}
+
+/*
+ * $0200: CLI; NOP; JMP $0201
+ * $0300: JSR $0310; RTI       IRQ handler
+ * $0310: RTS
+ */
+TEST(test_callgraph_interrupts) {
+    const uint8_t main_prog[] = { 0x58, 0xEA, 0x4C, 0x01, 0x02 };
+    const uint8_t handler[] = { 0x20, 0x10, 0x03, 0x40 };
+    CPU* cpu = load_cpu(0x0200, main_prog, sizeof(main_prog));
+    load(cpu, 0x0300, handler, sizeof(handler));
+    bus_write(cpu_get_bus(cpu), 0x0310, 0x60);
+    bus_write(cpu_get_bus(cpu), 0xFFFE, 0x00);
+    bus_write(cpu_get_bus(cpu), 0xFFFF, 0x03);
+
+    CallGraph* g = callgraph_create();
+    cpu_set_callgraph(cpu, g);
+    cpu_run_instructions(cpu, 3);
+    cpu_irq(cpu);
+    cpu_run_instructions(cpu, 1);
+    cpu_irq_release(cpu);
+    cpu_run_instructions(cpu, 3);           // JSR, RTS, RTI
+    CHECK(callgraph_depth(g) == 0, "RTI leaves the handler frame");
+    CHECK(cpu_get_pc(cpu) >= 0x0201 && cpu_get_pc(cpu) <= 0x0204);
+
+    const uint16_t handler_path[] = { 0x0300 };
+    CHECK(self_cycles(g, handler_path, 1) == 7 + 6 + 6, "entry, JSR and RTI");
+
+    char* text = folded(g);
+    CHECK(strstr(text, "main;irq:$0300;$0310 6\n") != NULL, "interrupt frame in the path");
+    free(text);
+
+    callgraph_clear(g);
+    CHECK(callgraph_node_count(g) == 1 && callgraph_inclusive(g, CALLGRAPH_ROOT) == 0);
+
+    callgraph_destroy(g);
+    cpu_destroy(cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Call Graph Tests ===\n\n");
+
+    RUN_TEST(test_callgraph_nested);
+    RUN_TEST(test_callgraph_step_and_trace_agree);
+    RUN_TEST(test_callgraph_dropped_return);
+    RUN_TEST(test_callgraph_rts_as_jump);
+    RUN_TEST(test_callgraph_stack_reset);
+    RUN_TEST(test_callgraph_runaway_recursion);
+    RUN_TEST(test_callgraph_interrupts);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Command line smoke tests: stop reasons, exit statuses and argument
+# checks of the emu6502 run mode. Usage: tests/test_cli.sh path/to/emu6502
+#
+
+EMU=${1:?usage: $0 path/to/emu6502}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+tests_run=0
+failed=0
+
+# image NAME OCTAL-ESCAPED-BYTES
+image() {
+    printf "$2" > "$DIR/$1"
+}
+
+# check NAME EXPECTED-STATUS EXPECTED-TEXT ARGS...: run, compare status, grep output
+check() {
+    name=$1 status=$2 text=$3
+    shift 3
+    tests_run=$((tests_run + 1))
+    out=$("$EMU" "$@" 2>&1)
+    got=$?
+    if [ "$got" -eq "$status" ] && printf '%s\n' "$out" | grep -q -- "$text"; then
+        printf '  %-40s ✓\n' "$name"
+    else
+        printf '  %-40s ✗\n' "$name"
+        printf '    FAIL: status %s (expected %s), output:\n%s\n' "$got" "$status" "$out"
+        failed=$((failed + 1))
+    fi
+}
+
+printf '\n=== Command Line Tests ===\n\n'
+
+image jam.bin    '\251\001\002'                     # LDA #$01; JAM
+image write.bin  '\251\007\215\377\320\002'         # LDA #$07; STA $D0FF; JAM
+image ill.bin    '\251\001\003\020\002'             # LDA #$01; SLO ($10,X)
+image spin.bin   '\251\001\114\000\002'             # LDA #$01; JMP $0200
+image count.bin  '\350\114\000\002'                 # INX; JMP $0200
+printf '\000\004\352\002' > "$DIR/prog.prg"         # PRG at $0400: NOP; JAM
+
+check "jam stops with status 0"      0  "PC=0202 cycles=3 insns=2 stop=jam" \
+      --load "$DIR/jam.bin@0200" --reset 0200
+check "stop-write exits with the byte" 7 "stop=write value=07" \
+      --load "$DIR/write.bin@0200" --reset 0200 --stop-write D0FF
+check "illegal opcode exits 1"       1  "PC=0202 cycles=2 insns=2 stop=illegal opcode=03" \
+      --load "$DIR/ill.bin@0200" --reset 0200
+check "unbounded idle loop stops"    0  "PC=0200 .* stop=loop" \
+      --load "$DIR/spin.bin@0200" --reset 0200
+check "cycle budget"                 0  "cycles=1000 .* stop=budget" \
+      --load "$DIR/spin.bin@0200" --reset 0200 --cycles 1000
+check "instruction budget"           0  "X=32 .* insns=100 stop=budget" \
+      --load "$DIR/count.bin@0200" --pc 0200 --insns 100
+check "stop-pc"                      0  "PC=0201 cycles=2 insns=1 stop=pc" \
+      --load "$DIR/count.bin@0200" --pc 0200 --stop-pc 0201
+check "prg loads at its address"     0  "PC=0401 .* stop=jam" \
+      --prg "$DIR/prog.prg" --reset 0400
+check "dump prints memory"           0  "^0200: A9 01 02" \
+      --load "$DIR/jam.bin@0200" --reset 0200 --dump 0200:0202
+check "cycles and insns together"    1  "usage:" \
+      --load "$DIR/jam.bin@0200" --cycles 10 --insns 10
+check "non-numeric budget"           1  "expected a decimal count, got 'abc'" \
+      --load "$DIR/jam.bin@0200" --cycles abc
+check "budget with a suffix"         1  "expected a decimal count, got '10k'" \
+      --load "$DIR/jam.bin@0200" --insns 10k
+check "negative budget"              1  "usage:" \
+      --load "$DIR/jam.bin@0200" --cycles -1
+check "no image"                     1  "usage:" --cycles 10
+check "missing image file"           1  "Cannot open" --load "$DIR/none.bin@0200"
+
+printf '\n========================================\n'
+printf 'Tests run: %d\nPassed: %d\nFailed: %d\n' "$tests_run" $((tests_run - failed)) "$failed"
+[ "$failed" -eq 0 ] && printf '\nAll tests passed!\n\n'
+[ "$failed" -eq 0 ]
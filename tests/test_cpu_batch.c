@@ -0,0 +1,305 @@
+#include "test_common.h"
+#include "cpu_batch.h"
+#include "bus.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Differential tests: every lane of a batch must end exactly where
+ * cpu_run leaves an identical machine run on its own.
+ */
+
+#define MAX_LANES 64
+
+typedef struct {
+    CPU*    cpu;
+    Memory* mem;
+} Machine;
+
+/* MMIO page: reads count up, $xx01 raises IRQ, $xx02 releases it */
+typedef struct {
+    CPU*    cpu;
+    uint8_t counter;
+} IrqDevice;
+
+static uint8_t irq_dev_read(void* ctx, uint16_t addr) {
+    (void)addr;
+    return ((IrqDevice*)ctx)->counter++;
+}
+
+static void irq_dev_write(void* ctx, uint16_t addr, uint8_t val) {
+    (void)val;
+    IrqDevice* dev = (IrqDevice*)ctx;
+    if ((addr & 0xFF) == 0x01) cpu_irq(dev->cpu);
+    if ((addr & 0xFF) == 0x02) cpu_irq_release(dev->cpu);
+}
+
+/* ========================= Programs ========================= */
+
+/* Flags, transfers and stack traffic */
+static const uint8_t alu_prog[] = {
+    0xA5, 0x10,         /* LDA $10 */
+    0x18,               /* CLC */
+    0x65, 0x11,         /* ADC $11 */
+    0xE9, 0x10,         /* SBC #$10 */
+    0x38,               /* SEC */
+    0xE5, 0x11,         /* SBC $11 */
+    0xC9, 0x40,         /* CMP #$40 */
+    0xC5, 0x11,         /* CMP $11 */
+    0xA6, 0x11,         /* LDX $11 */
+    0xE0, 0x80,         /* CPX #$80 */
+    0xA4, 0x10,         /* LDY $10 */
+    0xC0, 0x02,         /* CPY #$02 */
+    0x24, 0x11,         /* BIT $11 */
+    0x09, 0x0F,         /* ORA #$0F */
+    0x29, 0xF3,         /* AND #$F3 */
+    0x45, 0x10,         /* EOR $10 */
+    0x0A, 0x2A,         /* ASL A, ROL A */
+    0x4A, 0x6A,         /* LSR A, ROR A */
+    0x08, 0x68,         /* PHP, PLA */
+    0x48, 0x28,         /* PHA, PLP */
+    0xB8,               /* CLV */
+    0xAA, 0xA8,         /* TAX, TAY */
+    0xBA, 0x8A,         /* TSX, TXA */
+    0x98, 0x9A,         /* TYA, TXS */
+    0xE8, 0xC8,         /* INX, INY */
+    0xCA, 0x88,         /* DEX, DEY */
+    0xF8, 0xD8,         /* SED, CLD */
+    0x78, 0x58,         /* SEI, CLI */
+    0xEA,               /* NOP */
+    0x02                /* JAM */
+};
+
+/* Indexed and indirect modes, page crosses, read-modify-write */
+static const uint8_t mem_prog[] = {
+    0xA6, 0x10,         /* LDX $10 */
+    0xA4, 0x11,         /* LDY $11 */
+    0xA9, 0x20,         /* LDA #$20 */
+    0x85, 0x30,         /* STA $30 */
+    0xA9, 0x03,         /* LDA #$03 */
+    0x85, 0x31,         /* STA $31   ($30) -> $0320 */
+    0xA5, 0x11,         /* LDA $11 */
+    0x95, 0x40,         /* STA $40,X */
+    0x9D, 0xFF, 0x02,   /* STA $02FF,X */
+    0xBD, 0xFF, 0x02,   /* LDA $02FF,X */
+    0xB9, 0x20, 0x03,   /* LDA $0320,Y */
+    0x99, 0x20, 0x03,   /* STA $0320,Y */
+    0xB1, 0x30,         /* LDA ($30),Y */
+    0x91, 0x30,         /* STA ($30),Y */
+    0xA1, 0x2B,         /* LDA ($2B,X) */
+    0x81, 0x2B,         /* STA ($2B,X) */
+    0xF6, 0x40,         /* INC $40,X */
+    0xDE, 0xFF, 0x02,   /* DEC $02FF,X */
+    0x1E, 0xFF, 0x02,   /* ASL $02FF,X */
+    0x66, 0x40,         /* ROR $40 */
+    0x96, 0x50,         /* STX $50,Y */
+    0x94, 0x50,         /* STY $50,X */
+    0x1C, 0xFF, 0x02,   /* NOP $02FF,X */
+    0x02                /* JAM */
+};
+
+/* Data-dependent branches and a subroutine */
+static const uint8_t branch_prog[] = {
+    0xA6, 0x10,         /* $0200: LDX $10 */
+    0xA9, 0x00,         /* $0202: LDA #0 */
+    0x18,               /* $0204: CLC */
+    0x65, 0x11,         /* $0205: ADC $11 */
+    0x90, 0x01,         /* $0207: BCC $020A */
+    0xC8,               /* $0209: INY */
+    0xCA,               /* $020A: DEX */
+    0xD0, 0xF7,         /* $020B: BNE $0204 */
+    0x20, 0x20, 0x02,   /* $020D: JSR $0220 */
+    0x4C, 0xFC, 0x06,   /* $0210: JMP $06FC */
+    0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+    0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+    0x8D, 0x00, 0x04,   /* $0220: STA $0400 */
+    0x6C, 0x30, 0x00,   /* $0223: JMP ($0030) -> $0228 */
+    0x02, 0x02,
+    0x60                /* $0228: RTS */
+};
+
+static const uint8_t branch_straddle[] = {
+    0xCA,               /* $06FC: DEX */
+    0xEA, 0xEA,         /* $06FD: NOP, NOP */
+    0xD0, 0xFB,         /* $06FF: BNE $06FC (loop across pages, crossing) */
+    0x02                /* $0701: JAM */
+};
+
+/* IRQ raised by an MMIO write in the middle of a loop */
+static const uint8_t irq_prog[] = {
+    0x58,               /* $0200: CLI */
+    0xA2, 0x00,         /* $0201: LDX #0 */
+    0xAD, 0x00, 0xD0,   /* $0203: LDA $D000 */
+    0x8D, 0x01, 0xD0,   /* $0206: STA $D001 (raise IRQ) */
+    0xC8,               /* $0209: INY */
+    0xC0, 0x0A,         /* $020A: CPY #10 */
+    0xD0, 0xF5,         /* $020C: BNE $0203 */
+    0x02                /* $020E: JAM */
+};
+
+static const uint8_t irq_handler[] = {
+    0x8D, 0x02, 0xD0,   /* $0400: STA $D002 (release) */
+    0xE8,               /* INX */
+    0x40                /* RTI */
+};
+
+/* Copy loop over a table */
+static const uint8_t loop_prog[] = {
+    0xA0, 0x03,         /* $0200: LDY #3 */
+    0xA2, 0x00,         /* $0202: LDX #0 */
+    0xBD, 0xF0, 0x03,   /* $0204: LDA $03F0,X */
+    0x9D, 0x00, 0x05,   /* $0207: STA $0500,X */
+    0x65, 0x10,         /* $020A: ADC $10 */
+    0xCA,               /* $020C: DEX */
+    0xD0, 0xF5,         /* $020D: BNE $0204 */
+    0x88,               /* $020F: DEY */
+    0xD0, 0xF0,         /* $0210: BNE $0202 */
+    0x02                /* $0212: JAM */
+};
+
+typedef struct {
+    const uint8_t* code;
+    size_t         size;
+} Program;
+
+static const Program programs[] = {
+    { loop_prog,   sizeof(loop_prog) },
+    { branch_prog, sizeof(branch_prog) },
+    { alu_prog,    sizeof(alu_prog) },
+    { mem_prog,    sizeof(mem_prog) },
+    { irq_prog,    sizeof(irq_prog) },
+};
+
+/* Program and per-lane data for a lane; the IRQ program gets its device */
+static Machine machine_create(const Program* prog, int lane) {
+    Machine m;
+    m.mem = memory_create();
+    Bus* bus = bus_create();
+    bus_map_memory(bus, m.mem);
+    bus_load(bus, 0x0200, prog->code, prog->size);
+    bus_load(bus, 0x06FC, branch_straddle, sizeof(branch_straddle));
+    bus_write(bus, 0xFFFC, 0x00);
+    bus_write(bus, 0xFFFD, 0x02);
+    bus_write(bus, 0x0010, (uint8_t)(lane + 1));
+    bus_write(bus, 0x0011, (uint8_t)(lane * 37));
+    bus_write(bus, 0x0030, 0x28);
+    bus_write(bus, 0x0031, 0x02);
+    for (int i = 0; i < 256; i++)
+        bus_write(bus, 0x0300 + i, (uint8_t)(i * 7 + lane));
+    m.cpu = cpu_create(bus);
+    if (prog->code == irq_prog) {
+        uint8_t vec[] = { 0x00, 0x04 };
+        bus_load(bus, 0x0400, irq_handler, sizeof(irq_handler));
+        bus_load(bus, 0xFFFE, vec, sizeof(vec));
+        IrqDevice* dev = calloc(1, sizeof(IrqDevice));
+        dev->cpu = m.cpu;
+        bus_map(bus, 0xD000, 0xD0FF, irq_dev_read, irq_dev_write, dev, free);
+    }
+    return m;
+}
+
+static void check_same(Machine* a, Machine* b) {
+    CHECK_EQ(cpu_get_pc(a->cpu), cpu_get_pc(b->cpu));
+    CHECK_EQ(cpu_get_a(a->cpu), cpu_get_a(b->cpu));
+    CHECK_EQ(cpu_get_x(a->cpu), cpu_get_x(b->cpu));
+    CHECK_EQ(cpu_get_y(a->cpu), cpu_get_y(b->cpu));
+    CHECK_EQ(cpu_get_sp(a->cpu), cpu_get_sp(b->cpu));
+    CHECK_EQ(cpu_get_status(a->cpu), cpu_get_status(b->cpu));
+    CHECK_EQ(cpu_get_total_cycles(a->cpu), cpu_get_total_cycles(b->cpu));
+    CHECK_EQ(cpu_is_halted(a->cpu), cpu_is_halted(b->cpu));
+    CHECK(memcmp(memory_get_raw(a->mem), memory_get_raw(b->mem), 0x10000) == 0,
+          "memory differs");
+}
+
+/*
+ * Run `lanes` lanes (program chosen by lane % prog_count) through a
+ * batch `runs` times and the same machines through cpu_run, comparing
+ * every lane after each run. Returns the batch's scalar step count.
+ */
+static uint64_t batch_vs_run(int lanes, int prog_count, uint64_t budget, int runs) {
+    Machine batch_m[MAX_LANES], ref_m[MAX_LANES];
+    CPU* cpus[MAX_LANES];
+    for (int i = 0; i < lanes; i++) {
+        batch_m[i] = machine_create(&programs[i % prog_count], i);
+        ref_m[i] = machine_create(&programs[i % prog_count], i);
+        cpus[i] = batch_m[i].cpu;
+    }
+
+    CPUBatch* batch = cpu_batch_create(cpus, lanes);
+    for (int r = 0; r < runs; r++) {
+        uint64_t total = cpu_batch_run(batch, budget);
+        uint64_t ref_total = 0;
+        for (int i = 0; i < lanes; i++) {
+            uint64_t ran = cpu_run(ref_m[i].cpu, budget);
+            CHECK_EQ(cpu_batch_lane_cycles(batch, i), ran);
+            ref_total += ran;
+            check_same(&batch_m[i], &ref_m[i]);
+        }
+        CHECK(total == ref_total, "batch total should sum the lanes");
+    }
+    uint64_t scalar = cpu_batch_scalar_steps(batch);
+
+    cpu_batch_destroy(batch);
+    for (int i = 0; i < lanes; i++) {
+        cpu_destroy(batch_m[i].cpu);
+        cpu_destroy(ref_m[i].cpu);
+    }
+    return scalar;
+}
+
+/* ========================= Tests ========================= */
+
+TEST(test_batch_matches_run_to_completion) {
+    /* 37 lanes: two full groups plus a partial one, all programs mixed */
+    batch_vs_run(37, 5, 100000, 1);
+}
+
+TEST(test_batch_budget_boundaries) {
+    for (uint64_t budget = 1; budget < 300; budget += 7)
+        batch_vs_run(20, 4, budget, 3);
+}
+
+TEST(test_batch_direct_code_stays_vectorized) {
+    /* Only JAM leaves the vector path: one scalar step per lane */
+    uint64_t scalar = batch_vs_run(40, 4, 100000, 1);
+    CHECK_EQ(scalar, 40);
+}
+
+TEST(test_batch_mmio_lanes_fall_back) {
+    /* Every IRQ lane touches its device; the others stay vectorized */
+    uint64_t scalar = batch_vs_run(10, 5, 100000, 1);
+    CHECK(scalar > 10, "MMIO and interrupt work should go through cpu_step");
+}
+
+TEST(test_batch_skips_halted_lanes) {
+    Machine m = machine_create(&programs[0], 0);
+    CPU* cpus[1] = { m.cpu };
+    CPUBatch* batch = cpu_batch_create(cpus, 1);
+
+    cpu_batch_run(batch, 100000);
+    CHECK(cpu_is_halted(m.cpu), "lane should reach JAM");
+    uint64_t total = cpu_get_total_cycles(m.cpu);
+
+    CHECK_EQ(cpu_batch_run(batch, 100000), 0);
+    CHECK(cpu_get_total_cycles(m.cpu) == total, "halted lane should not run");
+
+    cpu_batch_destroy(batch);
+    cpu_destroy(m.cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== CPU Batch Tests ===\n\n");
+
+    RUN_TEST(test_batch_matches_run_to_completion);
+    RUN_TEST(test_batch_budget_boundaries);
+    RUN_TEST(test_batch_direct_code_stays_vectorized);
+    RUN_TEST(test_batch_mmio_lanes_fall_back);
+    RUN_TEST(test_batch_skips_halted_lanes);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -400,6 +400,41 @@ TEST(test_php_preserves_status) {
     cpu_destroy(cpu);
 }
 
+TEST(test_status_round_trip) {
+    CPU* cpu = setup_cpu();
+
+    /* Flags are held unpacked: every byte must come back unchanged */
+    for (int v = 0; v < 256; v++) {
+        cpu_set_status(cpu, (uint8_t)v);
+        CHECK_EQ(cpu_get_status(cpu), v);
+    }
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_php_materializes_flags) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    cpu_set_status(cpu, FLAG_U);
+    cpu_set_a(cpu, 0x01);
+    bus_write(bus, 0x0010, 0xC0);
+    bus_write(bus, 0x0200, encode_op(BIT, ZPG));    /* N, V from M; Z from A & M */
+    bus_write(bus, 0x0201, 0x10);
+    bus_write(bus, 0x0202, encode_op(CMP, IMM));    /* equal: Z, C set, N kept */
+    bus_write(bus, 0x0203, 0x01);
+    bus_write(bus, 0x0204, encode_op(PHP, IMPL));
+
+    uint8_t sp_before = cpu_get_sp(cpu);
+    cpu_step(cpu);
+    cpu_step(cpu);
+    cpu_step(cpu);
+
+    uint8_t pushed = bus_read(bus, 0x0100 | sp_before);
+    CHECK_EQ(pushed, FLAG_N | FLAG_V | FLAG_U | FLAG_B | FLAG_Z | FLAG_C);
+
+    cpu_destroy(cpu);
+}
+
 TEST(test_php_timing_and_sp) {
     CPU* cpu = setup_cpu();
     Bus* bus = cpu_get_bus(cpu);
@@ -840,6 +875,8 @@ int main(void) {
     RUN_TEST(test_php_sets_b_and_u);
     RUN_TEST(test_php_preserves_status);
     RUN_TEST(test_php_timing_and_sp);
+    RUN_TEST(test_status_round_trip);
+    RUN_TEST(test_php_materializes_flags);
     RUN_TEST(test_pla_basic);
     RUN_TEST(test_pla_sets_zero_flag);
     RUN_TEST(test_pla_sets_negative_flag);
@@ -0,0 +1,446 @@
+#include "test_common.h"
+#include "bus.h"
+#include "memory.h"
+
+/*
+ * Batch execution tests: cpu_run / cpu_run_instructions / cpu_stop
+ */
+
+/*
+ *      LDX #$05
+ * loop: DEX
+ *      BNE loop
+ *      JAM
+ */
+static const uint8_t count_prog[] = {
+    0xA2, 0x05,     /* LDX #$05 */
+    0xCA,           /* DEX */
+    0xD0, 0xFD,     /* BNE -3 */
+    0x02            /* JAM */
+};
+
+/* Device that stops the CPU when written */
+typedef struct {
+    CPU* cpu;
+    int  writes;
+} StopDevice;
+
+static uint8_t stop_dev_read(void* ctx, uint16_t addr) {
+    (void)ctx; (void)addr;
+    return 0x00;
+}
+
+static void stop_dev_write(void* ctx, uint16_t addr, uint8_t val) {
+    (void)addr; (void)val;
+    StopDevice* dev = (StopDevice*)ctx;
+    dev->writes++;
+    cpu_stop(dev->cpu);
+}
+
+/* ========================= cpu_run ========================= */
+
+TEST(test_run_matches_step) {
+    CPU* a = setup_cpu();
+    CPU* b = setup_cpu();
+    bus_load(cpu_get_bus(a), 0x0200, count_prog, sizeof(count_prog));
+    bus_load(cpu_get_bus(b), 0x0200, count_prog, sizeof(count_prog));
+
+    /* LDX + (DEX + BNE)*5 = 11 instructions */
+    uint64_t stepped = 0;
+    for (int i = 0; i < 11; i++) stepped += cpu_step(a);
+    uint64_t ran = cpu_run_instructions(b, 11);
+
+    CHECK_EQ(ran, stepped);
+    CHECK_EQ(cpu_get_pc(b), cpu_get_pc(a));
+    CHECK_EQ(cpu_get_x(b), cpu_get_x(a));
+    CHECK_EQ(cpu_get_status(b), cpu_get_status(a));
+
+    cpu_destroy(a);
+    cpu_destroy(b);
+}
+
+TEST(test_run_cycle_budget) {
+    CPU* cpu = setup_cpu();
+    bus_load(cpu_get_bus(cpu), 0x0200, count_prog, sizeof(count_prog));
+
+    /* LDX (2) + DEX (2) exactly uses a budget of 4 */
+    uint64_t cycles = cpu_run(cpu, 4);
+    CHECK_EQ(cycles, 4);
+    check_pc(cpu, 0x0203);
+
+    /* A budget of 1 still runs the whole BNE (3 cycles, taken) */
+    cycles = cpu_run(cpu, 1);
+    CHECK_EQ(cycles, 3);
+    check_pc(cpu, 0x0202);
+
+    /* Budget 3: DEX (2) leaves 1, so BNE runs too and overshoots */
+    cycles = cpu_run(cpu, 3);
+    CHECK_EQ(cycles, 5);
+    check_pc(cpu, 0x0202);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_run_total_cycles) {
+    CPU* cpu = setup_cpu();
+    bus_load(cpu_get_bus(cpu), 0x0200, count_prog, sizeof(count_prog));
+
+    CHECK_EQ(cpu_get_total_cycles(cpu), 0);
+    uint64_t sum = cpu_step(cpu);
+    sum += cpu_run_instructions(cpu, 4);
+    sum += cpu_run(cpu, 6);
+    CHECK_EQ(cpu_get_total_cycles(cpu), sum);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_run_halts_on_jam) {
+    CPU* cpu = setup_cpu();
+    bus_load(cpu_get_bus(cpu), 0x0200, count_prog, sizeof(count_prog));
+
+    /* LDX 2 + 4 taken loops * 5 + last DEX/BNE 4 + JAM 1 = 27 */
+    uint64_t cycles = cpu_run(cpu, 1000);
+    CHECK_EQ(cycles, 27);
+    CHECK(cpu_is_halted(cpu), "JAM should halt the CPU");
+    check_pc(cpu, 0x0205);
+
+    /* Halted CPU does nothing until reset */
+    CHECK_EQ(cpu_step(cpu), 0);
+    CHECK_EQ(cpu_run(cpu, 100), 0);
+    check_pc(cpu, 0x0205);
+
+    cpu_reset(cpu);
+    CHECK(!cpu_is_halted(cpu), "reset clears halt");
+    check_pc(cpu, 0x0200);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_run_halts_on_every_jam) {
+    /* The twelve JAM bytes in the $x2 column all lock up alike */
+    static const uint8_t jams[] = {
+        0x02, 0x12, 0x22, 0x32, 0x42, 0x52, 0x62, 0x72, 0x92, 0xB2, 0xD2, 0xF2
+    };
+    for (size_t i = 0; i < sizeof(jams); i++) {
+        CPU* cpu = setup_cpu();
+        uint8_t prog[] = { 0xA9, 0x01, jams[i], 0x00 };     /* LDA #$01; JAM */
+        bus_load(cpu_get_bus(cpu), 0x0200, prog, sizeof(prog));
+
+        CHECK_EQ(cpu_run(cpu, 1000), 3);
+        CHECK(cpu_is_halted(cpu), "JAM should halt the CPU");
+        check_pc(cpu, 0x0202);
+        CHECK(cpu_get_last_steps(cpu) == 2);
+        cpu_destroy(cpu);
+    }
+}
+
+TEST(test_run_halts_on_illegal) {
+    CPU* cpu = setup_cpu();
+    uint8_t prog[] = { 0xA9, 0x01, 0x0F, 0x00, 0x30, 0xE8 };    /* LDA #$01; SLO $3000 */
+    bus_load(cpu_get_bus(cpu), 0x0200, prog, sizeof(prog));
+
+    /* Only the LDA takes cycles: the SLO halts before its operand */
+    CHECK_EQ(cpu_run(cpu, 1000), 2);
+    CHECK(cpu_get_total_cycles(cpu) == 2);
+    CHECK(cpu_is_halted(cpu) && cpu_is_illegal(cpu), "unimplemented opcode halts");
+    check_pc(cpu, 0x0202);
+    CHECK_EQ(cpu_get_a(cpu), 0x01);
+    CHECK_EQ(cpu_run(cpu, 100), 0);
+
+    cpu_reset(cpu);
+    CHECK(!cpu_is_halted(cpu) && !cpu_is_illegal(cpu), "reset clears it");
+
+    /* Stepped, indexed and indirect forms take no cycles either */
+    static const uint8_t slo[] = { 0x1F, 0x13, 0x03 };     /* abs,X  (zp),Y  (zp,X) */
+    for (size_t i = 0; i < sizeof(slo); i++) {
+        cpu_reset(cpu);
+        uint64_t total = cpu_get_total_cycles(cpu);
+        bus_write(cpu_get_bus(cpu), 0x0200, slo[i]);
+        CHECK_EQ(cpu_step(cpu), 0);
+        CHECK(cpu_is_illegal(cpu));
+        CHECK(cpu_get_total_cycles(cpu) == total);
+        check_pc(cpu, 0x0200);
+    }
+    cpu_reset(cpu);
+    bus_write(cpu_get_bus(cpu), 0x0200, 0xA9);
+
+    /* JAM is a halt, not an illegal one */
+    bus_write(cpu_get_bus(cpu), 0x0202, 0x02);
+    cpu_run(cpu, 1000);
+    CHECK(cpu_is_halted(cpu) && !cpu_is_illegal(cpu));
+    cpu_destroy(cpu);
+}
+
+TEST(test_run_last_steps) {
+    CPU* cpu = setup_cpu();
+    bus_load(cpu_get_bus(cpu), 0x0200, count_prog, sizeof(count_prog));
+
+    cpu_run_instructions(cpu, 4);
+    CHECK_EQ(cpu_get_last_steps(cpu), 4);
+    cpu_step(cpu);
+    CHECK_EQ(cpu_get_last_steps(cpu), 1);
+
+    /* The remaining three DEX/BNE pairs, then the JAM */
+    cpu_run(cpu, 1000);
+    CHECK_EQ(cpu_get_last_steps(cpu), 7);
+    cpu_step(cpu);
+    CHECK_EQ(cpu_get_last_steps(cpu), 0);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_run_stop_from_device) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    StopDevice* dev = calloc(1, sizeof(StopDevice));
+    dev->cpu = cpu;
+    bus_map(bus, 0xD000, 0xD0FF, stop_dev_read, stop_dev_write, dev, free);
+
+    uint8_t prog[] = {
+        0xE8,               /* INX */
+        0x8D, 0x00, 0xD0,   /* STA $D000 */
+        0xE8,               /* INX */
+        0x4C, 0x00, 0x02    /* JMP $0200 */
+    };
+    bus_load(bus, 0x0200, prog, sizeof(prog));
+
+    uint64_t cycles = cpu_run(cpu, 1000);
+    CHECK_EQ(cycles, 2 + 4);
+    CHECK_EQ(dev->writes, 1);
+    CHECK_EQ(cpu_get_x(cpu), 1);
+    check_pc(cpu, 0x0204);
+
+    /* Next run resumes where it stopped */
+    cpu_run(cpu, 1000);
+    CHECK_EQ(dev->writes, 2);
+    CHECK_EQ(cpu_get_x(cpu), 3);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_run_services_irq) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+
+    bus_write(bus, 0xFFFE, 0x00);
+    bus_write(bus, 0xFFFF, 0x04);
+    uint8_t prog[] = {
+        0x58,               /* CLI */
+        0x4C, 0x01, 0x02    /* JMP $0201 */
+    };
+    bus_load(bus, 0x0200, prog, sizeof(prog));
+    bus_write(bus, 0x0400, 0x02);   /* JAM in handler */
+
+    cpu_irq(cpu);
+    /* CLI (2), IRQ entry (7), then JAM in the handler */
+    uint64_t cycles = cpu_run(cpu, 1000);
+    CHECK_EQ(cycles, 2 + 7 + 1);
+    CHECK(cpu_is_halted(cpu), "handler should have run");
+    check_pc(cpu, 0x0400);
+
+    cpu_irq_release(cpu);
+    cpu_destroy(cpu);
+}
+
+/* Stores from the run loop (and JIT code) reach the memory's dirty bitmap */
+TEST(test_run_marks_dirty_pages) {
+    Memory* mem = memory_create();
+    Bus* bus = bus_create();
+    bus_map_memory(bus, mem);
+    static const uint8_t prog[] = {
+        0xA2, 0x00,             /* LDX #$00 */
+        0x9D, 0x00, 0x30,       /* loop: STA $3000,X */
+        0x9D, 0x00, 0x50,       /* STA $5000,X */
+        0xE8,                   /* INX */
+        0xD0, 0xF7,             /* BNE loop */
+        0x02                    /* JAM */
+    };
+    bus_load(bus, 0x0200, prog, sizeof(prog));
+    bus_write(bus, 0xFFFC, 0x00);
+    bus_write(bus, 0xFFFD, 0x02);
+    CPU* cpu = cpu_create(bus);
+
+    memory_clear_dirty(mem);
+    cpu_run(cpu, 100000);
+    CHECK(cpu_is_halted(cpu));
+    CHECK_EQ(memory_dirty_count(mem), 2);
+    CHECK(memory_page_dirty(mem, 0x30));
+    CHECK(memory_page_dirty(mem, 0x50));
+
+    cpu_destroy(cpu);
+}
+
+/* ========================= Idle loops ========================= */
+
+/*
+ * $0200: CLI
+ * wait:  LDA $10
+ *        BEQ wait
+ *        JAM
+ * $0300: INC $10       IRQ handler
+ *        RTI
+ */
+static const uint8_t wait_prog[] = { 0x58, 0xA5, 0x10, 0xF0, 0xFC, 0x02 };
+static const uint8_t wait_handler[] = { 0xE6, 0x10, 0x40 };
+
+static CPU* setup_wait(bool skip) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_load(bus, 0x0200, wait_prog, sizeof(wait_prog));
+    bus_load(bus, 0x0300, wait_handler, sizeof(wait_handler));
+    bus_write(bus, 0xFFFE, 0x00);
+    bus_write(bus, 0xFFFF, 0x03);
+    cpu_set_idle_skip(cpu, skip);
+    return cpu;
+}
+
+static void check_same_state(CPU* a, CPU* b) {
+    CHECK_EQ(cpu_get_pc(a), cpu_get_pc(b));
+    CHECK_EQ(cpu_get_a(a), cpu_get_a(b));
+    CHECK_EQ(cpu_get_sp(a), cpu_get_sp(b));
+    CHECK_EQ(cpu_get_status(a), cpu_get_status(b));
+    CHECK(cpu_get_total_cycles(a) == cpu_get_total_cycles(b), "same cycle count");
+    CHECK(cpu_is_halted(a) == cpu_is_halted(b));
+}
+
+TEST(test_run_idle_skip_exact) {
+    CPU* skip = setup_wait(true);
+    CPU* full = setup_wait(false);
+
+    /* Odd budgets: the skip must stop where the real loop would */
+    uint64_t budgets[] = { 1000000, 3, 12345, 77777 };
+    for (size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+        CHECK(cpu_run(skip, budgets[i]) == cpu_run(full, budgets[i]));
+        CHECK(cpu_get_last_steps(skip) == cpu_get_last_steps(full));
+        check_same_state(skip, full);
+    }
+    CHECK(cpu_run_instructions(skip, 100001) == cpu_run_instructions(full, 100001));
+    check_same_state(skip, full);
+
+    CHECK(cpu_get_idle_cycles(skip) > 1000000, "the wait loop was skipped");
+    CHECK(cpu_get_idle_cycles(full) == 0);
+
+    /* The interrupt the loop waits for ends it, on both */
+    cpu_irq(skip);
+    cpu_irq(full);
+    CHECK(cpu_run(skip, 100) == cpu_run(full, 100));
+    cpu_irq_release(skip);
+    cpu_irq_release(full);
+    CHECK(cpu_run(skip, 100) == cpu_run(full, 100));
+    CHECK(cpu_is_halted(skip), "handler set the flag, loop fell through");
+    check_same_state(skip, full);
+
+    cpu_destroy(skip);
+    cpu_destroy(full);
+}
+
+TEST(test_run_idle_skip_jmp_self) {
+    CPU* cpu = setup_cpu();
+    const uint8_t prog[] = { 0x4C, 0x00, 0x02 };     /* JMP $0200 */
+    bus_load(cpu_get_bus(cpu), 0x0200, prog, sizeof(prog));
+
+    /* 3 cycles a pass; the pass that reaches the budget overshoots it */
+    CHECK_EQ(cpu_run(cpu, 1000000), 1000002);
+    CHECK(cpu_get_last_steps(cpu) == 333334);
+    CHECK(cpu_get_idle_cycles(cpu) > 999000);
+    check_pc(cpu, 0x0200);
+
+    cpu_destroy(cpu);
+}
+
+TEST(test_run_idle_skip_unbounded) {
+    /* With no budget a settled loop would run forever: the run stops */
+    CPU* cpu = setup_cpu();
+    const uint8_t prog[] = { 0x4C, 0x00, 0x02 };     /* JMP $0200 */
+    bus_load(cpu_get_bus(cpu), 0x0200, prog, sizeof(prog));
+
+    CHECK_EQ(cpu_run(cpu, UINT64_MAX), 3);
+    CHECK(cpu_is_stuck(cpu), "one pass, then stuck");
+    CHECK(!cpu_is_halted(cpu));
+    CHECK(cpu_get_idle_cycles(cpu) == 0);
+    check_pc(cpu, 0x0200);
+
+    CHECK_EQ(cpu_run(cpu, 30), 30);
+    CHECK(!cpu_is_stuck(cpu), "a bounded run skips as usual");
+    cpu_destroy(cpu);
+
+    /* Waiting for an IRQ that is never raised is stuck too */
+    cpu = setup_wait(true);
+    cpu_run(cpu, UINT64_MAX);
+    CHECK(cpu_is_stuck(cpu));
+    check_pc(cpu, 0x0201);
+    cpu_irq(cpu);
+    CHECK_EQ(cpu_run(cpu, 1), 7);
+    cpu_irq_release(cpu);
+    cpu_run(cpu, UINT64_MAX);
+    CHECK(!cpu_is_stuck(cpu) && cpu_is_halted(cpu), "the IRQ ends the wait");
+    cpu_destroy(cpu);
+}
+
+/* Device reads and loops that make progress are run, not skipped */
+static uint8_t count_dev_read(void* ctx, uint16_t addr) {
+    (void)addr;
+    (*(int*)ctx)++;
+    return 0;
+}
+
+static void count_dev_write(void* ctx, uint16_t addr, uint8_t val) {
+    (void)ctx; (void)addr; (void)val;
+}
+
+TEST(test_run_idle_skip_needs_idle) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    int reads = 0;
+    bus_map(bus, 0xD000, 0xD0FF, count_dev_read, count_dev_write, &reads, NULL);
+
+    /* LDA $D000 / BEQ: polls a device, which may change at any read */
+    const uint8_t poll[] = { 0xAD, 0x00, 0xD0, 0xF0, 0xFB };
+    bus_load(bus, 0x0200, poll, sizeof(poll));
+    cpu_run(cpu, 7000);
+    CHECK(reads > 0 && (uint64_t)reads == cpu_get_last_steps(cpu) / 2, "one read a pass");
+    CHECK(cpu_get_idle_cycles(cpu) == 0);
+
+    /* STA in the loop: a write */
+    const uint8_t store[] = { 0x85, 0x10, 0x4C, 0x00, 0x02 };
+    bus_load(bus, 0x0200, store, sizeof(store));
+    cpu_set_pc(cpu, 0x0200);
+    cpu_run(cpu, 10000);
+    CHECK(cpu_get_idle_cycles(cpu) == 0);
+
+    /* INX / JMP: registers change every pass */
+    const uint8_t count[] = { 0xE8, 0x4C, 0x00, 0x02 };
+    bus_load(bus, 0x0200, count, sizeof(count));
+    cpu_set_pc(cpu, 0x0200);
+    cpu_set_x(cpu, 0);
+    cpu_run(cpu, 5000);
+    CHECK(cpu_get_idle_cycles(cpu) == 0);
+    CHECK_EQ(cpu_get_x(cpu), 1000 & 0xFF);
+
+    cpu_destroy(cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== CPU Run Tests ===\n\n");
+
+    RUN_TEST(test_run_matches_step);
+    RUN_TEST(test_run_cycle_budget);
+    RUN_TEST(test_run_total_cycles);
+    RUN_TEST(test_run_halts_on_jam);
+    RUN_TEST(test_run_halts_on_every_jam);
+    RUN_TEST(test_run_halts_on_illegal);
+    RUN_TEST(test_run_last_steps);
+    RUN_TEST(test_run_stop_from_device);
+    RUN_TEST(test_run_services_irq);
+    RUN_TEST(test_run_marks_dirty_pages);
+    RUN_TEST(test_run_idle_skip_exact);
+    RUN_TEST(test_run_idle_skip_jmp_self);
+    RUN_TEST(test_run_idle_skip_unbounded);
+    RUN_TEST(test_run_idle_skip_needs_idle);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,236 @@
+#include "test_common.h"
+#include "fleet.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Fleet runner tests: every job must come out exactly as if it ran on a
+ * freshly created machine, whichever worker ran it and whatever ran there
+ * before.
+ */
+
+#define IMAGE_SIZE 0x200
+
+/*
+ * $0200: LDX #$00
+ * loop:  TXA
+ *        CLC
+ *        ADC $0300,X
+ *        STA $0400,X
+ *        INX
+ *        BNE loop
+ *        LDY $0300
+ *        JAM
+ * $0300: per-job data
+ */
+static const uint8_t sum_prog[] = {
+    0xA2, 0x00,
+    0x8A,
+    0x18,
+    0x7D, 0x00, 0x03,
+    0x9D, 0x00, 0x04,
+    0xE8,
+    0xD0, 0xF5,
+    0xAC, 0x00, 0x03,
+    0x02
+};
+
+#define SUM_PROG_JAM 0x0210
+
+static uint8_t* make_image(uint64_t seed) {
+    uint8_t* image = calloc(1, IMAGE_SIZE);
+    memcpy(image, sum_prog, sizeof(sum_prog));
+    for (int i = 0x100; i < IMAGE_SIZE; i++) image[i] = random_byte_r(&seed);
+    return image;
+}
+
+/* Run a job on a machine created just for it */
+static void reference_run(const FleetJob* job, FleetResult* r) {
+    Memory* mem = memory_create();
+    Bus* bus = bus_create();
+    bus_map_memory(bus, mem);
+    memory_load(mem, job->load_addr, job->image, job->image_size);
+    memory_write(mem, 0xFFFC, job->reset_vector & 0xFF);
+    memory_write(mem, 0xFFFD, job->reset_vector >> 8);
+    CPU* cpu = cpu_create(bus);
+    cpu_reset(cpu);
+
+    uint64_t cycles = 0;
+    r->stop = FLEET_STOP_BUDGET;
+    if (job->stop_on_pc) {
+        while (cycles < job->cycle_budget && !cpu_is_halted(cpu)) {
+            if (cpu_get_pc(cpu) == job->stop_pc) {
+                r->stop = FLEET_STOP_PC;
+                break;
+            }
+            cycles += cpu_step(cpu);
+        }
+    } else {
+        cycles = cpu_run(cpu, job->cycle_budget);
+    }
+    if (cpu_is_halted(cpu))
+        r->stop = cpu_is_illegal(cpu) ? FLEET_STOP_ILLEGAL : FLEET_STOP_HALTED;
+
+    r->a = cpu_get_a(cpu);
+    r->x = cpu_get_x(cpu);
+    r->y = cpu_get_y(cpu);
+    r->sp = cpu_get_sp(cpu);
+    r->status = cpu_get_status(cpu);
+    r->pc = cpu_get_pc(cpu);
+    r->cycles = cycles;
+    r->digest = fleet_digest(memory_get_raw(mem), 0x10000);
+    cpu_destroy(cpu);
+}
+
+static void make_jobs(FleetJob* jobs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        memset(&jobs[i], 0, sizeof(FleetJob));
+        jobs[i].image = make_image(i + 1);
+        jobs[i].image_size = IMAGE_SIZE;
+        jobs[i].load_addr = 0x0200;
+        jobs[i].reset_vector = 0x0200;
+        /* Mix of jobs that halt and jobs cut off by the budget */
+        jobs[i].cycle_budget = (i % 3 == 0) ? 1 + i * 37 : 100000;
+        if (i % 5 == 4) {
+            jobs[i].stop_on_pc = true;
+            jobs[i].stop_pc = 0x020D;   // LDY after the loop
+        }
+    }
+}
+
+static void free_jobs(FleetJob* jobs, size_t count) {
+    for (size_t i = 0; i < count; i++) free((void*)jobs[i].image);
+}
+
+static int same_result(const FleetResult* a, const FleetResult* b) {
+    return a->a == b->a && a->x == b->x && a->y == b->y && a->sp == b->sp
+        && a->status == b->status && a->pc == b->pc && a->cycles == b->cycles
+        && a->stop == b->stop && a->digest == b->digest;
+}
+
+static void check_fleet(size_t workers, size_t count) {
+    FleetJob* jobs = malloc(count * sizeof(FleetJob));
+    FleetResult* results = calloc(count, sizeof(FleetResult));
+    make_jobs(jobs, count);
+
+    Fleet* fleet = fleet_create(workers);
+    CHECK_EQ(fleet_workers(fleet), workers);
+
+    /* Twice, so every machine is reused after dirtying its memory */
+    for (int run = 0; run < 2; run++) {
+        memset(results, 0xEE, count * sizeof(FleetResult));
+        fleet_run(fleet, jobs, count, results);
+
+        int mismatches = 0;
+        for (size_t i = 0; i < count; i++) {
+            FleetResult ref;
+            reference_run(&jobs[i], &ref);
+            if (!same_result(&results[i], &ref)) mismatches++;
+            CHECK(results[i].worker < workers);
+        }
+        CHECK_EQ(mismatches, 0);
+    }
+
+    fleet_destroy(fleet);
+    free_jobs(jobs, count);
+    free(jobs);
+    free(results);
+}
+
+TEST(test_fleet_single_worker_matches_reference) {
+    check_fleet(1, 20);
+}
+
+TEST(test_fleet_many_workers_match_reference) {
+    check_fleet(4, 101);
+}
+
+TEST(test_fleet_more_workers_than_jobs) {
+    check_fleet(8, 3);
+}
+
+TEST(test_fleet_stop_conditions) {
+    FleetJob jobs[3];
+    FleetResult results[3];
+    make_jobs(jobs, 3);
+    jobs[0].cycle_budget = 100000;
+    jobs[1].cycle_budget = 50;
+    jobs[2].cycle_budget = 100000;
+    jobs[2].stop_on_pc = true;
+    jobs[2].stop_pc = 0x020D;
+
+    Fleet* fleet = fleet_create(2);
+    fleet_run(fleet, jobs, 3, results);
+
+    CHECK_EQ(results[0].stop, FLEET_STOP_HALTED);
+    CHECK_EQ(results[0].pc, SUM_PROG_JAM);
+    CHECK_EQ(results[1].stop, FLEET_STOP_BUDGET);
+    CHECK(results[1].cycles >= 50);
+    CHECK(results[1].cycles < 50 + 8);
+    CHECK_EQ(results[2].stop, FLEET_STOP_PC);
+    CHECK_EQ(results[2].pc, 0x020D);
+    CHECK_EQ(results[2].x, 0x00);
+
+    fleet_destroy(fleet);
+    free_jobs(jobs, 3);
+}
+
+TEST(test_fleet_illegal_opcode) {
+    /* A bad image stops its own job only; the rest of the run carries on */
+    FleetJob jobs[5];
+    FleetResult results[5];
+    make_jobs(jobs, 5);
+    for (size_t i = 0; i < 5; i++) {
+        jobs[i].cycle_budget = 100000;
+        jobs[i].stop_on_pc = (i == 3);
+    }
+    uint8_t* bad = (uint8_t*)jobs[1].image;
+    bad[0x0A] = 0x03;           /* SLO ($00,X) in place of INX */
+    bad = (uint8_t*)jobs[3].image;
+    bad[0x02] = 0xAB;           /* LXA #$18 in place of TXA/CLC */
+
+    Fleet* fleet = fleet_create(2);
+    fleet_run(fleet, jobs, 5, results);
+
+    CHECK_EQ(results[1].stop, FLEET_STOP_ILLEGAL);
+    CHECK_EQ(results[1].pc, 0x020A);
+    CHECK_EQ(results[3].stop, FLEET_STOP_ILLEGAL);
+    CHECK_EQ(results[3].pc, 0x0202);
+    for (size_t i = 0; i < 5; i += 2) {
+        CHECK_EQ(results[i].stop, FLEET_STOP_HALTED);
+        CHECK_EQ(results[i].pc, SUM_PROG_JAM);
+    }
+    for (size_t i = 0; i < 5; i++) {
+        FleetResult ref;
+        reference_run(&jobs[i], &ref);
+        CHECK(same_result(&results[i], &ref));
+    }
+
+    fleet_destroy(fleet);
+    free_jobs(jobs, 5);
+}
+
+TEST(test_fleet_empty_run) {
+    Fleet* fleet = fleet_create(2);
+    fleet_run(fleet, NULL, 0, NULL);
+    CHECK_EQ(fleet_steals(fleet), 0);
+    fleet_destroy(fleet);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Fleet Runner Tests ===\n\n");
+
+    RUN_TEST(test_fleet_single_worker_matches_reference);
+    RUN_TEST(test_fleet_many_workers_match_reference);
+    RUN_TEST(test_fleet_more_workers_than_jobs);
+    RUN_TEST(test_fleet_stop_conditions);
+    RUN_TEST(test_fleet_illegal_opcode);
+    RUN_TEST(test_fleet_empty_run);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,258 @@
+#define _DEFAULT_SOURCE
+#include "test_common.h"
+#include "heatmap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Heatmap tests: with HEATMAP=1 every CPU access lands in the right
+ * counter exactly once, whatever engine the build has; in any build the
+ * dump, image and report are right for a given set of counters.
+ */
+
+/*
+ * $0200: LDX #$03
+ * loop:  LDA $D000
+ *        STA $0300,X
+ *        JSR $0220
+ *        DEX
+ *        BNE loop
+ *        JAM
+ * $0220: RTS
+ */
+static const uint8_t count_prog[] = {
+    0xA2, 0x03,
+    0xAD, 0x00, 0xD0,
+    0x9D, 0x00, 0x03,
+    0x20, 0x20, 0x02,
+    0xCA,
+    0xD0, 0xF4,
+    0x02
+};
+
+static uint8_t dev_read(void* ctx, uint16_t addr) {
+    (void)ctx;
+    return (uint8_t)addr;
+}
+
+static void dev_write(void* ctx, uint16_t addr, uint8_t val) {
+    (void)ctx;
+    (void)addr;
+    (void)val;
+}
+
+static char* temp_path(void) {
+    static char path[64];
+    strcpy(path, "/tmp/heatmap_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+    return path;
+}
+
+static uint64_t sum(const uint32_t* counters) {
+    uint64_t total = 0;
+    for (uint32_t a = 0; a < 0x10000; a++) total += counters[a];
+    return total;
+}
+
+TEST(test_heatmap_counts) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_map(bus, 0xD000, 0xD0FF, dev_read, dev_write, NULL, NULL);
+    bus_load(bus, 0x0200, count_prog, sizeof(count_prog));
+    bus_write(bus, 0x0220, 0x60);
+    cpu_reset(cpu);
+
+    Heatmap* h = heatmap_create();
+    if (!bus_set_heatmap(bus, h)) {
+        /* Built without HEATMAP=1: nothing to count */
+        heatmap_destroy(h);
+        cpu_destroy(cpu);
+        return;
+    }
+    cpu_run(cpu, 100000);
+    CHECK(cpu_is_halted(cpu));
+
+    /* Opcode bytes only, once per instruction run */
+    CHECK(h->fetches[0x0200] == 1 && h->fetches[0x020E] == 1);
+    CHECK(h->fetches[0x0202] == 3 && h->fetches[0x0205] == 3 && h->fetches[0x0208] == 3);
+    CHECK(h->fetches[0x0220] == 3 && h->fetches[0x020B] == 3 && h->fetches[0x020C] == 3);
+    CHECK(sum(h->fetches) == 2 + 6 * 3, "LDX, JAM and six instructions per pass");
+
+    /* Operands and data, device reads included */
+    CHECK(h->reads[0x0201] == 1 && h->reads[0x0203] == 3 && h->reads[0x0204] == 3);
+    CHECK(h->reads[0xD000] == 3, "device reads counted");
+    CHECK(h->fetches[0x0202] == 3 && h->reads[0x0202] == 0, "a fetch is not also a read");
+
+    /* STA and the JSR return addresses; RTS reads them back */
+    CHECK(h->writes[0x0301] == 1 && h->writes[0x0302] == 1 && h->writes[0x0303] == 1);
+    CHECK(h->writes[0x01FF] == 3 && h->writes[0x01FE] == 3);
+    CHECK(h->reads[0x01FF] == 3 && h->reads[0x01FE] == 3);
+    CHECK(sum(h->writes) == 3 + 3 * 2);
+
+    /* Loading is not an access; once detached nothing is counted */
+    bus_load(bus, 0x0400, count_prog, sizeof(count_prog));
+    CHECK(h->writes[0x0400] == 0);
+    bus_set_heatmap(bus, NULL);
+    cpu_reset(cpu);
+    cpu_run(cpu, 100000);
+    CHECK(sum(h->fetches) == 20);
+
+    heatmap_destroy(h);
+    cpu_destroy(cpu);
+}
+
+TEST(test_heatmap_does_not_change_execution) {
+    CPU* plain = setup_cpu();
+    CPU* counted = setup_cpu();
+    Heatmap* h = heatmap_create();
+    bus_load(cpu_get_bus(plain), 0x0200, count_prog, sizeof(count_prog));
+    bus_load(cpu_get_bus(counted), 0x0200, count_prog, sizeof(count_prog));
+    bus_write(cpu_get_bus(plain), 0x0220, 0x60);
+    bus_write(cpu_get_bus(counted), 0x0220, 0x60);
+    cpu_reset(plain);
+    cpu_reset(counted);
+    bus_set_heatmap(cpu_get_bus(counted), h);
+
+    CHECK(cpu_run(plain, 100000) == cpu_run(counted, 100000));
+    CHECK_EQ(cpu_get_pc(counted), cpu_get_pc(plain));
+    CHECK_EQ(cpu_get_sp(counted), cpu_get_sp(plain));
+    CHECK(cpu_get_total_cycles(counted) == cpu_get_total_cycles(plain));
+
+    heatmap_destroy(h);
+    cpu_destroy(plain);
+    cpu_destroy(counted);
+}
+
+TEST(test_heatmap_saturates) {
+    Heatmap* h = heatmap_create();
+    h->reads[0x1234] = UINT32_MAX - 1;
+    heatmap_count(h->reads, 0x1234);
+    heatmap_count(h->reads, 0x1234);
+    CHECK(h->reads[0x1234] == UINT32_MAX);
+
+    heatmap_clear(h);
+    CHECK(h->reads[0x1234] == 0);
+    heatmap_destroy(h);
+}
+
+TEST(test_heatmap_dump_round_trip) {
+    Heatmap* h = heatmap_create();
+    for (uint32_t a = 0; a < 0x10000; a += 7) {
+        h->reads[a] = a * 3;
+        h->writes[a] = a ^ 0x5A5A;
+        h->fetches[a] = UINT32_MAX - a;
+    }
+    char* path = temp_path();
+    CHECK(heatmap_write_dump(h, path));
+
+    Heatmap* back = heatmap_read_dump(path);
+    CHECK(back != NULL);
+    if (back) CHECK(memcmp(back, h, sizeof(Heatmap)) == 0, "dump round trips");
+    heatmap_destroy(back);
+
+    /* A truncated file or another format is not a dump */
+    FILE* f = fopen(path, "r+b");
+    fseek(f, 0, SEEK_SET);
+    fputc('X', f);
+    fclose(f);
+    CHECK(heatmap_read_dump(path) == NULL, "bad magic refused");
+    CHECK(truncate(path, 100) == 0);
+    CHECK(heatmap_read_dump(path) == NULL, "short file refused");
+
+    unlink(path);
+    heatmap_destroy(h);
+}
+
+TEST(test_heatmap_pgm) {
+    Heatmap* h = heatmap_create();
+    h->reads[0x0000] = 1;
+    h->writes[0x01FF] = 1000;
+    h->fetches[0xFFFF] = 1000000;
+    char* path = temp_path();
+    CHECK(heatmap_write_pgm(h, HEAT_ALL, path));
+
+    FILE* f = fopen(path, "rb");
+    char magic[3] = {0};
+    int width = 0, height = 0, maxval = 0;
+    CHECK(fscanf(f, "%2s %d %d %d", magic, &width, &height, &maxval) == 4);
+    fgetc(f);
+    CHECK(strcmp(magic, "P5") == 0 && width == 256 && height == 256 && maxval == 255);
+    uint8_t* pixels = malloc(0x10000);
+    CHECK(fread(pixels, 1, 0x10000, f) == 0x10000);
+    fclose(f);
+
+    CHECK(pixels[0xFFFF] == 255, "busiest address is white");
+    CHECK(pixels[0x0000] == 1, "touched once is just above black");
+    CHECK(pixels[0x01FF] > 1 && pixels[0x01FF] < 255, "log scale between them");
+    CHECK(pixels[0x8000] == 0, "untouched is black");
+
+    /* One kind alone */
+    CHECK(heatmap_write_pgm(h, HEAT_WRITES, path));
+    f = fopen(path, "rb");
+    CHECK(fscanf(f, "%2s %d %d %d", magic, &width, &height, &maxval) == 4);
+    fgetc(f);
+    CHECK(fread(pixels, 1, 0x10000, f) == 0x10000);
+    fclose(f);
+    CHECK(pixels[0x01FF] == 255 && pixels[0xFFFF] == 0);
+
+    free(pixels);
+    unlink(path);
+    heatmap_destroy(h);
+}
+
+TEST(test_heatmap_report) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_map(bus, 0xD000, 0xD0FF, dev_read, dev_write, NULL, NULL);
+
+    Heatmap* h = heatmap_create();
+    h->reads[0xD012] = 500;
+    h->writes[0x0300] = 40;
+    h->writes[0x0301] = 30;
+    h->fetches[0x0200] = 20;
+
+    char* path = temp_path();
+    FILE* out = fopen(path, "w+");
+    heatmap_report(h, bus, out, 2);
+    rewind(out);
+    char text[2048] = {0};
+    size_t n = fread(text, 1, sizeof(text) - 1, out);
+    fclose(out);
+    unlink(path);
+    text[n] = '\0';
+
+    CHECK(strstr(text, "500 reads, 70 writes, 20 opcode fetches") != NULL);
+    char* pages = strstr(text, "Busiest pages");
+    char* addrs = strstr(text, "Busiest addresses");
+    CHECK(pages && addrs);
+    if (pages && addrs) {
+        CHECK(strstr(pages, "$D0xx device") < addrs, "device page first");
+        CHECK(strstr(pages, "$03xx ram") < addrs, "then the two stores' page");
+        CHECK(strstr(pages, "$02xx") == NULL, "top 2 only");
+        CHECK(strstr(addrs, "$D012 device") != NULL);
+        CHECK(strstr(addrs, "$0300 ram") != NULL);
+        CHECK(strstr(addrs, "$0301") == NULL, "top 2 only");
+    }
+
+    heatmap_destroy(h);
+    cpu_destroy(cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Heatmap Tests ===\n\n");
+
+    RUN_TEST(test_heatmap_counts);
+    RUN_TEST(test_heatmap_does_not_change_execution);
+    RUN_TEST(test_heatmap_saturates);
+    RUN_TEST(test_heatmap_dump_round_trip);
+    RUN_TEST(test_heatmap_pgm);
+    RUN_TEST(test_heatmap_report);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,378 @@
+#include "test_common.h"
+#include "bus.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Differential tests: cpu_run (block cache, native code in JIT builds)
+ * must leave exactly the same state as single-stepping the interpreter.
+ */
+
+typedef struct {
+    CPU*    cpu;
+    Memory* mem;
+} Machine;
+
+/* MMIO page: reads count up, $xx01 raises IRQ, $xx02 releases it */
+typedef struct {
+    CPU*    cpu;
+    uint8_t counter;
+} IrqDevice;
+
+static uint8_t irq_dev_read(void* ctx, uint16_t addr) {
+    (void)addr;
+    return ((IrqDevice*)ctx)->counter++;
+}
+
+static void irq_dev_write(void* ctx, uint16_t addr, uint8_t val) {
+    (void)val;
+    IrqDevice* dev = (IrqDevice*)ctx;
+    if ((addr & 0xFF) == 0x01) cpu_irq(dev->cpu);
+    if ((addr & 0xFF) == 0x02) cpu_irq_release(dev->cpu);
+}
+
+static Machine machine_create(const uint8_t* prog, size_t size, bool with_irq_dev) {
+    Machine m;
+    m.mem = memory_create();
+    Bus* bus = bus_create();
+    bus_map_memory(bus, m.mem);
+    bus_load(bus, 0x0200, prog, size);
+    bus_write(bus, 0xFFFC, 0x00);
+    bus_write(bus, 0xFFFD, 0x02);
+    m.cpu = cpu_create(bus);
+    if (with_irq_dev) {
+        IrqDevice* dev = calloc(1, sizeof(IrqDevice));
+        dev->cpu = m.cpu;
+        bus_map(bus, 0xD000, 0xD0FF, irq_dev_read, irq_dev_write, dev, free);
+    }
+    return m;
+}
+
+static void machine_load(Machine* m, uint16_t addr, const uint8_t* data, size_t size) {
+    bus_load(cpu_get_bus(m->cpu), addr, data, size);
+}
+
+static void check_same(Machine* a, Machine* b) {
+    CHECK_EQ(cpu_get_pc(a->cpu), cpu_get_pc(b->cpu));
+    CHECK_EQ(cpu_get_a(a->cpu), cpu_get_a(b->cpu));
+    CHECK_EQ(cpu_get_x(a->cpu), cpu_get_x(b->cpu));
+    CHECK_EQ(cpu_get_y(a->cpu), cpu_get_y(b->cpu));
+    CHECK_EQ(cpu_get_sp(a->cpu), cpu_get_sp(b->cpu));
+    CHECK_EQ(cpu_get_status(a->cpu), cpu_get_status(b->cpu));
+    CHECK_EQ(cpu_get_total_cycles(a->cpu), cpu_get_total_cycles(b->cpu));
+    CHECK(memcmp(memory_get_raw(a->mem), memory_get_raw(b->mem), 0x10000) == 0,
+          "memory differs");
+}
+
+static void machine_destroy(Machine* m) {
+    cpu_destroy(m->cpu);
+}
+
+/* Run one copy with cpu_run, step the other until it halts */
+static void run_vs_step(const uint8_t* prog, size_t size,
+                        const uint8_t* extra, uint16_t extra_addr, size_t extra_size,
+                        bool with_irq_dev) {
+    Machine a = machine_create(prog, size, with_irq_dev);
+    Machine b = machine_create(prog, size, with_irq_dev);
+    if (extra) {
+        machine_load(&a, extra_addr, extra, extra_size);
+        machine_load(&b, extra_addr, extra, extra_size);
+    }
+
+    cpu_run(a.cpu, 100000);
+    for (int i = 0; i < 100000 && !cpu_is_halted(b.cpu); i++) cpu_step(b.cpu);
+
+    CHECK(cpu_is_halted(a.cpu), "run should reach JAM");
+    CHECK(cpu_is_halted(b.cpu), "step should reach JAM");
+    check_same(&a, &b);
+
+    machine_destroy(&a);
+    machine_destroy(&b);
+}
+
+/* ========================= Programs ========================= */
+
+/* Straight-line ALU, flag and stack work */
+static const uint8_t alu_prog[] = {
+    0xA9, 0x50,         /* LDA #$50 */
+    0x18,               /* CLC */
+    0x69, 0x50,         /* ADC #$50  -> V */
+    0xE9, 0x10,         /* SBC #$10 */
+    0x38,               /* SEC */
+    0xE9, 0xF0,         /* SBC #$F0 */
+    0xC9, 0x40,         /* CMP #$40 */
+    0xC9, 0xF0,         /* CMP #$F0 */
+    0xA2, 0x80,         /* LDX #$80 */
+    0xE0, 0x80,         /* CPX #$80 */
+    0xA0, 0x01,         /* LDY #$01 */
+    0xC0, 0x02,         /* CPY #$02 */
+    0x85, 0x10,         /* STA $10 */
+    0x24, 0x10,         /* BIT $10 */
+    0x09, 0x0F,         /* ORA #$0F */
+    0x29, 0xF3,         /* AND #$F3 */
+    0x49, 0xAA,         /* EOR #$AA */
+    0x0A,               /* ASL A */
+    0x2A,               /* ROL A */
+    0x4A,               /* LSR A */
+    0x6A,               /* ROR A */
+    0x08,               /* PHP */
+    0x68,               /* PLA */
+    0x48,               /* PHA */
+    0x28,               /* PLP */
+    0xB8,               /* CLV */
+    0xAA, 0xA8,         /* TAX, TAY */
+    0xBA, 0x8A,         /* TSX, TXA */
+    0x98, 0x9A,         /* TYA, TXS */
+    0xE8, 0xC8,         /* INX, INY */
+    0xCA, 0x88,         /* DEX, DEY */
+    0xF8, 0xD8,         /* SED, CLD */
+    0x78, 0xEA,         /* SEI, NOP */
+    0x02                /* JAM */
+};
+
+/* Every addressing mode, page-crossing reads, read-modify-write */
+static const uint8_t mem_prog[] = {
+    0xA2, 0x05,         /* LDX #$05 */
+    0xA0, 0xF0,         /* LDY #$F0 */
+    0xA9, 0x11,         /* LDA #$11 */
+    0x85, 0x20,         /* STA $20 */
+    0x95, 0x20,         /* STA $20,X */
+    0xB5, 0x20,         /* LDA $20,X */
+    0xB6, 0x20,         /* LDX $20,Y */
+    0xA2, 0x05,         /* LDX #$05 */
+    0x8D, 0x00, 0x03,   /* STA $0300 */
+    0x9D, 0xFF, 0x02,   /* STA $02FF,X */
+    0xBD, 0xFF, 0x02,   /* LDA $02FF,X (cross) */
+    0xB9, 0x20, 0x03,   /* LDA $0320,Y (cross) */
+    0x99, 0x20, 0x03,   /* STA $0320,Y */
+    0xA9, 0x20,         /* LDA #$20 */
+    0x85, 0x30,         /* STA $30 */
+    0xA9, 0x03,         /* LDA #$03 */
+    0x85, 0x31,         /* STA $31   ($30) -> $0320 */
+    0xA1, 0x2B,         /* LDA ($2B,X) */
+    0xB1, 0x30,         /* LDA ($30),Y (cross) */
+    0x91, 0x30,         /* STA ($30),Y */
+    0x81, 0x2B,         /* STA ($2B,X) */
+    0xE6, 0x20,         /* INC $20 */
+    0xD6, 0x20,         /* DEC $20,X */
+    0xEE, 0x00, 0x03,   /* INC $0300 */
+    0xDE, 0xFF, 0x02,   /* DEC $02FF,X */
+    0x06, 0x20,         /* ASL $20 */
+    0x26, 0x21,         /* ROL $21 */
+    0x46, 0x25,         /* LSR $25 */
+    0x66, 0x25,         /* ROR $25 */
+    0x0E, 0x00, 0x03,   /* ASL $0300 */
+    0x1E, 0xFF, 0x02,   /* ASL $02FF,X */
+    0x2C, 0x00, 0x03,   /* BIT $0300 */
+    0x6D, 0x00, 0x03,   /* ADC $0300 */
+    0xED, 0x04, 0x03,   /* SBC $0304 */
+    0xCD, 0x00, 0x03,   /* CMP $0300 */
+    0xEC, 0x00, 0x03,   /* CPX $0300 */
+    0xCC, 0x00, 0x03,   /* CPY $0300 */
+    0x0D, 0x20, 0x03,   /* ORA $0320 */
+    0x2D, 0x00, 0x03,   /* AND $0300 */
+    0x4D, 0x04, 0x03,   /* EOR $0304 */
+    0xAE, 0x00, 0x03,   /* LDX $0300 */
+    0xAC, 0x04, 0x03,   /* LDY $0304 */
+    0xBE, 0xFF, 0x02,   /* LDX $02FF,Y */
+    0xBC, 0xFF, 0x02,   /* LDY $02FF,X */
+    0x8E, 0x40, 0x00,   /* STX $0040 */
+    0x8C, 0x41, 0x00,   /* STY $0041 */
+    0x96, 0x20,         /* STX $20,Y */
+    0x94, 0x20,         /* STY $20,X */
+    0x1C, 0xFF, 0x02,   /* NOP $02FF,X (illegal NOP, pays cross) */
+    0x02                /* JAM */
+};
+
+/* Subroutines, indirect jumps (with the page bug) and every branch */
+static const uint8_t flow_prog[] = {
+    0xA2, 0x00,         /* $0200: LDX #0 */
+    0x20, 0x10, 0x02,   /* $0202: JSR $0210 */
+    0xE8,               /* $0205: INX */
+    0xE0, 0x03,         /* $0206: CPX #3 */
+    0xD0, 0xF8,         /* $0208: BNE $0202 */
+    0x6C, 0x00, 0x03,   /* $020A: JMP ($0300) -> $0220 */
+    0x02, 0x02, 0x02,
+    0xC8,               /* $0210: INY */
+    0x98,               /* $0211: TYA */
+    0x60,               /* $0212: RTS */
+    0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+    0x6C, 0xFF, 0x03    /* $0220: JMP ($03FF) -> $2030 via the page bug */
+};
+
+static const uint8_t flow_ptrs[256] = {
+    [0x00] = 0x20, [0x01] = 0x02,   /* $0300: -> $0220, also hi byte of ($03FF) */
+    [0xFF] = 0x30                   /* $03FF: lo byte */
+};
+
+static const uint8_t flow_far[] = {
+    0x4C, 0xF8, 0x20    /* $2030: JMP $20F8 */
+};
+
+static const uint8_t flow_branches[] = {
+    0xA0, 0x05,         /* $20F8: LDY #5 */
+    0x88,               /* $20FA: DEY */
+    0xD0, 0xFD,         /* $20FB: BNE $20FA (loops on itself) */
+    0x10, 0x03,         /* $20FD: BPL $2102 (page cross) */
+    0x02, 0x02, 0x02,
+    0x18,               /* $2102: CLC */
+    0x90, 0x02,         /* $2103: BCC $2107 */
+    0x02, 0x02,
+    0x38,               /* $2107: SEC */
+    0xB0, 0x00,         /* $2108: BCS $210A */
+    0xB8,               /* $210A: CLV */
+    0x50, 0x00,         /* $210B: BVC $210D */
+    0xA9, 0x7F,         /* $210D: LDA #$7F */
+    0x69, 0x01,         /* $210F: ADC #1 -> V, N */
+    0x70, 0x00,         /* $2111: BVS $2113 */
+    0xF0, 0x01,         /* $2113: BEQ (not taken) */
+    0x30, 0x01,         /* $2115: BMI $2118 */
+    0x02,
+    0xD0, 0x01,         /* $2118: BNE $211B */
+    0x02,
+    0xA2, 0x04,         /* $211B: LDX #4 */
+    0x4C, 0xFC, 0x22    /* $211D: JMP $22FC */
+};
+
+static const uint8_t flow_straddle[] = {
+    0xCA,               /* $22FC: DEX */
+    0xEA, 0xEA,         /* $22FD: NOP, NOP */
+    0xD0, 0xFB,         /* $22FF: BNE $22FC (loop across pages, crossing) */
+    0x02                /* $2301: JAM */
+};
+
+/* IRQ raised by an MMIO write in the middle of a loop */
+static const uint8_t irq_prog[] = {
+    0x58,               /* $0200: CLI */
+    0xA2, 0x00,         /* $0201: LDX #0 */
+    0xAD, 0x00, 0xD0,   /* $0203: LDA $D000 */
+    0x8D, 0x01, 0xD0,   /* $0206: STA $D001 (raise IRQ) */
+    0xC8,               /* $0209: INY */
+    0xC0, 0x0A,         /* $020A: CPY #10 */
+    0xD0, 0xF5,         /* $020C: BNE $0203 */
+    0x02                /* $020E: JAM */
+};
+
+static const uint8_t irq_handler[] = {
+    0x8D, 0x02, 0xD0,   /* $0400: STA $D002 (release) */
+    0xE8,               /* INX */
+    0x40                /* RTI */
+};
+
+/* Counting loop: the inner loop branches back to its own block */
+static const uint8_t loop_prog[] = {
+    0xA0, 0x03,         /* $0200: LDY #3 */
+    0xA2, 0x00,         /* $0202: LDX #0 */
+    0xBD, 0xF0, 0x03,   /* $0204: LDA $03F0,X */
+    0x9D, 0x00, 0x05,   /* $0207: STA $0500,X */
+    0x69, 0x01,         /* $020A: ADC #1 */
+    0xCA,               /* $020C: DEX */
+    0xD0, 0xF5,         /* $020D: BNE $0204 */
+    0x88,               /* $020F: DEY */
+    0xD0, 0xF0,         /* $0210: BNE $0202 */
+    0x02                /* $0212: JAM */
+};
+
+/* ========================= Tests ========================= */
+
+TEST(test_run_matches_step_alu) {
+    run_vs_step(alu_prog, sizeof(alu_prog), NULL, 0, 0, false);
+}
+
+TEST(test_run_matches_step_memory) {
+    run_vs_step(mem_prog, sizeof(mem_prog), NULL, 0, 0, false);
+}
+
+TEST(test_run_matches_step_flow) {
+    Machine a = machine_create(flow_prog, sizeof(flow_prog), false);
+    Machine b = machine_create(flow_prog, sizeof(flow_prog), false);
+    Machine* ms[2] = { &a, &b };
+    for (int i = 0; i < 2; i++) {
+        machine_load(ms[i], 0x0300, flow_ptrs, sizeof(flow_ptrs));
+        machine_load(ms[i], 0x2030, flow_far, sizeof(flow_far));
+        machine_load(ms[i], 0x20F8, flow_branches, sizeof(flow_branches));
+        machine_load(ms[i], 0x22FC, flow_straddle, sizeof(flow_straddle));
+    }
+
+    cpu_run(a.cpu, 100000);
+    for (int i = 0; i < 100000 && !cpu_is_halted(b.cpu); i++) cpu_step(b.cpu);
+
+    CHECK(cpu_is_halted(a.cpu), "run should reach JAM");
+    check_pc(a.cpu, 0x2301);
+    check_same(&a, &b);
+
+    machine_destroy(&a);
+    machine_destroy(&b);
+}
+
+TEST(test_run_matches_step_irq) {
+    uint8_t vec[] = { 0x00, 0x04 };
+    Machine a = machine_create(irq_prog, sizeof(irq_prog), true);
+    Machine b = machine_create(irq_prog, sizeof(irq_prog), true);
+    Machine* ms[2] = { &a, &b };
+    for (int i = 0; i < 2; i++) {
+        machine_load(ms[i], 0x0400, irq_handler, sizeof(irq_handler));
+        machine_load(ms[i], 0xFFFE, vec, sizeof(vec));
+    }
+
+    cpu_run(a.cpu, 100000);
+    for (int i = 0; i < 100000 && !cpu_is_halted(b.cpu); i++) cpu_step(b.cpu);
+
+    CHECK(cpu_is_halted(a.cpu), "run should reach JAM");
+    CHECK_EQ(cpu_get_x(a.cpu), 10);     // one IRQ per iteration
+    check_same(&a, &b);
+
+    machine_destroy(&a);
+    machine_destroy(&b);
+}
+
+/* Any cycle budget stops at the same instruction boundary as stepping */
+TEST(test_run_budget_boundaries) {
+    for (uint64_t budget = 1; budget < 400; budget += 3) {
+        Machine a = machine_create(loop_prog, sizeof(loop_prog), false);
+        Machine b = machine_create(loop_prog, sizeof(loop_prog), false);
+
+        uint64_t ran = cpu_run(a.cpu, budget);
+        uint64_t stepped = 0;
+        while (stepped < budget && !cpu_is_halted(b.cpu)) stepped += cpu_step(b.cpu);
+
+        CHECK_EQ(ran, stepped);
+        check_same(&a, &b);
+
+        machine_destroy(&a);
+        machine_destroy(&b);
+    }
+}
+
+TEST(test_run_instruction_budget) {
+    for (uint64_t count = 1; count < 120; count += 5) {
+        Machine a = machine_create(loop_prog, sizeof(loop_prog), false);
+        Machine b = machine_create(loop_prog, sizeof(loop_prog), false);
+
+        cpu_run_instructions(a.cpu, count);
+        for (uint64_t i = 0; i < count; i++) cpu_step(b.cpu);
+
+        check_same(&a, &b);
+
+        machine_destroy(&a);
+        machine_destroy(&b);
+    }
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Run vs Step (JIT) Tests ===\n\n");
+
+    RUN_TEST(test_run_matches_step_alu);
+    RUN_TEST(test_run_matches_step_memory);
+    RUN_TEST(test_run_matches_step_flow);
+    RUN_TEST(test_run_matches_step_irq);
+    RUN_TEST(test_run_budget_boundaries);
+    RUN_TEST(test_run_instruction_budget);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
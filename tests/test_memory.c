@@ -86,6 +86,59 @@ TEST(test_memory_load) {
     memory_destroy(mem);
 }
 
+TEST(test_memory_dirty_pages) {
+    Memory* mem = memory_create();
+
+    // Fresh memory counts as written everywhere
+    assert(memory_dirty_count(mem) == 256);
+    memory_clear_dirty(mem);
+    assert(memory_dirty_count(mem) == 0);
+    assert(memory_next_dirty(mem, 0) == -1);
+
+    memory_write(mem, 0x12FF, 0x01);
+    memory_write(mem, 0x1200, 0x02);
+    memory_write(mem, 0xC040, 0x03);
+    assert(memory_dirty_count(mem) == 2);
+    assert(memory_page_dirty(mem, 0x12));
+    assert(!memory_page_dirty(mem, 0x13));
+
+    // Walk the dirty pages in order
+    assert(memory_next_dirty(mem, 0) == 0x12);
+    assert(memory_next_dirty(mem, 0x13) == 0xC0);
+    assert(memory_next_dirty(mem, 0xC1) == -1);
+
+    uint64_t bits[4];
+    memory_get_dirty(mem, bits);
+    assert(bits[0] == 1ull << 0x12);
+    assert(bits[1] == 0 && bits[2] == 0);
+    assert(bits[3] == 1ull << (0xC0 - 0xC0));
+
+    memory_destroy(mem);
+}
+
+TEST(test_memory_load_marks_dirty) {
+    Memory* mem = memory_create();
+    uint8_t data[0x180] = {0};
+
+    memory_clear_dirty(mem);
+    memory_load(mem, 0x40F0, data, sizeof(data));
+    assert(memory_dirty_count(mem) == 3);   // $40F0-$426F
+    assert(memory_page_dirty(mem, 0x40));
+    assert(memory_page_dirty(mem, 0x42));
+
+    memory_clear_dirty(mem);
+    memory_load(mem, 0x5000, data, 0);
+    assert(memory_dirty_count(mem) == 0);
+
+    memory_mark_dirty(mem, 0xFF00, 0xFFFF);
+    assert(memory_next_dirty(mem, 0) == 0xFF);
+
+    memory_reset(mem);
+    assert(memory_dirty_count(mem) == 256);
+
+    memory_destroy(mem);
+}
+
 /* ============================== Test Runner ================================ */
 
 int main(void) {
@@ -97,6 +150,8 @@ int main(void) {
     RUN_TEST(test_memory_zero_page);
     RUN_TEST(test_memory_stack_region);
     RUN_TEST(test_memory_load);
+    RUN_TEST(test_memory_dirty_pages);
+    RUN_TEST(test_memory_load_marks_dirty);
 
     printf("\nAll memory tests passed!\n\n");
     return 0;
@@ -0,0 +1,210 @@
+#define _DEFAULT_SOURCE
+#include "test_common.h"
+#include "perfcount.h"
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Host counter tests. Which events a host has varies (a VM often has
+ * no hardware PMU at all), so host counts are only checked for being
+ * there; what is checked exactly is the emulated side: the wrapped
+ * runs execute the same as plain ones, and samples go to the class of
+ * the instruction they ran. Skipped where perf_event_open is refused.
+ */
+
+/*
+ * $0200: LDX #$00
+ * loop:  INX
+ *        BNE loop
+ *        JAM
+ */
+static const uint8_t count_prog[] = {
+    0xA2, 0x00,
+    0xE8,
+    0xD0, 0xFD,
+    0x02
+};
+
+/* $0200: eight NOPs, JMP $0200 */
+static const uint8_t nop_prog[] = {
+    0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA,
+    0x4C, 0x00, 0x02
+};
+
+static CPU* setup_prog(const uint8_t* prog, size_t size) {
+    CPU* cpu = setup_cpu();
+    bus_load(cpu_get_bus(cpu), 0x0200, prog, size);
+    return cpu;
+}
+
+TEST(test_perf_open) {
+    PerfCounters* pc = perf_open();
+    if (!pc) return;
+
+    bool any = false;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        any |= perf_has(pc, (PerfEvent)e);
+        CHECK(strcmp(perf_event_name((PerfEvent)e), "?") != 0);
+    }
+    CHECK(any, "open means at least one event");
+    CHECK(!perf_has(pc, PERF_EVENTS));
+    CHECK(perf_samples(pc) == 0);
+    perf_close(pc);
+}
+
+TEST(test_perf_run_matches_cpu_run) {
+    PerfCounters* pc = perf_open();
+    if (!pc) return;
+    CPU* counted = setup_prog(count_prog, sizeof(count_prog));
+    CPU* plain = setup_prog(count_prog, sizeof(count_prog));
+
+    /* LDX, 256 INX/BNE pairs, JAM */
+    PerfCounts acc = {0};
+    uint64_t cycles = perf_run(pc, counted, 1000000, &acc);
+    CHECK(cycles == cpu_run(plain, 1000000));
+    CHECK(cpu_is_halted(counted));
+    CHECK(acc.cycles == cycles);
+    CHECK(acc.steps == 1 + 2 * 256 + 1, "every instruction counted once");
+    CHECK_EQ(cpu_get_pc(counted), cpu_get_pc(plain));
+    CHECK(cpu_get_total_cycles(counted) == cpu_get_total_cycles(plain));
+
+    /* Halted: nothing more runs or is counted */
+    CHECK(perf_run(pc, counted, 1000, &acc) == 0);
+    CHECK(acc.steps == 1 + 2 * 256 + 1);
+
+    perf_close(pc);
+    cpu_destroy(counted);
+    cpu_destroy(plain);
+}
+
+TEST(test_perf_step) {
+    PerfCounters* pc = perf_open();
+    if (!pc) return;
+    CPU* cpu = setup_prog(count_prog, sizeof(count_prog));
+
+    PerfCounts acc = {0};
+    CHECK(perf_step(pc, cpu, &acc) == 2);
+    CHECK(perf_step(pc, cpu, &acc) == 2);
+    CHECK(acc.steps == 2 && acc.cycles == 4);
+    check_pc(cpu, 0x0203);
+    CHECK(perf_samples(pc) == 0, "no samples unless sampling");
+
+    perf_close(pc);
+    cpu_destroy(cpu);
+}
+
+TEST(test_perf_sampling_classes) {
+    PerfCounters* pc = perf_open();
+    if (!pc) return;
+    CPU* counted = setup_prog(nop_prog, sizeof(nop_prog));
+    CPU* plain = setup_prog(nop_prog, sizeof(nop_prog));
+
+    perf_set_sampling(pc, 7);
+    PerfCounts acc = {0};
+    perf_run(pc, counted, 20000, &acc);
+
+    /* One sample per period, each in the class of what it ran */
+    uint64_t samples = perf_samples(pc);
+    CHECK(samples > 20000 / 14 && samples <= 20000 / 7);
+    PerfCounts nop, jump, other;
+    perf_class_counts(pc, NOP_T, &nop);
+    perf_class_counts(pc, JUMP, &jump);
+    perf_class_counts(pc, TRANS, &other);
+    CHECK(nop.steps + jump.steps == samples);
+    CHECK(nop.steps > jump.steps);
+    CHECK(nop.cycles == 2 * nop.steps && jump.cycles == 3 * jump.steps);
+    CHECK(other.steps == 0);
+
+    /* Same machine state as running the same steps unsampled */
+    cpu_run_instructions(plain, acc.steps);
+    CHECK_EQ(cpu_get_pc(counted), cpu_get_pc(plain));
+    CHECK(cpu_get_total_cycles(counted) == cpu_get_total_cycles(plain));
+    CHECK(acc.cycles == cpu_get_total_cycles(plain));
+
+    perf_clear_samples(pc);
+    perf_class_counts(pc, NOP_T, &nop);
+    CHECK(perf_samples(pc) == 0 && nop.steps == 0);
+
+    perf_close(pc);
+    cpu_destroy(counted);
+    cpu_destroy(plain);
+}
+
+TEST(test_perf_counts_host_time) {
+    PerfCounters* pc = perf_open();
+    if (!pc) return;
+    if (!perf_has(pc, PERF_TASK_CLOCK)) {
+        perf_close(pc);
+        return;
+    }
+    CPU* cpu = setup_prog(nop_prog, sizeof(nop_prog));
+
+    PerfCounts acc = {0};
+    perf_run(pc, cpu, 2000000, &acc);
+    CHECK(acc.events[PERF_TASK_CLOCK] > 0, "running takes host time");
+
+    /* An empty region costs little next to a million instructions */
+    PerfCounts empty = {0};
+    perf_begin(pc);
+    perf_end(pc, &empty);
+    CHECK(empty.events[PERF_TASK_CLOCK] < acc.events[PERF_TASK_CLOCK]);
+
+    perf_close(pc);
+    cpu_destroy(cpu);
+}
+
+TEST(test_perf_report) {
+    PerfCounters* pc = perf_open();
+    if (!pc) return;
+    CPU* cpu = setup_prog(nop_prog, sizeof(nop_prog));
+
+    perf_set_sampling(pc, 11);
+    PerfCounts acc = {0};
+    perf_run(pc, cpu, 10000, &acc);
+
+    char path[] = "/tmp/perfcount_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+    FILE* out = fopen(path, "w+");
+    perf_report(pc, &acc, out);
+    rewind(out);
+    char text[4096] = {0};
+    size_t n = fread(text, 1, sizeof(text) - 1, out);
+    fclose(out);
+    unlink(path);
+    text[n] = '\0';
+
+    char head[64];
+    snprintf(head, sizeof(head), "over %llu emulated instructions",
+             (unsigned long long)acc.steps);
+    CHECK(strstr(text, head) != NULL);
+    CHECK(strstr(text, "By opcode class") != NULL);
+    CHECK(strstr(text, "\n  nop ") != NULL && strstr(text, "\n  jump ") != NULL);
+    CHECK(strstr(text, "\n  transfer ") == NULL, "unsampled classes left out");
+    for (int e = 0; e < PERF_EVENTS; e++)
+        if (!perf_has(pc, (PerfEvent)e)) CHECK(strstr(text, "unavailable") != NULL);
+
+    perf_close(pc);
+    cpu_destroy(cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Host Counter Tests ===\n\n");
+
+    PerfCounters* probe = perf_open();
+    if (!probe) printf("  (perf_event_open unavailable: counter tests skipped)\n");
+    perf_close(probe);
+
+    RUN_TEST(test_perf_open);
+    RUN_TEST(test_perf_run_matches_cpu_run);
+    RUN_TEST(test_perf_step);
+    RUN_TEST(test_perf_sampling_classes);
+    RUN_TEST(test_perf_counts_host_time);
+    RUN_TEST(test_perf_report);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+#include "test_common.h"
+#include "profile.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Profiler tests: per-address counts must match what the program is
+ * known to execute, however the CPU is driven.
+ */
+
+/*
+ * $0200: LDX #$00
+ * loop:  JSR $0220
+ *        INX
+ *        CPX #$0A
+ *        BNE loop
+ *        JAM
+ * $0220: JSR $0230
+ *        RTS
+ * $0230: LDY #$03
+ * inner: DEY
+ *        BNE inner
+ *        RTS
+ */
+static const uint8_t main_prog[] = {
+    0xA2, 0x00,
+    0x20, 0x20, 0x02,
+    0xE8,
+    0xE0, 0x0A,
+    0xD0, 0xF8,
+    0x02
+};
+static const uint8_t outer_prog[] = { 0x20, 0x30, 0x02, 0x60 };
+static const uint8_t inner_prog[] = { 0xA0, 0x03, 0x88, 0xD0, 0xFD, 0x60 };
+
+static CPU* calls_cpu(void) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_load(bus, 0x0200, main_prog, sizeof(main_prog));
+    bus_load(bus, 0x0220, outer_prog, sizeof(outer_prog));
+    bus_load(bus, 0x0230, inner_prog, sizeof(inner_prog));
+    cpu_reset(cpu);
+    return cpu;
+}
+
+static void check_calls_counts(const Profile* p) {
+    CHECK(p->insns[0x0200] == 1, "LDX runs once");
+    CHECK(p->insns[0x0202] == 10, "JSR $0220 runs 10 times");
+    CHECK(p->insns[0x0220] == 10, "JSR $0230 runs 10 times");
+    CHECK(p->insns[0x0232] == 30, "DEY runs 30 times");
+    CHECK(p->insns[0x0233] == 30, "inner BNE runs 30 times");
+    CHECK(p->insns[0x020A] == 1, "JAM counted");
+    CHECK(p->insns[0x0201] == 0, "operand bytes never count");
+
+    /* 20 taken branches at 3 cycles, 10 falling through at 2 */
+    CHECK(p->cycles[0x0233] == 80, "branch penalties counted");
+    CHECK(p->cycles[0x0202] == 60, "JSR is 6 cycles");
+}
+
+TEST(test_profile_counts) {
+    CPU* cpu = calls_cpu();
+    Profile* p = profile_create();
+    cpu_set_profile(cpu, p);
+
+    uint64_t cycles = cpu_run(cpu, 100000);
+
+    CHECK(cpu_is_halted(cpu), "program ran to its JAM");
+    check_calls_counts(p);
+    CHECK(profile_total_cycles(p) == cycles, "per-address cycles add up to the run");
+    CHECK(profile_total_insns(p) == 1 + 10 * 4 + 1 + 10 * 2 + 10 * 2 + 30 * 2,
+          "every instruction counted once");
+    CHECK(p->interrupts == 0);
+
+    profile_destroy(p);
+    cpu_destroy(cpu);
+}
+
+TEST(test_profile_step_matches_run) {
+    CPU* cpu = calls_cpu();
+    Profile* p = profile_create();
+    cpu_set_profile(cpu, p);
+    uint64_t cycles = 0;
+    while (!cpu_is_halted(cpu)) cycles += cpu_step(cpu);
+    check_calls_counts(p);
+    CHECK(profile_total_cycles(p) == cycles);
+    profile_destroy(p);
+    cpu_destroy(cpu);
+
+    /* With a tracer attached the traced loop does the counting */
+    cpu = calls_cpu();
+    p = profile_create();
+    Tracer* t = tracer_open("/dev/null", 0);
+    cpu_set_tracer(cpu, t);
+    cpu_set_profile(cpu, p);
+    cycles = cpu_run(cpu, 100000);
+    CHECK(tracer_close(t));
+    check_calls_counts(p);
+    CHECK(profile_total_cycles(p) == cycles);
+    profile_destroy(p);
+    cpu_destroy(cpu);
+}
+
+TEST(test_profile_same_result) {
+    CPU* plain = calls_cpu();
+    CPU* profiled = calls_cpu();
+    Profile* p = profile_create();
+    cpu_set_profile(profiled, p);
+
+    uint64_t a = cpu_run(plain, 100000);
+    uint64_t b = cpu_run(profiled, 100000);
+    CHECK(a == b, "profiling does not change timing");
+    CHECK_EQ(cpu_get_pc(profiled), cpu_get_pc(plain));
+    CHECK_EQ(cpu_get_x(profiled), cpu_get_x(plain));
+    CHECK_EQ(cpu_get_status(profiled), cpu_get_status(plain));
+
+    profile_destroy(p);
+    cpu_destroy(plain);
+    cpu_destroy(profiled);
+}
+
+TEST(test_profile_interrupts_and_detach) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    const uint8_t loop[] = { 0x58, 0xEA, 0x4C, 0x01, 0x02 };    // CLI; NOP; JMP $0201
+    bus_load(bus, 0x0200, loop, sizeof(loop));
+    bus_write(bus, 0x0300, 0x40);                              // RTI
+    bus_write(bus, 0xFFFE, 0x00);
+    bus_write(bus, 0xFFFF, 0x03);
+    cpu_reset(cpu);
+
+    Profile* p = profile_create();
+    cpu_set_profile(cpu, p);
+    cpu_run_instructions(cpu, 3);
+    cpu_irq(cpu);
+    cpu_run_instructions(cpu, 1);
+    cpu_irq_release(cpu);
+    cpu_run_instructions(cpu, 1);
+
+    CHECK(p->interrupts == 1, "one IRQ entry");
+    CHECK(p->interrupt_cycles == 7);
+    CHECK(p->insns[0x0300] == 1, "handler counted at its own address");
+
+    cpu_set_profile(cpu, NULL);
+    uint64_t before = profile_total_insns(p);
+    cpu_run_instructions(cpu, 100);
+    CHECK(profile_total_insns(p) == before, "nothing counted after detaching");
+
+    profile_clear(p);
+    CHECK(profile_total_insns(p) == 0 && p->interrupts == 0);
+
+    profile_destroy(p);
+    cpu_destroy(cpu);
+}
+
+TEST(test_profile_routines) {
+    CPU* cpu = calls_cpu();
+    Profile* p = profile_create();
+    cpu_set_profile(cpu, p);
+    cpu_run(cpu, 100000);
+
+    ProfileRoutine r[8];
+    size_t n = profile_routines(p, cpu_get_bus(cpu), r, 8);
+    CHECK(n == 3, "main program and two JSR targets");
+    if (n == 3) {
+        /* Hottest first: the inner loop, then main, then the wrapper */
+        CHECK_EQ(r[0].start, 0x0230);
+        CHECK(r[0].calls == 10 && r[0].insns == 10 + 30 + 30 + 10);
+        CHECK(r[0].cycles == 20 + 60 + 80 + 60);
+        CHECK_EQ(r[1].start, 0x0000);
+        CHECK(r[1].calls == 0);
+        CHECK_EQ(r[2].start, 0x0220);
+        CHECK(r[2].calls == 10 && r[2].insns == 20);
+    }
+    CHECK(profile_routines(p, cpu_get_bus(cpu), r, 1) == 3, "count is not capped by max");
+
+    profile_destroy(p);
+    cpu_destroy(cpu);
+}
+
+TEST(test_profile_report) {
+    CPU* cpu = calls_cpu();
+    Profile* p = profile_create();
+    cpu_set_profile(cpu, p);
+    cpu_run(cpu, 100000);
+
+    FILE* f = tmpfile();
+    CHECK(f != NULL);
+    if (!f) return;
+    profile_report(p, cpu_get_bus(cpu), f, 5);
+    long size = ftell(f);
+    char* text = calloc(1, size + 1);
+    rewind(f);
+    CHECK(fread(text, 1, size, f) == (size_t)size);
+    fclose(f);
+
+    CHECK(strstr(text, "Hottest addresses") != NULL);
+    CHECK(strstr(text, "0233  BNE $0232") != NULL, "hot address disassembled");
+    CHECK(strstr(text, "$0230") != NULL, "routine listed by its start");
+    CHECK(strstr(text, "(main)") != NULL);
+    CHECK(strstr(text, "88  DEY") != NULL, "opcode totals");
+
+    free(text);
+    profile_destroy(p);
+    cpu_destroy(cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Profile Tests ===\n\n");
+
+    RUN_TEST(test_profile_counts);
+    RUN_TEST(test_profile_step_matches_run);
+    RUN_TEST(test_profile_same_result);
+    RUN_TEST(test_profile_interrupts_and_detach);
+    RUN_TEST(test_profile_routines);
+    RUN_TEST(test_profile_report);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+#include "test_common.h"
+#include "sampler.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Sampling profiler tests: samples must come at the configured rate,
+ * leave execution untouched and agree with the exact profilers.
+ */
+
+/*
+ * $0200: JSR $0220
+ *        JMP $0200
+ * $0220: JSR $0230
+ *        RTS
+ * $0230: LDY #$10
+ * inner: DEY
+ *        BNE inner
+ *        RTS
+ */
+static const uint8_t loop_main[] = { 0x20, 0x20, 0x02, 0x4C, 0x00, 0x02 };
+static const uint8_t loop_outer[] = { 0x20, 0x30, 0x02, 0x60 };
+static const uint8_t loop_inner[] = { 0xA0, 0x10, 0x88, 0xD0, 0xFD, 0x60 };
+
+static CPU* loop_cpu(void) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_load(bus, 0x0200, loop_main, sizeof(loop_main));
+    bus_load(bus, 0x0220, loop_outer, sizeof(loop_outer));
+    bus_load(bus, 0x0230, loop_inner, sizeof(loop_inner));
+    cpu_reset(cpu);
+    return cpu;
+}
+
+/* Share of all cycles spent in one path, inclusive */
+static double path_share(const CallGraph* g, const uint16_t* path, int length) {
+    int64_t node = callgraph_find(g, path, length);
+    uint64_t total = callgraph_inclusive(g, CALLGRAPH_ROOT);
+    if (node < 0 || !total) return 0.0;
+    return (double)callgraph_inclusive(g, node) / (double)total;
+}
+
+TEST(test_sampler_rate) {
+    CPU* cpu = loop_cpu();
+    Sampler* s = sampler_create(1000, 0);
+    cpu_set_sampler(cpu, s);
+
+    uint64_t cycles = cpu_run(cpu, 1000000);
+    uint64_t weight = profile_total_cycles(sampler_profile(s));
+
+    CHECK(sampler_samples(s) >= 990 && sampler_samples(s) <= 1000, "one sample per period");
+    CHECK(profile_total_insns(sampler_profile(s)) == sampler_samples(s));
+    CHECK(weight <= cycles && cycles - weight < 1000, "weights cover the run up to the last sample");
+    CHECK(callgraph_inclusive(sampler_stacks(s), CALLGRAPH_ROOT) == weight);
+
+    sampler_destroy(s);
+    cpu_destroy(cpu);
+}
+
+TEST(test_sampler_does_not_change_execution) {
+    CPU* plain = loop_cpu();
+    CPU* sampled = loop_cpu();
+    Sampler* s = sampler_create(97, 40);
+    cpu_set_sampler(sampled, s);
+
+    CHECK(cpu_run_instructions(plain, 12345) == cpu_run_instructions(sampled, 12345),
+          "same cycles for the same step count");
+    CHECK_EQ(cpu_get_pc(sampled), cpu_get_pc(plain));
+    CHECK_EQ(cpu_get_sp(sampled), cpu_get_sp(plain));
+    CHECK_EQ(cpu_get_y(sampled), cpu_get_y(plain));
+
+    CHECK(cpu_run(plain, 54321) == cpu_run(sampled, 54321), "same cycles for a cycle budget");
+    CHECK_EQ(cpu_get_pc(sampled), cpu_get_pc(plain));
+
+    for (int i = 0; i < 500; i++)
+        CHECK(cpu_step(plain) == cpu_step(sampled));
+    CHECK_EQ(cpu_get_pc(sampled), cpu_get_pc(plain));
+    CHECK(cpu_get_total_cycles(sampled) == cpu_get_total_cycles(plain));
+    CHECK(sampler_samples(s) > 0);
+
+    sampler_destroy(s);
+    cpu_destroy(plain);
+    cpu_destroy(sampled);
+}
+
+TEST(test_sampler_matches_exact) {
+    /* Exact call graph for the same run */
+    CPU* cpu = loop_cpu();
+    CallGraph* exact = callgraph_create();
+    cpu_set_callgraph(cpu, exact);
+    cpu_run(cpu, 2000000);
+    cpu_destroy(cpu);
+
+    /* Stacks recovered from the stack page */
+    cpu = loop_cpu();
+    Sampler* s = sampler_create(997, 300);
+    cpu_set_sampler(cpu, s);
+    cpu_run(cpu, 2000000);
+
+    const uint16_t inner[] = { 0x0220, 0x0230 };
+    const uint16_t outer[] = { 0x0220 };
+    double want = path_share(exact, inner, 2);
+    double got = path_share(sampler_stacks(s), inner, 2);
+    CHECK(want > 0.5, "the inner loop dominates");
+    CHECK(got > want - 0.03 && got < want + 0.03, "sampled share close to the exact one");
+    CHECK(path_share(sampler_stacks(s), outer, 1) > got, "outer path includes the inner one");
+
+    /* The hottest sampled address is in the inner loop */
+    const Profile* p = sampler_profile(s);
+    CHECK(p->insns[0x0232] + p->insns[0x0233] > sampler_samples(s) / 2);
+
+    callgraph_destroy(exact);
+    sampler_destroy(s);
+    cpu_destroy(cpu);
+}
+
+TEST(test_sampler_uses_live_callgraph) {
+    CPU* cpu = loop_cpu();
+    CallGraph* live = callgraph_create();
+    Sampler* s = sampler_create(500, 100);
+    cpu_set_callgraph(cpu, live);
+    cpu_set_sampler(cpu, s);
+    cpu_run(cpu, 200000);
+
+    /* Every sampled path exists in the exact graph */
+    const CallGraph* sampled = sampler_stacks(s);
+    for (uint32_t i = 1; i < callgraph_node_count(sampled); i++) {
+        uint16_t path[CALLGRAPH_MAX_DEPTH];
+        int length = 0;
+        for (uint32_t n = i; n != CALLGRAPH_ROOT; n = callgraph_node(sampled, n)->parent)
+            length++;
+        int j = length;
+        for (uint32_t n = i; n != CALLGRAPH_ROOT; n = callgraph_node(sampled, n)->parent)
+            path[--j] = callgraph_node(sampled, n)->addr;
+        CHECK(callgraph_find(live, path, length) >= 0, "sampled path ran");
+    }
+    CHECK(callgraph_node_count(sampled) == 3, "root and both routines");
+
+    cpu_set_callgraph(cpu, NULL);
+    callgraph_destroy(live);
+    sampler_destroy(s);
+    cpu_destroy(cpu);
+}
+
+TEST(test_sampler_jitter_breaks_aliasing) {
+    /* $0200: NOP; NOP; JMP $0200 is 7 cycles: a period of 700 always hits one PC */
+    const uint8_t prog[] = { 0xEA, 0xEA, 0x4C, 0x00, 0x02 };
+    CPU* cpu = setup_cpu();
+    bus_load(cpu_get_bus(cpu), 0x0200, prog, sizeof(prog));
+    cpu_reset(cpu);
+
+    Sampler* s = sampler_create(700, 0);
+    cpu_set_sampler(cpu, s);
+    cpu_run(cpu, 700000);
+    const Profile* p = sampler_profile(s);
+    int hit = (p->insns[0x0200] > 0) + (p->insns[0x0201] > 0) + (p->insns[0x0202] > 0);
+    CHECK(hit == 1, "without jitter every sample aliases onto one PC");
+
+    sampler_destroy(s);
+    s = sampler_create(700, 100);
+    cpu_set_sampler(cpu, s);
+    cpu_run(cpu, 700000);
+    p = sampler_profile(s);
+    CHECK(p->insns[0x0200] && p->insns[0x0201] && p->insns[0x0202], "jitter spreads samples");
+
+    sampler_clear(s);
+    CHECK(sampler_samples(s) == 0 && profile_total_insns(sampler_profile(s)) == 0);
+
+    cpu_set_sampler(cpu, NULL);
+    sampler_destroy(s);
+    cpu_destroy(cpu);
+}
+
+TEST(test_sampler_halt) {
+    /* $0200: NOP x 3; JAM */
+    const uint8_t prog[] = { 0xEA, 0xEA, 0xEA, 0x02 };
+    CPU* cpu = setup_cpu();
+    bus_load(cpu_get_bus(cpu), 0x0200, prog, sizeof(prog));
+    cpu_reset(cpu);
+
+    Sampler* s = sampler_create(2, 0);
+    cpu_set_sampler(cpu, s);
+    uint64_t cycles = cpu_run(cpu, 1000000);
+    CHECK(cpu_is_halted(cpu), "run ends at JAM");
+    CHECK(cycles == 7, "three NOPs and the JAM");
+    CHECK(sampler_samples(s) >= 3);
+
+    sampler_destroy(s);
+    cpu_destroy(cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Sampler Tests ===\n\n");
+
+    RUN_TEST(test_sampler_rate);
+    RUN_TEST(test_sampler_does_not_change_execution);
+    RUN_TEST(test_sampler_matches_exact);
+    RUN_TEST(test_sampler_uses_live_callgraph);
+    RUN_TEST(test_sampler_jitter_breaks_aliasing);
+    RUN_TEST(test_sampler_halt);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
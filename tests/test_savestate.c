@@ -0,0 +1,300 @@
+#define _DEFAULT_SOURCE
+#include "test_common.h"
+#include "savestate.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Save-state tests: a loaded machine must continue exactly like the one
+ * that was saved, whether it was streamed in or mapped from the file.
+ */
+
+/*
+ * $0200: LDX #$00
+ * loop:  LDA $0300,X
+ *        ADC $10
+ *        STA $10
+ *        STA $0400,X
+ *        INX
+ *        BNE loop
+ *        INC $0300
+ *        JMP $0200
+ */
+static const uint8_t churn_prog[] = {
+    0xA2, 0x00,
+    0xBD, 0x00, 0x03,
+    0x65, 0x10,
+    0x85, 0x10,
+    0x9D, 0x00, 0x04,
+    0xE8,
+    0xD0, 0xF3,
+    0xEE, 0x00, 0x03,
+    0x4C, 0x00, 0x02
+};
+
+static CPU* churn_cpu(void) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_load(bus, 0x0200, churn_prog, sizeof(churn_prog));
+    for (int i = 0; i < 256; i++) bus_write(bus, 0x0300 + i, (uint8_t)(i * 7));
+    cpu_reset(cpu);
+    return cpu;
+}
+
+/* Registers, cycle counter and the first pages must all agree */
+static int same_machine(CPU* a, CPU* b) {
+    CPUState sa, sb;
+    cpu_get_state(a, &sa);
+    cpu_get_state(b, &sb);
+    if (sa.a != sb.a || sa.x != sb.x || sa.y != sb.y || sa.sp != sb.sp
+        || sa.p != sb.p || sa.pc != sb.pc || sa.total_cycles != sb.total_cycles
+        || sa.halted != sb.halted || sa.illegal != sb.illegal
+        || sa.irq_line != sb.irq_line)
+        return 0;
+    for (int addr = 0; addr < 0x10000; addr++)
+        if (bus_read(cpu_get_bus(a), addr) != bus_read(cpu_get_bus(b), addr)) return 0;
+    return 1;
+}
+
+/* A device whose state lives outside memory: an 8-byte counter bank */
+typedef struct {
+    uint8_t regs[8];
+} Counters;
+
+static uint8_t counters_read(void* ctx, uint16_t addr) { return ((Counters*)ctx)->regs[addr & 7]; }
+static void counters_write(void* ctx, uint16_t addr, uint8_t val) { ((Counters*)ctx)->regs[addr & 7] += val; }
+static size_t counters_size(void* ctx) { (void)ctx; return sizeof(Counters); }
+static void counters_save(void* ctx, uint8_t* buf) { memcpy(buf, ctx, sizeof(Counters)); }
+static void counters_restore(void* ctx, const uint8_t* buf) { memcpy(ctx, buf, sizeof(Counters)); }
+
+static const BusDevice counters_device = {
+    .read = counters_read, .write = counters_write, .destroy = free,
+    .state_size = counters_size, .save = counters_save, .restore = counters_restore,
+};
+
+static char* temp_path(void) {
+    static char path[64];
+    strcpy(path, "/tmp/savestate_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+    return path;
+}
+
+TEST(test_stream_round_trip) {
+    CPU* a = churn_cpu();
+    CPU* b = churn_cpu();
+    cpu_run(a, 12345);
+    cpu_irq(a);
+    cpu_set_status(a, cpu_get_status(a) | FLAG_I);
+
+    FILE* f = tmpfile();
+    CHECK(savestate_write(a, f), "write succeeds");
+    rewind(f);
+    CHECK(savestate_read(b, f), "read succeeds");
+    fclose(f);
+    CHECK(same_machine(a, b), "loaded machine matches");
+
+    cpu_irq_release(a);
+    cpu_irq_release(b);
+    cpu_run(a, 5000);
+    cpu_run(b, 5000);
+    CHECK(same_machine(a, b), "and keeps matching");
+
+    cpu_destroy(a);
+    cpu_destroy(b);
+}
+
+/* Memory data starts on a 4 KB boundary of the file */
+TEST(test_memory_section_page_aligned) {
+    CPU* cpu = churn_cpu();
+    FILE* f = tmpfile();
+    savestate_write(cpu, f);
+    long size = ftell(f);
+    rewind(f);
+
+    uint8_t* buf = malloc(size);
+    CHECK_EQ(fread(buf, 1, size, f), size);
+    CHECK(memcmp(buf, "6502SAV", 8) == 0, "magic");
+    CHECK_EQ(buf[8] | (buf[9] << 8), SAVESTATE_MAJOR);
+
+    /* Walk the sections to the memory image */
+    long off = 32, data = -1;
+    while (off + 16 <= size) {
+        uint32_t tag = buf[off] | (buf[off + 1] << 8) | (buf[off + 2] << 16) | ((uint32_t)buf[off + 3] << 24);
+        uint64_t len = 0;
+        for (int i = 7; i >= 0; i--) len = (len << 8) | buf[off + 8 + i];
+        if (tag == ('M' | ('E' << 8) | ('M' << 16) | ((uint32_t)' ' << 24)))
+            data = off + 16 + (buf[off + 16] | (buf[off + 17] << 8) | (buf[off + 18] << 16));
+        off += 16 + ((len + 7) & ~7ull);
+    }
+    CHECK(data > 0 && data % 4096 == 0, "image is page aligned");
+    CHECK(data > 0 && buf[data + 0x0200] == 0xA2, "image holds the program");
+    CHECK_EQ(off, size);
+
+    free(buf);
+    fclose(f);
+    cpu_destroy(cpu);
+}
+
+TEST(test_open_maps_file) {
+    CPU* a = churn_cpu();
+    cpu_run(a, 777);
+    uint64_t saved_cycles = cpu_get_total_cycles(a);
+    uint8_t saved_byte = bus_read(cpu_get_bus(a), 0x0300);
+    char* path = temp_path();
+    CHECK(savestate_save(a, path), "save succeeds");
+
+    CPU* b = savestate_open(path);
+    CHECK(b != NULL, "open succeeds");
+    if (b) {
+        CHECK(same_machine(a, b), "opened machine matches");
+        cpu_run(a, 4000);
+        cpu_run(b, 4000);
+        CHECK(same_machine(a, b), "and keeps matching");
+
+        /* Writes to mapped memory stay private to the machine */
+        bus_write(cpu_get_bus(b), 0x0300, saved_byte ^ 0xFF);
+        CPU* c = savestate_open(path);
+        CHECK(c && bus_read(cpu_get_bus(c), 0x0300) == saved_byte, "file unchanged");
+        cpu_destroy(c);
+        cpu_destroy(b);
+    }
+
+    /* Loading into an existing machine from a path works the same */
+    CPU* d = churn_cpu();
+    CHECK(savestate_load(d, path), "load succeeds");
+    CHECK_EQ(cpu_get_total_cycles(d), saved_cycles);
+    CHECK_EQ(bus_read(cpu_get_bus(d), 0x0300), saved_byte);
+
+    unlink(path);
+    cpu_destroy(a);
+    cpu_destroy(d);
+}
+
+/* Unknown sections are skipped, even when they move the image off alignment */
+TEST(test_unknown_section_skipped) {
+    CPU* a = churn_cpu();
+    cpu_run(a, 3000);
+    FILE* f = tmpfile();
+    savestate_write(a, f);
+    long size = ftell(f);
+    rewind(f);
+    uint8_t* buf = malloc(size);
+    CHECK_EQ(fread(buf, 1, size, f), size);
+    fclose(f);
+
+    static const uint8_t extra[24] = { 'X', 'T', 'R', 'A', 3, 0, 0, 0, 5, 0, 0, 0, 0, 0, 0, 0,
+                                       1, 2, 3, 4, 5, 0, 0, 0 };
+    char* path = temp_path();
+    f = fopen(path, "wb");
+    fwrite(buf, 1, 32, f);
+    fwrite(extra, 1, sizeof(extra), f);
+    fwrite(buf + 32, 1, size - 32, f);
+    fclose(f);
+
+    CPU* b = churn_cpu();
+    CHECK(savestate_load(b, path), "streamed load skips the section");
+    CHECK(same_machine(a, b), "streamed machine matches");
+    CPU* c = savestate_open(path);
+    CHECK(c && same_machine(a, c), "unaligned image is read instead of mapped");
+
+    unlink(path);
+    free(buf);
+    cpu_destroy(a);
+    cpu_destroy(b);
+    cpu_destroy(c);
+}
+
+TEST(test_bad_states_rejected) {
+    CPU* a = churn_cpu();
+    CPU* b = churn_cpu();
+    cpu_run(a, 1000);
+    FILE* f = tmpfile();
+    savestate_write(a, f);
+    long size = ftell(f);
+    rewind(f);
+    uint8_t* buf = malloc(size);
+    CHECK_EQ(fread(buf, 1, size, f), size);
+    fclose(f);
+
+    uint16_t pc = cpu_get_pc(b);
+
+    /* Newer major version */
+    buf[8] = SAVESTATE_MAJOR + 1;
+    f = tmpfile();
+    fwrite(buf, 1, size, f);
+    rewind(f);
+    CHECK(!savestate_read(b, f), "other major rejected");
+    fclose(f);
+    buf[8] = SAVESTATE_MAJOR;
+
+    /* Truncated before the end marker: nothing applied */
+    f = tmpfile();
+    fwrite(buf, 1, size - 20, f);
+    rewind(f);
+    CHECK(!savestate_read(b, f), "truncated state rejected");
+    fclose(f);
+    CHECK_EQ(cpu_get_pc(b), pc);
+
+    /* Bad magic */
+    buf[0] = 'X';
+    f = tmpfile();
+    fwrite(buf, 1, size, f);
+    rewind(f);
+    CHECK(!savestate_read(b, f), "bad magic rejected");
+    fclose(f);
+
+    CHECK(savestate_open("/nonexistent/state") == NULL, "missing file");
+
+    free(buf);
+    cpu_destroy(a);
+    cpu_destroy(b);
+}
+
+TEST(test_device_section_round_trip) {
+    CPU* a = churn_cpu();
+    CPU* b = churn_cpu();
+    Counters* ca = calloc(1, sizeof(Counters));
+    Counters* cb = calloc(1, sizeof(Counters));
+    bus_map_device(cpu_get_bus(a), 0xD000, 0xD0FF, &counters_device, ca);
+    bus_map_device(cpu_get_bus(b), 0xD000, 0xD0FF, &counters_device, cb);
+    bus_write(cpu_get_bus(a), 0xD003, 0x21);
+    bus_write(cpu_get_bus(a), 0xD003, 0x21);
+
+    FILE* f = tmpfile();
+    CHECK(savestate_write(a, f), "write succeeds");
+    rewind(f);
+    CHECK(savestate_read(b, f), "read succeeds");
+    CHECK_EQ(cb->regs[3], 0x42);
+
+    /* A machine without the device cannot take its state */
+    CPU* c = churn_cpu();
+    uint16_t pc = cpu_get_pc(c);
+    rewind(f);
+    CHECK(!savestate_read(c, f), "device layout mismatch rejected");
+    CHECK_EQ(cpu_get_pc(c), pc);
+    fclose(f);
+
+    cpu_destroy(a);
+    cpu_destroy(b);
+    cpu_destroy(c);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Save State Tests ===\n\n");
+
+    RUN_TEST(test_stream_round_trip);
+    RUN_TEST(test_memory_section_page_aligned);
+    RUN_TEST(test_open_maps_file);
+    RUN_TEST(test_unknown_section_skipped);
+    RUN_TEST(test_bad_states_rejected);
+    RUN_TEST(test_device_section_round_trip);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,303 @@
+#include "test_common.h"
+#include "bus.h"
+#include "memory.h"
+#include <string.h>
+
+/*
+ * Snapshot / restore tests: a restored machine must continue exactly as
+ * the original did from the snapshot point, and only pages written in
+ * between may be copied.
+ */
+
+/*
+ * $0200: LDX #$00
+ * loop:  LDA $0300,X
+ *        ADC $10
+ *        STA $10
+ *        STA $0400,X
+ *        PHA
+ *        PLA
+ *        INX
+ *        BNE loop
+ *        INC $0300
+ *        JMP $0200
+ */
+static const uint8_t churn_prog[] = {
+    0xA2, 0x00,
+    0xBD, 0x00, 0x03,
+    0x65, 0x10,
+    0x85, 0x10,
+    0x9D, 0x00, 0x04,
+    0x48,
+    0x68,
+    0xE8,
+    0xD0, 0xF1,
+    0xEE, 0x00, 0x03,
+    0x4C, 0x00, 0x02
+};
+
+static CPU* churn_cpu(void) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_load(bus, 0x0200, churn_prog, sizeof(churn_prog));
+    for (int i = 0; i < 256; i++) bus_write(bus, 0x0300 + i, (uint8_t)(i * 13));
+    cpu_reset(cpu);
+    return cpu;
+}
+
+/* Device with state outside memory: a latch and a write counter */
+typedef struct {
+    uint8_t  latch;
+    uint32_t writes;
+} Latch;
+
+static uint8_t latch_read(void* ctx, uint16_t addr) {
+    (void)addr;
+    return ((Latch*)ctx)->latch;
+}
+
+static void latch_write(void* ctx, uint16_t addr, uint8_t val) {
+    (void)addr;
+    ((Latch*)ctx)->latch = val;
+    ((Latch*)ctx)->writes++;
+}
+
+static size_t latch_size(void* ctx) {
+    (void)ctx;
+    return sizeof(Latch);
+}
+
+static void latch_save(void* ctx, uint8_t* buf)          { memcpy(buf, ctx, sizeof(Latch)); }
+static void latch_restore(void* ctx, const uint8_t* buf) { memcpy(ctx, buf, sizeof(Latch)); }
+static void latch_reset(void* ctx)                       { memset(ctx, 0, sizeof(Latch)); }
+
+static const BusDevice latch_device = {
+    .read = latch_read, .write = latch_write, .destroy = free,
+    .state_size = latch_size, .save = latch_save, .restore = latch_restore,
+    .reset = latch_reset,
+};
+
+typedef struct {
+    uint8_t  a, x, y, sp, p;
+    uint16_t pc;
+    uint64_t cycles;
+    uint8_t  mem[0x500];
+} State;
+
+static void capture(CPU* cpu, State* s) {
+    Bus* bus = cpu_get_bus(cpu);
+    s->a = cpu_get_a(cpu);
+    s->x = cpu_get_x(cpu);
+    s->y = cpu_get_y(cpu);
+    s->sp = cpu_get_sp(cpu);
+    s->p = cpu_get_status(cpu);
+    s->pc = cpu_get_pc(cpu);
+    s->cycles = cpu_get_total_cycles(cpu);
+    for (int i = 0; i < (int)sizeof(s->mem); i++) s->mem[i] = bus_read(bus, i);
+}
+
+static int same_state(const State* a, const State* b) {
+    return a->a == b->a && a->x == b->x && a->y == b->y && a->sp == b->sp
+        && a->p == b->p && a->pc == b->pc && a->cycles == b->cycles
+        && memcmp(a->mem, b->mem, sizeof(a->mem)) == 0;
+}
+
+TEST(test_restore_replays_identically) {
+    CPU* cpu = churn_cpu();
+    State at_snap, first, again;
+
+    cpu_run(cpu, 5000);
+    Snapshot* snap = cpu_snapshot(cpu);
+    capture(cpu, &at_snap);
+
+    cpu_run(cpu, 20000);
+    capture(cpu, &first);
+
+    int mismatches = 0;
+    for (int i = 0; i < 50; i++) {
+        State s;
+        cpu_restore(cpu, snap);
+        capture(cpu, &s);
+        if (!same_state(&s, &at_snap)) mismatches++;
+        cpu_run(cpu, 20000);
+        capture(cpu, &again);
+        if (!same_state(&again, &first)) mismatches++;
+    }
+    CHECK_EQ(mismatches, 0);
+
+    cpu_snapshot_free(snap);
+    cpu_destroy(cpu);
+}
+
+TEST(test_snapshot_copies_only_dirty_pages) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+
+    /* The first snapshot stores every page */
+    Snapshot* a = cpu_snapshot(cpu);
+    CHECK_EQ(cpu_snapshot_page_copies(cpu), 256);
+
+    /* Nothing written: nothing copied either way */
+    Snapshot* b = cpu_snapshot(cpu);
+    cpu_restore(cpu, a);
+    CHECK_EQ(cpu_snapshot_page_copies(cpu), 256);
+
+    /* Two writes to one page, one to another */
+    bus_write(bus, 0x1234, 0x55);
+    bus_write(bus, 0x1235, 0x66);
+    bus_write(bus, 0x8000, 0x77);
+    Snapshot* c = cpu_snapshot(cpu);
+    CHECK_EQ(cpu_snapshot_page_copies(cpu), 258);
+
+    /* Back to a: exactly those two pages differ */
+    cpu_restore(cpu, a);
+    CHECK_EQ(cpu_snapshot_page_copies(cpu), 260);
+    CHECK_EQ(bus_read(bus, 0x1234), 0x00);
+    CHECK_EQ(bus_read(bus, 0x8000), 0x00);
+
+    /* Restoring what is already there copies nothing */
+    cpu_restore(cpu, b);
+    CHECK_EQ(cpu_snapshot_page_copies(cpu), 260);
+
+    cpu_restore(cpu, c);
+    CHECK_EQ(bus_read(bus, 0x1234), 0x55);
+    CHECK_EQ(bus_read(bus, 0x1235), 0x66);
+    CHECK_EQ(bus_read(bus, 0x8000), 0x77);
+
+    cpu_snapshot_free(a);
+    cpu_snapshot_free(b);
+    cpu_snapshot_free(c);
+    cpu_destroy(cpu);
+}
+
+/* Freeing the snapshot a page was first stored for must not free it */
+TEST(test_shared_pages_outlive_their_first_snapshot) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+
+    bus_write(bus, 0x4000, 0xAB);
+    Snapshot* a = cpu_snapshot(cpu);
+    Snapshot* b = cpu_snapshot(cpu);
+    cpu_snapshot_free(a);
+
+    bus_write(bus, 0x4000, 0xCD);
+    cpu_restore(cpu, b);
+    CHECK_EQ(bus_read(bus, 0x4000), 0xAB);
+
+    cpu_snapshot_free(b);
+    cpu_destroy(cpu);
+}
+
+/* Code patched after the snapshot must not survive restore in the block cache */
+TEST(test_restore_drops_stale_code) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    static const uint8_t prog[] = { 0xA9, 0x11, 0x02 };   // LDA #$11; JAM
+    bus_load(bus, 0x0200, prog, sizeof(prog));
+    cpu_reset(cpu);
+
+    Snapshot* snap = cpu_snapshot(cpu);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x11);
+
+    /* Run the patched code so it is what the cache holds */
+    bus_write(bus, 0x0201, 0x22);
+    cpu_reset(cpu);
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x22);
+
+    cpu_restore(cpu, snap);
+    CHECK(!cpu_is_halted(cpu));
+    cpu_run(cpu, 100);
+    CHECK_EQ(cpu_get_a(cpu), 0x11);
+
+    cpu_snapshot_free(snap);
+    cpu_destroy(cpu);
+}
+
+TEST(test_restore_interrupt_lines) {
+    CPU* cpu = setup_cpu();
+    cpu_irq(cpu);
+    cpu_nmi(cpu);
+    Snapshot* snap = cpu_snapshot(cpu);
+
+    cpu_irq_release(cpu);
+    cpu_nmi_release(cpu);
+    CHECK(!cpu_interrupt_requested(cpu));
+
+    cpu_restore(cpu, snap);
+    CHECK(cpu_interrupt_requested(cpu));
+
+    cpu_snapshot_free(snap);
+    cpu_destroy(cpu);
+}
+
+/* ROM is left alone; a snapshot restores onto a second machine */
+TEST(test_restore_onto_other_cpu) {
+    CPU* a = churn_cpu();
+    CPU* b = churn_cpu();
+    Memory* rom_a = memory_create();
+    Memory* rom_b = memory_create();
+    memory_write(rom_a, 0xF000, 0x5A);
+    memory_write(rom_b, 0xF000, 0xA5);
+    bus_map_rom(cpu_get_bus(a), rom_a, 0xF000, 0xF0FF);
+    bus_map_rom(cpu_get_bus(b), rom_b, 0xF000, 0xF0FF);
+
+    cpu_run(a, 7777);
+    Snapshot* snap = cpu_snapshot(a);
+    cpu_restore(b, snap);
+
+    State sa, sb;
+    cpu_run(a, 3000);
+    cpu_run(b, 3000);
+    capture(a, &sa);
+    capture(b, &sb);
+    CHECK(same_state(&sa, &sb));
+    CHECK_EQ(bus_read(cpu_get_bus(b), 0xF000), 0xA5);
+
+    cpu_snapshot_free(snap);
+    cpu_destroy(a);
+    cpu_destroy(b);     // the buses own the ROMs
+}
+
+TEST(test_restore_device_state) {
+    CPU* cpu = churn_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    Latch* latch = calloc(1, sizeof(Latch));
+    bus_map_device(bus, 0xD000, 0xD0FF, &latch_device, latch);
+
+    bus_write(bus, 0xD000, 0x42);
+    Snapshot* snap = cpu_snapshot(cpu);
+    bus_write(bus, 0xD000, 0x99);
+    bus_write(bus, 0xD000, 0x98);
+    CHECK_EQ(latch->writes, 3);
+
+    cpu_restore(cpu, snap);
+    CHECK_EQ(bus_read(bus, 0xD000), 0x42);
+    CHECK_EQ(latch->writes, 1);
+
+    /* The reset line clears the device */
+    cpu_reset(cpu);
+    CHECK_EQ(latch->writes, 0);
+
+    cpu_snapshot_free(snap);
+    cpu_destroy(cpu);
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Snapshot Tests ===\n\n");
+
+    RUN_TEST(test_restore_replays_identically);
+    RUN_TEST(test_snapshot_copies_only_dirty_pages);
+    RUN_TEST(test_shared_pages_outlive_their_first_snapshot);
+    RUN_TEST(test_restore_drops_stale_code);
+    RUN_TEST(test_restore_interrupt_lines);
+    RUN_TEST(test_restore_onto_other_cpu);
+    RUN_TEST(test_restore_device_state);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
@@ -0,0 +1,330 @@
+#define _DEFAULT_SOURCE
+#include "test_common.h"
+#include "trace.h"
+#include "trace_reader.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Trace recorder tests: every step must reach the file, in order, with
+ * the state a reference CPU had before the same step.
+ */
+
+/*
+ * $0200: LDX #$00
+ * loop:  LDA $0300,X
+ *        ADC $10
+ *        STA $10
+ *        STA $0400,X
+ *        INX
+ *        BNE loop
+ *        INC $0300
+ *        JMP $0200
+ */
+static const uint8_t churn_prog[] = {
+    0xA2, 0x00,
+    0xBD, 0x00, 0x03,
+    0x65, 0x10,
+    0x85, 0x10,
+    0x9D, 0x00, 0x04,
+    0xE8,
+    0xD0, 0xF3,
+    0xEE, 0x00, 0x03,
+    0x4C, 0x00, 0x02
+};
+
+static CPU* churn_cpu(void) {
+    CPU* cpu = setup_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_load(bus, 0x0200, churn_prog, sizeof(churn_prog));
+    for (int i = 0; i < 256; i++) bus_write(bus, 0x0300 + i, (uint8_t)(i * 5));
+    cpu_reset(cpu);
+    return cpu;
+}
+
+static char* temp_path(void) {
+    static char path[64];
+    strcpy(path, "/tmp/trace_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd >= 0) close(fd);
+    return path;
+}
+
+/* Read a whole trace file back; NULL if it is not a trace */
+static TraceRecord* read_trace(const char* path, size_t* count) {
+    TraceReader* reader = trace_reader_open(path);
+    if (!reader) return NULL;
+    uint64_t n = trace_reader_count(reader);
+    TraceRecord* recs = malloc((n ? n : 1) * sizeof(TraceRecord));
+    *count = 0;
+    while (*count < n && trace_reader_next(reader, &recs[*count])) (*count)++;
+    trace_reader_close(reader);
+    return recs;
+}
+
+static long file_size(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+/* Trace n instructions of the churn program into path */
+static void record_churn(const char* path, uint64_t n) {
+    CPU* cpu = churn_cpu();
+    Tracer* t = tracer_open(path, 0);
+    cpu_set_tracer(cpu, t);
+    cpu_run_instructions(cpu, n);
+    tracer_close(t);
+    cpu_destroy(cpu);
+}
+
+static int same_record(const TraceRecord* a, const TraceRecord* b) {
+    return a->cycle == b->cycle && a->pc == b->pc && a->operand == b->operand
+        && a->ea == b->ea && a->opcode == b->opcode && a->kind == b->kind
+        && a->a == b->a && a->x == b->x && a->y == b->y && a->sp == b->sp
+        && a->p == b->p && a->data == b->data && a->flags == b->flags;
+}
+
+TEST(test_trace_matches_reference) {
+    CPU* cpu = churn_cpu();
+    CPU* ref = churn_cpu();
+    char* path = temp_path();
+    Tracer* t = tracer_open(path, 0);
+    CHECK(t != NULL, "tracer opens");
+    cpu_set_tracer(cpu, t);
+
+    cpu_run(cpu, 20000);
+    uint64_t steps = tracer_records(t);
+    CHECK(tracer_close(t), "tracer closes cleanly");
+    cpu_set_tracer(cpu, NULL);
+
+    size_t count = 0;
+    TraceRecord* recs = read_trace(path, &count);
+    CHECK(recs != NULL, "header valid");
+    CHECK_EQ(count, steps);
+
+    int mismatches = 0;
+    Bus* bus = cpu_get_bus(ref);
+    for (size_t i = 0; recs && i < count; i++) {
+        const TraceRecord* r = &recs[i];
+        if (r->kind != TRACE_INSN || r->pc != cpu_get_pc(ref)
+            || r->opcode != bus_read(bus, r->pc)
+            || r->a != cpu_get_a(ref) || r->x != cpu_get_x(ref) || r->y != cpu_get_y(ref)
+            || r->sp != cpu_get_sp(ref) || r->p != cpu_get_status(ref)
+            || r->cycle != cpu_get_total_cycles(ref))
+            mismatches++;
+        cpu_step(ref);
+    }
+    CHECK_EQ(mismatches, 0);
+    CHECK(cpu_get_total_cycles(ref) == cpu_get_total_cycles(cpu), "same end point");
+    CHECK_EQ(cpu_get_pc(ref), cpu_get_pc(cpu));
+
+    /* Spot-check decoding: LDA $0300,X and the loop branch */
+    CHECK(recs && recs[1].opcode == 0xBD && recs[1].operand == 0x0300
+          && recs[1].ea == 0x0300, "absolute,X operand and address");
+    CHECK(recs && recs[6].opcode == 0xD0 && recs[6].ea == 0x0202, "branch target");
+
+    /* Data accesses: the loaded byte and the stored accumulator */
+    CHECK(recs && (recs[1].flags & TRACE_F_DATA) && recs[1].data == 0x00, "load data");
+    CHECK(recs && (recs[3].flags & TRACE_F_DATA) && recs[3].ea == 0x0010
+          && recs[3].data == recs[4].a, "store data");
+    CHECK(recs && !(recs[0].flags & TRACE_F_DATA), "immediate has no access");
+
+    free(recs);
+    unlink(path);
+    cpu_destroy(cpu);
+    cpu_destroy(ref);
+}
+
+/* A tiny ring stalls the producer, but no record is lost or reordered */
+TEST(test_trace_small_ring_lossless) {
+    CPU* cpu = churn_cpu();
+    char* path = temp_path();
+    Tracer* t = tracer_open(path, 4);
+    cpu_set_tracer(cpu, t);
+    cpu_run_instructions(cpu, 50000);
+    CHECK_EQ(tracer_records(t), 50000);
+    CHECK(tracer_stalls(t) > 0, "producer waited for the writer");
+    CHECK(tracer_close(t));
+
+    size_t count = 0;
+    TraceRecord* recs = read_trace(path, &count);
+    CHECK_EQ(count, 50000);
+    int out_of_order = 0;
+    for (size_t i = 1; recs && i < count; i++)
+        if (recs[i].cycle <= recs[i - 1].cycle) out_of_order++;
+    CHECK_EQ(out_of_order, 0);
+
+    free(recs);
+    unlink(path);
+    cpu_destroy(cpu);
+}
+
+TEST(test_trace_interrupt_entry) {
+    CPU* cpu = churn_cpu();
+    Bus* bus = cpu_get_bus(cpu);
+    bus_write(bus, 0xFFFE, 0x00);
+    bus_write(bus, 0xFFFF, 0x05);
+    bus_write(bus, 0x0500, 0x40);   // RTI
+    cpu_set_status(cpu, cpu_get_status(cpu) & ~FLAG_I);
+
+    char* path = temp_path();
+    Tracer* t = tracer_open(path, 0);
+    cpu_set_tracer(cpu, t);
+    cpu_step(cpu);
+    cpu_irq(cpu);
+    cpu_step(cpu);
+    cpu_irq_release(cpu);
+    cpu_step(cpu);
+    tracer_close(t);
+
+    size_t count = 0;
+    TraceRecord* recs = read_trace(path, &count);
+    CHECK_EQ(count, 3);
+    CHECK(recs && recs[1].kind == TRACE_IRQ, "IRQ entry recorded");
+    CHECK(recs && recs[1].pc == 0x0202 && recs[1].ea == 0x0500, "from and to");
+    CHECK(recs && recs[2].kind == TRACE_INSN && recs[2].opcode == 0x40, "handler runs next");
+
+    free(recs);
+    unlink(path);
+    cpu_destroy(cpu);
+}
+
+/* Detaching the tracer goes back to the normal engine mid-run */
+TEST(test_trace_detach_matches_untraced) {
+    CPU* a = churn_cpu();
+    CPU* b = churn_cpu();
+    char* path = temp_path();
+    Tracer* t = tracer_open(path, 0);
+
+    cpu_set_tracer(a, t);
+    cpu_run(a, 3000);
+    cpu_set_tracer(a, NULL);
+    cpu_run(a, 3000);
+    cpu_run(b, cpu_get_total_cycles(a));
+
+    /* b may stop a few cycles later; step a to the same point */
+    while (cpu_get_total_cycles(a) < cpu_get_total_cycles(b)) cpu_step(a);
+    CHECK(cpu_get_total_cycles(a) == cpu_get_total_cycles(b), "same cycle");
+    CHECK_EQ(cpu_get_pc(a), cpu_get_pc(b));
+    CHECK_EQ(cpu_get_a(a), cpu_get_a(b));
+    CHECK_EQ(cpu_get_status(a), cpu_get_status(b));
+
+    CHECK(tracer_close(t));
+    CHECK(tracer_open("/nonexistent/trace", 0) == NULL, "bad path");
+    unlink(path);
+    cpu_destroy(a);
+    cpu_destroy(b);
+}
+
+/* Seeking by record or cycle lands where a sequential read does */
+TEST(test_trace_seek) {
+    char* path = temp_path();
+    record_churn(path, 3 * TRACE_KEYFRAME + 123);
+
+    size_t count = 0;
+    TraceRecord* all = read_trace(path, &count);
+    CHECK_EQ(count, 3 * TRACE_KEYFRAME + 123);
+
+    TraceReader* reader = trace_reader_open(path);
+    CHECK(trace_reader_indexed(reader), "index read from the footer");
+    static const uint64_t targets[] = { 0, 1, TRACE_KEYFRAME - 1, TRACE_KEYFRAME,
+                                        2 * TRACE_KEYFRAME + 77, 3 * TRACE_KEYFRAME + 122 };
+    int bad = 0;
+    for (size_t i = 0; all && i < sizeof(targets) / sizeof(targets[0]); i++) {
+        TraceRecord rec;
+        uint64_t n = targets[i];
+        if (!trace_reader_seek(reader, n) || trace_reader_tell(reader) != n
+            || !trace_reader_next(reader, &rec) || !same_record(&rec, &all[n]))
+            bad++;
+
+        /* A cycle in the middle of record n's step finds record n + 1 */
+        if (n + 1 < count) {
+            if (!trace_reader_seek_cycle(reader, all[n].cycle + 1)
+                || trace_reader_tell(reader) != n + 1
+                || !trace_reader_next(reader, &rec) || !same_record(&rec, &all[n + 1]))
+                bad++;
+        }
+    }
+    CHECK_EQ(bad, 0);
+    CHECK(!trace_reader_seek(reader, count), "past the end");
+    CHECK(!trace_reader_seek_cycle(reader, all[count - 1].cycle + 1), "after the last cycle");
+
+    trace_reader_close(reader);
+    free(all);
+    unlink(path);
+}
+
+/* Deltas keep the file well under the raw record size */
+TEST(test_trace_compressed) {
+    char* path = temp_path();
+    record_churn(path, 100000);
+    long size = file_size(path);
+    CHECK(size > 0 && size < 100000L * (long)sizeof(TraceRecord) / 3, "at most a third of raw");
+    unlink(path);
+}
+
+/* A trace cut short (no index) is still readable up to its last full block */
+TEST(test_trace_unindexed) {
+    char* path = temp_path();
+    record_churn(path, 2 * TRACE_KEYFRAME + 5);
+    size_t count = 0;
+    TraceRecord* all = read_trace(path, &count);
+
+    /* Drop the footer, the index and part of the last block */
+    long size = file_size(path);
+    CHECK(truncate(path, size - 32 - 3 * 24 - 10) == 0);
+
+    TraceReader* reader = trace_reader_open(path);
+    CHECK(reader && !trace_reader_indexed(reader), "index rebuilt");
+    CHECK(reader && trace_reader_count(reader) == 2 * TRACE_KEYFRAME, "complete blocks kept");
+    TraceRecord rec;
+    CHECK(reader && trace_reader_seek(reader, TRACE_KEYFRAME + 9)
+          && trace_reader_next(reader, &rec) && same_record(&rec, &all[TRACE_KEYFRAME + 9]),
+          "seek in the rebuilt index");
+    trace_reader_close(reader);
+
+    CHECK(trace_reader_open("/nonexistent/trace") == NULL, "missing file");
+    free(all);
+    unlink(path);
+}
+
+TEST(test_trace_format) {
+    TraceRecord rec = { .cycle = 7, .pc = 0x0202, .operand = 0x0300, .ea = 0x0305,
+                        .opcode = 0xBD, .kind = TRACE_INSN, .a = 0x11, .x = 0x05,
+                        .sp = 0xFD, .p = 0x24, .data = 0x5A, .flags = TRACE_F_DATA };
+    char line[160];
+    trace_format(&rec, 42, line, sizeof(line));
+    CHECK(strstr(line, "0202  BD 00 03") != NULL, "pc and bytes");
+    CHECK(strstr(line, "LDA $0300,X") != NULL, "disassembly");
+    CHECK(strstr(line, "@0305=5A") != NULL, "data access");
+    CHECK(strstr(line, "A:11 X:05") != NULL && strstr(line, "CYC:7") != NULL, "registers");
+
+    rec.kind = TRACE_NMI;
+    rec.ea = 0x0500;
+    trace_format(&rec, 43, line, sizeof(line));
+    CHECK(strstr(line, "NMI -> $0500") != NULL, "interrupt entry");
+}
+
+/* ============================== Test Runner ================================ */
+
+int main(void) {
+    reset_test_state();
+    printf("\n=== Trace Tests ===\n\n");
+
+    RUN_TEST(test_trace_matches_reference);
+    RUN_TEST(test_trace_small_ring_lossless);
+    RUN_TEST(test_trace_interrupt_entry);
+    RUN_TEST(test_trace_detach_matches_untraced);
+    RUN_TEST(test_trace_seek);
+    RUN_TEST(test_trace_compressed);
+    RUN_TEST(test_trace_unindexed);
+    RUN_TEST(test_trace_format);
+
+    print_test_summary();
+    return failed_test_count > 0 ? 1 : 0;
+}
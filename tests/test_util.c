@@ -18,7 +18,58 @@ TEST(test_encode_op) {
     assert(res == 0xEA);
 }
 
+/* Every legal (opcode, mode) pair must decode back through the table */
+TEST(test_opcode_info_roundtrip) {
+    for (int op = LDA; op <= NOP; op++) {
+        for (int am = IMM; am <= REL; am++) {
+            uint8_t b = encode_op(op, am);
+            if (b == 0x00 && !(op == BRK && am == IMPL)) continue;
+
+            assert(opcode_info[b].op == (opcode_t)op);
+            assert(opcode_info[b].mode == (addr_mode_t)am);
+            assert(opcode_info[b].type == cat_opcode(op));
+            assert(fetch_opcode(b) == (opcode_t)op);
+            assert(fetch_addr_mode(b) == (addr_mode_t)am);
+        }
+    }
+}
+
+TEST(test_opcode_info_lengths) {
+    assert(opcode_info[0xEA].length == 1);  /* NOP */
+    assert(opcode_info[0xA9].length == 2);  /* LDA #imm */
+    assert(opcode_info[0xB1].length == 2);  /* LDA (zp),Y */
+    assert(opcode_info[0x4C].length == 3);  /* JMP abs */
+    assert(opcode_info[0x9D].flags & OPF_STORE);
+    assert(opcode_info[0xFE].flags & OPF_RMW);
+    assert(!(opcode_info[0x0A].flags & OPF_RMW));  /* ASL A */
+}
+
+TEST(test_byte_to_bits) {
+    char buf[10];
+    assert(strcmp(byte_to_bits(0xA5), "1010 0101") == 0);
+    assert(strcmp(byte_to_bits_r(0x0F, buf), "0000 1111") == 0);
+    assert(byte_to_bits_r(0x00, buf) == buf);
+}
+
+/* Same state, same sequence; a zero state is usable */
+TEST(test_random_byte_r_deterministic) {
+    uint64_t s1 = 0, s2 = 0;
+    int differs = 0;
+    uint8_t first = random_byte_r(&s1);
+    assert(first == random_byte_r(&s2));
+    for (int i = 0; i < 64; i++) {
+        uint8_t b = random_byte_r(&s1);
+        assert(b == random_byte_r(&s2));
+        if (b != first) differs = 1;
+    }
+    assert(differs);
+}
+
 int main(void) {
     RUN_TEST(test_encode_op);
+    RUN_TEST(test_opcode_info_roundtrip);
+    RUN_TEST(test_opcode_info_lengths);
+    RUN_TEST(test_byte_to_bits);
+    RUN_TEST(test_random_byte_r_deterministic);
     return 0;
 }